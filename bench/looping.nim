@@ -0,0 +1,27 @@
+#
+# Tight loops in the style of test/looping_test.nim.
+#
+# Build with -DNIM_VM_STATS to have each VM report the number of
+# instructions it dispatched on exit.
+#
+
+use io
+
+main argv {
+  var i = 0
+  var sum = 0
+  while i < 2000000 {
+    sum = sum + i
+    i = i + 1
+  }
+  io.print(sum)
+
+  var j = 0
+  while true {
+    j = j + 1
+    if j == 1000000 {
+      break
+    }
+  }
+  io.print(j)
+}
@@ -0,0 +1,32 @@
+use io
+
+#
+# producer-consumer.nim without the tasks: each stage is a generator,
+# so items flow through the pipeline one at a time in a single task.
+#
+
+producer tests {
+  for test in tests {
+    io.print(str("[producer] yield ", test))
+    yield ["test", test]
+  }
+}
+
+only_odd msgs {
+  for msg in msgs {
+    match msg {
+      ["test", test] {
+        if test / 2 * 2 != test {
+          yield test
+        }
+      }
+    }
+  }
+}
+
+main argv {
+  for test in only_odd(producer(range(1, 6))) {
+    io.print(str("test ", test, " on the consumer"))
+  }
+  io.print("consumer is done")
+}
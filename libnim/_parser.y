@@ -11,6 +11,10 @@ void yyerror(const NimAstNodeLocation *loc, void *scanner, NimRef *filename, Nim
 #define YYDEBUG 1
 #endif
 
+/* the GC can collect mid-parse: keep the value stack on the C stack, */
+/* where it'll see the refs in it, even once the stack has to grow */
+#define YYSTACK_USE_ALLOCA 1
+
 %}
 
 %union {
@@ -78,6 +82,9 @@ extern int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, void *scanner, NimRef *filename
 %token TOK_NOT "`not`"
 %token TOK_MATCH "`match`"
 %token TOK_BREAK "`break`"
+%token TOK_FOR "`for`"
+%token TOK_IN "`in`"
+%token TOK_YIELD "`yield`"
 %token TOK_NEWLINE "newline"
 %token TOK_UNDERSCORE "`_`"
 
@@ -118,15 +125,15 @@ extern int yylex(YYSTYPE *lvalp, YYLTYPE *llocp, void *scanner, NimRef *filename
 %type <ref> func_decl class_decl func_ident
 %type <ref> opt_extends type_name opt_class_decls
 %type <ref> opt_params opt_params_tail param
-%type <ref> opt_args args opt_args_tail
+%type <ref> opt_args args
 %type <ref> opt_patterns pattern pattern_test opt_pattern_array_elements
 %type <ref> pattern_array_elements opt_pattern_array_elements_tail
-%type <ref> opt_array_elements array_elements opt_array_elements_tail
-%type <ref> hash_elements opt_hash_elements_tail
+%type <ref> opt_array_elements array_elements
+%type <ref> hash_elements
 %type <ref> opt_pattern_hash_elements pattern_hash_elements
 %type <ref> opt_pattern_hash_elements_tail
 %type <ref> ident str array hash bool nil int float
-%type <ref> ret break
+%type <ref> ret break yield
 
 %%
 
@@ -186,10 +193,13 @@ opt_params_tail : TOK_COMMA param opt_params_tail { $$ = $3; nim_array_unshift (
 param : ident { $$ = nim_ast_decl_new_var (NIM_AST_EXPR($1)->ident.id, NULL, &@$); }
       ;
 
-stmts: stmt opt_stmts { $$ = $2; nim_array_unshift ($$, $1); }
+/* XXX left recursive so long bodies don't grow the parser stack: */
+/*     bison moves a deep stack to the heap where the GC can't see it. */
+stmts: stmt { $$ = nim_array_new (); nim_array_push ($$, $1); }
+     | stmts stmt { $$ = $1; nim_array_push ($$, $2); }
      ;
 
-opt_stmts : stmt opt_stmts { $$ = $2; nim_array_unshift ($$, $1); }
+opt_stmts : stmts { $$ = $1; }
           | /* empty */ { $$ = nim_array_new (); }
           ;
 
@@ -206,11 +216,16 @@ simple_stmt : expr { $$ = nim_ast_stmt_new_expr ($1, &@$); }
             | assign { $$ = $1; }
             | ret { $$ = $1; }
             | break { $$ = $1; }
+            | yield { $$ = $1; }
             ;
 
 compound_stmt : TOK_IF expr block else { $$ = nim_ast_stmt_new_if_ ($2, $3, $4, &@$); }
               | TOK_IF expr block { $$ = nim_ast_stmt_new_if_ ($2, $3, NULL, &@$); }
               | TOK_WHILE expr block { $$ = nim_ast_stmt_new_while_ ($2, $3, &@$); }
+              | TOK_FOR ident TOK_IN expr block {
+                    $$ = nim_ast_stmt_new_for_ (
+                        NIM_AST_EXPR($2)->ident.id, $4, $5, &@$);
+              }
               | TOK_MATCH expr TOK_LBRACE TOK_NEWLINE opt_patterns TOK_RBRACE {
                     $$ = nim_ast_stmt_new_match ($2, $5, &@$);
               }
@@ -358,13 +373,10 @@ opt_args : args        { $$ = $1; }
          | /* empty */ { $$ = nim_array_new (); }
          ;
 
-args : expr opt_args_tail { $$ = $2; nim_array_unshift ($$, $1); }
+args : expr { $$ = nim_array_new (); nim_array_push ($$, $1); }
+     | args TOK_COMMA expr { $$ = $1; nim_array_push ($$, $3); }
      ;
 
-opt_args_tail : TOK_COMMA expr opt_args_tail { $$ = $3; nim_array_unshift ($$, $2); }
-              | /* empty */ { $$ = nim_array_new (); }
-              ;
-
 func_ident : TOK_IDENT { $$ = nim_ast_expr_new_ident ($1, &@$); }
            ;
 
@@ -392,13 +404,11 @@ hash : TOK_LBRACE hash_elements TOK_RBRACE { $$ = nim_ast_expr_new_hash ($2, &@$
      | TOK_LBRACE TOK_RBRACE { $$ = nim_ast_expr_new_hash (nim_array_new (), &@$); }
      ;
 
-hash_elements : expr TOK_COLON expr opt_hash_elements_tail { $$ = $4; nim_array_unshift ($$, $3); nim_array_unshift ($$, $1); }
+/* XXX left recursive for the same reason as stmts above */
+hash_elements : expr TOK_COLON expr { $$ = nim_array_new (); nim_array_push ($$, $1); nim_array_push ($$, $3); }
+              | hash_elements TOK_COMMA expr TOK_COLON expr { $$ = $1; nim_array_push ($$, $3); nim_array_push ($$, $5); }
               ;
 
-opt_hash_elements_tail : TOK_COMMA expr TOK_COLON expr opt_hash_elements_tail { $$ = $5; nim_array_unshift ($$, $4); nim_array_unshift ($$, $2); }
-                       | /* empty */ { $$ = nim_array_new (); }
-                       ;
-
 array : TOK_LSQBRACKET opt_array_elements TOK_RSQBRACKET { $$ = nim_ast_expr_new_array ($2, &@$); }
       | TOK_LSQBRACKET TOK_NEWLINE opt_array_elements TOK_NEWLINE TOK_RSQBRACKET { $$ = nim_ast_expr_new_array ($3, &@$); }
       ;
@@ -407,13 +417,10 @@ opt_array_elements : array_elements { $$ = $1; }
                    | /* empty */ { $$ = nim_array_new (); }
                    ;
 
-array_elements : expr opt_array_elements_tail { $$ = $2; nim_array_unshift ($$, $1); }
+array_elements : expr { $$ = nim_array_new (); nim_array_push ($$, $1); }
+               | array_elements TOK_COMMA expr { $$ = $1; nim_array_push ($$, $3); }
                ;
 
-opt_array_elements_tail : TOK_COMMA expr opt_array_elements_tail { $$ = $3; nim_array_unshift ($$, $2); }
-                        | /* empty */ { $$ = nim_array_new (); }
-                        ;
-
 opt_expr : expr { $$ = $1; }
          | /* empty */ { $$ = NULL; }
          ;
@@ -424,6 +431,9 @@ break : TOK_BREAK { $$ = nim_ast_stmt_new_break_ (&@$); }
 ret : TOK_RET opt_expr { $$ = nim_ast_stmt_new_ret ($2, &@$); }
     ;
 
+yield : TOK_YIELD expr { $$ = nim_ast_stmt_new_yield ($2, &@$); }
+      ;
+
 %%
 
 void
@@ -21,6 +21,7 @@
 #include "nim/core.h"
 #include "nim/class.h"
 #include "nim/str.h"
+#include "nim/range.h"
 
 NimRef *nim_array_class = NULL;
 
@@ -46,12 +47,10 @@ _nim_array_real_index (NimRef *self, int32_t pos)
 }
 
 static NimRef *
-_nim_array_push (NimRef *self, NimRef *args)
+_nim_array_push (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     NimRef *arg;
-    if (!nim_method_parse_args (args, "o", &arg)) {
-        return NULL;
-    }
+    arg = args[0].o;
     /* TODO error if args len == 0 */
     if (!nim_array_push (self, arg)) {
         /* XXX error? exception? abort? */
@@ -61,23 +60,18 @@ _nim_array_push (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_array_pop (NimRef *self, NimRef *args)
+_nim_array_pop (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    if (!nim_method_no_args (args)) {
-        return NULL;
-    }
     return nim_array_pop (self);
 }
 
 static NimRef *
-_nim_array_map (NimRef *self, NimRef *args)
+_nim_array_map (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     size_t i;
     NimRef *fn;
     NimRef *result = nim_array_new_with_capacity (NIM_ARRAY_SIZE(self));
-    if (!nim_method_parse_args (args, "o", &fn)) {
-        return NULL;
-    }
+    fn = args[0].o;
     for (i = 0; i < NIM_ARRAY_SIZE(self); i++) {
         NimRef *fn_args;
         NimRef *mapped;
@@ -99,13 +93,11 @@ _nim_array_map (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_array_each (NimRef *self, NimRef *args)
+_nim_array_each (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     size_t i;
     NimRef *fn;
-    if (!nim_method_parse_args (args, "o", &fn)) {
-        return NULL;
-    }
+    fn = args[0].o;
     for (i = 0; i < NIM_ARRAY_SIZE(self); i++) {
         NimRef *fn_args;
         NimRef *value;
@@ -123,13 +115,11 @@ _nim_array_each (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_array_contains (NimRef *self, NimRef *args)
+_nim_array_contains (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     size_t i;
     NimRef *right;
-    if (!nim_method_parse_args (args, "o", &right)) {
-        return NULL;
-    }
+    right = args[0].o;
     for (i = 0; i < NIM_ARRAY_SIZE(self); i++) {
         NimCmpResult r;
         NimRef *left = NIM_ARRAY_ITEM(self, i);
@@ -146,7 +136,7 @@ _nim_array_contains (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_array_any (NimRef *self, NimRef *args)
+_nim_array_any (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
 
     NimRef *fn;
@@ -155,9 +145,7 @@ _nim_array_any (NimRef *self, NimRef *args)
     NimRef *fn_args;
     NimRef *result;
 
-    if (!nim_method_parse_args (args, "o", &fn)) {
-        return NULL;
-    }
+    fn = args[0].o;
 
     for (i = 0; i < NIM_ARRAY_SIZE(self); i++) {
         item = NIM_ARRAY_ITEM(self, i);
@@ -181,15 +169,13 @@ _nim_array_any (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_array_filter (NimRef *self, NimRef *args)
+_nim_array_filter (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     size_t i;
     NimRef *result;
     NimRef *fn;
 
-    if (!nim_method_parse_args (args, "o", &fn)) {
-        return NULL;
-    }
+    fn = args[0].o;
 
     result = nim_array_new ();
     for (i = 0; i < NIM_ARRAY_SIZE(self); i++) {
@@ -277,14 +263,13 @@ nim_array_str (NimRef *self)
 }
 
 static NimRef *
-_nim_array_insert (NimRef *self, NimRef *args)
+_nim_array_insert (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     int32_t pos;
     NimRef *value;
 
-    if (!nim_method_parse_args (args, "io", &pos, &value)) {
-        return NULL;
-    }
+    pos = args[0].i;
+    value = args[1].o;
 
     if (!nim_array_insert (self, pos, value)) {
         return NULL;
@@ -293,17 +278,13 @@ _nim_array_insert (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_array_size (NimRef *self, NimRef *args)
+_nim_array_size (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    if (!nim_method_no_args (args)) {
-        return NULL;
-    }
-
     return nim_int_new (NIM_ARRAY_SIZE(self));
 }
 
 static NimRef *
-_nim_array_join (NimRef *self, NimRef *args)
+_nim_array_join (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     size_t i;
     size_t len;
@@ -313,9 +294,7 @@ _nim_array_join (NimRef *self, NimRef *args)
     char *result;
     char *ptr;
 
-    if (!nim_method_parse_args (args, "s", &sep)) {
-        return NULL;
-    }
+    sep = args[0].s;
     seplen = strlen (sep);
 
     strs = nim_array_new_with_capacity (NIM_ARRAY_SIZE(self));
@@ -386,8 +365,26 @@ _nim_array_mark (NimGC *gc, NimRef *self)
 static NimCmpResult
 _nim_array_cmp(NimRef *left, NimRef *right)
 {
-    size_t lsize = NIM_ARRAY_SIZE(left);
-    size_t rsize = NIM_ARRAY_SIZE(right);
+    size_t lsize;
+    size_t rsize;
+
+    if (NIM_ANY_CLASS(right) == nim_range_class) {
+        /* ranges know how to compare themselves to arrays */
+        NimCmpResult r = nim_object_cmp (right, left);
+        if (r == NIM_CMP_LT) {
+            return NIM_CMP_GT;
+        }
+        else if (r == NIM_CMP_GT) {
+            return NIM_CMP_LT;
+        }
+        return r;
+    }
+    else if (NIM_ANY_CLASS(right) != nim_array_class) {
+        return NIM_CMP_NOT_IMPL;
+    }
+
+    lsize = NIM_ARRAY_SIZE(left);
+    rsize = NIM_ARRAY_SIZE(right);
 
     if (lsize != rsize)
     {
@@ -413,6 +410,12 @@ _nim_array_cmp(NimRef *left, NimRef *right)
 static NimRef *
 _nim_array_add (NimRef *self, NimRef *other)
 {
+    if (NIM_ANY_CLASS(other) == nim_range_class) {
+        other = nim_range_to_array (other);
+        if (other == NULL) {
+            return NULL;
+        }
+    }
     if (NIM_ANY_CLASS(self) == NIM_ANY_CLASS(other)) {
         size_t i;
         size_t required_capacity =
@@ -453,13 +456,11 @@ _nim_array_remove_at_internal (NimRef *self, size_t index)
 }
 
 static NimRef *
-_nim_array_remove (NimRef *self, NimRef *args)
+_nim_array_remove (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     NimRef *other;
     size_t i;
-    if (!nim_method_parse_args (args, "o", &other)) {
-        return NULL;
-    }
+    other = args[0].o;
     for (i = 0; i < NIM_ARRAY_SIZE(self); i++) {
         int rc = nim_object_cmp (NIM_ARRAY_ITEM(self, i), other);
         if (rc == NIM_CMP_EQ) {
@@ -474,13 +475,11 @@ _nim_array_remove (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_array_remove_at (NimRef *self, NimRef *args)
+_nim_array_remove_at (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     NimRef *removed;
     int64_t pos;
-    if (!nim_method_parse_args (args, "I", &pos)) {
-        return NULL;
-    }
+    pos = args[0].I;
     if (pos < 0) {
         pos = NIM_ARRAY_SIZE(self) + pos;
     }
@@ -495,14 +494,12 @@ _nim_array_remove_at (NimRef *self, NimRef *args)
 
 
 static NimRef *
-_nim_array_slice(NimRef *self, NimRef *args)
+_nim_array_slice(NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     int64_t start;
     int64_t end;
-    if (!nim_method_parse_args (args, "II", &start, &end)) {
-        NIM_BUG("invalid parameters, expecting two numeric values");
-        return NULL;
-    }
+    start = args[0].I;
+    end = args[1].I;
     // XXX - Better parameter validation?
     // XXX - Negative positioning for slicing
 
@@ -516,22 +513,16 @@ _nim_array_slice(NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_array_shift (NimRef *self, NimRef *args)
+_nim_array_shift (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    if (!nim_method_no_args (args)) {
-        return NULL;
-    }
-
     return nim_array_shift (self);
 }
 static NimRef *
-_nim_array_unshift (NimRef *self, NimRef *args)
+_nim_array_unshift (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     NimRef *arg;
 
-    if (!nim_method_parse_args (args, "o", &arg)) {
-        return NULL;
-    }
+    arg = args[0].o;
 
     if (!nim_array_unshift (self, arg)) {
         return NULL;
@@ -546,6 +537,18 @@ _nim_array_nonzero (NimRef *self)
     return NIM_BOOL_REF(NIM_ARRAY_SIZE(self) > 0);
 }
 
+static nim_bool_t
+_nim_array_iter_next (NimRef *self, size_t *pos, NimRef **value)
+{
+    if (*pos < NIM_ARRAY_SIZE(self)) {
+        *value = NIM_ARRAY_ITEM(self, (*pos)++);
+    }
+    else {
+        *value = NULL;
+    }
+    return NIM_TRUE;
+}
+
 nim_bool_t
 nim_array_class_bootstrap (void)
 {
@@ -561,22 +564,38 @@ nim_array_class_bootstrap (void)
     NIM_CLASS(nim_array_class)->cmp = _nim_array_cmp;
     NIM_CLASS(nim_array_class)->add = _nim_array_add;
     NIM_CLASS(nim_array_class)->nonzero = _nim_array_nonzero;
+    NIM_CLASS(nim_array_class)->iter_next = _nim_array_iter_next;
     nim_gc_make_root (NULL, nim_array_class);
-    nim_class_add_native_method (nim_array_class, "push", _nim_array_push);
-    nim_class_add_native_method (nim_array_class, "pop", _nim_array_pop);
-    nim_class_add_native_method (nim_array_class, "map", _nim_array_map);
-    nim_class_add_native_method (nim_array_class, "shift", _nim_array_shift);
-    nim_class_add_native_method (nim_array_class, "unshift", _nim_array_unshift);
-    nim_class_add_native_method (nim_array_class, "filter", _nim_array_filter);
-    nim_class_add_native_method (nim_array_class, "each", _nim_array_each);
-    nim_class_add_native_method (nim_array_class, "contains", _nim_array_contains);
-    nim_class_add_native_method (nim_array_class, "any", _nim_array_any);
-    nim_class_add_native_method (nim_array_class, "size", _nim_array_size);
-    nim_class_add_native_method (nim_array_class, "join", _nim_array_join);
-    nim_class_add_native_method (nim_array_class, "remove", _nim_array_remove);
-    nim_class_add_native_method (nim_array_class, "remove_at", _nim_array_remove_at);
-    nim_class_add_native_method (nim_array_class, "slice", _nim_array_slice);
-    nim_class_add_native_method (nim_array_class, "insert", _nim_array_insert);
+    nim_class_add_native_method_typed (
+        nim_array_class, "push", "o", _nim_array_push);
+    nim_class_add_native_method_typed (
+        nim_array_class, "pop", "", _nim_array_pop);
+    nim_class_add_native_method_typed (
+        nim_array_class, "map", "o", _nim_array_map);
+    nim_class_add_native_method_typed (
+        nim_array_class, "shift", "", _nim_array_shift);
+    nim_class_add_native_method_typed (
+        nim_array_class, "unshift", "o", _nim_array_unshift);
+    nim_class_add_native_method_typed (
+        nim_array_class, "filter", "o", _nim_array_filter);
+    nim_class_add_native_method_typed (
+        nim_array_class, "each", "o", _nim_array_each);
+    nim_class_add_native_method_typed (
+        nim_array_class, "contains", "o", _nim_array_contains);
+    nim_class_add_native_method_typed (
+        nim_array_class, "any", "o", _nim_array_any);
+    nim_class_add_native_method_typed (
+        nim_array_class, "size", "", _nim_array_size);
+    nim_class_add_native_method_typed (
+        nim_array_class, "join", "s", _nim_array_join);
+    nim_class_add_native_method_typed (
+        nim_array_class, "remove", "o", _nim_array_remove);
+    nim_class_add_native_method_typed (
+        nim_array_class, "remove_at", "I", _nim_array_remove_at);
+    nim_class_add_native_method_typed (
+        nim_array_class, "slice", "II", _nim_array_slice);
+    nim_class_add_native_method_typed (
+        nim_array_class, "insert", "io", _nim_array_insert);
     return NIM_TRUE;
 }
 
@@ -625,15 +644,30 @@ nim_array_new_var (NimRef *a, ...)
     return ref;
 }
 
-#if 0
-static nim_bool_t
+NimRef *
+nim_array_copy (NimRef *self)
+{
+    const size_t size = NIM_ARRAY_SIZE(self);
+    NimRef *copy = nim_array_new_with_capacity (size > 0 ? size : 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy (NIM_ARRAY_ITEMS(copy), NIM_ARRAY_ITEMS(self),
+            size * sizeof(NimRef *));
+    NIM_ARRAY_SIZE(copy) = size;
+    return copy;
+}
+
+nim_bool_t
 nim_array_ensure_capacity (NimRef *self, size_t capacity)
 {
-    if (NIM_ARRAY(self)->capacity < capacity) {
+    NimArray *arr = NIM_ARRAY(self);
+    if (arr->capacity < capacity) {
         NimRef **items;
         items = NIM_REALLOC(
-            NimRef *, arr->items, sizeof(*arr->items) * new_capacity);
+            NimRef *, arr->items, sizeof(*arr->items) * capacity);
         if (items == NULL) {
+            NIM_BUG ("failed to grow internal array buffer");
             return NIM_FALSE;
         }
         arr->items = items;
@@ -641,7 +675,6 @@ nim_array_ensure_capacity (NimRef *self, size_t capacity)
     }
     return NIM_TRUE;
 }
-#endif
 
 static nim_bool_t
 nim_array_grow (NimRef *self)
@@ -649,8 +682,9 @@ nim_array_grow (NimRef *self)
     NimRef **items;
     NimArray *arr = NIM_ARRAY(self);
     if (arr->size >= arr->capacity) {
+        /* 1.8 times a capacity of 1 is still 1 */
         size_t new_capacity =
-            (arr->capacity == 0 ? 10 : (size_t)(arr->capacity * 1.8));
+            (arr->capacity < 10 ? 10 : (size_t)(arr->capacity * 1.8));
         items = NIM_REALLOC(
             NimRef *, arr->items, sizeof(*arr->items) * new_capacity);
         if (items == NULL) {
@@ -762,7 +796,7 @@ nim_array_find (NimRef *self, NimRef *value)
 {
     size_t i;
     for (i = 0; i < NIM_ARRAY_SIZE(self); i++) {
-        NimCmpResult r = nim_object_cmp (NIM_ARRAY_ITEM(self, i), value);
+        NimCmpResult r = nim_object_cmp_eq (NIM_ARRAY_ITEM(self, i), value);
         if (r == NIM_CMP_ERROR) {
             return -1;
         }
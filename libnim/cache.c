@@ -0,0 +1,1117 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "nim/cache.h"
+#include "nim/compile.h"
+#include "nim/optimize.h"
+#include "nim/module_mgr.h"
+#include "nim/module.h"
+#include "nim/method.h"
+#include "nim/class.h"
+#include "nim/code.h"
+#include "nim/array.h"
+#include "nim/hash.h"
+#include "nim/lwhash.h"
+#include "nim/str.h"
+#include "nim/int.h"
+#include "nim/float.h"
+#include "nim/object.h"
+
+/*
+ * a cache file is a header (magic, NIM_CACHE_VERSION, the opcode count,
+ * a hash of the builtin names, the optimization level & a stamp of the
+ * source file), the names of the modules it uses, the module's locals as
+ * tagged values, then an FNV-1a hash of everything before it. integers
+ * are written in native byte order: cache files aren't meant to move
+ * between machines.
+ */
+
+#define NIM_CACHE_MAGIC "NIMC"
+#define NIM_CACHE_MAGIC_SIZE (sizeof(NIM_CACHE_MAGIC)-1)
+
+typedef enum _NimCacheTag {
+    NIM_CACHE_TAG_NIL,
+    NIM_CACHE_TAG_TRUE,
+    NIM_CACHE_TAG_FALSE,
+    NIM_CACHE_TAG_INT,
+    NIM_CACHE_TAG_FLOAT,
+    NIM_CACHE_TAG_STR,
+    NIM_CACHE_TAG_ARRAY,
+    NIM_CACHE_TAG_HASH,
+    NIM_CACHE_TAG_NIL_CLASS,
+    NIM_CACHE_TAG_METHOD,
+    NIM_CACHE_TAG_CLASS,
+    NIM_CACHE_TAG_MODULE,
+    /* class bases: a builtin, or a path through the module's locals */
+    NIM_CACHE_TAG_BUILTIN,
+    NIM_CACHE_TAG_PATH
+} NimCacheTag;
+
+typedef struct _NimCacheStamp {
+    int64_t  mtime;
+    uint64_t size;
+    uint64_t hash;
+} NimCacheStamp;
+
+typedef struct _NimCacheWriter {
+    char   *data;
+    size_t  size;
+    size_t  allocated;
+    NimRef *module;
+} NimCacheWriter;
+
+typedef struct _NimCacheReader {
+    const char *data;
+    size_t      size;
+    size_t      pos;
+    NimRef     *module;
+} NimCacheReader;
+
+static nim_bool_t
+nim_cache_enabled (void)
+{
+    const char *value = getenv ("NIM_CACHE");
+    return value == NULL || strcmp (value, "0") != 0;
+}
+
+#define NIM_CACHE_HASH_INIT 14695981039346656037ULL
+
+static uint64_t
+nim_cache_hash_update (uint64_t hash, const char *data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t
+nim_cache_hash (const char *data, size_t size)
+{
+    return nim_cache_hash_update (NIM_CACHE_HASH_INIT, data, size);
+}
+
+/* LOADBUILTIN bakes a builtin's index into the bytecode, so the cache */
+/* is only good for the builtins it was written with, in the same order */
+static uint64_t
+nim_cache_builtins_hash (void)
+{
+    uint64_t hash = NIM_CACHE_HASH_INIT;
+    size_t i;
+
+    for (i = 0; i < NIM_HASH_SIZE(nim_builtins); i++) {
+        NimRef *name = NIM_HASH(nim_builtins)->keys[i];
+        /* the NUL keeps e.g. "ab", "c" apart from "a", "bc" */
+        hash = nim_cache_hash_update (
+                    hash, NIM_STR_DATA(name), NIM_STR_SIZE(name) + 1);
+    }
+    return hash;
+}
+
+static char *
+nim_cache_read_file (const char *filename, size_t *size)
+{
+    FILE *input;
+    char *data;
+    long len;
+
+    input = fopen (filename, "rb");
+    if (input == NULL) {
+        return NULL;
+    }
+    if (fseek (input, 0, SEEK_END) != 0 || (len = ftell (input)) < 0 ||
+            fseek (input, 0, SEEK_SET) != 0) {
+        fclose (input);
+        return NULL;
+    }
+    /* never zero bytes, so an empty file still gets a buffer */
+    data = NIM_MALLOC(char, len + 1);
+    if (data == NULL) {
+        fclose (input);
+        return NULL;
+    }
+    if (fread (data, 1, len, input) != (size_t) len) {
+        NIM_FREE (data);
+        fclose (input);
+        return NULL;
+    }
+    fclose (input);
+    *size = (size_t) len;
+    return data;
+}
+
+static nim_bool_t
+nim_cache_stamp (const char *filename, NimCacheStamp *stamp)
+{
+    struct stat st;
+    char *data;
+    size_t size;
+
+    if (stat (filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return NIM_FALSE;
+    }
+    data = nim_cache_read_file (filename, &size);
+    if (data == NULL) {
+        return NIM_FALSE;
+    }
+    stamp->mtime = (int64_t) st.st_mtime;
+    stamp->size = (uint64_t) size;
+    stamp->hash = nim_cache_hash (data, size);
+    NIM_FREE (data);
+    return NIM_TRUE;
+}
+
+static NimRef *
+nim_cache_path (NimRef *name, const char *filename)
+{
+    const char *dir = getenv ("NIM_CACHE_DIR");
+    size_t len = strlen (filename);
+
+    if (dir != NULL && *dir != '\0') {
+        /* module names can be paths, so key the file on the source too */
+        NimRef *base = nim_compile_module_name (NIM_STR_DATA(name));
+        if (base == NULL) {
+            return NULL;
+        }
+        return nim_str_new_format ("%s/%s-%016" PRIx64 ".nimc",
+                    dir, NIM_STR_DATA(base),
+                    nim_cache_hash (filename, len));
+    }
+    else if (len > 4 && strcmp (filename + len - 4, ".nim") == 0) {
+        return nim_str_new_format ("%sc", filename);
+    }
+    else {
+        return nim_str_new_format ("%s.nimc", filename);
+    }
+}
+
+/* writing */
+
+static nim_bool_t
+nim_cache_put (NimCacheWriter *w, const void *data, size_t size)
+{
+    if (w->size + size > w->allocated) {
+        size_t allocated = w->allocated > 0 ? w->allocated : 4096;
+        char *buf;
+        while (w->size + size > allocated) {
+            allocated *= 2;
+        }
+        buf = NIM_REALLOC(char, w->data, allocated);
+        if (buf == NULL) {
+            return NIM_FALSE;
+        }
+        w->data = buf;
+        w->allocated = allocated;
+    }
+    memcpy (w->data + w->size, data, size);
+    w->size += size;
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_cache_put_u8 (NimCacheWriter *w, uint8_t value)
+{
+    return nim_cache_put (w, &value, sizeof(value));
+}
+
+static nim_bool_t
+nim_cache_put_u32 (NimCacheWriter *w, uint32_t value)
+{
+    return nim_cache_put (w, &value, sizeof(value));
+}
+
+static nim_bool_t
+nim_cache_put_u64 (NimCacheWriter *w, uint64_t value)
+{
+    return nim_cache_put (w, &value, sizeof(value));
+}
+
+static nim_bool_t
+nim_cache_put_str (NimCacheWriter *w, NimRef *str)
+{
+    if (NIM_ANY_CLASS(str) != nim_str_class) {
+        return NIM_FALSE;
+    }
+    return nim_cache_put_u32 (w, (uint32_t) NIM_STR_SIZE(str)) &&
+            nim_cache_put (w, NIM_STR_DATA(str), NIM_STR_SIZE(str));
+}
+
+static nim_bool_t
+nim_cache_put_value (NimCacheWriter *w, NimRef *value);
+
+static nim_bool_t
+nim_cache_put_code (NimCacheWriter *w, NimRef *code)
+{
+    NimCode *co = NIM_CODE(code);
+    size_t i;
+
+    if (!nim_cache_put_u32 (w, (uint32_t) co->used)) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_put (w, co->bytecode, sizeof(uint32_t) * co->used)) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_put_value (w, co->constants) ||
+            !nim_cache_put_value (w, co->names) ||
+            !nim_cache_put_value (w, co->vars) ||
+            !nim_cache_put_value (w, co->freevars)) {
+        return NIM_FALSE;
+    }
+    for (i = 0; i < NIM_ARRAY_SIZE(co->freevars); i++) {
+        if (!nim_cache_put_u32 (w, (uint32_t) co->freevar_slots[i])) {
+            return NIM_FALSE;
+        }
+    }
+    return nim_cache_put_u32 (w, (uint32_t) co->nargs) &&
+            nim_cache_put_u8 (w, co->generator ? 1 : 0) &&
+            nim_cache_put_u32 (w, (uint32_t) co->attr_caches_used);
+}
+
+static nim_bool_t
+nim_cache_put_base (NimCacheWriter *w, NimRef *base)
+{
+    NimRef *locals = NIM_MODULE_LOCALS(w->module);
+    size_t i;
+    size_t j;
+
+    if (base == nim_object_class) {
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_NIL);
+    }
+
+    for (i = 0; i < NIM_HASH_SIZE(nim_builtins); i++) {
+        if (NIM_HASH(nim_builtins)->values[i] == base) {
+            return nim_cache_put_u8 (w, NIM_CACHE_TAG_BUILTIN) &&
+                    nim_cache_put_str (w, NIM_HASH(nim_builtins)->keys[i]);
+        }
+    }
+
+    /* a class from this module, or from a module it uses */
+    for (i = 0; i < NIM_HASH_SIZE(locals); i++) {
+        NimRef *value = NIM_HASH(locals)->values[i];
+        if (value == base) {
+            return nim_cache_put_u8 (w, NIM_CACHE_TAG_PATH) &&
+                    nim_cache_put_u32 (w, 1) &&
+                    nim_cache_put_str (w, NIM_HASH(locals)->keys[i]);
+        }
+        else if (NIM_ANY_CLASS(value) == nim_module_class) {
+            NimRef *inner = NIM_MODULE_LOCALS(value);
+            for (j = 0; j < NIM_HASH_SIZE(inner); j++) {
+                if (NIM_HASH(inner)->values[j] == base) {
+                    return nim_cache_put_u8 (w, NIM_CACHE_TAG_PATH) &&
+                            nim_cache_put_u32 (w, 2) &&
+                            nim_cache_put_str (w, NIM_HASH(locals)->keys[i]) &&
+                            nim_cache_put_str (w, NIM_HASH(inner)->keys[j]);
+                }
+            }
+        }
+    }
+
+    return NIM_FALSE;
+}
+
+typedef struct _NimCacheMethods {
+    NimRef     *names;
+    NimRef     *methods;
+    nim_bool_t  ok;
+} NimCacheMethods;
+
+static void
+nim_cache_collect_method (
+    NimLWHash *lwhash, NimRef *name, NimRef *method, void *data)
+{
+    NimCacheMethods *collected = (NimCacheMethods *) data;
+
+    if (!nim_array_push (collected->names, name) ||
+            !nim_array_push (collected->methods, method)) {
+        collected->ok = NIM_FALSE;
+    }
+}
+
+static nim_bool_t
+nim_cache_put_class (NimCacheWriter *w, NimRef *klass)
+{
+    NimCacheMethods collected;
+    size_t i;
+
+    collected.names = nim_array_new ();
+    collected.methods = nim_array_new ();
+    collected.ok = collected.names != NULL && collected.methods != NULL;
+    if (!collected.ok) {
+        return NIM_FALSE;
+    }
+    nim_lwhash_foreach (
+        NIM_CLASS(klass)->methods, nim_cache_collect_method, &collected);
+    if (!collected.ok) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_cache_put_u8 (w, NIM_CACHE_TAG_CLASS) ||
+            !nim_cache_put_str (w, NIM_CLASS_NAME(klass)) ||
+            !nim_cache_put_base (w, NIM_CLASS_SUPER(klass)) ||
+            !nim_cache_put_u32 (w, (uint32_t) NIM_ARRAY_SIZE(collected.names))) {
+        return NIM_FALSE;
+    }
+    for (i = 0; i < NIM_ARRAY_SIZE(collected.names); i++) {
+        if (!nim_cache_put_str (w, NIM_ARRAY_ITEM(collected.names, i)) ||
+                !nim_cache_put_value (
+                    w, NIM_ARRAY_ITEM(collected.methods, i))) {
+            return NIM_FALSE;
+        }
+    }
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_cache_put_value (NimCacheWriter *w, NimRef *value)
+{
+    NimRef *klass = NIM_ANY_CLASS(value);
+    size_t i;
+
+    if (value == nim_nil) {
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_NIL);
+    }
+    else if (value == nim_true) {
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_TRUE);
+    }
+    else if (value == nim_false) {
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_FALSE);
+    }
+    else if (value == nim_nil_class) {
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_NIL_CLASS);
+    }
+    else if (klass == nim_int_class) {
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_INT) &&
+                nim_cache_put_u64 (w, (uint64_t) NIM_INT_VALUE(value));
+    }
+    else if (klass == nim_float_class) {
+        double d = NIM_FLOAT_VALUE(value);
+        uint64_t bits;
+        memcpy (&bits, &d, sizeof(bits));
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_FLOAT) &&
+                nim_cache_put_u64 (w, bits);
+    }
+    else if (klass == nim_str_class) {
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_STR) &&
+                nim_cache_put_str (w, value);
+    }
+    else if (klass == nim_array_class) {
+        if (!nim_cache_put_u8 (w, NIM_CACHE_TAG_ARRAY) ||
+                !nim_cache_put_u32 (w, (uint32_t) NIM_ARRAY_SIZE(value))) {
+            return NIM_FALSE;
+        }
+        for (i = 0; i < NIM_ARRAY_SIZE(value); i++) {
+            if (!nim_cache_put_value (w, NIM_ARRAY_ITEM(value, i))) {
+                return NIM_FALSE;
+            }
+        }
+        return NIM_TRUE;
+    }
+    else if (klass == nim_hash_class) {
+        if (!nim_cache_put_u8 (w, NIM_CACHE_TAG_HASH) ||
+                !nim_cache_put_u32 (w, (uint32_t) NIM_HASH_SIZE(value))) {
+            return NIM_FALSE;
+        }
+        for (i = 0; i < NIM_HASH_SIZE(value); i++) {
+            if (!nim_cache_put_value (w, NIM_HASH(value)->keys[i]) ||
+                    !nim_cache_put_value (w, NIM_HASH(value)->values[i])) {
+                return NIM_FALSE;
+            }
+        }
+        return NIM_TRUE;
+    }
+    else if (klass == nim_method_class) {
+        /* only the module's own functions can be rebuilt on load */
+        if (NIM_METHOD_TYPE(value) != NIM_METHOD_TYPE_BYTECODE ||
+                NIM_METHOD_SELF(value) != NULL ||
+                NIM_METHOD(value)->module != w->module) {
+            return NIM_FALSE;
+        }
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_METHOD) &&
+                nim_cache_put_code (w, NIM_BYTECODE_METHOD(value)->code);
+    }
+    else if (klass == nim_class_class) {
+        return nim_cache_put_class (w, value);
+    }
+    else if (klass == nim_module_class) {
+        return nim_cache_put_u8 (w, NIM_CACHE_TAG_MODULE) &&
+                nim_cache_put_str (w, NIM_MODULE_NAME(value));
+    }
+    else {
+        /* e.g. the AST of a module-level var's initializer */
+        return NIM_FALSE;
+    }
+}
+
+static nim_bool_t
+nim_cache_put_header (
+    NimCacheWriter *w, const char *filename, const NimCacheStamp *stamp)
+{
+    NimRef *filename_obj = nim_str_new (filename, strlen (filename));
+    if (filename_obj == NULL) {
+        return NIM_FALSE;
+    }
+    return nim_cache_put (w, NIM_CACHE_MAGIC, NIM_CACHE_MAGIC_SIZE) &&
+            nim_cache_put_u32 (w, NIM_CACHE_VERSION) &&
+            nim_cache_put_u32 (w, NIM_OPCODE_COUNT) &&
+            nim_cache_put_u64 (w, nim_cache_builtins_hash ()) &&
+            nim_cache_put_u32 (w, (uint32_t) nim_opt_level ()) &&
+            nim_cache_put_u64 (w, (uint64_t) stamp->mtime) &&
+            nim_cache_put_u64 (w, stamp->size) &&
+            nim_cache_put_u64 (w, stamp->hash) &&
+            nim_cache_put_str (w, filename_obj);
+}
+
+/* the modules it uses, so a loader can fetch them all up front */
+static nim_bool_t
+nim_cache_put_uses (NimCacheWriter *w)
+{
+    NimRef *locals = NIM_MODULE_LOCALS(w->module);
+    uint32_t n = 0;
+    size_t i;
+
+    for (i = 0; i < NIM_HASH_SIZE(locals); i++) {
+        if (NIM_ANY_CLASS(NIM_HASH(locals)->values[i]) == nim_module_class) {
+            n++;
+        }
+    }
+    if (!nim_cache_put_u32 (w, n)) {
+        return NIM_FALSE;
+    }
+    for (i = 0; i < NIM_HASH_SIZE(locals); i++) {
+        NimRef *value = NIM_HASH(locals)->values[i];
+        if (NIM_ANY_CLASS(value) == nim_module_class &&
+                !nim_cache_put_str (w, NIM_MODULE_NAME(value))) {
+            return NIM_FALSE;
+        }
+    }
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_cache_store_stamped (
+    NimRef *module, const char *filename, const NimCacheStamp *stamp)
+{
+    NimCacheWriter w;
+    NimRef *locals = NIM_MODULE_LOCALS(module);
+    NimRef *path;
+    NimRef *tmp;
+    FILE *output;
+    nim_bool_t ok;
+    size_t i;
+
+    memset (&w, 0, sizeof(w));
+    w.module = module;
+
+    ok = nim_cache_put_header (&w, filename, stamp) &&
+            nim_cache_put_uses (&w) &&
+            nim_cache_put_u32 (&w, (uint32_t) NIM_HASH_SIZE(locals));
+    for (i = 0; ok && i < NIM_HASH_SIZE(locals); i++) {
+        ok = nim_cache_put_str (&w, NIM_HASH(locals)->keys[i]) &&
+                nim_cache_put_value (&w, NIM_HASH(locals)->values[i]);
+    }
+    ok = ok && nim_cache_put_u64 (&w, nim_cache_hash (w.data, w.size));
+    if (!ok) {
+        NIM_FREE (w.data);
+        return NIM_FALSE;
+    }
+
+    path = nim_cache_path (NIM_MODULE_NAME(module), filename);
+    if (path == NULL) {
+        NIM_FREE (w.data);
+        return NIM_FALSE;
+    }
+    tmp = nim_str_new_format ("%s.%ld.tmp", NIM_STR_DATA(path), (long) getpid ());
+    if (tmp == NULL) {
+        NIM_FREE (w.data);
+        return NIM_FALSE;
+    }
+
+    /* write a temp file & rename it so readers never see half a file */
+    output = fopen (NIM_STR_DATA(tmp), "wb");
+    if (output == NULL) {
+        NIM_FREE (w.data);
+        return NIM_FALSE;
+    }
+    ok = fwrite (w.data, 1, w.size, output) == w.size;
+    ok = fclose (output) == 0 && ok;
+    NIM_FREE (w.data);
+    if (!ok || rename (NIM_STR_DATA(tmp), NIM_STR_DATA(path)) != 0) {
+        unlink (NIM_STR_DATA(tmp));
+        return NIM_FALSE;
+    }
+    return NIM_TRUE;
+}
+
+/* reading */
+
+static nim_bool_t
+nim_cache_get (NimCacheReader *r, void *data, size_t size)
+{
+    if (size > r->size - r->pos) {
+        return NIM_FALSE;
+    }
+    memcpy (data, r->data + r->pos, size);
+    r->pos += size;
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_cache_get_u8 (NimCacheReader *r, uint8_t *value)
+{
+    return nim_cache_get (r, value, sizeof(*value));
+}
+
+static nim_bool_t
+nim_cache_get_u32 (NimCacheReader *r, uint32_t *value)
+{
+    return nim_cache_get (r, value, sizeof(*value));
+}
+
+static nim_bool_t
+nim_cache_get_u64 (NimCacheReader *r, uint64_t *value)
+{
+    return nim_cache_get (r, value, sizeof(*value));
+}
+
+static nim_bool_t
+nim_cache_get_str (NimCacheReader *r, NimRef **str)
+{
+    uint32_t size;
+
+    if (!nim_cache_get_u32 (r, &size) || size > r->size - r->pos) {
+        return NIM_FALSE;
+    }
+    *str = nim_str_intern (r->data + r->pos, size);
+    if (*str == NULL) {
+        return NIM_FALSE;
+    }
+    r->pos += size;
+    return NIM_TRUE;
+}
+
+/* every item takes at least a byte, which bounds bogus counts */
+static nim_bool_t
+nim_cache_get_count (NimCacheReader *r, uint32_t *count)
+{
+    return nim_cache_get_u32 (r, count) && *count <= r->size - r->pos;
+}
+
+static nim_bool_t
+nim_cache_get_value (NimCacheReader *r, NimRef **value);
+
+static nim_bool_t
+nim_cache_get_array (NimCacheReader *r, NimRef **array)
+{
+    if (!nim_cache_get_value (r, array)) {
+        return NIM_FALSE;
+    }
+    return NIM_ANY_CLASS(*array) == nim_array_class;
+}
+
+static nim_bool_t
+nim_cache_get_code (NimCacheReader *r, NimRef **code)
+{
+    NimCode *co;
+    uint32_t used;
+    uint32_t value;
+    uint8_t generator;
+    size_t i;
+
+    *code = nim_code_new ();
+    if (*code == NULL) {
+        return NIM_FALSE;
+    }
+    co = NIM_CODE(*code);
+
+    if (!nim_cache_get_u32 (r, &used) ||
+            used > (r->size - r->pos) / sizeof(uint32_t)) {
+        return NIM_FALSE;
+    }
+    if (used > co->allocated) {
+        uint32_t *bytecode = NIM_REALLOC(
+            uint32_t, co->bytecode, sizeof(uint32_t) * used);
+        if (bytecode == NULL) {
+            return NIM_FALSE;
+        }
+        co->bytecode = bytecode;
+        co->allocated = used;
+    }
+    if (!nim_cache_get (r, co->bytecode, sizeof(uint32_t) * used)) {
+        return NIM_FALSE;
+    }
+    co->used = used;
+
+    if (!nim_cache_get_array (r, &co->constants) ||
+            !nim_cache_get_array (r, &co->names) ||
+            !nim_cache_get_array (r, &co->vars) ||
+            !nim_cache_get_array (r, &co->freevars)) {
+        return NIM_FALSE;
+    }
+    if (NIM_ARRAY_SIZE(co->freevars) > 0) {
+        co->freevar_slots = NIM_MALLOC(
+            int32_t, sizeof(int32_t) * NIM_ARRAY_SIZE(co->freevars));
+        if (co->freevar_slots == NULL) {
+            return NIM_FALSE;
+        }
+        for (i = 0; i < NIM_ARRAY_SIZE(co->freevars); i++) {
+            if (!nim_cache_get_u32 (r, &value)) {
+                return NIM_FALSE;
+            }
+            co->freevar_slots[i] = (int32_t) value;
+        }
+    }
+
+    if (!nim_cache_get_u32 (r, &value)) {
+        return NIM_FALSE;
+    }
+    co->nargs = value;
+    if (!nim_cache_get_u8 (r, &generator)) {
+        return NIM_FALSE;
+    }
+    co->generator = generator ? NIM_TRUE : NIM_FALSE;
+    /* every cached site is at least one instruction */
+    if (!nim_cache_get_u32 (r, &value) || value > used) {
+        return NIM_FALSE;
+    }
+    if (value > 0) {
+        co->attr_caches = NIM_MALLOC(
+            NimAttrCache, sizeof(NimAttrCache) * value);
+        if (co->attr_caches == NULL) {
+            return NIM_FALSE;
+        }
+        memset (co->attr_caches, 0, sizeof(NimAttrCache) * value);
+        co->attr_caches_used = value;
+    }
+
+    /* unverified code still runs, just without the fast path */
+    nim_code_verify (*code);
+
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_cache_get_base (NimCacheReader *r, NimRef **base)
+{
+    uint8_t tag;
+    uint32_t n;
+    uint32_t i;
+    NimRef *name;
+
+    if (!nim_cache_get_u8 (r, &tag)) {
+        return NIM_FALSE;
+    }
+    switch (tag) {
+        case NIM_CACHE_TAG_NIL:
+            *base = NULL;
+            return NIM_TRUE;
+        case NIM_CACHE_TAG_BUILTIN:
+            if (!nim_cache_get_str (r, &name)) {
+                return NIM_FALSE;
+            }
+            if (nim_hash_get (nim_builtins, name, base) != 0) {
+                return NIM_FALSE;
+            }
+            break;
+        case NIM_CACHE_TAG_PATH:
+            if (!nim_cache_get_count (r, &n)) {
+                return NIM_FALSE;
+            }
+            *base = r->module;
+            for (i = 0; i < n; i++) {
+                if (NIM_ANY_CLASS(*base) != nim_module_class ||
+                        !nim_cache_get_str (r, &name) ||
+                        nim_hash_get (
+                            NIM_MODULE_LOCALS(*base), name, base) != 0) {
+                    return NIM_FALSE;
+                }
+            }
+            break;
+        default:
+            return NIM_FALSE;
+    }
+    return NIM_ANY_CLASS(*base) == nim_class_class;
+}
+
+static nim_bool_t
+nim_cache_get_class (NimCacheReader *r, NimRef **klass)
+{
+    NimRef *name;
+    NimRef *base;
+    NimRef *method;
+    uint32_t n;
+    uint32_t i;
+
+    if (!nim_cache_get_str (r, &name) || !nim_cache_get_base (r, &base)) {
+        return NIM_FALSE;
+    }
+    *klass = nim_class_new (name, base, sizeof(NimObject));
+    if (*klass == NULL) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_get_count (r, &n)) {
+        return NIM_FALSE;
+    }
+    for (i = 0; i < n; i++) {
+        if (!nim_cache_get_str (r, &name) ||
+                !nim_cache_get_value (r, &method) ||
+                NIM_ANY_CLASS(method) != nim_method_class) {
+            return NIM_FALSE;
+        }
+        if (!nim_class_add_method (*klass, name, method)) {
+            return NIM_FALSE;
+        }
+    }
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_cache_get_value (NimCacheReader *r, NimRef **value)
+{
+    uint8_t tag;
+    uint64_t bits;
+    uint32_t n;
+    uint32_t i;
+    NimRef *code;
+
+    if (!nim_cache_get_u8 (r, &tag)) {
+        return NIM_FALSE;
+    }
+
+    switch (tag) {
+        case NIM_CACHE_TAG_NIL:
+            *value = nim_nil;
+            return NIM_TRUE;
+        case NIM_CACHE_TAG_TRUE:
+            *value = nim_true;
+            return NIM_TRUE;
+        case NIM_CACHE_TAG_FALSE:
+            *value = nim_false;
+            return NIM_TRUE;
+        case NIM_CACHE_TAG_NIL_CLASS:
+            *value = nim_nil_class;
+            return NIM_TRUE;
+        case NIM_CACHE_TAG_INT:
+            if (!nim_cache_get_u64 (r, &bits)) {
+                return NIM_FALSE;
+            }
+            *value = nim_int_new ((int64_t) bits);
+            return *value != NULL;
+        case NIM_CACHE_TAG_FLOAT:
+            {
+                double d;
+                if (!nim_cache_get_u64 (r, &bits)) {
+                    return NIM_FALSE;
+                }
+                memcpy (&d, &bits, sizeof(d));
+                *value = nim_float_new (d);
+                return *value != NULL;
+            }
+        case NIM_CACHE_TAG_STR:
+            return nim_cache_get_str (r, value);
+        case NIM_CACHE_TAG_ARRAY:
+            if (!nim_cache_get_count (r, &n)) {
+                return NIM_FALSE;
+            }
+            *value = nim_array_new_with_capacity (n);
+            if (*value == NULL) {
+                return NIM_FALSE;
+            }
+            for (i = 0; i < n; i++) {
+                NimRef *item;
+                if (!nim_cache_get_value (r, &item) ||
+                        !nim_array_push (*value, item)) {
+                    return NIM_FALSE;
+                }
+            }
+            return NIM_TRUE;
+        case NIM_CACHE_TAG_HASH:
+            if (!nim_cache_get_count (r, &n)) {
+                return NIM_FALSE;
+            }
+            *value = nim_hash_new ();
+            if (*value == NULL) {
+                return NIM_FALSE;
+            }
+            for (i = 0; i < n; i++) {
+                NimRef *k;
+                NimRef *v;
+                if (!nim_cache_get_value (r, &k) ||
+                        !nim_cache_get_value (r, &v) ||
+                        !nim_hash_put (*value, k, v)) {
+                    return NIM_FALSE;
+                }
+            }
+            return NIM_TRUE;
+        case NIM_CACHE_TAG_METHOD:
+            if (!nim_cache_get_code (r, &code)) {
+                return NIM_FALSE;
+            }
+            *value = nim_method_new_bytecode (r->module, code);
+            return *value != NULL;
+        case NIM_CACHE_TAG_CLASS:
+            return nim_cache_get_class (r, value);
+        case NIM_CACHE_TAG_MODULE:
+            {
+                NimRef *name;
+                if (!nim_cache_get_str (r, &name)) {
+                    return NIM_FALSE;
+                }
+                *value = nim_module_mgr_load (name);
+                return *value != NULL;
+            }
+        default:
+            return NIM_FALSE;
+    }
+}
+
+static nim_bool_t
+nim_cache_check_header (
+    NimCacheReader *r, const char *filename, const NimCacheStamp *stamp)
+{
+    char magic[NIM_CACHE_MAGIC_SIZE];
+    uint32_t value;
+    uint64_t value64;
+    size_t len = strlen (filename);
+
+    if (!nim_cache_get (r, magic, sizeof(magic)) ||
+            memcmp (magic, NIM_CACHE_MAGIC, sizeof(magic)) != 0) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_get_u32 (r, &value) || value != NIM_CACHE_VERSION) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_get_u32 (r, &value) ||
+            value != NIM_OPCODE_COUNT) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_get_u64 (r, &value64) ||
+            value64 != nim_cache_builtins_hash ()) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_get_u32 (r, &value) ||
+            value != (uint32_t) nim_opt_level ()) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_get_u64 (r, &value64) ||
+            value64 != (uint64_t) stamp->mtime) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_get_u64 (r, &value64) || value64 != stamp->size) {
+        return NIM_FALSE;
+    }
+    if (!nim_cache_get_u64 (r, &value64) || value64 != stamp->hash) {
+        return NIM_FALSE;
+    }
+    /* __file__ is baked into the bytecode, so the path has to match too */
+    if (!nim_cache_get_u32 (r, &value) || value != len ||
+            len > r->size - r->pos ||
+            memcmp (r->data + r->pos, filename, len) != 0) {
+        return NIM_FALSE;
+    }
+    r->pos += len;
+    return NIM_TRUE;
+}
+
+/* reads & checks a cache file, leaving r just past the list of the */
+/* modules it uses. the caller has to free the returned buffer. */
+static char *
+nim_cache_open (
+    NimCacheReader *r, NimRef **uses,
+    NimRef *name, const char *filename, const NimCacheStamp *stamp)
+{
+    NimRef *path;
+    char *data;
+    size_t size;
+    uint64_t hash;
+    uint32_t n;
+    uint32_t i;
+
+    path = nim_cache_path (name, filename);
+    if (path == NULL) {
+        return NULL;
+    }
+    data = nim_cache_read_file (NIM_STR_DATA(path), &size);
+    if (data == NULL) {
+        return NULL;
+    }
+    if (size < sizeof(hash)) {
+        goto error;
+    }
+    memcpy (&hash, data + size - sizeof(hash), sizeof(hash));
+    if (hash != nim_cache_hash (data, size - sizeof(hash))) {
+        goto error;
+    }
+
+    memset (r, 0, sizeof(*r));
+    r->data = data;
+    r->size = size - sizeof(hash);
+    if (!nim_cache_check_header (r, filename, stamp)) {
+        goto error;
+    }
+
+    if (!nim_cache_get_count (r, &n)) {
+        goto error;
+    }
+    *uses = nim_array_new_with_capacity (n);
+    if (*uses == NULL) {
+        goto error;
+    }
+    for (i = 0; i < n; i++) {
+        NimRef *use;
+        if (!nim_cache_get_str (r, &use) || !nim_array_push (*uses, use)) {
+            goto error;
+        }
+    }
+    return data;
+
+error:
+    NIM_FREE (data);
+    return NULL;
+}
+
+static NimRef *
+nim_cache_load_stamped (
+    NimRef *name, const char *filename, const NimCacheStamp *stamp)
+{
+    NimCacheReader r;
+    NimRef *module = NULL;
+    NimRef *uses;
+    char *data;
+    uint32_t n;
+    uint32_t i;
+
+    data = nim_cache_open (&r, &uses, name, filename, stamp);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    if (NIM_ARRAY_SIZE(uses) > 1 && !nim_module_mgr_prefetch (uses)) {
+        goto done;
+    }
+
+    r.module = nim_module_new (name, NULL);
+    if (r.module == NULL) {
+        goto done;
+    }
+    if (!nim_cache_get_count (&r, &n)) {
+        goto done;
+    }
+    for (i = 0; i < n; i++) {
+        NimRef *key;
+        NimRef *value;
+        if (!nim_cache_get_str (&r, &key) ||
+                !nim_cache_get_value (&r, &value) ||
+                !nim_module_add_local (r.module, key, value)) {
+            goto done;
+        }
+    }
+    if (r.pos == r.size) {
+        module = r.module;
+    }
+
+done:
+    NIM_FREE (data);
+    return module;
+}
+
+NimRef *
+nim_cache_load (NimRef *name, const char *filename)
+{
+    NimCacheStamp stamp;
+
+    if (!nim_cache_enabled () || !nim_cache_stamp (filename, &stamp)) {
+        return NULL;
+    }
+    return nim_cache_load_stamped (name, filename, &stamp);
+}
+
+NimRef *
+nim_cache_uses (NimRef *name, const char *filename)
+{
+    NimCacheStamp stamp;
+    NimCacheReader r;
+    NimRef *uses;
+    char *data;
+
+    if (!nim_cache_enabled () || !nim_cache_stamp (filename, &stamp)) {
+        return NULL;
+    }
+    data = nim_cache_open (&r, &uses, name, filename, &stamp);
+    if (data == NULL) {
+        return NULL;
+    }
+    NIM_FREE (data);
+    return uses;
+}
+
+nim_bool_t
+nim_cache_store (NimRef *module, const char *filename)
+{
+    NimCacheStamp stamp;
+
+    if (!nim_cache_enabled () || !nim_cache_stamp (filename, &stamp)) {
+        return NIM_FALSE;
+    }
+    return nim_cache_store_stamped (module, filename, &stamp);
+}
+
+NimRef *
+nim_cache_compile_file (NimRef *name, const char *filename)
+{
+    NimCacheStamp stamp;
+    NimRef *module;
+
+    if (name == NULL) {
+        name = nim_compile_module_name (filename);
+        if (name == NULL) {
+            return NULL;
+        }
+    }
+
+    /* stamp the source before compiling it, so an edit made while */
+    /* we're compiling can only ever make the cache file look stale */
+    if (!nim_cache_enabled () || !nim_cache_stamp (filename, &stamp)) {
+        return nim_compile_file (name, filename);
+    }
+
+    /* the bytecode dumps are only printed by the compiler */
+    if (getenv ("NIM_DEBUG_MODE") == NULL) {
+        module = nim_cache_load_stamped (name, filename, &stamp);
+        if (module != NULL) {
+            return module;
+        }
+    }
+
+    module = nim_compile_file (name, filename);
+    if (module != NULL) {
+        /* not every module can be cached, & the cache is best-effort */
+        nim_cache_store_stamped (module, filename, &stamp);
+    }
+    return module;
+}
+
@@ -22,6 +22,7 @@
 #include "nim/lwhash.h"
 #include "nim/str.h"
 #include "nim/method.h"
+#include "nim/code.h"
 
 static NimRef *
 nim_class_call (NimRef *self, NimRef *args)
@@ -173,6 +174,7 @@ nim_class_new (NimRef *name, NimRef *super, size_t size)
     NIM_CLASS(ref)->getattr = NIM_CLASS(super)->getattr;
     NIM_CLASS(ref)->getitem = NIM_CLASS(super)->getitem;
     NIM_CLASS(ref)->nonzero = NIM_CLASS(super)->nonzero;
+    NIM_CLASS(ref)->iter_next = NIM_CLASS(super)->iter_next;
     return ref;
 }
 
@@ -211,14 +213,31 @@ nim_class_new_instance (NimRef *klass, ...)
 nim_bool_t
 nim_class_add_method (NimRef *self, NimRef *name, NimRef *method)
 {
+    nim_code_attr_cache_invalidate ();
     return nim_lwhash_put (NIM_CLASS(self)->methods, name, method);
 }
 
+NimRef *
+nim_class_lookup_method (NimRef *self, NimRef *name)
+{
+    while (self != NULL) {
+        NimRef *method;
+        if (!nim_lwhash_get (NIM_CLASS(self)->methods, name, &method)) {
+            break;
+        }
+        if (method != NULL) {
+            return method;
+        }
+        self = NIM_CLASS(self)->super;
+    }
+    return NULL;
+}
+
 nim_bool_t
 nim_class_add_native_method (NimRef *self, const char *name, NimNativeMethodFunc func)
 {
     NimRef *method_ref;
-    NimRef *name_ref = nim_str_new (name, strlen (name));
+    NimRef *name_ref = nim_str_intern (name, strlen (name));
     if (name_ref == NULL) {
         return NIM_FALSE;
     }
@@ -230,6 +249,23 @@ nim_class_add_native_method (NimRef *self, const char *name, NimNativeMethodFunc
     return nim_class_add_method (self, name_ref, method_ref);
 }
 
+nim_bool_t
+nim_class_add_native_method_typed (
+    NimRef *self, const char *name, const char *sig,
+    NimTypedNativeMethodFunc func)
+{
+    NimRef *method_ref;
+    NimRef *name_ref = nim_str_intern (name, strlen (name));
+    if (name_ref == NULL) {
+        return NIM_FALSE;
+    }
+    method_ref = nim_method_new_native_typed (NULL, sig, func);
+    if (method_ref == NULL) {
+        return NIM_FALSE;
+    }
+    return nim_class_add_method (self, name_ref, method_ref);
+}
+
 static void
 nim_class_dtor (NimRef *self)
 {
@@ -21,9 +21,16 @@
 #include "nim/class.h"
 #include "nim/array.h"
 #include "nim/int.h"
+#include "nim/float.h"
+#include "nim/object.h"
+#include "nim/jit.h"
 
 NimRef *nim_code_class = NULL;
 
+/* bumped whenever a class or module namespace changes, invalidating */
+/* every inline cache entry filled before the change. */
+static volatile uint32_t nim_code_attr_cache_epoch = 1;
+
 void
 nim_code_use_label (NimRef *self, NimLabel *label)
 {
@@ -54,6 +61,12 @@ nim_label_free (NimLabel *label)
 static nim_bool_t
 nim_code_get_jump_addr (NimRef *self, NimLabel *label, size_t *dest_addr)
 {
+    /* XXX jump addresses are 24 bits wide */
+    if (NIM_CODE(self)->used > 0xffffff) {
+        NIM_BUG ("code object too large for jump at pc=%zu",
+                    NIM_CODE(self)->used);
+        return NIM_FALSE;
+    }
     if (label->in_use) {
         *dest_addr = label->addr;
     }
@@ -71,21 +84,64 @@ nim_code_get_jump_addr (NimRef *self, NimLabel *label, size_t *dest_addr)
     return NIM_TRUE;
 }
 
+/* pools this small are cheaper to search than to index */
+#define NIM_CODE_POOL_INDEX_MIN 16
+
+typedef struct _NimCodePoolEntry {
+    uint32_t hash;
+    /* position in the pool + 1, or 0 for an empty slot */
+    int32_t  pos;
+} NimCodePoolEntry;
+
+typedef struct _NimCodePoolIndex {
+    NimCodePoolEntry *entries;
+    size_t            capacity;
+    /* how much of the pool has been indexed so far */
+    size_t            indexed;
+} NimCodePoolIndex;
+
+static void
+nim_code_pool_index_free (NimCodePoolIndex *index)
+{
+    if (index != NULL) {
+        NIM_FREE (index->entries);
+        NIM_FREE (index);
+    }
+}
+
 static void
 _nim_code_dtor (NimRef *self)
 {
+    /* before anything else: the native code reads the bytecode */
+    nim_jit_free (self);
+    nim_code_pool_index_free (NIM_CODE(self)->const_index);
+    nim_code_pool_index_free (NIM_CODE(self)->name_index);
     NIM_FREE (NIM_CODE(self)->bytecode);
+    NIM_FREE (NIM_CODE(self)->attr_caches);
+    NIM_FREE (NIM_CODE(self)->freevar_slots);
 }
 
 static void
 _nim_code_mark (NimGC *gc, NimRef *self)
 {
+    size_t i;
+
     NIM_SUPER (self)->mark (gc, self);
 
     nim_gc_mark_ref (gc, NIM_CODE(self)->constants);
     nim_gc_mark_ref (gc, NIM_CODE(self)->names);
     nim_gc_mark_ref (gc, NIM_CODE(self)->vars);
     nim_gc_mark_ref (gc, NIM_CODE(self)->freevars);
+
+    for (i = 0; i < NIM_CODE(self)->attr_caches_used; i++) {
+        NimAttrCache *cache = NIM_CODE(self)->attr_caches + i;
+        if (cache->key != NULL) {
+            nim_gc_mark_ref (gc, cache->key);
+        }
+        if (cache->value != NULL) {
+            nim_gc_mark_ref (gc, cache->value);
+        }
+    }
 }
 
 static NimRef *
@@ -122,6 +178,19 @@ _nim_code_init (NimRef *self, NimRef *args)
         return NULL;
     }
     NIM_CODE(self)->freevars = temp;
+    NIM_CODE(self)->freevar_slots = NULL;
+    NIM_CODE(self)->attr_caches = NULL;
+    NIM_CODE(self)->attr_caches_used = 0;
+    NIM_CODE(self)->const_index = NULL;
+    NIM_CODE(self)->name_index = NULL;
+    NIM_CODE(self)->jit = NULL;
+    NIM_CODE(self)->jit_state = NIM_CODE_JIT_NONE;
+    NIM_CODE(self)->jit_counter = 0;
+    NIM_CODE(self)->jit_pins = 0;
+    NIM_CODE(self)->nargs = 0;
+    NIM_CODE(self)->verified = NIM_FALSE;
+    NIM_CODE(self)->max_stack = 0;
+    NIM_CODE(self)->generator = NIM_FALSE;
     return self;
 }
 
@@ -188,30 +257,203 @@ nim_code_grow (NimRef *self)
     return NIM_TRUE;
 }
 
+/* emits an EXTENDED_ARG prefix if arg won't fit in 8 bits. the caller */
+/* must have grown the code already; we leave room for its instruction. */
+static nim_bool_t
+nim_code_extended_arg (NimRef *self, size_t arg)
+{
+    if (arg <= 0xff) {
+        return NIM_TRUE;
+    }
+    if (arg > 0xffffffff) {
+        NIM_BUG ("instruction argument too large: %zu", arg);
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) =
+        NIM_MAKE_INSTR0(EXTENDED_ARG) | ((arg >> 8) & 0xffffff);
+    return nim_code_grow (self);
+}
+
+/* equal values (per nim_object_cmp_eq) must hash alike */
+static uint32_t
+nim_code_pool_hash (NimRef *value)
+{
+    NimRef *klass = NIM_ANY_CLASS(value);
+    uint64_t bits;
+
+    if (klass == nim_str_class) {
+        return nim_str_hash (value);
+    }
+    else if (klass == nim_int_class) {
+        bits = (uint64_t) NIM_INT(value)->value;
+    }
+    else if (klass == nim_float_class) {
+        /* 0.0 == -0.0 */
+        double d = NIM_FLOAT(value)->value == 0.0
+            ? 0.0 : NIM_FLOAT(value)->value;
+        memcpy (&bits, &d, sizeof(bits));
+    }
+    else if (NIM_CLASS(klass)->cmp != NULL) {
+        /* compared by value, but we don't know how */
+        bits = (uint64_t)(uintptr_t) klass;
+    }
+    else {
+        bits = (uint64_t)(uintptr_t) value;
+    }
+
+    /* murmur3's finalizer */
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdULL;
+    bits ^= bits >> 33;
+    return (uint32_t) bits;
+}
+
+static nim_bool_t
+nim_code_pool_index_insert (
+    NimCodePoolIndex *index, uint32_t hash, int32_t pos);
+
+static nim_bool_t
+nim_code_pool_index_grow (NimCodePoolIndex *index)
+{
+    NimCodePoolEntry *old = index->entries;
+    size_t old_capacity = index->capacity;
+    size_t i;
+
+    index->capacity = old_capacity == 0 ? 64 : old_capacity * 2;
+    index->entries = NIM_MALLOC(NimCodePoolEntry,
+                        sizeof(*index->entries) * index->capacity);
+    if (index->entries == NULL) {
+        index->entries = old;
+        index->capacity = old_capacity;
+        return NIM_FALSE;
+    }
+    memset (index->entries, 0, sizeof(*index->entries) * index->capacity);
+
+    for (i = 0; i < old_capacity; i++) {
+        if (old[i].pos != 0) {
+            nim_code_pool_index_insert (index, old[i].hash, old[i].pos - 1);
+        }
+    }
+    NIM_FREE (old);
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_code_pool_index_insert (
+    NimCodePoolIndex *index, uint32_t hash, int32_t pos)
+{
+    size_t i;
+
+    /* keep it at most half full */
+    if ((index->indexed + 1) * 2 > index->capacity) {
+        if (!nim_code_pool_index_grow (index)) {
+            return NIM_FALSE;
+        }
+    }
+
+    i = hash & (index->capacity - 1);
+    while (index->entries[i].pos != 0) {
+        i = (i + 1) & (index->capacity - 1);
+    }
+    index->entries[i].hash = hash;
+    index->entries[i].pos = pos + 1;
+    return NIM_TRUE;
+}
+
+/*
+ * Finds value in pool, adding it if it's not there. Big pools get a hash
+ * index so emitting stays linear in the number of constants & names.
+ */
 static int32_t
-nim_code_add_const (NimRef *self, NimRef *value)
+nim_code_pool_add (NimRef *pool, NimCodePoolIndex **index_p, NimRef *value)
 {
-    int32_t n = nim_array_find (NIM_CODE(self)->constants, value);
-    if (n >= 0) {
-        return n;
+    NimCodePoolIndex *index = *index_p;
+    const size_t size = NIM_ARRAY_SIZE(pool);
+    uint32_t hash;
+    size_t i;
+
+    if (index == NULL && size < NIM_CODE_POOL_INDEX_MIN) {
+        int32_t n = nim_array_find (pool, value);
+        if (n >= 0) {
+            return n;
+        }
+        if (!nim_array_push (pool, value)) {
+            return -1;
+        }
+        return NIM_ARRAY_SIZE(pool) - 1;
+    }
+
+    if (index == NULL) {
+        index = NIM_MALLOC(NimCodePoolIndex, sizeof(*index));
+        if (index == NULL) {
+            return -1;
+        }
+        memset (index, 0, sizeof(*index));
+        *index_p = index;
+    }
+
+    /* catch up on anything pushed without us (e.g. clone templates) */
+    while (index->indexed < size) {
+        NimRef *item = NIM_ARRAY_ITEM(pool, index->indexed);
+        if (!nim_code_pool_index_insert (
+                index, nim_code_pool_hash (item), index->indexed)) {
+            return -1;
+        }
+        index->indexed++;
+    }
+
+    hash = nim_code_pool_hash (value);
+    i = hash & (index->capacity - 1);
+    while (index->entries[i].pos != 0) {
+        if (index->entries[i].hash == hash) {
+            const int32_t n = index->entries[i].pos - 1;
+            NimCmpResult r = nim_object_cmp_eq (NIM_ARRAY_ITEM(pool, n), value);
+            if (r == NIM_CMP_ERROR) {
+                return -1;
+            }
+            else if (r == NIM_CMP_EQ) {
+                return n;
+            }
+        }
+        i = (i + 1) & (index->capacity - 1);
+    }
+
+    if (!nim_array_push (pool, value)) {
+        return -1;
     }
-    if (!nim_array_push (NIM_CODE(self)->constants, value)) {
+    if (!nim_code_pool_index_insert (index, hash, size)) {
         return -1;
     }
-    return NIM_ARRAY_SIZE(NIM_CODE(self)->constants) - 1;
+    index->indexed++;
+    return (int32_t) size;
+}
+
+void
+nim_code_finish (NimRef *self)
+{
+    nim_code_pool_index_free (NIM_CODE(self)->const_index);
+    NIM_CODE(self)->const_index = NULL;
+    nim_code_pool_index_free (NIM_CODE(self)->name_index);
+    NIM_CODE(self)->name_index = NULL;
+}
+
+static int32_t
+nim_code_add_const (NimRef *self, NimRef *value)
+{
+    return nim_code_pool_add (
+        NIM_CODE(self)->constants, &NIM_CODE(self)->const_index, value);
 }
 
 static int32_t
 nim_code_add_name (NimRef *self, NimRef *id)
 {
-    int32_t n = nim_array_find (NIM_CODE(self)->names, id);
-    if (n >= 0) {
-        return n;
-    }
-    if (!nim_array_push (NIM_CODE(self)->names, id)) {
+    /* interned names make the VM's lookups pointer comparisons */
+    id = nim_str_intern_ref (id);
+    if (id == NULL) {
         return -1;
     }
-    return NIM_ARRAY_SIZE(NIM_CODE(self)->names) - 1;
+    return nim_code_pool_add (
+        NIM_CODE(self)->names, &NIM_CODE(self)->name_index, id);
 }
 
 nim_bool_t
@@ -225,6 +467,9 @@ nim_code_pushconst (NimRef *self, NimRef *value)
     if (arg < 0) {
         return NIM_FALSE;
     }
+    if (!nim_code_extended_arg (self, arg)) {
+        return NIM_FALSE;
+    }
     NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(PUSHCONST, arg);
     return NIM_TRUE;
 }
@@ -240,6 +485,9 @@ nim_code_pushname (NimRef *self, NimRef *id)
     if (arg < 0) {
         return NIM_FALSE;
     }
+    if (!nim_code_extended_arg (self, arg)) {
+        return NIM_FALSE;
+    }
     NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(PUSHNAME, arg);
     return NIM_TRUE;
 }
@@ -254,6 +502,43 @@ nim_code_pushnil (NimRef *self)
     return NIM_TRUE;
 }
 
+static nim_bool_t
+nim_code_slot_instr (NimRef *self, NimOpcode op, size_t slot)
+{
+    if (!nim_code_grow (self)) {
+        return NIM_FALSE;
+    }
+    if (!nim_code_extended_arg (self, slot)) {
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) = ((op & 0xff) << 24) | ((slot & 0xff) << 16);
+    return NIM_TRUE;
+}
+
+nim_bool_t
+nim_code_pushlocal (NimRef *self, size_t slot)
+{
+    return nim_code_slot_instr (self, NIM_OPCODE_PUSHLOCAL, slot);
+}
+
+nim_bool_t
+nim_code_storelocal (NimRef *self, size_t slot)
+{
+    return nim_code_slot_instr (self, NIM_OPCODE_STORELOCAL, slot);
+}
+
+nim_bool_t
+nim_code_pushupval (NimRef *self, size_t slot)
+{
+    return nim_code_slot_instr (self, NIM_OPCODE_PUSHUPVAL, slot);
+}
+
+nim_bool_t
+nim_code_storeupval (NimRef *self, size_t slot)
+{
+    return nim_code_slot_instr (self, NIM_OPCODE_STOREUPVAL, slot);
+}
+
 nim_bool_t
 nim_code_storename (NimRef *self, NimRef *id)
 {
@@ -267,6 +552,9 @@ nim_code_storename (NimRef *self, NimRef *id)
         return NIM_FALSE;
     }
 
+    if (!nim_code_extended_arg (self, arg)) {
+        return NIM_FALSE;
+    }
     NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(STORENAME, arg);
     return NIM_TRUE;
 }
@@ -284,10 +572,82 @@ nim_code_getclass (NimRef *self)
 }
 
 
+static int32_t
+nim_code_add_attr_cache (NimRef *self)
+{
+    NimAttrCache *caches;
+    size_t n = NIM_CODE(self)->attr_caches_used;
+
+    if (n >= 0x7fffffff) {
+        NIM_BUG ("too many attribute caches: %zu", n);
+        return -1;
+    }
+    caches = NIM_REALLOC(NimAttrCache,
+        NIM_CODE(self)->attr_caches, sizeof(NimAttrCache) * (n + 1));
+    if (caches == NULL) {
+        return -1;
+    }
+    memset (caches + n, 0, sizeof(NimAttrCache));
+    NIM_CODE(self)->attr_caches = caches;
+    NIM_CODE(self)->attr_caches_used++;
+    return (int32_t) n;
+}
+
+/* nim_code_extended_arg for an instruction with an attr cache slot in */
+/* ARG3. a slot that won't fit gets an EXTENDED_ARG of its own ahead of */
+/* the one for ARG1, which then has to be there even if ARG1 fits. */
+static nim_bool_t
+nim_code_cached_extended_arg (NimRef *self, size_t arg, size_t slot)
+{
+    if (slot <= 0xff) {
+        return nim_code_extended_arg (self, arg);
+    }
+    if (!nim_code_extended_arg (self, slot)) {
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) =
+        NIM_MAKE_INSTR0(EXTENDED_ARG) | ((arg >> 8) & 0xffffff);
+    return nim_code_grow (self);
+}
+
+nim_bool_t
+nim_code_loadglobal (NimRef *self, NimRef *id)
+{
+    int32_t arg;
+    int32_t slot;
+    if (!nim_code_grow (self)) {
+        return NIM_FALSE;
+    }
+
+    arg = nim_code_add_name (self, id);
+    if (arg < 0) {
+        return NIM_FALSE;
+    }
+
+    /* module-level names share the GETATTR caches & their invalidation */
+    slot = nim_code_add_attr_cache (self);
+    if (slot < 0) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_cached_extended_arg (self, arg, slot)) {
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR3(LOADGLOBAL, arg, 0, slot);
+    return NIM_TRUE;
+}
+
+nim_bool_t
+nim_code_loadbuiltin (NimRef *self, size_t index)
+{
+    return nim_code_slot_instr (self, NIM_OPCODE_LOADBUILTIN, index);
+}
+
 nim_bool_t
 nim_code_getattr (NimRef *self, NimRef *id)
 {
     int32_t arg;
+    int32_t slot;
     if (!nim_code_grow (self)) {
         return NIM_FALSE;
     }
@@ -297,10 +657,78 @@ nim_code_getattr (NimRef *self, NimRef *id)
         return NIM_FALSE;
     }
 
-    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(GETATTR, arg);
+    slot = nim_code_add_attr_cache (self);
+    if (slot < 0) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_cached_extended_arg (self, arg, slot)) {
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR3(GETATTR, arg, 0, slot);
     return NIM_TRUE;
 }
 
+NimRef *
+nim_code_attr_cache_get (NimRef *self, size_t slot, NimRef *key)
+{
+    NimAttrCache *cache;
+    uint32_t seq;
+    uint32_t epoch;
+    NimRef *cached_key;
+    NimRef *value;
+
+    if (slot >= NIM_CODE(self)->attr_caches_used) {
+        return NULL;
+    }
+    cache = NIM_CODE(self)->attr_caches + slot;
+    seq = cache->seq;
+    if (seq & 1) {
+        return NULL;
+    }
+    __sync_synchronize ();
+    epoch = cache->epoch;
+    cached_key = cache->key;
+    value = cache->value;
+    __sync_synchronize ();
+    if (cache->seq != seq) {
+        return NULL;
+    }
+    if (cached_key != key || epoch != nim_code_attr_cache_epoch) {
+        return NULL;
+    }
+    return value;
+}
+
+void
+nim_code_attr_cache_put (
+    NimRef *self, size_t slot, NimRef *key, NimRef *value)
+{
+    NimAttrCache *cache;
+    uint32_t seq;
+
+    if (slot >= NIM_CODE(self)->attr_caches_used) {
+        return;
+    }
+    cache = NIM_CODE(self)->attr_caches + slot;
+    seq = cache->seq;
+    /* somebody else is filling this entry: let them have it */
+    if ((seq & 1) || !__sync_bool_compare_and_swap (&cache->seq, seq, seq + 1)) {
+        return;
+    }
+    cache->epoch = nim_code_attr_cache_epoch;
+    cache->key = key;
+    cache->value = value;
+    __sync_synchronize ();
+    cache->seq = seq + 2;
+}
+
+void
+nim_code_attr_cache_invalidate (void)
+{
+    __sync_add_and_fetch (&nim_code_attr_cache_epoch, 1);
+}
+
 nim_bool_t
 nim_code_getitem (NimRef *self)
 {
@@ -314,12 +742,51 @@ nim_code_getitem (NimRef *self)
 }
 
 nim_bool_t
-nim_code_call (NimRef *self, uint8_t nargs)
+nim_code_call (NimRef *self, size_t nargs)
 {
     if (!nim_code_grow (self)) {
         return NIM_FALSE;
     }
-    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(CALL, (int32_t)nargs);
+    if (!nim_code_extended_arg (self, nargs)) {
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(CALL, nargs);
+    return NIM_TRUE;
+}
+
+nim_bool_t
+nim_code_callmethod (NimRef *self, NimRef *id, size_t nargs)
+{
+    int32_t arg;
+    int32_t slot;
+
+    /* nargs only gets 8 bits here: fall back to GETATTR + CALL */
+    if (nargs > 0xff) {
+        if (!nim_code_getattr (self, id)) {
+            return NIM_FALSE;
+        }
+        return nim_code_call (self, nargs);
+    }
+
+    if (!nim_code_grow (self)) {
+        return NIM_FALSE;
+    }
+
+    arg = nim_code_add_name (self, id);
+    if (arg < 0) {
+        return NIM_FALSE;
+    }
+
+    slot = nim_code_add_attr_cache (self);
+    if (slot < 0) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_cached_extended_arg (self, arg, slot)) {
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) =
+        NIM_MAKE_INSTR3(CALLMETHOD, arg, (int32_t)nargs, slot);
     return NIM_TRUE;
 }
 
@@ -333,6 +800,34 @@ nim_code_ret (NimRef *self)
     return NIM_TRUE;
 }
 
+/* rewrites the CALL we just emitted as a TAILCALL. the caller still */
+/* emits the RET: it returns the result when the target isn't bytecode. */
+nim_bool_t
+nim_code_tailcall (NimRef *self)
+{
+    const size_t used = NIM_CODE(self)->used;
+    if (used == 0 || NIM_INSTR_OP(self, used - 1) != NIM_OPCODE_CALL) {
+        NIM_BUG ("TAILCALL must replace a CALL");
+        return NIM_FALSE;
+    }
+    NIM_INSTR_SET_OP(self, used - 1, NIM_OPCODE_TAILCALL);
+    return NIM_TRUE;
+}
+
+/* removes the POP that ended the expression statement we just emitted, */
+/* leaving its value on the stack. */
+nim_bool_t
+nim_code_unpop (NimRef *self)
+{
+    const size_t used = NIM_CODE(self)->used;
+    if (used == 0 || NIM_INSTR_OP(self, used - 1) != NIM_OPCODE_POP) {
+        NIM_BUG ("expected a POP to remove");
+        return NIM_FALSE;
+    }
+    NIM_CODE(self)->used--;
+    return NIM_TRUE;
+}
+
 nim_bool_t
 nim_code_spawn (NimRef *self)
 {
@@ -364,23 +859,47 @@ nim_code_dup (NimRef *self)
 }
 
 nim_bool_t
-nim_code_makearray (NimRef *self, uint8_t nargs)
+nim_code_makearray (NimRef *self, size_t nargs)
 {
     if (!nim_code_grow (self)) {
         return NIM_FALSE;
     }
-    /* XXX this cast should happen automatically in the make_instr macro */
-    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(MAKEARRAY, (int32_t)nargs);
+    if (!nim_code_extended_arg (self, nargs)) {
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(MAKEARRAY, nargs);
     return NIM_TRUE;
 }
 
 nim_bool_t
-nim_code_makehash (NimRef *self, uint8_t nargs)
+nim_code_makehash (NimRef *self, size_t nargs)
 {
     if (!nim_code_grow (self)) {
         return NIM_FALSE;
     }
-    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(MAKEHASH, (int32_t)nargs);
+    if (!nim_code_extended_arg (self, nargs)) {
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(MAKEHASH, nargs);
+    return NIM_TRUE;
+}
+
+nim_bool_t
+nim_code_cloneconst (NimRef *self, NimRef *template)
+{
+    int32_t arg;
+    if (!nim_code_grow (self)) {
+        return NIM_FALSE;
+    }
+    /* skip nim_code_add_const: templates are never shared by value */
+    if (!nim_array_push (NIM_CODE(self)->constants, template)) {
+        return NIM_FALSE;
+    }
+    arg = NIM_ARRAY_SIZE(NIM_CODE(self)->constants) - 1;
+    if (!nim_code_extended_arg (self, arg)) {
+        return NIM_FALSE;
+    }
+    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR1(CLONECONST, arg);
     return NIM_TRUE;
 }
 
@@ -394,6 +913,35 @@ nim_code_makeclosure (NimRef *self)
     return NIM_TRUE;
 }
 
+nim_bool_t
+nim_code_add_freevar (NimRef *self, NimRef *name, int32_t slot)
+{
+    const size_t n = NIM_ARRAY_SIZE(NIM_CODE(self)->freevars);
+    int32_t *slots = NIM_REALLOC(int32_t,
+        NIM_CODE(self)->freevar_slots, sizeof(*slots) * (n + 1));
+    if (slots == NULL) {
+        return NIM_FALSE;
+    }
+    NIM_CODE(self)->freevar_slots = slots;
+    if (!nim_array_push (NIM_CODE(self)->freevars, name)) {
+        return NIM_FALSE;
+    }
+    slots[n] = slot;
+    return NIM_TRUE;
+}
+
+int32_t
+nim_code_find_var (NimRef *self, NimRef *name)
+{
+    return nim_array_find (NIM_CODE(self)->vars, name);
+}
+
+int32_t
+nim_code_find_freevar (NimRef *self, NimRef *name)
+{
+    return nim_array_find (NIM_CODE(self)->freevars, name);
+}
+
 nim_bool_t
 nim_code_jumpiftrue (NimRef *self, NimLabel *label)
 {
@@ -445,6 +993,46 @@ nim_code_jump (NimRef *self, NimLabel *label)
     return NIM_TRUE;
 }
 
+nim_bool_t
+nim_code_getiter (NimRef *self)
+{
+    if (!nim_code_grow (self)) {
+        return NIM_FALSE;
+    }
+
+    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR0(GETITER);
+    return NIM_TRUE;
+}
+
+nim_bool_t
+nim_code_foriter (NimRef *self, NimLabel *label)
+{
+    if (label == NULL) {
+        NIM_BUG ("jump labels can't be null, fool.");
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_grow (self)) {
+        return NIM_FALSE;
+    }
+
+    NIM_JUMP_INSTR(self, FORITER, label);
+
+    return NIM_TRUE;
+}
+
+nim_bool_t
+nim_code_yield (NimRef *self)
+{
+    if (!nim_code_grow (self)) {
+        return NIM_FALSE;
+    }
+
+    NIM_NEXT_INSTR(self) = NIM_MAKE_INSTR0(YIELD);
+    NIM_CODE(self)->generator = NIM_TRUE;
+    return NIM_TRUE;
+}
+
 nim_bool_t
 nim_code_eq (NimRef *self)
 {
@@ -566,7 +1154,616 @@ nim_code_pop (NimRef *self)
     return NIM_TRUE;
 }
 
-static const char *
+/* the PUSHxx that reads back what the STORExx op wrote, if any */
+static NimOpcode
+nim_code_reload_op (NimOpcode store)
+{
+    switch (store) {
+        case NIM_OPCODE_STORELOCAL:
+            return NIM_OPCODE_PUSHLOCAL;
+        case NIM_OPCODE_STOREUPVAL:
+            return NIM_OPCODE_PUSHUPVAL;
+        case NIM_OPCODE_STORENAME:
+            return NIM_OPCODE_PUSHNAME;
+        default:
+            return store;
+    }
+}
+
+/* where a jump to addr ends up once it's followed through any JUMPs */
+static size_t
+nim_code_jump_dest (NimRef *self, size_t addr)
+{
+    const size_t used = NIM_CODE(self)->used;
+    size_t hops = 0;
+    while (addr < used && NIM_INSTR_OP(self, addr) == NIM_OPCODE_JUMP &&
+            hops++ < used) {
+        addr = NIM_INSTR_ADDR(self, addr);
+    }
+    return addr;
+}
+
+/* marks everything reachable from pc in reachable. removed instructions */
+/* have no effect, so control just falls through them. */
+static void
+nim_code_mark_reachable (NimRef *self, size_t pc, nim_bool_t *reachable)
+{
+    const size_t used = NIM_CODE(self)->used;
+    while (pc < used && !reachable[pc]) {
+        const NimOpcode op = NIM_INSTR_OP(self, pc);
+        reachable[pc] = NIM_TRUE;
+        if (op == NIM_OPCODE_RET) {
+            return;
+        }
+        else if (op == NIM_OPCODE_JUMP) {
+            pc = NIM_INSTR_ADDR(self, pc);
+        }
+        else {
+            if (NIM_OPCODE_IS_JUMP(op)) {
+                nim_code_mark_reachable (self, NIM_INSTR_ADDR(self, pc),
+                                            reachable);
+            }
+            pc++;
+        }
+    }
+}
+
+#define NIM_PEEPHOLE_MAX_PASSES 8
+
+/*
+ * Cleans up the naive sequences the compiler emits, before
+ * nim_code_optimize sees them:
+ *
+ *   STORExx n; PUSHxx n           => DUP; STORExx n
+ *   DUP; POP                      => (nothing)
+ *   NOT; JUMPIFFALSE addr         => JUMPIFTRUE addr (and vice versa)
+ *   JUMPxx a, where a: JUMP b     => JUMPxx b
+ *   JUMP a, where a: RET          => RET
+ *   JUMP to the next instruction  => (nothing)
+ *
+ * and drops any code that can't be reached. Passes repeat until nothing
+ * changes. Rewrites are described on stderr if verbose is set. Must be
+ * called once all labels are resolved.
+ */
+nim_bool_t
+nim_code_peephole (NimRef *self, nim_bool_t verbose)
+{
+    uint32_t *bytecode = NIM_CODE(self)->bytecode;
+    nim_bool_t *targets = NULL;
+    nim_bool_t *removed = NULL;
+    size_t *addrs = NULL;
+    nim_bool_t changed = NIM_TRUE;
+    size_t pass;
+
+    for (pass = 0; changed && pass < NIM_PEEPHOLE_MAX_PASSES; pass++) {
+        const size_t used = NIM_CODE(self)->used;
+        size_t i;
+        size_t n;
+
+        changed = NIM_FALSE;
+
+        targets = NIM_MALLOC(nim_bool_t, sizeof(nim_bool_t) * (used + 1));
+        removed = NIM_MALLOC(nim_bool_t, sizeof(nim_bool_t) * (used + 1));
+        addrs = NIM_MALLOC(size_t, sizeof(size_t) * (used + 1));
+        if (targets == NULL || removed == NULL || addrs == NULL) {
+            goto error;
+        }
+        memset (targets, 0, sizeof(nim_bool_t) * (used + 1));
+        memset (removed, 0, sizeof(nim_bool_t) * (used + 1));
+        for (i = 0; i < used; i++) {
+            if (NIM_OPCODE_IS_JUMP(NIM_INSTR_OP(self, i))) {
+                if (NIM_INSTR_ADDR(self, i) > used) {
+                    NIM_BUG ("jump at pc=%zu out of range: %zu",
+                                i, (size_t) NIM_INSTR_ADDR(self, i));
+                    goto error;
+                }
+                targets[NIM_INSTR_ADDR(self, i)] = NIM_TRUE;
+            }
+        }
+
+        for (i = 0; i < used; i++) {
+            const NimOpcode op = NIM_INSTR_OP(self, i);
+            const NimOpcode next = i + 1 < used ?
+                                    NIM_INSTR_OP(self, i + 1) :
+                                    NIM_OPCODE_EXTENDED_ARG;
+
+            if (removed[i]) {
+                continue;
+            }
+
+            if (NIM_OPCODE_IS_JUMP(op)) {
+                const size_t addr = NIM_INSTR_ADDR(self, i);
+                const size_t dest = nim_code_jump_dest (self, addr);
+                if (dest != addr) {
+                    if (verbose) {
+                        fprintf (stderr, "peephole %zu: %s %zu => %s %zu\n",
+                            i, nim_code_opcode_str (op), addr,
+                            nim_code_opcode_str (op), dest);
+                    }
+                    bytecode[i] = (bytecode[i] & 0xff000000) |
+                                    (dest & 0xffffff);
+                    changed = NIM_TRUE;
+                }
+                if (op == NIM_OPCODE_JUMP && dest < used &&
+                        NIM_INSTR_OP(self, dest) == NIM_OPCODE_RET) {
+                    if (verbose) {
+                        fprintf (stderr, "peephole %zu: JUMP %zu => RET\n",
+                            i, dest);
+                    }
+                    bytecode[i] = bytecode[dest];
+                    changed = NIM_TRUE;
+                }
+                else if (op == NIM_OPCODE_JUMP && dest == i + 1) {
+                    if (verbose) {
+                        fprintf (stderr, "peephole %zu: JUMP %zu => \n",
+                            i, dest);
+                    }
+                    removed[i] = NIM_TRUE;
+                    changed = NIM_TRUE;
+                }
+            }
+            else if (op == NIM_OPCODE_NOT && !targets[i + 1] &&
+                    (next == NIM_OPCODE_JUMPIFFALSE ||
+                     next == NIM_OPCODE_JUMPIFTRUE)) {
+                const NimOpcode flipped = next == NIM_OPCODE_JUMPIFFALSE ?
+                                            NIM_OPCODE_JUMPIFTRUE :
+                                            NIM_OPCODE_JUMPIFFALSE;
+                if (verbose) {
+                    fprintf (stderr, "peephole %zu: NOT; %s %zu => %s %zu\n",
+                        i, nim_code_opcode_str (next),
+                        (size_t) NIM_INSTR_ADDR(self, i + 1),
+                        nim_code_opcode_str (flipped),
+                        (size_t) NIM_INSTR_ADDR(self, i + 1));
+                }
+                NIM_INSTR_SET_OP(self, i + 1, flipped);
+                removed[i] = NIM_TRUE;
+                changed = NIM_TRUE;
+                i++;
+            }
+            else if (op == NIM_OPCODE_DUP && next == NIM_OPCODE_POP &&
+                    !targets[i + 1]) {
+                if (verbose) {
+                    fprintf (stderr, "peephole %zu: DUP; POP => \n", i);
+                }
+                removed[i] = removed[i + 1] = NIM_TRUE;
+                changed = NIM_TRUE;
+                i++;
+            }
+            else if (nim_code_reload_op (op) != op &&
+                    nim_code_reload_op (op) == next &&
+                    !NIM_INSTR_EXTENDED(self, i) && !targets[i + 1] &&
+                    NIM_INSTR_ARG1(self, i) == NIM_INSTR_ARG1(self, i + 1)) {
+                if (verbose) {
+                    fprintf (stderr, "peephole %zu: %s %zu; %s %zu => "
+                                     "DUP; %s %zu\n",
+                        i, nim_code_opcode_str (op),
+                        (size_t) NIM_INSTR_ARG1(self, i),
+                        nim_code_opcode_str (next),
+                        (size_t) NIM_INSTR_ARG1(self, i),
+                        nim_code_opcode_str (op),
+                        (size_t) NIM_INSTR_ARG1(self, i));
+                }
+                bytecode[i + 1] = bytecode[i];
+                bytecode[i] = NIM_MAKE_INSTR0(DUP);
+                changed = NIM_TRUE;
+                i++;
+            }
+        }
+
+        /* unreachable code: reuse targets to hold what's reachable */
+        memset (targets, 0, sizeof(nim_bool_t) * (used + 1));
+        nim_code_mark_reachable (self, 0, targets);
+        for (i = 0; i < used; i++) {
+            if (!targets[i] && !removed[i]) {
+                if (verbose) {
+                    fprintf (stderr, "peephole %zu: unreachable %s\n",
+                        i, nim_code_opcode_str (NIM_INSTR_OP(self, i)));
+                }
+                removed[i] = NIM_TRUE;
+                changed = NIM_TRUE;
+            }
+        }
+
+        /* compact, sending jumps to removed code to whatever follows it */
+        n = 0;
+        for (i = 0; i < used; i++) {
+            addrs[i] = n;
+            if (!removed[i]) {
+                bytecode[n++] = bytecode[i];
+            }
+        }
+        addrs[used] = n;
+        NIM_CODE(self)->used = n;
+        for (i = 0; i < n; i++) {
+            if (NIM_OPCODE_IS_JUMP(NIM_INSTR_OP(self, i))) {
+                bytecode[i] = (bytecode[i] & 0xff000000) |
+                                (addrs[NIM_INSTR_ADDR(self, i)] & 0xffffff);
+            }
+        }
+
+        NIM_FREE (targets);
+        NIM_FREE (removed);
+        NIM_FREE (addrs);
+        targets = removed = NULL;
+        addrs = NULL;
+    }
+    return NIM_TRUE;
+
+error:
+    NIM_FREE (targets);
+    NIM_FREE (removed);
+    NIM_FREE (addrs);
+    return NIM_FALSE;
+}
+
+static NimOpcode
+nim_code_fused_jump (NimOpcode cmp)
+{
+    switch (cmp) {
+        case NIM_OPCODE_CMPEQ:
+            return NIM_OPCODE_JUMPIFNOTEQ;
+        case NIM_OPCODE_CMPNEQ:
+            return NIM_OPCODE_JUMPIFNOTNEQ;
+        case NIM_OPCODE_CMPGT:
+            return NIM_OPCODE_JUMPIFNOTGT;
+        case NIM_OPCODE_CMPGTE:
+            return NIM_OPCODE_JUMPIFNOTGTE;
+        case NIM_OPCODE_CMPLT:
+            return NIM_OPCODE_JUMPIFNOTLT;
+        case NIM_OPCODE_CMPLTE:
+            return NIM_OPCODE_JUMPIFNOTLTE;
+        default:
+            return cmp;
+    };
+}
+
+/*
+ * Fuses common instruction sequences into superinstructions so the VM
+ * dispatches fewer instructions and pushes fewer temporaries:
+ *
+ *   CMPxx; JUMPIFFALSE addr       => JUMPIFNOTxx addr
+ *   PUSHNAME n; PUSHCONST c; ADD  => ADDNAMECONST n, c
+ *   PUSHLOCAL n; PUSHCONST c; ADD => ADDLOCALCONST n, c
+ *
+ * A sequence is only fused if nothing jumps into the middle of it. Must
+ * be called once all labels are resolved; jump addresses are remapped
+ * to account for the removed instructions.
+ */
+nim_bool_t
+nim_code_optimize (NimRef *self)
+{
+    const size_t used = NIM_CODE(self)->used;
+    uint32_t *bytecode = NIM_CODE(self)->bytecode;
+    nim_bool_t *targets;
+    size_t *addrs;
+    size_t i;
+    size_t n;
+
+    targets = NIM_MALLOC(nim_bool_t, sizeof(nim_bool_t) * (used + 1));
+    if (targets == NULL) {
+        return NIM_FALSE;
+    }
+    addrs = NIM_MALLOC(size_t, sizeof(size_t) * (used + 1));
+    if (addrs == NULL) {
+        NIM_FREE (targets);
+        return NIM_FALSE;
+    }
+    memset (targets, 0, sizeof(nim_bool_t) * (used + 1));
+    for (i = 0; i < used; i++) {
+        if (NIM_OPCODE_IS_JUMP(NIM_INSTR_OP(self, i))) {
+            size_t addr = NIM_INSTR_ADDR(self, i);
+            if (addr > used) {
+                NIM_BUG ("jump at pc=%zu out of range: %zu", i, addr);
+                NIM_FREE (targets);
+                NIM_FREE (addrs);
+                return NIM_FALSE;
+            }
+            targets[addr] = NIM_TRUE;
+        }
+    }
+
+    /* compact in place: n never overtakes i */
+    n = 0;
+    i = 0;
+    while (i < used) {
+        const NimOpcode op = NIM_INSTR_OP(self, i);
+        addrs[i] = n;
+        if (i + 1 < used &&
+                nim_code_fused_jump (op) != op &&
+                NIM_INSTR_OP(self, i + 1) == NIM_OPCODE_JUMPIFFALSE &&
+                !targets[i + 1]) {
+            addrs[i + 1] = n;
+            bytecode[n++] =
+                ((nim_code_fused_jump (op) & 0xff) << 24) |
+                NIM_INSTR_ADDR(self, i + 1);
+            i += 2;
+        }
+        else if (i + 2 < used &&
+                (op == NIM_OPCODE_PUSHNAME || op == NIM_OPCODE_PUSHLOCAL) &&
+                NIM_INSTR_OP(self, i + 1) == NIM_OPCODE_PUSHCONST &&
+                NIM_INSTR_OP(self, i + 2) == NIM_OPCODE_ADD &&
+                !targets[i + 1] && !targets[i + 2]) {
+            addrs[i + 1] = addrs[i + 2] = n;
+            if (op == NIM_OPCODE_PUSHNAME) {
+                bytecode[n++] =
+                    NIM_MAKE_INSTR2(ADDNAMECONST,
+                        NIM_INSTR_ARG1(self, i), NIM_INSTR_ARG1(self, i + 1));
+            }
+            else {
+                bytecode[n++] =
+                    NIM_MAKE_INSTR2(ADDLOCALCONST,
+                        NIM_INSTR_ARG1(self, i), NIM_INSTR_ARG1(self, i + 1));
+            }
+            i += 3;
+        }
+        else {
+            bytecode[n++] = bytecode[i++];
+        }
+    }
+    addrs[used] = n;
+    NIM_CODE(self)->used = n;
+
+    for (i = 0; i < n; i++) {
+        if (NIM_OPCODE_IS_JUMP(NIM_INSTR_OP(self, i))) {
+            bytecode[i] = (bytecode[i] & 0xff000000) |
+                            (addrs[NIM_INSTR_ADDR(self, i)] & 0xffffff);
+        }
+    }
+
+    NIM_FREE (targets);
+    NIM_FREE (addrs);
+    return NIM_TRUE;
+}
+
+/* how many values the instruction at pc needs on the stack & how it */
+/* changes the stack depth. NIM_FALSE if the opcode isn't known. */
+static nim_bool_t
+nim_code_stack_effect (NimRef *self, size_t pc, size_t *needs, int *delta)
+{
+    switch (NIM_INSTR_OP(self, pc)) {
+        case NIM_OPCODE_JUMP:
+        case NIM_OPCODE_RET:
+        case NIM_OPCODE_EXTENDED_ARG:
+            *needs = 0; *delta = 0;
+            break;
+        case NIM_OPCODE_PUSHCONST:
+        case NIM_OPCODE_CLONECONST:
+        case NIM_OPCODE_PUSHNAME:
+        case NIM_OPCODE_PUSHLOCAL:
+        case NIM_OPCODE_PUSHUPVAL:
+        case NIM_OPCODE_LOADGLOBAL:
+        case NIM_OPCODE_LOADBUILTIN:
+        case NIM_OPCODE_PUSHNIL:
+        case NIM_OPCODE_ADDNAMECONST:
+        case NIM_OPCODE_ADDLOCALCONST:
+            *needs = 0; *delta = 1;
+            break;
+        case NIM_OPCODE_DUP:
+        case NIM_OPCODE_FORITER:
+            /* FORITER leaves the stack alone if it jumps */
+            *needs = 1; *delta = 1;
+            break;
+        case NIM_OPCODE_GETATTR:
+        case NIM_OPCODE_GETCLASS:
+        case NIM_OPCODE_GETITER:
+        case NIM_OPCODE_NOT:
+        case NIM_OPCODE_SPAWN:
+        case NIM_OPCODE_MAKECLOSURE:
+            *needs = 1; *delta = 0;
+            break;
+        case NIM_OPCODE_JUMPIFTRUE:
+        case NIM_OPCODE_JUMPIFFALSE:
+        case NIM_OPCODE_STORENAME:
+        case NIM_OPCODE_STORELOCAL:
+        case NIM_OPCODE_STOREUPVAL:
+        case NIM_OPCODE_POP:
+        case NIM_OPCODE_YIELD:
+            *needs = 1; *delta = -1;
+            break;
+        case NIM_OPCODE_GETITEM:
+        case NIM_OPCODE_CMPEQ:
+        case NIM_OPCODE_CMPNEQ:
+        case NIM_OPCODE_CMPGT:
+        case NIM_OPCODE_CMPGTE:
+        case NIM_OPCODE_CMPLT:
+        case NIM_OPCODE_CMPLTE:
+        case NIM_OPCODE_ADD:
+        case NIM_OPCODE_SUB:
+        case NIM_OPCODE_MUL:
+        case NIM_OPCODE_DIV:
+        case NIM_OPCODE_ADD_INT:
+        case NIM_OPCODE_SUB_INT:
+        case NIM_OPCODE_MUL_INT:
+        case NIM_OPCODE_DIV_INT:
+        case NIM_OPCODE_CMPEQ_INT:
+        case NIM_OPCODE_CMPNEQ_INT:
+        case NIM_OPCODE_CMPGT_INT:
+        case NIM_OPCODE_CMPGTE_INT:
+        case NIM_OPCODE_CMPLT_INT:
+        case NIM_OPCODE_CMPLTE_INT:
+            *needs = 2; *delta = -1;
+            break;
+        case NIM_OPCODE_JUMPIFNOTEQ:
+        case NIM_OPCODE_JUMPIFNOTNEQ:
+        case NIM_OPCODE_JUMPIFNOTGT:
+        case NIM_OPCODE_JUMPIFNOTGTE:
+        case NIM_OPCODE_JUMPIFNOTLT:
+        case NIM_OPCODE_JUMPIFNOTLTE:
+            *needs = 2; *delta = -2;
+            break;
+        case NIM_OPCODE_CALL:
+        case NIM_OPCODE_TAILCALL:
+            *needs = NIM_INSTR_EXTARG1(self, pc) + 1;
+            *delta = -(int) NIM_INSTR_EXTARG1(self, pc);
+            break;
+        case NIM_OPCODE_CALLMETHOD:
+            *needs = NIM_INSTR_ARG2(self, pc) + 1;
+            *delta = -(int) NIM_INSTR_ARG2(self, pc);
+            break;
+        case NIM_OPCODE_MAKEARRAY:
+            *needs = NIM_INSTR_EXTARG1(self, pc);
+            *delta = 1 - (int) *needs;
+            break;
+        case NIM_OPCODE_MAKEHASH:
+            *needs = NIM_INSTR_EXTARG1(self, pc) * 2;
+            *delta = 1 - (int) *needs;
+            break;
+        default:
+            return NIM_FALSE;
+    };
+    return NIM_TRUE;
+}
+
+/* checks the operands of the instruction at pc index something that exists */
+static nim_bool_t
+nim_code_verify_operands (NimRef *self, size_t pc)
+{
+    const NimOpcode op = NIM_INSTR_OP(self, pc);
+    const size_t arg1 = NIM_INSTR_EXTARG1(self, pc);
+    const size_t caches = NIM_CODE(self)->attr_caches_used;
+
+    switch (op) {
+        case NIM_OPCODE_EXTENDED_ARG:
+            return pc + 1 < NIM_CODE(self)->used;
+        case NIM_OPCODE_PUSHCONST:
+        case NIM_OPCODE_CLONECONST:
+            return arg1 < NIM_ARRAY_SIZE(NIM_CODE(self)->constants);
+        case NIM_OPCODE_PUSHNAME:
+        case NIM_OPCODE_STORENAME:
+            return arg1 < NIM_ARRAY_SIZE(NIM_CODE(self)->names);
+        case NIM_OPCODE_GETATTR:
+        case NIM_OPCODE_LOADGLOBAL:
+        case NIM_OPCODE_CALLMETHOD:
+            return arg1 < NIM_ARRAY_SIZE(NIM_CODE(self)->names) &&
+                    NIM_INSTR_ATTRCACHE(self, pc) < caches;
+        case NIM_OPCODE_PUSHLOCAL:
+        case NIM_OPCODE_STORELOCAL:
+            return arg1 < NIM_ARRAY_SIZE(NIM_CODE(self)->vars);
+        case NIM_OPCODE_PUSHUPVAL:
+        case NIM_OPCODE_STOREUPVAL:
+            return arg1 < NIM_ARRAY_SIZE(NIM_CODE(self)->freevars);
+        case NIM_OPCODE_LOADBUILTIN:
+            return nim_builtin_at (arg1) != NULL;
+        case NIM_OPCODE_ADDLOCALCONST:
+            return arg1 < NIM_ARRAY_SIZE(NIM_CODE(self)->vars) &&
+                    NIM_INSTR_ARG2(self, pc) <
+                        NIM_ARRAY_SIZE(NIM_CODE(self)->constants);
+        case NIM_OPCODE_ADDNAMECONST:
+            return arg1 < NIM_ARRAY_SIZE(NIM_CODE(self)->names) &&
+                    NIM_INSTR_ARG2(self, pc) <
+                        NIM_ARRAY_SIZE(NIM_CODE(self)->constants);
+        default:
+            if (NIM_OPCODE_IS_JUMP(op)) {
+                return NIM_INSTR_ADDR(self, pc) <= NIM_CODE(self)->used;
+            }
+            return NIM_TRUE;
+    };
+}
+
+/*
+ * Proves the code is safe to run without the checks the VM makes on
+ * every instruction: all opcodes are known, every const/name/local/
+ * upvalue/cache/builtin operand is in range, every jump lands inside
+ * the code & the stack never drops below what was there on entry
+ * (nargs), with the same depth on every path into an instruction.
+ *
+ * On success sets verified & max_stack, the deepest the stack gets.
+ * Returns NIM_FALSE for code that fails verification, which is still
+ * run, just by the checked interpreter.
+ */
+nim_bool_t
+nim_code_verify (NimRef *self)
+{
+    const size_t used = NIM_CODE(self)->used;
+    int64_t *depths;
+    size_t *work;
+    size_t nwork;
+    size_t max_stack;
+    nim_bool_t ok = NIM_FALSE;
+    size_t i;
+
+    NIM_CODE(self)->verified = NIM_FALSE;
+
+    depths = NIM_MALLOC(int64_t, sizeof(int64_t) * (used + 1));
+    if (depths == NULL) {
+        return NIM_FALSE;
+    }
+    work = NIM_MALLOC(size_t, sizeof(size_t) * (used + 1));
+    if (work == NULL) {
+        NIM_FREE (depths);
+        return NIM_FALSE;
+    }
+    for (i = 0; i <= used; i++) {
+        depths[i] = -1;
+    }
+
+    /* each pc goes on the worklist once, the first time it's reached */
+    depths[0] = NIM_CODE(self)->nargs;
+    max_stack = NIM_CODE(self)->nargs;
+    work[0] = 0;
+    nwork = 1;
+    while (nwork > 0) {
+        const size_t pc = work[--nwork];
+        size_t succ[2];
+        size_t nsucc = 0;
+        size_t needs;
+        int delta;
+        int64_t depth;
+        NimOpcode op;
+
+        if (pc == used) {
+            /* falling off the end returns, like RET */
+            continue;
+        }
+        op = NIM_INSTR_OP(self, pc);
+        if (!nim_code_stack_effect (self, pc, &needs, &delta) ||
+                !nim_code_verify_operands (self, pc)) {
+            goto error;
+        }
+        if (depths[pc] < (int64_t) needs) {
+            goto error;
+        }
+        depth = depths[pc] + delta;
+        if ((size_t) depth > max_stack) {
+            max_stack = (size_t) depth;
+        }
+
+        if (op == NIM_OPCODE_JUMP) {
+            succ[nsucc++] = NIM_INSTR_ADDR(self, pc);
+        }
+        else if (NIM_OPCODE_IS_JUMP(op)) {
+            succ[nsucc++] = NIM_INSTR_ADDR(self, pc);
+            succ[nsucc++] = pc + 1;
+        }
+        else if (op != NIM_OPCODE_RET) {
+            succ[nsucc++] = pc + 1;
+        }
+        for (i = 0; i < nsucc; i++) {
+            int64_t succ_depth = depth;
+            if (op == NIM_OPCODE_FORITER && i == 0) {
+                succ_depth = depths[pc];
+            }
+            if (depths[succ[i]] < 0) {
+                depths[succ[i]] = succ_depth;
+                work[nwork++] = succ[i];
+            }
+            else if (depths[succ[i]] != succ_depth) {
+                goto error;
+            }
+        }
+    }
+
+    NIM_CODE(self)->verified = NIM_TRUE;
+    NIM_CODE(self)->max_stack = max_stack;
+    ok = NIM_TRUE;
+
+error:
+    NIM_FREE (depths);
+    NIM_FREE (work);
+    return ok;
+}
+
+const char *
 nim_code_opcode_str (NimOpcode op)
 {
     switch (op) {
@@ -578,10 +1775,24 @@ nim_code_opcode_str (NimOpcode op)
              return "JUMP";
         case NIM_OPCODE_PUSHCONST:
              return "PUSHCONST";
+        case NIM_OPCODE_CLONECONST:
+             return "CLONECONST";
         case NIM_OPCODE_STORENAME:
              return "STORENAME";
         case NIM_OPCODE_PUSHNAME:
              return "PUSHNAME";
+        case NIM_OPCODE_PUSHLOCAL:
+             return "PUSHLOCAL";
+        case NIM_OPCODE_STORELOCAL:
+             return "STORELOCAL";
+        case NIM_OPCODE_PUSHUPVAL:
+             return "PUSHUPVAL";
+        case NIM_OPCODE_STOREUPVAL:
+             return "STOREUPVAL";
+        case NIM_OPCODE_LOADGLOBAL:
+             return "LOADGLOBAL";
+        case NIM_OPCODE_LOADBUILTIN:
+             return "LOADBUILTIN";
         case NIM_OPCODE_PUSHNIL:
              return "PUSHNIL";
         case NIM_OPCODE_GETATTR:
@@ -590,6 +1801,10 @@ nim_code_opcode_str (NimOpcode op)
              return "GETITEM";
         case NIM_OPCODE_CALL:
              return "CALL";
+        case NIM_OPCODE_CALLMETHOD:
+             return "CALLMETHOD";
+        case NIM_OPCODE_TAILCALL:
+             return "TAILCALL";
         case NIM_OPCODE_MAKEARRAY:
              return "MAKEARRAY";
         case NIM_OPCODE_MAKEHASH:
@@ -626,8 +1841,52 @@ nim_code_opcode_str (NimOpcode op)
              return "DUP";
         case NIM_OPCODE_GETCLASS:
              return "GETCLASS";
+        case NIM_OPCODE_EXTENDED_ARG:
+             return "EXTENDED_ARG";
         case NIM_OPCODE_MAKECLOSURE:
              return "MAKECLOSURE";
+        case NIM_OPCODE_GETITER:
+             return "GETITER";
+        case NIM_OPCODE_FORITER:
+             return "FOR_ITER";
+        case NIM_OPCODE_YIELD:
+             return "YIELD";
+        case NIM_OPCODE_ADD_INT:
+             return "ADD_INT";
+        case NIM_OPCODE_SUB_INT:
+             return "SUB_INT";
+        case NIM_OPCODE_MUL_INT:
+             return "MUL_INT";
+        case NIM_OPCODE_DIV_INT:
+             return "DIV_INT";
+        case NIM_OPCODE_CMPEQ_INT:
+             return "CMP_EQ_INT";
+        case NIM_OPCODE_CMPNEQ_INT:
+             return "CMP_NEQ_INT";
+        case NIM_OPCODE_CMPGT_INT:
+             return "CMP_GT_INT";
+        case NIM_OPCODE_CMPGTE_INT:
+             return "CMP_GTE_INT";
+        case NIM_OPCODE_CMPLT_INT:
+             return "CMP_LT_INT";
+        case NIM_OPCODE_CMPLTE_INT:
+             return "CMP_LTE_INT";
+        case NIM_OPCODE_JUMPIFNOTEQ:
+             return "JUMP_IF_NOT_EQ";
+        case NIM_OPCODE_JUMPIFNOTNEQ:
+             return "JUMP_IF_NOT_NEQ";
+        case NIM_OPCODE_JUMPIFNOTGT:
+             return "JUMP_IF_NOT_GT";
+        case NIM_OPCODE_JUMPIFNOTGTE:
+             return "JUMP_IF_NOT_GTE";
+        case NIM_OPCODE_JUMPIFNOTLT:
+             return "JUMP_IF_NOT_LT";
+        case NIM_OPCODE_JUMPIFNOTLTE:
+             return "JUMP_IF_NOT_LTE";
+        case NIM_OPCODE_ADDNAMECONST:
+             return "ADD_NAME_CONST";
+        case NIM_OPCODE_ADDLOCALCONST:
+             return "ADD_LOCAL_CONST";
         default:
              return "???OPCODE???";
     };
@@ -653,7 +1912,8 @@ nim_code_dump (NimRef *self)
         if (!nim_str_append_str (str, op_str)) {
             return NULL;
         }
-        if (op == NIM_OPCODE_PUSHNAME || op == NIM_OPCODE_STORENAME || op == NIM_OPCODE_GETATTR) {
+        if (op == NIM_OPCODE_PUSHNAME || op == NIM_OPCODE_STORENAME ||
+                op == NIM_OPCODE_GETATTR || op == NIM_OPCODE_LOADGLOBAL) {
             if (!nim_str_append_str (str, " ")) {
                 return NULL;
             }
@@ -661,7 +1921,21 @@ nim_code_dump (NimRef *self)
                 return NULL;
             }
         }
-        else if (op == NIM_OPCODE_PUSHCONST) {
+        else if (op == NIM_OPCODE_CALLMETHOD) {
+            if (!nim_str_append_str (str, " ")) {
+                return NULL;
+            }
+            if (!nim_str_append (str, NIM_INSTR_NAME1(self, i))) {
+                return NULL;
+            }
+            if (!nim_str_append_str (str, " ")) {
+                return NULL;
+            }
+            if (!nim_str_append (str, nim_int_new (NIM_INSTR_ARG2(self, i)))) {
+                return NULL;
+            }
+        }
+        else if (op == NIM_OPCODE_PUSHCONST || op == NIM_OPCODE_CLONECONST) {
             if (!nim_str_append_str (str, " ")) {
                 return NULL;
             }
@@ -669,15 +1943,64 @@ nim_code_dump (NimRef *self)
                 return NULL;
             }
         }
-        else if (op == NIM_OPCODE_MAKEARRAY || op == NIM_OPCODE_MAKEHASH || op == NIM_OPCODE_CALL) {
+        else if (op == NIM_OPCODE_PUSHLOCAL || op == NIM_OPCODE_STORELOCAL) {
+            if (!nim_str_append_str (str, " ")) {
+                return NULL;
+            }
+            if (!nim_str_append (str, NIM_ARRAY_ITEM(
+                    NIM_CODE(self)->vars, NIM_INSTR_EXTARG1(self, i)))) {
+                return NULL;
+            }
+        }
+        else if (op == NIM_OPCODE_PUSHUPVAL || op == NIM_OPCODE_STOREUPVAL) {
+            if (!nim_str_append_str (str, " ")) {
+                return NULL;
+            }
+            if (!nim_str_append (str, NIM_ARRAY_ITEM(
+                    NIM_CODE(self)->freevars, NIM_INSTR_EXTARG1(self, i)))) {
+                return NULL;
+            }
+        }
+        else if (op == NIM_OPCODE_MAKEARRAY || op == NIM_OPCODE_MAKEHASH ||
+                op == NIM_OPCODE_CALL || op == NIM_OPCODE_TAILCALL ||
+                op == NIM_OPCODE_LOADBUILTIN) {
+            if (!nim_str_append_str (str, " ")) {
+                return NULL;
+            }
+            if (!nim_str_append (str, nim_int_new (NIM_INSTR_EXTARG1(self, i)))) {
+                return NULL;
+            }
+        }
+        else if (op == NIM_OPCODE_ADDLOCALCONST) {
+            if (!nim_str_append_str (str, " ")) {
+                return NULL;
+            }
+            if (!nim_str_append (str, NIM_ARRAY_ITEM(
+                    NIM_CODE(self)->vars, NIM_INSTR_EXTARG1(self, i)))) {
+                return NULL;
+            }
+            if (!nim_str_append_str (str, " ")) {
+                return NULL;
+            }
+            if (!nim_str_append (str, NIM_INSTR_CONST2(self, i))) {
+                return NULL;
+            }
+        }
+        else if (op == NIM_OPCODE_ADDNAMECONST) {
+            if (!nim_str_append_str (str, " ")) {
+                return NULL;
+            }
+            if (!nim_str_append (str, NIM_INSTR_NAME1(self, i))) {
+                return NULL;
+            }
             if (!nim_str_append_str (str, " ")) {
                 return NULL;
             }
-            if (!nim_str_append (str, nim_int_new (NIM_INSTR_ARG1(self, i)))) {
+            if (!nim_str_append (str, NIM_INSTR_CONST2(self, i))) {
                 return NULL;
             }
         }
-        else if (op == NIM_OPCODE_JUMP || op == NIM_OPCODE_JUMPIFTRUE || op == NIM_OPCODE_JUMPIFFALSE) {
+        else if (NIM_OPCODE_IS_JUMP(op)) {
             if (!nim_str_append_str (str, " ")) {
                 return NULL;
             }
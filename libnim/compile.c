@@ -24,9 +24,11 @@
 #include "nim/ast.h"
 #include "nim/code.h"
 #include "nim/array.h"
+#include "nim/hash.h"
 #include "nim/int.h"
 #include "nim/method.h"
 #include "nim/object.h"
+#include "nim/optimize.h"
 #include "nim/task.h"
 #include "nim/_parser.h"
 #include "nim/symtable.h"
@@ -60,11 +62,28 @@ typedef struct _NimLoopStack {
 } NimLoopStack;
 
 typedef struct _NimCodeCompiler {
+    /* the AST, symbol tables & units all live here until we're done */
+    NimArena     *arena;
+    NimArena     *prev_arena;
     NimCodeUnit  *current_unit;
+    /* the value of each unit in current_unit: the units are arena */
+    /* memory the GC never looks in, but it finds this via the C stack */
+    NimRef       *units;
     NimLoopStack  loop_stack;
     NimRef       *symtable;
+    /* instruction counts before & after optimization, for the module */
+    size_t        emitted;
+    size_t        optimized;
+    /* module-level functions we can inline: name -> decl (or nil) */
+    NimRef       *inlinable;
+    /* while inlining: the callee's locals -> their slots' names */
+    NimRef       *inline_vars;
+    size_t        inlined;
 } NimCodeCompiler;
 
+/* module-level functions no bigger than this (in AST nodes) get inlined */
+#define NIM_INLINE_MAX_NODES 24
+
 /* the NimBind* structures are used for pattern matching */
 
 typedef struct _NimBindPathItem {
@@ -230,17 +249,16 @@ nim_compile_ast_stmt_pattern_test (
 static void
 nim_code_compiler_cleanup (NimCodeCompiler *c)
 {
-    while (c->current_unit != NULL) {
-        NimCodeUnit *unit = c->current_unit;
-        NimCodeUnit *next = unit->next;
-        NIM_FREE (unit);
-        unit = next;
-        c->current_unit = NULL;
-    }
+    c->current_unit = NULL;
     if (c->loop_stack.items != NULL) {
         free (c->loop_stack.items);
         c->loop_stack.items = NULL;
     }
+    if (c->arena != NULL) {
+        nim_gc_arena_enter (NULL, c->prev_arena);
+        nim_gc_arena_delete (NULL, c->arena);
+        c->arena = NULL;
+    }
 }
 
 static NimLabel *
@@ -292,7 +310,7 @@ static NimRef *
 nim_code_compiler_push_unit (
     NimCodeCompiler *c, NimUnitType type, NimRef *scope, NimRef *value)
 {
-    NimCodeUnit *unit = NIM_MALLOC(NimCodeUnit, sizeof(*unit));
+    NimCodeUnit *unit = nim_gc_arena_alloc (c->arena, sizeof(*unit));
     if (unit == NULL) {
         return NULL;
     }
@@ -310,23 +328,19 @@ nim_code_compiler_push_unit (
             break;
         default:
             NIM_BUG ("unknown unit type: %d", type);
-            NIM_FREE (unit);
             return NULL;
     };
-    if (unit->value == NULL) {
-        NIM_FREE (unit);
+    if (unit->value == NULL || !nim_array_push (c->units, unit->value)) {
         return NULL;
     }
     unit->type = type;
     unit->next = c->current_unit;
     unit->ste = nim_symtable_lookup (c->symtable, scope);
     if (unit->ste == NULL) {
-        NIM_FREE (unit);
         NIM_BUG ("symtable lookup error for scope %p", scope);
         return NULL;
     }
     if (unit->ste == nim_nil) {
-        NIM_FREE (unit);
         NIM_BUG ("symtable lookup failed for scope %p", scope);
         return NULL;
     }
@@ -365,7 +379,7 @@ nim_code_compiler_pop_unit (NimCodeCompiler *c, NimUnitType expected)
         return NULL;
     }
     c->current_unit = unit->next;
-    NIM_FREE(unit);
+    nim_array_pop (c->units);
     if (c->current_unit != NULL) {
         return c->current_unit->value;
     }
@@ -392,6 +406,92 @@ nim_code_compiler_pop_class_unit (NimCodeCompiler *c)
     return nim_code_compiler_pop_unit (c, NIM_UNIT_TYPE_CLASS);
 }
 
+static nim_bool_t
+nim_compile_is_module_symbol (NimCodeCompiler *c, NimRef *name)
+{
+    NimRef *ste = NIM_COMPILER_SYMTABLE_ENTRY(c);
+    while (ste != nim_nil) {
+        if ((NIM_SYMTABLE_ENTRY(ste)->flags & NIM_SYM_TYPE_MASK) ==
+                NIM_SYM_MODULE) {
+            return nim_symtable_entry_sym_exists (ste, name);
+        }
+        ste = NIM_SYMTABLE_ENTRY(ste)->parent;
+    }
+    return NIM_FALSE;
+}
+
+/* an inlined body sees only its own locals (in their new slots) & */
+/* module-level names: never the locals of the function it's inlined into */
+static nim_bool_t
+nim_compile_inline_var (NimCodeCompiler *c, NimRef *name, int32_t *slot)
+{
+    NimRef *renamed;
+
+    if (nim_hash_get (c->inline_vars, name, &renamed) != 0) {
+        *slot = -1;
+        return NIM_FALSE;
+    }
+    *slot = nim_code_find_var (NIM_COMPILER_CODE(c), renamed);
+    return NIM_TRUE;
+}
+
+/* locals & free vars get slots, builtins get their index & module-level */
+/* names are looked up by name (through a per-instruction cache). */
+static nim_bool_t
+nim_compile_load_name (NimCodeCompiler *c, NimRef *name)
+{
+    NimRef *code = NIM_COMPILER_CODE(c);
+    int32_t slot;
+
+    if (c->inline_vars != NULL) {
+        if (nim_compile_inline_var (c, name, &slot)) {
+            return nim_code_pushlocal (code, slot);
+        }
+    }
+    else {
+        slot = nim_code_find_var (code, name);
+        if (slot >= 0) {
+            return nim_code_pushlocal (code, slot);
+        }
+        slot = nim_code_find_freevar (code, name);
+        if (slot >= 0) {
+            return nim_code_pushupval (code, slot);
+        }
+    }
+    /* module-level names shadow builtins */
+    if (!nim_compile_is_module_symbol (c, name)) {
+        slot = nim_builtin_index (name);
+        if (slot >= 0) {
+            return nim_code_loadbuiltin (code, slot);
+        }
+    }
+    return nim_code_loadglobal (code, name);
+}
+
+static nim_bool_t
+nim_compile_store_name (NimCodeCompiler *c, NimRef *name)
+{
+    NimRef *code = NIM_COMPILER_CODE(c);
+    int32_t slot;
+
+    if (c->inline_vars != NULL) {
+        if (nim_compile_inline_var (c, name, &slot)) {
+            return nim_code_storelocal (code, slot);
+        }
+    }
+    else {
+        slot = nim_code_find_var (code, name);
+        if (slot >= 0) {
+            return nim_code_storelocal (code, slot);
+        }
+        slot = nim_code_find_freevar (code, name);
+        if (slot >= 0) {
+            return nim_code_storeupval (code, slot);
+        }
+    }
+    return nim_code_storename (code, name);
+}
+
 static nim_bool_t
 nim_compile_ast_stmts (NimCodeCompiler *c, NimRef *stmts)
 {
@@ -450,13 +550,12 @@ nim_compile_ast_stmt_assign (NimCodeCompiler *c, NimRef *stmt)
 {
     NimRef *name =
         NIM_AST_EXPR(NIM_AST_STMT(stmt)->assign.target)->ident.id;
-    NimRef *code = NIM_COMPILER_CODE(c);
 
     if (!nim_compile_ast_expr (c, NIM_AST_STMT(stmt)->assign.value)) {
         return NIM_FALSE;
     }
 
-    if (!nim_code_storename (code, name)) {
+    if (!nim_compile_store_name (c, name)) {
         return NIM_FALSE;
     }
     return NIM_TRUE;
@@ -471,12 +570,15 @@ nim_compile_ast_stmt_while_ (NimCodeCompiler *c, NimRef *stmt)
     
     nim_code_use_label (code, &start_body);
 
-    if (!nim_compile_ast_expr (c, NIM_AST_STMT(stmt)->while_.expr))
+    /* a NULL expr is a loop the optimizer knows never stops */
+    if (NIM_AST_STMT(stmt)->while_.expr != NULL &&
+            !nim_compile_ast_expr (c, NIM_AST_STMT(stmt)->while_.expr))
         goto error;
 
     end_body = nim_code_compiler_begin_loop (c);
 
-    if (!nim_code_jumpiffalse (code, end_body))
+    if (NIM_AST_STMT(stmt)->while_.expr != NULL &&
+            !nim_code_jumpiffalse (code, end_body))
         goto error;
 
     if (!nim_compile_ast_stmts (c, NIM_AST_STMT(stmt)->while_.body))
@@ -497,24 +599,73 @@ error:
     return NIM_FALSE;
 }
 
+/*
+ *   <expr>
+ *   GETITER
+ * start:
+ *   FORITER end
+ *   <store name>
+ *   <body>
+ *   JUMP start
+ * end:
+ *   POP
+ *
+ * 'break' jumps to end too, so the POP cleans up the iterator either way.
+ */
 static nim_bool_t
-nim_compile_ast_stmt_array_pattern_test (
+nim_compile_ast_stmt_for_ (NimCodeCompiler *c, NimRef *stmt)
+{
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimLabel start_body = NIM_LABEL_INIT;
+    NimLabel *end_body = NULL;
+
+    if (!nim_compile_ast_expr (c, NIM_AST_STMT(stmt)->for_.expr))
+        goto error;
+
+    if (!nim_code_getiter (code))
+        goto error;
+
+    nim_code_use_label (code, &start_body);
+
+    end_body = nim_code_compiler_begin_loop (c);
+
+    if (!nim_code_foriter (code, end_body))
+        goto error;
+
+    if (!nim_compile_store_name (c, NIM_AST_STMT(stmt)->for_.name))
+        goto error;
+
+    if (!nim_compile_ast_stmts (c, NIM_AST_STMT(stmt)->for_.body))
+        goto error;
+
+    if (!nim_code_jump (code, &start_body))
+        goto error;
+
+    nim_code_compiler_end_loop (c);
+
+    if (!nim_code_pop (code))
+        return NIM_FALSE;
+
+    return NIM_TRUE;
+
+error:
+    nim_label_free (&start_body);
+    if (end_body != NULL) {
+        nim_code_compiler_end_loop (c);
+    }
+    return NIM_FALSE;
+}
+
+/* is the value on top of the stack an array (or a range)? */
+static nim_bool_t
+nim_compile_ast_stmt_sequence_class_test (
     NimCodeCompiler *c,
-    NimRef *array,
-    NimBindPath *path,
-    NimBindVars *vars,
     NimLabel *next_label
 )
 {
-    NimRef *size;
-    size_t i;
     NimRef *code = NIM_COMPILER_CODE(c);
-    NimLabel pop_label = NIM_LABEL_INIT;
-    NimLabel end_label = NIM_LABEL_INIT;
-
-    /* XXX need to free labels when things go bad */
+    NimLabel is_array_label = NIM_LABEL_INIT;
 
-    /* is the value an array ? */
     if (!nim_code_dup (code)) {
         return NIM_FALSE;
     }
@@ -523,7 +674,7 @@ nim_compile_ast_stmt_array_pattern_test (
         return NIM_FALSE;
     }
 
-    if (!nim_code_pushname (code, NIM_STR_NEW("array"))) {
+    if (!nim_compile_load_name (c, NIM_STR_NEW("array"))) {
         return NIM_FALSE;
     }
 
@@ -531,28 +682,20 @@ nim_compile_ast_stmt_array_pattern_test (
         return NIM_FALSE;
     }
 
-    if (!nim_code_jumpiffalse (code, next_label)) {
+    if (!nim_code_jumpiftrue (code, &is_array_label)) {
         return NIM_FALSE;
     }
 
+    /* ranges match too: size & getitem work without materializing them */
     if (!nim_code_dup (code)) {
         return NIM_FALSE;
     }
 
-    if (!nim_code_getattr (code, NIM_STR_NEW("size"))) {
-        return NIM_FALSE;
-    }
-
-    if (!nim_code_call (code, 0)) {
-        return NIM_FALSE;
-    }
-
-    size = nim_int_new (NIM_ARRAY_SIZE(array));
-    if (size == NULL) {
+    if (!nim_code_getclass (code)) {
         return NIM_FALSE;
     }
 
-    if (!nim_code_pushconst (code, size)) {
+    if (!nim_compile_load_name (c, NIM_STR_NEW("range"))) {
         return NIM_FALSE;
     }
 
@@ -564,7 +707,28 @@ nim_compile_ast_stmt_array_pattern_test (
         return NIM_FALSE;
     }
 
-    for (i = 0; i < NIM_ARRAY_SIZE(array); i++) {
+    nim_code_use_label (code, &is_array_label);
+
+    return NIM_TRUE;
+}
+
+/* tests the items of an array pattern from first onwards */
+static nim_bool_t
+nim_compile_ast_stmt_array_items_test (
+    NimCodeCompiler *c,
+    NimRef *array,
+    size_t first,
+    NimBindPath *path,
+    NimBindVars *vars,
+    NimLabel *next_label
+)
+{
+    size_t i;
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimLabel pop_label = NIM_LABEL_INIT;
+    NimLabel end_label = NIM_LABEL_INIT;
+
+    for (i = first; i < NIM_ARRAY_SIZE(array); i++) {
         NimRef *item = NIM_ARRAY_ITEM(array, i);
 
         if (!nim_code_dup (code)) {
@@ -610,6 +774,58 @@ nim_compile_ast_stmt_array_pattern_test (
     return NIM_TRUE;
 }
 
+static nim_bool_t
+nim_compile_ast_stmt_array_pattern_test (
+    NimCodeCompiler *c,
+    NimRef *array,
+    NimBindPath *path,
+    NimBindVars *vars,
+    NimLabel *next_label
+)
+{
+    NimRef *size;
+    NimRef *code = NIM_COMPILER_CODE(c);
+
+    /* XXX need to free labels when things go bad */
+
+    /* is the value an array ? */
+    if (!nim_compile_ast_stmt_sequence_class_test (c, next_label)) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_dup (code)) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_getattr (code, NIM_STR_NEW("size"))) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_call (code, 0)) {
+        return NIM_FALSE;
+    }
+
+    size = nim_int_new (NIM_ARRAY_SIZE(array));
+    if (size == NULL) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_pushconst (code, size)) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_eq (code)) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_jumpiffalse (code, next_label)) {
+        return NIM_FALSE;
+    }
+
+    return nim_compile_ast_stmt_array_items_test (
+                c, array, 0, path, vars, next_label);
+}
+
 static nim_bool_t
 nim_compile_ast_stmt_hash_pattern_test (
     NimCodeCompiler *c,
@@ -632,7 +848,7 @@ nim_compile_ast_stmt_hash_pattern_test (
         return NIM_FALSE;
     }
 
-    if (!nim_code_pushname (code, NIM_STR_NEW("hash"))) {
+    if (!nim_compile_load_name (c, NIM_STR_NEW("hash"))) {
         return NIM_FALSE;
     }
 
@@ -794,7 +1010,7 @@ nim_compile_ast_stmt_simple_pattern_test (
                 return NIM_FALSE;
             }
         }
-        else if (!nim_code_pushname (code,
+        else if (!nim_compile_load_name (c,
                 nim_str_new (class_name, strlen(class_name)))) {
             return NIM_FALSE;
         }
@@ -941,552 +1157,1649 @@ nim_compile_ast_stmt_pattern_test (
     return NIM_TRUE;
 }
 
+/* the tested value is on the stack: bind vars, pop it & run the body */
 static nim_bool_t
-nim_compile_ast_stmt_match (NimCodeCompiler *c, NimRef *stmt)
+nim_compile_ast_stmt_match_body (
+    NimCodeCompiler *c,
+    NimBindVars *bound,
+    NimRef *body,
+    NimLabel *end_label
+)
 {
-    size_t i;
-    NimLabel end_label = NIM_LABEL_INIT;
     NimRef *code = NIM_COMPILER_CODE(c);
-    NimRef *expr = NIM_AST_STMT(stmt)->match.expr;
-    NimRef *patterns = NIM_AST_STMT(stmt)->match.body;
-    const size_t size = NIM_ARRAY_SIZE(patterns);
-
-    if (!nim_compile_ast_expr (c, expr)) {
-        nim_label_free (&end_label);
-        return NIM_FALSE;
-    }
-
-    for (i = 0; i < size; i++) {
-        NimLabel next_label = NIM_LABEL_INIT;
-        NimRef *pattern = NIM_ARRAY_ITEM(patterns, i);
-        NimRef *test = NIM_AST_STMT(pattern)->pattern.test;
-        NimRef *body = NIM_AST_STMT(pattern)->pattern.body;
-        size_t j, k;
-        NimBindPath path;
-        NimBindVars bound;
+    size_t j, k;
 
-        NIM_BIND_PATH_INIT(&path);
-        NIM_BIND_VARS_INIT(&bound);
+    for (j = 0; j < bound->size; j++) {
+        const NimBindPath *var_path = &bound->items[j].path;
 
-        /* try to match the value against this test. if we fail, jump to next_label */
-        if (!nim_compile_ast_stmt_pattern_test (c, test, &path, &bound, &next_label)) {
-            nim_label_free (&end_label);
+        if (!nim_code_dup (code)) {
             return NIM_FALSE;
         }
 
-        /* pattern test succeeded: bind pattern vars (if any) */
-        for (j = 0; j < bound.size; j++) {
-            const NimBindPath *var_path = &bound.items[j].path;
-
-            if (!nim_code_dup (code)) {
-                return NIM_FALSE;
-            }
-
-            for (k = 0; k < var_path->size; k++) {
-                if (var_path->items[k].type == NIM_BIND_PATH_ITEM_TYPE_ARRAY) {
-                    size_t index = var_path->items[k].array_index;
+        for (k = 0; k < var_path->size; k++) {
+            if (var_path->items[k].type == NIM_BIND_PATH_ITEM_TYPE_ARRAY) {
+                size_t index = var_path->items[k].array_index;
 
-                    if (!nim_code_pushconst (code, nim_int_new (index))) {
-                        return NIM_FALSE;
-                    }
-
-                    if (!nim_code_getitem (code)) {
-                        return NIM_FALSE;
-                    }
+                if (!nim_code_pushconst (code, nim_int_new (index))) {
+                    return NIM_FALSE;
                 }
-                else if (var_path->items[k].type == NIM_BIND_PATH_ITEM_TYPE_HASH) {
-                    NimRef *key = var_path->items[k].hash_key;
 
-                    if (!nim_code_pushconst (code, key)) {
-                        return NIM_FALSE;
-                    }
+                if (!nim_code_getitem (code)) {
+                    return NIM_FALSE;
+                }
+            }
+            else if (var_path->items[k].type == NIM_BIND_PATH_ITEM_TYPE_HASH) {
+                NimRef *key = var_path->items[k].hash_key;
 
-                    if (!nim_code_getitem (code)) {
-                        return NIM_FALSE;
-                    }
+                if (!nim_code_pushconst (code, key)) {
+                    return NIM_FALSE;
                 }
-                else {
-                    /* simple binding: we're storing the matched value itself */
+
+                if (!nim_code_getitem (code)) {
+                    return NIM_FALSE;
                 }
             }
-            if (!nim_code_storename (code, bound.items[j].id)) {
-                return NIM_FALSE;
+            else {
+                /* simple binding: we're storing the matched value itself */
             }
         }
-
-        /* pop the value we're testing off the stack */
-        if (!nim_code_pop (code)) {
-            return NIM_FALSE;
-        }
-
-        /* successful match: execute the body */
-        if (!nim_compile_ast_stmts (c, body)) {
+        if (!nim_compile_store_name (c, bound->items[j].id)) {
             return NIM_FALSE;
         }
+    }
 
-        if (!nim_code_jump (code, &end_label)) {
-            return NIM_FALSE;
-        }
+    /* pop the value we're testing off the stack */
+    if (!nim_code_pop (code)) {
+        return NIM_FALSE;
+    }
 
-        nim_code_use_label (code, &next_label);
+    /* successful match: execute the body */
+    if (!nim_compile_ast_stmts (c, body)) {
+        return NIM_FALSE;
     }
 
-    nim_code_use_label (code, &end_label);
+    if (!nim_code_jump (code, end_label)) {
+        return NIM_FALSE;
+    }
 
     return NIM_TRUE;
 }
 
+/* one arm, tested on its own */
 static nim_bool_t
-nim_compile_ast_stmt_if_ (NimCodeCompiler *c, NimRef *stmt)
+nim_compile_ast_stmt_match_arm (
+    NimCodeCompiler *c,
+    NimRef *pattern,
+    NimLabel *end_label
+)
 {
-    NimRef *code = NIM_COMPILER_CODE(c);
-    NimLabel end_body = NIM_LABEL_INIT;
-    NimLabel end_orelse = NIM_LABEL_INIT;
-
-    if (!nim_compile_ast_expr (c, NIM_AST_STMT(stmt)->if_.expr))
-        goto error;
+    NimLabel next_label = NIM_LABEL_INIT;
+    NimRef *test = NIM_AST_STMT(pattern)->pattern.test;
+    NimRef *body = NIM_AST_STMT(pattern)->pattern.body;
+    NimBindPath path;
+    NimBindVars bound;
 
-    if (!nim_code_jumpiffalse (code, &end_body))
-        goto error;
+    NIM_BIND_PATH_INIT(&path);
+    NIM_BIND_VARS_INIT(&bound);
 
-    if (!nim_compile_ast_stmts (c, NIM_AST_STMT(stmt)->if_.body))
-        goto error;
+    /* try to match the value against this test. if we fail, jump to next_label */
+    if (!nim_compile_ast_stmt_pattern_test (c, test, &path, &bound, &next_label)) {
+        return NIM_FALSE;
+    }
 
-    if (NIM_AST_STMT(stmt)->if_.orelse != NULL) {
+    if (!nim_compile_ast_stmt_match_body (c, &bound, body, end_label)) {
+        return NIM_FALSE;
+    }
 
-        if (!nim_code_jump (code, &end_orelse))
-            goto error;
+    nim_code_use_label (NIM_COMPILER_CODE(c), &next_label);
 
-        nim_code_use_label (code, &end_body);
+    return NIM_TRUE;
+}
 
-        if (!nim_compile_ast_stmts (c, NIM_AST_STMT(stmt)->if_.orelse))
-            goto error;
+/*
+ * The literal an arm can be dispatched on before running its test: a str
+ * or int pattern itself, or the head of an array pattern (the tag of a
+ * message like ["ping", from]). NULL if there isn't one.
+ */
+static NimRef *
+nim_compile_match_key (NimRef *pattern, nim_bool_t *tagged)
+{
+    NimRef *test = NIM_AST_STMT(pattern)->pattern.test;
 
-        nim_code_use_label (code, &end_orelse);
+    *tagged = NIM_FALSE;
+    if (NIM_AST_EXPR_TYPE(test) == NIM_AST_EXPR_ARRAY) {
+        NimRef *items = NIM_AST_EXPR(test)->array.value;
+        if (NIM_ARRAY_SIZE(items) == 0) {
+            return NULL;
+        }
+        test = NIM_ARRAY_ITEM(items, 0);
+        *tagged = NIM_TRUE;
     }
-    else {
-        nim_code_use_label (code, &end_body);
+    switch (NIM_AST_EXPR_TYPE(test)) {
+        case NIM_AST_EXPR_STR:
+            return NIM_AST_EXPR(test)->str.value;
+        case NIM_AST_EXPR_INT_:
+            return NIM_AST_EXPR(test)->int_.value;
+        default:
+            return NULL;
     }
-
-    return NIM_TRUE;
-
-error:
-    nim_label_free (&end_body);
-    nim_label_free (&end_orelse);
-    return NIM_FALSE;
 }
 
-static nim_bool_t
-nim_compile_ast_stmt_ret (NimCodeCompiler *c, NimRef *stmt)
+/* how many arms from start on can share one decision tree: they need */
+/* keys of the same class, all tagged or all not. */
+static size_t
+nim_compile_match_group_size (NimRef *patterns, size_t start)
 {
-    NimRef *code = NIM_COMPILER_CODE(c);
-    NimRef *expr = NIM_AST_STMT(stmt)->ret.expr;
-    if (expr != NULL) {
-        if (!nim_compile_ast_expr (c, expr)) {
-            return NIM_FALSE;
-        }
+    nim_bool_t tagged;
+    nim_bool_t other_tagged;
+    NimRef *key;
+    size_t i;
+
+    key = nim_compile_match_key (NIM_ARRAY_ITEM(patterns, start), &tagged);
+    if (key == NULL) {
+        return 0;
     }
-    else if (!nim_code_pushnil (code)) {
-        return NIM_FALSE;
+    for (i = start + 1; i < NIM_ARRAY_SIZE(patterns); i++) {
+        NimRef *other =
+            nim_compile_match_key (NIM_ARRAY_ITEM(patterns, i), &other_tagged);
+        if (other == NULL || other_tagged != tagged ||
+                NIM_ANY_CLASS(other) != NIM_ANY_CLASS(key)) {
+            break;
+        }
     }
+    return i - start;
+}
 
-    if (!nim_code_ret (code)) {
-        return NIM_FALSE;
+static int
+nim_compile_match_key_cmp (const void *a, const void *b)
+{
+    switch (nim_object_cmp (*(NimRef **) a, *(NimRef **) b)) {
+        case NIM_CMP_LT:
+            return -1;
+        case NIM_CMP_GT:
+            return 1;
+        default:
+            return 0;
     }
-
-    return NIM_TRUE;
 }
 
+/*
+ * Binary search for the value on top of the stack in the sorted keys,
+ * jumping to the matching leaf (or miss) with the value still on the
+ * stack. A value of another class can't equal any key, so wherever the
+ * CMPLTs send it the final CMPEQ fails.
+ */
 static nim_bool_t
-nim_compile_ast_stmt_break_ (NimCodeCompiler *c, NimRef *stmt)
+nim_compile_match_search (
+    NimCodeCompiler *c,
+    NimRef **keys,
+    NimLabel *leaves,
+    size_t lo,
+    size_t hi,
+    NimLabel *miss
+)
 {
     NimRef *code = NIM_COMPILER_CODE(c);
-    NimLabel *label = nim_code_compiler_get_loop_label (c);
-    if (label == NULL) {
-        return NIM_FALSE;
-    }
+    NimLabel right = NIM_LABEL_INIT;
+    const size_t mid = lo + (hi - lo) / 2;
 
-    if (!nim_code_jump (code, label)) {
+    if (!nim_code_dup (code)) {
         return NIM_FALSE;
     }
-
-    return NIM_TRUE;
-}
-
-static NimRef *
-nim_compile_get_nearest_unit_with_type (
-        NimCodeCompiler *c, NimUnitType type)
-{
-    if (c->current_unit->type == type) {
-        return NIM_COMPILER_SCOPE(c);
+    if (!nim_code_pushconst (code, keys[mid])) {
+        return NIM_FALSE;
     }
-    else {
-        NimCodeUnit *unit = c->current_unit;
-        if (unit == NULL) return NULL;
-        unit = unit->next;
-        while (unit != NULL) {
-            if (unit->type == type) {
-                return unit->value;
-            }
-            unit = unit->next;
+    if (hi - lo == 1) {
+        if (!nim_code_eq (code)) {
+            return NIM_FALSE;
         }
-        return NULL;
+        if (!nim_code_jumpiftrue (code, &leaves[lo])) {
+            return NIM_FALSE;
+        }
+        return nim_code_jump (code, miss);
     }
-}
-
-static NimRef *
-nim_compile_get_current_class (NimCodeCompiler *c)
-{
-    return nim_compile_get_nearest_unit_with_type (
-            c, NIM_UNIT_TYPE_CLASS);
-}
 
-static NimRef *
-nim_compile_get_current_module (NimCodeCompiler *c)
-{
-    return nim_compile_get_nearest_unit_with_type (
-            c, NIM_UNIT_TYPE_MODULE);
+    if (!nim_code_lt (code)) {
+        return NIM_FALSE;
+    }
+    if (!nim_code_jumpiffalse (code, &right)) {
+        return NIM_FALSE;
+    }
+    if (!nim_compile_match_search (c, keys, leaves, lo, mid, miss)) {
+        return NIM_FALSE;
+    }
+    nim_code_use_label (code, &right);
+    return nim_compile_match_search (c, keys, leaves, mid, hi, miss);
 }
 
-static NimRef *
-nim_compile_bytecode_method (NimCodeCompiler *c, NimRef *fn, NimRef *args, NimRef *body)
+/*
+ * Dispatches on the key of the arms in [start, end) -- only those of the
+ * given size, if they're tagged -- & emits each key's arms in their
+ * original order. Arms with different keys can't match the same value, so
+ * the first arm that matches is still the one that runs.
+ *
+ * On entry the stack holds the tested value & (if tagged) its head. Any
+ * failure leaves just the tested value on the stack & jumps to group_end.
+ */
+static nim_bool_t
+nim_compile_match_dispatch (
+    NimCodeCompiler *c,
+    NimRef *patterns,
+    size_t start,
+    size_t end,
+    size_t size,
+    nim_bool_t tagged,
+    NimLabel *group_end,
+    NimLabel *end_label
+)
 {
-    NimRef *mod;
-    NimRef *func_code;
-    NimRef *symbols;
-    NimRef *method;
-    NimRef *ste;
-    size_t i;
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimRef **keys;
+    NimLabel *leaves = NULL;
+    NimLabel miss = NIM_LABEL_INIT;
+    nim_bool_t unused;
+    size_t nkeys = 0;
+    size_t i, j;
 
-    func_code = nim_code_compiler_push_code_unit (c, fn);
-    if (func_code == NULL) {
-        return NULL;
+    keys = NIM_MALLOC(NimRef *, sizeof(NimRef *) * (end - start));
+    if (keys == NULL) {
+        return NIM_FALSE;
     }
-
-    ste = c->current_unit->ste;
-    symbols = NIM_SYMTABLE_ENTRY(ste)->symbols;
-    for (i = 0; i < NIM_HASH_SIZE(symbols); i++) {
-        NimRef *key = NIM_HASH(symbols)->keys[i];
-        NimRef *value = NIM_HASH(symbols)->values[i];
-        if (NIM_INT(value)->value & NIM_SYM_DECL) {
-            if (!nim_array_push (NIM_CODE(func_code)->vars, key)) {
-                NIM_BUG ("failed to push var name");
-                return NULL;
-            }
+    for (i = start; i < end; i++) {
+        NimRef *pattern = NIM_ARRAY_ITEM(patterns, i);
+        NimRef *test = NIM_AST_STMT(pattern)->pattern.test;
+        NimRef *key = nim_compile_match_key (pattern, &unused);
+        if (tagged && NIM_ARRAY_SIZE(NIM_AST_EXPR(test)->array.value) != size) {
+            continue;
         }
-        else if (NIM_INT(value)->value & NIM_SYM_FREE) {
-            if (!nim_array_push (NIM_CODE(func_code)->freevars, key)) {
-                NIM_BUG ("failed to push freevar name");
-                return NULL;
+        for (j = 0; j < nkeys; j++) {
+            if (nim_object_cmp (keys[j], key) == NIM_CMP_EQ) {
+                break;
             }
         }
-    }
-
-    /* unpack arguments */
-    for (i = 0; i < NIM_ARRAY_SIZE(args); i++) {
-        NimRef *var_decl = NIM_ARRAY_ITEM(args, NIM_ARRAY_SIZE(args) - i - 1);
-        if (!nim_code_storename (func_code, NIM_AST_DECL(var_decl)->var.name)) {
-            NIM_BUG ("failed to emit STORENAME instruction");
-            return NULL;
+        if (j == nkeys) {
+            keys[nkeys++] = key;
         }
     }
-    
-    if (!nim_compile_ast_stmts (c, body)) {
-        return NULL;
+    qsort (keys, nkeys, sizeof(NimRef *), nim_compile_match_key_cmp);
+
+    leaves = NIM_MALLOC(NimLabel, sizeof(NimLabel) * nkeys);
+    if (leaves == NULL) {
+        goto error;
     }
+    memset (leaves, 0, sizeof(NimLabel) * nkeys);
 
-    if (!nim_code_compiler_pop_code_unit (c)) {
-        return NULL;
+    if (!nim_compile_match_search (
+            c, keys, leaves, 0, nkeys, tagged ? &miss : group_end)) {
+        goto error;
     }
 
-    mod = nim_compile_get_current_module (c);
+    for (j = 0; j < nkeys; j++) {
+        nim_code_use_label (code, &leaves[j]);
 
-    if (getenv ("NIM_DEBUG_MODE")) {
-        fprintf (stderr, "%s\n", NIM_STR_DATA(nim_code_dump (func_code)));
-    }
-    method = nim_method_new_bytecode (mod, func_code);
-    if (method == NULL) {
-        return NULL;
-    }
+        if (tagged && !nim_code_pop (code)) {
+            goto error;
+        }
 
-    return method;
-}
+        for (i = start; i < end; i++) {
+            NimRef *pattern = NIM_ARRAY_ITEM(patterns, i);
+            NimRef *test = NIM_AST_STMT(pattern)->pattern.test;
+            NimRef *body = NIM_AST_STMT(pattern)->pattern.body;
+            NimRef *key = nim_compile_match_key (pattern, &unused);
+            NimLabel next_label = NIM_LABEL_INIT;
+            NimBindPath path;
+            NimBindVars bound;
+
+            if (nim_object_cmp (keys[j], key) != NIM_CMP_EQ) {
+                continue;
+            }
 
-static nim_bool_t
-nim_compile_ast_decl_func (NimCodeCompiler *c, NimRef *decl)
-{
-    NimRef *method;
-    NimRef *mod;
+            NIM_BIND_PATH_INIT(&path);
+            NIM_BIND_VARS_INIT(&bound);
 
-    method = nim_compile_bytecode_method (
-        c,
-        decl,
-        NIM_AST_DECL(decl)->func.args,
-        NIM_AST_DECL(decl)->func.body
-    );
-    if (method == NULL) {
-        return NIM_FALSE;
-    }
+            if (tagged) {
+                NimRef *items = NIM_AST_EXPR(test)->array.value;
+                if (NIM_ARRAY_SIZE(items) != size) {
+                    continue;
+                }
+                /* the class, size & head are already known to match */
+                NIM_BIND_PATH_PUSH_ARRAY(&path);
+                if (!nim_compile_ast_stmt_array_items_test (
+                        c, items, 1, &path, &bound, &next_label)) {
+                    goto error;
+                }
+                NIM_BIND_PATH_POP(&path);
+            }
 
-    if (NIM_COMPILER_IN_CODE(c)) {
-        NimRef *code = NIM_COMPILER_CODE(c);
-        if (!nim_code_pushconst (code, method)) {
-            return NIM_FALSE;
+            if (!nim_compile_ast_stmt_match_body (c, &bound, body, end_label)) {
+                goto error;
+            }
+
+            /* a literal always matches: any later arms can't run */
+            if (!tagged) {
+                break;
+            }
+
+            nim_code_use_label (code, &next_label);
         }
 
-        if (!nim_code_storename (code, NIM_AST_DECL(decl)->func.name)) {
-            return NIM_FALSE;
+        if (!nim_code_jump (code, group_end)) {
+            goto error;
         }
     }
-    else if (NIM_COMPILER_IN_CLASS(c)) {
-        NimRef *name = NIM_AST_DECL(decl)->func.name;
-        mod = nim_compile_get_current_class (c);
-        if (!nim_class_add_method (mod, name, method)) {
-            return NIM_FALSE;
+
+    if (tagged) {
+        nim_code_use_label (code, &miss);
+        if (!nim_code_pop (code)) {
+            goto error;
         }
-    }
-    else {
-        NimRef *name = NIM_AST_DECL(decl)->func.name;
-        mod = nim_compile_get_current_module (c);
-        if (!nim_module_add_local (mod, name, method)) {
-            return NIM_FALSE;
+        if (!nim_code_jump (code, group_end)) {
+            goto error;
         }
     }
 
+    NIM_FREE (keys);
+    NIM_FREE (leaves);
     return NIM_TRUE;
+
+error:
+    NIM_FREE (keys);
+    NIM_FREE (leaves);
+    return NIM_FALSE;
 }
 
+/*
+ * Compiles a group of arms (see nim_compile_match_group_size) as a
+ * decision tree: arrays are class-checked & sized once, then dispatched
+ * by size & head, so N message types cost O(log N) comparisons rather
+ * than N full pattern tests.
+ */
 static nim_bool_t
-nim_compile_ast_decl_class (NimCodeCompiler *c, NimRef *decl)
+nim_compile_match_tree (
+    NimCodeCompiler *c,
+    NimRef *patterns,
+    size_t start,
+    size_t end,
+    NimLabel *end_label
+)
 {
-    NimRef *mod;
-    NimRef *name = NIM_AST_DECL(decl)->class.name;
-    NimRef *base = NIM_AST_DECL(decl)->class.base;
-    NimRef *body = NIM_AST_DECL(decl)->class.body;
-    NimRef *base_ref = NULL;
-    NimRef *klass;
-    size_t i;
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimLabel group_end = NIM_LABEL_INIT;
+    NimLabel *size_labels = NULL;
+    size_t *sizes = NULL;
+    size_t nsizes = 0;
+    nim_bool_t tagged;
+    size_t i, j;
+
+    nim_compile_match_key (NIM_ARRAY_ITEM(patterns, start), &tagged);
+    if (!tagged) {
+        if (!nim_compile_match_dispatch (
+                c, patterns, start, end, 0, NIM_FALSE, &group_end, end_label)) {
+            return NIM_FALSE;
+        }
+        nim_code_use_label (code, &group_end);
+        return NIM_TRUE;
+    }
 
-    if (NIM_COMPILER_IN_CODE(c)) {
-        NIM_BUG ("Cannot declare classes inside functions");
-        return NIM_FALSE;
+    sizes = NIM_MALLOC(size_t, sizeof(size_t) * (end - start));
+    size_labels = NIM_MALLOC(NimLabel, sizeof(NimLabel) * (end - start));
+    if (sizes == NULL || size_labels == NULL) {
+        goto error;
     }
-    else if (NIM_COMPILER_IN_CLASS(c)) {
-        NIM_BUG ("Cannot declare nested classes");
+    memset (size_labels, 0, sizeof(NimLabel) * (end - start));
+    for (i = start; i < end; i++) {
+        NimRef *test = NIM_AST_STMT(NIM_ARRAY_ITEM(patterns, i))->pattern.test;
+        size_t size = NIM_ARRAY_SIZE(NIM_AST_EXPR(test)->array.value);
+        for (j = 0; j < nsizes; j++) {
+            if (sizes[j] == size) {
+                break;
+            }
+        }
+        if (j == nsizes) {
+            sizes[nsizes++] = size;
+        }
     }
 
-    mod = nim_compile_get_current_module (c);
-    if (mod == NULL) {
-        NIM_BUG ("get_current_module failed");
-        return NIM_FALSE;
+    if (!nim_compile_ast_stmt_sequence_class_test (c, &group_end)) {
+        goto error;
     }
 
-    /* resolve the base class */
-    /* XXX this feels kind of hacky */
-    if (NIM_ARRAY_SIZE(base) > 0) {
-        if (nim_is_builtin (nim_array_first (base))) {
-            int rc = nim_hash_get (
-                        nim_builtins, nim_array_first (base), &base_ref);
-            if (rc < 0) {
-                NIM_BUG ("is_builtin/hash_get failed");
-                return NIM_FALSE;
+    if (!nim_code_dup (code)) {
+        goto error;
+    }
+    if (!nim_code_getattr (code, NIM_STR_NEW("size"))) {
+        goto error;
+    }
+    if (!nim_code_call (code, 0)) {
+        goto error;
+    }
+    if (nsizes == 1) {
+        /* the common case: every message type has the same shape */
+        if (!nim_code_pushconst (code, nim_int_new (sizes[0]))) {
+            goto error;
+        }
+        if (!nim_code_eq (code)) {
+            goto error;
+        }
+        if (!nim_code_jumpiffalse (code, &group_end)) {
+            goto error;
+        }
+    }
+    else {
+        for (j = 0; j < nsizes; j++) {
+            if (!nim_code_dup (code)) {
+                goto error;
             }
-            else if (rc > 0) {
-                return NIM_FALSE;
+            if (!nim_code_pushconst (code, nim_int_new (sizes[j]))) {
+                goto error;
+            }
+            if (!nim_code_eq (code)) {
+                goto error;
+            }
+            if (!nim_code_jumpiftrue (code, &size_labels[j])) {
+                goto error;
             }
         }
-        else {
-            base_ref = mod;
-            for (i = 0; i < NIM_ARRAY_SIZE(base); i++) {
-                int rc;
-                NimRef *child;
-                NimRef *name;
-                if (i != NIM_ARRAY_SIZE(base)-1 && 
-                    NIM_ANY_CLASS(base_ref) != nim_module_class) {
-                    NIM_BUG ("Cannot resolve class on non-module type: %s",
-                        NIM_STR_DATA(name));
-                    return NIM_FALSE;
-                }
-                name = NIM_ARRAY_ITEM(base, i);
-                rc = nim_hash_get (
-                        NIM_MODULE_LOCALS(base_ref), name, &child);
-                if (rc < 0) {
-                    NIM_BUG ("Error");
-                    return NIM_FALSE;
-                }
-                else if (rc > 0) {
-                    NIM_BUG ("Module does not expose `%s`",
-                        NIM_STR_DATA(NIM_ARRAY_ITEM(base_ref, i)));
-                    return NIM_FALSE;
-                }
-                base_ref = child;
+        if (!nim_code_pop (code)) {
+            goto error;
+        }
+        if (!nim_code_jump (code, &group_end)) {
+            goto error;
+        }
+    }
+
+    for (j = 0; j < nsizes; j++) {
+        if (nsizes > 1) {
+            nim_code_use_label (code, &size_labels[j]);
+
+            /* drop the size */
+            if (!nim_code_pop (code)) {
+                goto error;
             }
         }
+
+        /* fetch the head */
+        if (!nim_code_dup (code)) {
+            goto error;
+        }
+        if (!nim_code_pushconst (code, nim_int_new (0))) {
+            goto error;
+        }
+        if (!nim_code_getitem (code)) {
+            goto error;
+        }
+
+        if (!nim_compile_match_dispatch (c, patterns, start, end,
+                sizes[j], NIM_TRUE, &group_end, end_label)) {
+            goto error;
+        }
     }
 
-    klass = nim_class_new (name, base_ref, sizeof(NimObject));
-    if (klass == NULL) {
+    nim_code_use_label (code, &group_end);
+
+    NIM_FREE (sizes);
+    NIM_FREE (size_labels);
+    return NIM_TRUE;
+
+error:
+    NIM_FREE (sizes);
+    NIM_FREE (size_labels);
+    return NIM_FALSE;
+}
+
+/* arms worth a decision tree: below this, testing in turn is as cheap */
+#define NIM_MATCH_TREE_MIN_ARMS 2
+
+static nim_bool_t
+nim_compile_ast_stmt_match (NimCodeCompiler *c, NimRef *stmt)
+{
+    size_t i;
+    NimLabel end_label = NIM_LABEL_INIT;
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimRef *expr = NIM_AST_STMT(stmt)->match.expr;
+    NimRef *patterns = NIM_AST_STMT(stmt)->match.body;
+    const size_t size = NIM_ARRAY_SIZE(patterns);
+
+    if (!nim_compile_ast_expr (c, expr)) {
+        nim_label_free (&end_label);
         return NIM_FALSE;
     }
 
-    if (!nim_code_compiler_push_class_unit (c, decl, klass)) {
-        return NIM_FALSE;
+    i = 0;
+    while (i < size) {
+        const size_t group = nim_compile_match_group_size (patterns, i);
+
+        if (group >= NIM_MATCH_TREE_MIN_ARMS) {
+            if (!nim_compile_match_tree (c, patterns, i, i + group, &end_label)) {
+                nim_label_free (&end_label);
+                return NIM_FALSE;
+            }
+            i += group;
+        }
+        else {
+            if (!nim_compile_ast_stmt_match_arm (
+                    c, NIM_ARRAY_ITEM(patterns, i), &end_label)) {
+                nim_label_free (&end_label);
+                return NIM_FALSE;
+            }
+            i++;
+        }
     }
-    if (!nim_compile_ast_decls (c, body)) {
+
+    /* nothing matched: the value we tested is still on the stack */
+    if (!nim_code_pop (code)) {
         return NIM_FALSE;
     }
-    if (!nim_code_compiler_pop_class_unit (c)) {
+
+    nim_code_use_label (code, &end_label);
+
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_compile_ast_stmt_if_ (NimCodeCompiler *c, NimRef *stmt)
+{
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimLabel end_body = NIM_LABEL_INIT;
+    NimLabel end_orelse = NIM_LABEL_INIT;
+
+    if (!nim_compile_ast_expr (c, NIM_AST_STMT(stmt)->if_.expr))
+        goto error;
+
+    if (!nim_code_jumpiffalse (code, &end_body))
+        goto error;
+
+    if (!nim_compile_ast_stmts (c, NIM_AST_STMT(stmt)->if_.body))
+        goto error;
+
+    if (NIM_AST_STMT(stmt)->if_.orelse != NULL) {
+
+        if (!nim_code_jump (code, &end_orelse))
+            goto error;
+
+        nim_code_use_label (code, &end_body);
+
+        if (!nim_compile_ast_stmts (c, NIM_AST_STMT(stmt)->if_.orelse))
+            goto error;
+
+        nim_code_use_label (code, &end_orelse);
+    }
+    else {
+        nim_code_use_label (code, &end_body);
+    }
+
+    return NIM_TRUE;
+
+error:
+    nim_label_free (&end_body);
+    nim_label_free (&end_orelse);
+    return NIM_FALSE;
+}
+
+/* any function containing a yield is a generator (see nim_code_yield) */
+static nim_bool_t
+nim_compile_ast_stmt_yield (NimCodeCompiler *c, NimRef *stmt)
+{
+    NimRef *code = NIM_COMPILER_CODE(c);
+
+    if (!nim_compile_ast_expr (c, NIM_AST_STMT(stmt)->yield.expr)) {
         return NIM_FALSE;
     }
 
-    if (!nim_module_add_local (mod, name, klass)) {
-        NIM_BUG ("Failed to add new class to module");
+    if (!nim_code_yield (code)) {
         return NIM_FALSE;
     }
+
     return NIM_TRUE;
 }
 
 static nim_bool_t
-nim_compile_ast_decl_use (NimCodeCompiler *c, NimRef *decl)
+nim_compile_ast_stmt_ret (NimCodeCompiler *c, NimRef *stmt)
 {
-    NimRef *module = NIM_COMPILER_MODULE(c);
-    NimRef *import;
-    NimRef *name;
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimRef *expr = NIM_AST_STMT(stmt)->ret.expr;
+    if (expr != NULL) {
+        if (!nim_compile_ast_expr (c, expr)) {
+            return NIM_FALSE;
+        }
+        /* ret f(x): f can reuse our frame */
+        if (NIM_AST_EXPR_TYPE(expr) == NIM_AST_EXPR_CALL &&
+                NIM_CODE_SIZE(code) > 0 &&
+                NIM_INSTR_OP(code, NIM_CODE_SIZE(code) - 1) ==
+                    NIM_OPCODE_CALL) {
+            if (!nim_code_tailcall (code)) {
+                return NIM_FALSE;
+            }
+        }
+    }
+    else if (!nim_code_pushnil (code)) {
+        return NIM_FALSE;
+    }
 
-    name = NIM_AST_DECL(decl)->use.name;
-    import = nim_module_mgr_load (name);
+    if (!nim_code_ret (code)) {
+        return NIM_FALSE;
+    }
 
-    if (import == NULL) {
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_compile_ast_stmt_break_ (NimCodeCompiler *c, NimRef *stmt)
+{
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimLabel *label = nim_code_compiler_get_loop_label (c);
+    if (label == NULL) {
         return NIM_FALSE;
     }
 
-    if (!nim_module_add_local (module, name, import)) {
+    if (!nim_code_jump (code, label)) {
         return NIM_FALSE;
     }
 
     return NIM_TRUE;
 }
 
-static nim_bool_t
-nim_compile_ast_decl_var (NimCodeCompiler *c, NimRef *decl)
+static NimRef *
+nim_compile_get_nearest_unit_with_type (
+        NimCodeCompiler *c, NimUnitType type)
 {
-    NimRef *scope = NIM_COMPILER_SCOPE(c);
-    NimRef *name = NIM_AST_DECL(decl)->var.name;
-    NimRef *value = NIM_AST_DECL(decl)->var.value;
+    if (c->current_unit->type == type) {
+        return NIM_COMPILER_SCOPE(c);
+    }
+    else {
+        NimCodeUnit *unit = c->current_unit;
+        if (unit == NULL) return NULL;
+        unit = unit->next;
+        while (unit != NULL) {
+            if (unit->type == type) {
+                return unit->value;
+            }
+            unit = unit->next;
+        }
+        return NULL;
+    }
+}
+
+static NimRef *
+nim_compile_get_current_class (NimCodeCompiler *c)
+{
+    return nim_compile_get_nearest_unit_with_type (
+            c, NIM_UNIT_TYPE_CLASS);
+}
+
+static NimRef *
+nim_compile_get_current_module (NimCodeCompiler *c)
+{
+    return nim_compile_get_nearest_unit_with_type (
+            c, NIM_UNIT_TYPE_MODULE);
+}
+
+static NimRef *
+nim_compile_bytecode_method (NimCodeCompiler *c, NimRef *fn, NimRef *args, NimRef *body)
+{
+    NimRef *mod;
+    NimRef *func_code;
+    NimRef *symbols;
+    NimRef *method;
+    NimRef *ste;
+    NimCodeUnit *outer;
+    size_t i;
+
+    func_code = nim_code_compiler_push_code_unit (c, fn);
+    if (func_code == NULL) {
+        return NULL;
+    }
+    outer = c->current_unit->next;
+
+    ste = c->current_unit->ste;
+    symbols = NIM_SYMTABLE_ENTRY(ste)->symbols;
+    for (i = 0; i < NIM_HASH_SIZE(symbols); i++) {
+        NimRef *key = NIM_HASH(symbols)->keys[i];
+        NimRef *value = NIM_HASH(symbols)->values[i];
+        if (NIM_INT(value)->value & NIM_SYM_DECL) {
+            if (!nim_array_push (NIM_CODE(func_code)->vars,
+                    nim_str_intern_ref (key))) {
+                NIM_BUG ("failed to push var name");
+                return NULL;
+            }
+        }
+        else if (NIM_INT(value)->value & NIM_SYM_FREE) {
+            /* resolve where MAKECLOSURE will find it in the outer frame */
+            int32_t slot = -1;
+            int32_t up = -1;
+            if (outer != NULL && outer->type == NIM_UNIT_TYPE_CODE) {
+                slot = nim_code_find_var (outer->code, key);
+                if (slot < 0) {
+                    up = nim_code_find_freevar (outer->code, key);
+                }
+            }
+            if (slot < 0 && up < 0) {
+                NIM_BUG ("free var %s not found in the enclosing function",
+                            NIM_STR_DATA(key));
+                return NULL;
+            }
+            if (slot < 0) {
+                slot = -up - 1;
+            }
+            if (!nim_code_add_freevar (func_code, key, slot)) {
+                NIM_BUG ("failed to push freevar name");
+                return NULL;
+            }
+        }
+    }
+
+    /* unpack arguments */
+    NIM_CODE(func_code)->nargs = NIM_ARRAY_SIZE(args);
+    for (i = 0; i < NIM_ARRAY_SIZE(args); i++) {
+        NimRef *var_decl = NIM_ARRAY_ITEM(args, NIM_ARRAY_SIZE(args) - i - 1);
+        if (!nim_compile_store_name (c, NIM_AST_DECL(var_decl)->var.name)) {
+            NIM_BUG ("failed to emit STORELOCAL instruction");
+            return NULL;
+        }
+    }
+    
+    if (!nim_compile_ast_stmts (c, body)) {
+        return NULL;
+    }
+
+    /* the value of a trailing expression statement is returned */
+    if (NIM_ARRAY_SIZE(body) > 0) {
+        NimRef *last = NIM_ARRAY_ITEM(body, NIM_ARRAY_SIZE(body) - 1);
+        if (NIM_ANY_CLASS(last) == nim_ast_stmt_class &&
+                NIM_AST_STMT_TYPE(last) == NIM_AST_STMT_EXPR) {
+            NimRef *expr = NIM_AST_STMT(last)->expr.expr;
+            if (!nim_code_unpop (func_code)) {
+                return NULL;
+            }
+            if (NIM_AST_EXPR_TYPE(expr) == NIM_AST_EXPR_CALL &&
+                    NIM_INSTR_OP(func_code, NIM_CODE_SIZE(func_code) - 1) ==
+                        NIM_OPCODE_CALL) {
+                if (!nim_code_tailcall (func_code)) {
+                    return NULL;
+                }
+            }
+            if (!nim_code_ret (func_code)) {
+                return NULL;
+            }
+        }
+    }
+
+    if (!nim_code_compiler_pop_code_unit (c)) {
+        return NULL;
+    }
+
+    c->emitted += NIM_CODE_SIZE(func_code);
+
+    if (nim_opt_level () > 0 &&
+            !nim_code_peephole (func_code, getenv ("NIM_DEBUG_MODE") != NULL)) {
+        return NULL;
+    }
+
+    if (!nim_code_optimize (func_code)) {
+        return NULL;
+    }
+
+    c->optimized += NIM_CODE_SIZE(func_code);
+
+    /* done adding constants & names */
+    nim_code_finish (func_code);
+
+    /* unverified code still runs, just without the fast path */
+    nim_code_verify (func_code);
+
+    mod = nim_compile_get_current_module (c);
+
+    if (getenv ("NIM_DEBUG_MODE")) {
+        fprintf (stderr, "%s\n", NIM_STR_DATA(nim_code_dump (func_code)));
+        if (!NIM_CODE(func_code)->verified) {
+            fprintf (stderr, "(failed verification)\n");
+        }
+    }
+    method = nim_method_new_bytecode (mod, func_code);
+    if (method == NULL) {
+        return NULL;
+    }
+
+    return method;
+}
+
+static nim_bool_t
+nim_compile_ast_decl_func (NimCodeCompiler *c, NimRef *decl)
+{
+    NimRef *method;
+    NimRef *mod;
+
+    method = nim_compile_bytecode_method (
+        c,
+        decl,
+        NIM_AST_DECL(decl)->func.args,
+        NIM_AST_DECL(decl)->func.body
+    );
+    if (method == NULL) {
+        return NIM_FALSE;
+    }
+
+    if (NIM_COMPILER_IN_CODE(c)) {
+        NimRef *code = NIM_COMPILER_CODE(c);
+        if (!nim_code_pushconst (code, method)) {
+            return NIM_FALSE;
+        }
+
+        if (NIM_ARRAY_SIZE(NIM_CODE(
+                NIM_METHOD(method)->bytecode.code)->freevars) > 0) {
+            if (!nim_code_makeclosure (code)) {
+                return NIM_FALSE;
+            }
+        }
+
+        if (!nim_compile_store_name (c, NIM_AST_DECL(decl)->func.name)) {
+            return NIM_FALSE;
+        }
+    }
+    else if (NIM_COMPILER_IN_CLASS(c)) {
+        NimRef *name = NIM_AST_DECL(decl)->func.name;
+        mod = nim_compile_get_current_class (c);
+        if (!nim_class_add_method (mod, name, method)) {
+            return NIM_FALSE;
+        }
+    }
+    else {
+        NimRef *name = NIM_AST_DECL(decl)->func.name;
+        mod = nim_compile_get_current_module (c);
+        if (!nim_module_add_local (mod, name, method)) {
+            return NIM_FALSE;
+        }
+    }
+
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_compile_ast_decl_class (NimCodeCompiler *c, NimRef *decl)
+{
+    NimRef *mod;
+    NimRef *name = NIM_AST_DECL(decl)->class.name;
+    NimRef *base = NIM_AST_DECL(decl)->class.base;
+    NimRef *body = NIM_AST_DECL(decl)->class.body;
+    NimRef *base_ref = NULL;
+    NimRef *klass;
+    size_t i;
+
+    if (NIM_COMPILER_IN_CODE(c)) {
+        NIM_BUG ("Cannot declare classes inside functions");
+        return NIM_FALSE;
+    }
+    else if (NIM_COMPILER_IN_CLASS(c)) {
+        NIM_BUG ("Cannot declare nested classes");
+    }
+
+    mod = nim_compile_get_current_module (c);
+    if (mod == NULL) {
+        NIM_BUG ("get_current_module failed");
+        return NIM_FALSE;
+    }
+
+    /* resolve the base class */
+    /* XXX this feels kind of hacky */
+    if (NIM_ARRAY_SIZE(base) > 0) {
+        if (nim_is_builtin (nim_array_first (base))) {
+            int rc = nim_hash_get (
+                        nim_builtins, nim_array_first (base), &base_ref);
+            if (rc < 0) {
+                NIM_BUG ("is_builtin/hash_get failed");
+                return NIM_FALSE;
+            }
+            else if (rc > 0) {
+                return NIM_FALSE;
+            }
+        }
+        else {
+            base_ref = mod;
+            for (i = 0; i < NIM_ARRAY_SIZE(base); i++) {
+                int rc;
+                NimRef *child;
+                NimRef *name;
+                if (i != NIM_ARRAY_SIZE(base)-1 && 
+                    NIM_ANY_CLASS(base_ref) != nim_module_class) {
+                    NIM_BUG ("Cannot resolve class on non-module type: %s",
+                        NIM_STR_DATA(name));
+                    return NIM_FALSE;
+                }
+                name = NIM_ARRAY_ITEM(base, i);
+                rc = nim_hash_get (
+                        NIM_MODULE_LOCALS(base_ref), name, &child);
+                if (rc < 0) {
+                    NIM_BUG ("Error");
+                    return NIM_FALSE;
+                }
+                else if (rc > 0) {
+                    NIM_BUG ("Module does not expose `%s`",
+                        NIM_STR_DATA(NIM_ARRAY_ITEM(base_ref, i)));
+                    return NIM_FALSE;
+                }
+                base_ref = child;
+            }
+        }
+    }
+
+    klass = nim_class_new (name, base_ref, sizeof(NimObject));
+    if (klass == NULL) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_code_compiler_push_class_unit (c, decl, klass)) {
+        return NIM_FALSE;
+    }
+    if (!nim_compile_ast_decls (c, body)) {
+        return NIM_FALSE;
+    }
+    if (!nim_code_compiler_pop_class_unit (c)) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_module_add_local (mod, name, klass)) {
+        NIM_BUG ("Failed to add new class to module");
+        return NIM_FALSE;
+    }
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_compile_ast_decl_use (NimCodeCompiler *c, NimRef *decl)
+{
+    NimRef *module = NIM_COMPILER_MODULE(c);
+    NimRef *import;
+    NimRef *name;
+
+    name = NIM_AST_DECL(decl)->use.name;
+    import = nim_module_mgr_load (name);
+
+    if (import == NULL) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_module_add_local (module, name, import)) {
+        return NIM_FALSE;
+    }
+
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_compile_ast_decl_var (NimCodeCompiler *c, NimRef *decl)
+{
+    NimRef *scope = NIM_COMPILER_SCOPE(c);
+    NimRef *name = NIM_AST_DECL(decl)->var.name;
+    NimRef *value = NIM_AST_DECL(decl)->var.value;
+
+    if (NIM_ANY_CLASS(scope) == nim_module_class) {
+        return nim_module_add_local (scope, name, value == NULL ? nim_nil : value);
+    }
+    else {
+        /* TODO it's really about time we get ourselves a symbol table */
+        if (value != NULL) {
+            if (!nim_compile_ast_expr (c, value)) {
+                return NIM_FALSE;
+            }
+
+            if (!nim_compile_store_name (c, name)) {
+                return NIM_FALSE;
+            }
+        }
+    }
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_compile_ast_decl (NimCodeCompiler *c, NimRef *decl)
+{
+    switch (NIM_AST_DECL_TYPE(decl)) {
+        case NIM_AST_DECL_FUNC:
+            return nim_compile_ast_decl_func (c, decl);
+        case NIM_AST_DECL_CLASS:
+            return nim_compile_ast_decl_class (c, decl);
+        case NIM_AST_DECL_USE:
+            return nim_compile_ast_decl_use (c, decl);
+        case NIM_AST_DECL_VAR:
+            return nim_compile_ast_decl_var (c, decl);
+        default:
+            NIM_BUG ("unknown AST stmt type: %d", NIM_AST_DECL_TYPE(decl));
+            return NIM_FALSE;
+    }
+}
+
+static nim_bool_t
+nim_compile_ast_stmt (NimCodeCompiler *c, NimRef *stmt)
+{
+    switch (NIM_AST_STMT_TYPE(stmt)) {
+        case NIM_AST_STMT_EXPR:
+            if (!nim_compile_ast_expr (c, NIM_AST_STMT(stmt)->expr.expr)) {
+                return NIM_FALSE;
+            }
+            /* clean up the stack when we're not saving the result */
+            if (!nim_code_pop (NIM_COMPILER_CODE(c))) {
+                return NIM_FALSE;
+            }
+            return NIM_TRUE;
+        case NIM_AST_STMT_ASSIGN:
+            return nim_compile_ast_stmt_assign (c, stmt);
+        case NIM_AST_STMT_IF_:
+            return nim_compile_ast_stmt_if_ (c, stmt);
+        case NIM_AST_STMT_WHILE_:
+            return nim_compile_ast_stmt_while_ (c, stmt);
+        case NIM_AST_STMT_FOR_:
+            return nim_compile_ast_stmt_for_ (c, stmt);
+        case NIM_AST_STMT_MATCH:
+            return nim_compile_ast_stmt_match (c, stmt);
+        case NIM_AST_STMT_RET:
+            return nim_compile_ast_stmt_ret (c, stmt);
+        case NIM_AST_STMT_YIELD:
+            return nim_compile_ast_stmt_yield (c, stmt);
+        case NIM_AST_STMT_BREAK_:
+            return nim_compile_ast_stmt_break_ (c, stmt);
+        default:
+            NIM_BUG ("unknown AST stmt type: %d", NIM_AST_STMT_TYPE(stmt));
+            return NIM_FALSE;
+    };
+}
+
+static nim_bool_t
+nim_compile_ast_expr (NimCodeCompiler *c, NimRef *expr)
+{
+    switch (NIM_AST_EXPR_TYPE(expr)) {
+        case NIM_AST_EXPR_CALL:
+            return nim_compile_ast_expr_call (c, expr);
+        case NIM_AST_EXPR_GETATTR:
+            return nim_compile_ast_expr_getattr (c, expr);
+        case NIM_AST_EXPR_GETITEM:
+            return nim_compile_ast_expr_getitem (c, expr);
+        case NIM_AST_EXPR_ARRAY:
+            return nim_compile_ast_expr_array (c, expr);
+        case NIM_AST_EXPR_HASH:
+            return nim_compile_ast_expr_hash (c, expr);
+        case NIM_AST_EXPR_IDENT:
+            return nim_compile_ast_expr_ident (c, expr);
+        case NIM_AST_EXPR_STR:
+            return nim_compile_ast_expr_str (c, expr);
+        case NIM_AST_EXPR_BOOL:
+            return nim_compile_ast_expr_bool (c, expr);
+        case NIM_AST_EXPR_NIL:
+            return nim_code_pushnil (NIM_COMPILER_CODE(c));
+        case NIM_AST_EXPR_BINOP:
+            return nim_compile_ast_expr_binop (c, expr);
+        case NIM_AST_EXPR_INT_:
+            return nim_compile_ast_expr_int_ (c, expr);
+        case NIM_AST_EXPR_FLOAT_:
+            return nim_compile_ast_expr_float_ (c, expr);
+        case NIM_AST_EXPR_FN:
+            return nim_compile_ast_expr_fn (c, expr);
+        case NIM_AST_EXPR_SPAWN:
+            return nim_compile_ast_expr_spawn (c, expr);
+        case NIM_AST_EXPR_NOT:
+            return nim_compile_ast_expr_not (c, expr);
+        case NIM_AST_EXPR_WILDCARD:
+            {
+                NIM_BUG (
+                    "wildcard can't be used outside of a match statement");
+                return NIM_FALSE;
+            }
+        default:
+            NIM_BUG ("unknown AST expr type: %d", NIM_AST_EXPR_TYPE(expr));
+            return NIM_FALSE;
+    };
+}
+
+/*
+ * Inlining: calls to small module-level functions are compiled as the
+ * callee's body, saving a frame per call. A function qualifies if its
+ * body is straight-line code (no loops, branches, closures or early
+ * returns) that gives each local a value before it's used, it never
+ * refers to itself & its name is never bound to anything else in the
+ * module (by an assignment, another decl or a use).
+ */
+
+static int
+nim_compile_inline_expr_size (NimRef *expr, NimRef *name);
+
+static int
+nim_compile_inline_exprs_size (NimRef *exprs, NimRef *name)
+{
+    size_t i;
+    int total = 0;
+
+    for (i = 0; i < NIM_ARRAY_SIZE(exprs); i++) {
+        int n = nim_compile_inline_expr_size (NIM_ARRAY_ITEM(exprs, i), name);
+        if (n < 0) {
+            return -1;
+        }
+        total += n;
+    }
+    return total;
+}
+
+/* the number of nodes in expr, or -1 if it can't be inlined */
+static int
+nim_compile_inline_expr_size (NimRef *expr, NimRef *name)
+{
+    int left;
+    int right;
+
+    switch (NIM_AST_EXPR_TYPE(expr)) {
+        case NIM_AST_EXPR_IDENT:
+            return nim_object_cmp_eq (
+                NIM_AST_EXPR(expr)->ident.id, name) == NIM_CMP_EQ ? -1 : 1;
+        case NIM_AST_EXPR_STR:
+        case NIM_AST_EXPR_INT_:
+        case NIM_AST_EXPR_FLOAT_:
+        case NIM_AST_EXPR_BOOL:
+        case NIM_AST_EXPR_NIL:
+            return 1;
+        case NIM_AST_EXPR_NOT:
+            left = nim_compile_inline_expr_size (
+                NIM_AST_EXPR(expr)->not.value, name);
+            return left < 0 ? -1 : left + 1;
+        case NIM_AST_EXPR_GETATTR:
+            left = nim_compile_inline_expr_size (
+                NIM_AST_EXPR(expr)->getattr.target, name);
+            return left < 0 ? -1 : left + 1;
+        case NIM_AST_EXPR_BINOP:
+            left = nim_compile_inline_expr_size (
+                NIM_AST_EXPR(expr)->binop.left, name);
+            right = nim_compile_inline_expr_size (
+                NIM_AST_EXPR(expr)->binop.right, name);
+            return left < 0 || right < 0 ? -1 : left + right + 1;
+        case NIM_AST_EXPR_GETITEM:
+            left = nim_compile_inline_expr_size (
+                NIM_AST_EXPR(expr)->getitem.target, name);
+            right = nim_compile_inline_expr_size (
+                NIM_AST_EXPR(expr)->getitem.key, name);
+            return left < 0 || right < 0 ? -1 : left + right + 1;
+        case NIM_AST_EXPR_CALL:
+            left = nim_compile_inline_expr_size (
+                NIM_AST_EXPR(expr)->call.target, name);
+            right = nim_compile_inline_exprs_size (
+                NIM_AST_EXPR(expr)->call.args, name);
+            return left < 0 || right < 0 ? -1 : left + right + 1;
+        case NIM_AST_EXPR_ARRAY:
+            left = nim_compile_inline_exprs_size (
+                NIM_AST_EXPR(expr)->array.value, name);
+            return left < 0 ? -1 : left + 1;
+        case NIM_AST_EXPR_HASH:
+            left = nim_compile_inline_exprs_size (
+                NIM_AST_EXPR(expr)->hash.value, name);
+            return left < 0 ? -1 : left + 1;
+        default:
+            /* closures, spawns & wildcards */
+            return -1;
+    }
+}
+
+/* the number of nodes in a statement or decl, or -1 if it can't be inlined */
+static int
+nim_compile_inline_item_size (NimRef *item, NimRef *name, nim_bool_t last)
+{
+    NimRef *expr = NULL;
+    int n;
+
+    if (NIM_ANY_CLASS(item) == nim_ast_decl_class) {
+        if (NIM_AST_DECL_TYPE(item) != NIM_AST_DECL_VAR) {
+            return -1;
+        }
+        expr = NIM_AST_DECL(item)->var.value;
+    }
+    else {
+        switch (NIM_AST_STMT_TYPE(item)) {
+            case NIM_AST_STMT_EXPR:
+                expr = NIM_AST_STMT(item)->expr.expr;
+                break;
+            case NIM_AST_STMT_ASSIGN:
+                expr = NIM_AST_STMT(item)->assign.value;
+                break;
+            case NIM_AST_STMT_RET:
+                /* only as the last statement */
+                if (!last) {
+                    return -1;
+                }
+                expr = NIM_AST_STMT(item)->ret.expr;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    if (expr == NULL) {
+        return 1;
+    }
+    n = nim_compile_inline_expr_size (expr, name);
+    return n < 0 ? -1 : n + 1;
+}
+
+/* the number of nodes in a function body, or -1 if it can't be inlined */
+static int
+nim_compile_inline_body_size (NimRef *body, NimRef *name)
+{
+    const size_t size = NIM_ARRAY_SIZE(body);
+    size_t i;
+    size_t j;
+    int total = 0;
+
+    for (i = 0; i < size; i++) {
+        NimRef *item = NIM_ARRAY_ITEM(body, i);
+        int n = nim_compile_inline_item_size (item, name, i == size - 1);
+        if (n < 0) {
+            return -1;
+        }
+        total += n;
+
+        /* nothing resets an inlined local's slot between calls, so each */
+        /* one must get a value before anything can read it */
+        if (NIM_ANY_CLASS(item) == nim_ast_decl_class) {
+            NimRef *var = NIM_AST_DECL(item)->var.name;
+            if (NIM_AST_DECL(item)->var.value == NULL) {
+                return -1;
+            }
+            for (j = 0; j <= i; j++) {
+                if (nim_compile_inline_item_size (
+                        NIM_ARRAY_ITEM(body, j), var, j == size - 1) < 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+    return total;
+}
+
+static nim_bool_t
+nim_compile_inline_exclude (NimRef *inlinable, NimRef *name)
+{
+    if (nim_hash_get (inlinable, name, NULL) != 0) {
+        return NIM_TRUE;
+    }
+    return nim_hash_put (inlinable, name, nim_nil);
+}
+
+static nim_bool_t
+nim_compile_inline_scan_stmts (NimRef *inlinable, NimRef *stmts);
+
+static nim_bool_t
+nim_compile_inline_scan_exprs (NimRef *inlinable, NimRef *exprs);
+
+/* drops anything assigned to inside expr's closures from inlinable */
+static nim_bool_t
+nim_compile_inline_scan_expr (NimRef *inlinable, NimRef *expr)
+{
+    if (expr == NULL) {
+        return NIM_TRUE;
+    }
+    switch (NIM_AST_EXPR_TYPE(expr)) {
+        case NIM_AST_EXPR_BINOP:
+            return nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_EXPR(expr)->binop.left) &&
+                   nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_EXPR(expr)->binop.right);
+        case NIM_AST_EXPR_NOT:
+            return nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_EXPR(expr)->not.value);
+        case NIM_AST_EXPR_CALL:
+            return nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_EXPR(expr)->call.target) &&
+                   nim_compile_inline_scan_exprs (
+                        inlinable, NIM_AST_EXPR(expr)->call.args);
+        case NIM_AST_EXPR_SPAWN:
+            return nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_EXPR(expr)->spawn.target) &&
+                   nim_compile_inline_scan_exprs (
+                        inlinable, NIM_AST_EXPR(expr)->spawn.args);
+        case NIM_AST_EXPR_GETATTR:
+            return nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_EXPR(expr)->getattr.target);
+        case NIM_AST_EXPR_GETITEM:
+            return nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_EXPR(expr)->getitem.target) &&
+                   nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_EXPR(expr)->getitem.key);
+        case NIM_AST_EXPR_ARRAY:
+            return nim_compile_inline_scan_exprs (
+                        inlinable, NIM_AST_EXPR(expr)->array.value);
+        case NIM_AST_EXPR_HASH:
+            return nim_compile_inline_scan_exprs (
+                        inlinable, NIM_AST_EXPR(expr)->hash.value);
+        case NIM_AST_EXPR_FN:
+            return nim_compile_inline_scan_stmts (
+                        inlinable, NIM_AST_EXPR(expr)->fn.body);
+        default:
+            return NIM_TRUE;
+    }
+}
+
+static nim_bool_t
+nim_compile_inline_scan_exprs (NimRef *inlinable, NimRef *exprs)
+{
+    size_t i;
+
+    for (i = 0; i < NIM_ARRAY_SIZE(exprs); i++) {
+        if (!nim_compile_inline_scan_expr (
+                inlinable, NIM_ARRAY_ITEM(exprs, i))) {
+            return NIM_FALSE;
+        }
+    }
+    return NIM_TRUE;
+}
+
+/* drops anything assigned to in stmts from inlinable. this errs on the */
+/* side of caution: an assignment to a local of the same name counts. */
+static nim_bool_t
+nim_compile_inline_scan_stmts (NimRef *inlinable, NimRef *stmts)
+{
+    size_t i;
+
+    if (stmts == NULL) {
+        return NIM_TRUE;
+    }
+    for (i = 0; i < NIM_ARRAY_SIZE(stmts); i++) {
+        NimRef *item = NIM_ARRAY_ITEM(stmts, i);
+        nim_bool_t ok = NIM_TRUE;
+
+        if (NIM_ANY_CLASS(item) == nim_ast_decl_class) {
+            switch (NIM_AST_DECL_TYPE(item)) {
+                case NIM_AST_DECL_FUNC:
+                    ok = nim_compile_inline_scan_stmts (
+                            inlinable, NIM_AST_DECL(item)->func.body);
+                    break;
+                case NIM_AST_DECL_CLASS:
+                    ok = nim_compile_inline_scan_stmts (
+                            inlinable, NIM_AST_DECL(item)->class.body);
+                    break;
+                case NIM_AST_DECL_VAR:
+                    ok = nim_compile_inline_scan_expr (
+                            inlinable, NIM_AST_DECL(item)->var.value);
+                    break;
+                default:
+                    break;
+            }
+            if (!ok) {
+                return NIM_FALSE;
+            }
+            continue;
+        }
+
+        switch (NIM_AST_STMT_TYPE(item)) {
+            case NIM_AST_STMT_EXPR:
+                ok = nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_STMT(item)->expr.expr);
+                break;
+            case NIM_AST_STMT_ASSIGN:
+                ok = nim_compile_inline_exclude (inlinable,
+                        NIM_AST_EXPR(NIM_AST_STMT(item)->assign.target)
+                            ->ident.id) &&
+                     nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_STMT(item)->assign.value);
+                break;
+            case NIM_AST_STMT_IF_:
+                ok = nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_STMT(item)->if_.expr) &&
+                     nim_compile_inline_scan_stmts (
+                        inlinable, NIM_AST_STMT(item)->if_.body) &&
+                     nim_compile_inline_scan_stmts (
+                        inlinable, NIM_AST_STMT(item)->if_.orelse);
+                break;
+            case NIM_AST_STMT_WHILE_:
+                ok = nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_STMT(item)->while_.expr) &&
+                     nim_compile_inline_scan_stmts (
+                        inlinable, NIM_AST_STMT(item)->while_.body);
+                break;
+            case NIM_AST_STMT_FOR_:
+                ok = nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_STMT(item)->for_.expr) &&
+                     nim_compile_inline_scan_stmts (
+                        inlinable, NIM_AST_STMT(item)->for_.body);
+                break;
+            case NIM_AST_STMT_RET:
+                ok = nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_STMT(item)->ret.expr);
+                break;
+            case NIM_AST_STMT_YIELD:
+                ok = nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_STMT(item)->yield.expr);
+                break;
+            case NIM_AST_STMT_MATCH:
+                ok = nim_compile_inline_scan_expr (
+                        inlinable, NIM_AST_STMT(item)->match.expr) &&
+                     nim_compile_inline_scan_stmts (
+                        inlinable, NIM_AST_STMT(item)->match.body);
+                break;
+            case NIM_AST_STMT_PATTERN:
+                ok = nim_compile_inline_scan_stmts (
+                        inlinable, NIM_AST_STMT(item)->pattern.body);
+                break;
+            default:
+                break;
+        }
+        if (!ok) {
+            return NIM_FALSE;
+        }
+    }
+    return NIM_TRUE;
+}
+
+/* finds the module-level functions in mod that calls can be inlined to */
+static NimRef *
+nim_compile_find_inlinable (NimRef *mod)
+{
+    NimRef *uses = NIM_AST_MOD(mod)->root.uses;
+    NimRef *body = NIM_AST_MOD(mod)->root.body;
+    NimRef *inlinable;
+    size_t i;
+
+    inlinable = nim_hash_new ();
+    if (inlinable == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < NIM_ARRAY_SIZE(body); i++) {
+        NimRef *decl = NIM_ARRAY_ITEM(body, i);
+        NimRef *name;
+        NimRef *value = nim_nil;
+
+        switch (NIM_AST_DECL_TYPE(decl)) {
+            case NIM_AST_DECL_FUNC:
+                {
+                    NimRef *args = NIM_AST_DECL(decl)->func.args;
+                    int size;
+                    size_t j;
+
+                    name = NIM_AST_DECL(decl)->func.name;
+                    size = nim_compile_inline_body_size (
+                                NIM_AST_DECL(decl)->func.body, name);
+                    if (size >= 0 && size <= NIM_INLINE_MAX_NODES) {
+                        value = decl;
+                    }
+                    for (j = 0; j < NIM_ARRAY_SIZE(args); j++) {
+                        if (NIM_AST_DECL(NIM_ARRAY_ITEM(args, j))->var.value
+                                != NULL) {
+                            value = nim_nil;
+                        }
+                    }
+                    break;
+                }
+            case NIM_AST_DECL_CLASS:
+                name = NIM_AST_DECL(decl)->class.name;
+                break;
+            case NIM_AST_DECL_VAR:
+                name = NIM_AST_DECL(decl)->var.name;
+                break;
+            case NIM_AST_DECL_USE:
+                name = NIM_AST_DECL(decl)->use.name;
+                break;
+            default:
+                NIM_BUG ("unknown AST decl type: %d", NIM_AST_DECL_TYPE(decl));
+                return NULL;
+        }
+
+        /* declared twice: which one a call gets depends on the order */
+        if (nim_hash_get (inlinable, name, NULL) == 0) {
+            value = nim_nil;
+        }
+        if (!nim_hash_put (inlinable, name, value)) {
+            return NULL;
+        }
+    }
+
+    /* a function can't be inlined across modules, nor shadowed by one */
+    for (i = 0; i < NIM_ARRAY_SIZE(uses); i++) {
+        NimRef *decl = NIM_ARRAY_ITEM(uses, i);
+        if (!nim_compile_inline_exclude (
+                inlinable, NIM_AST_DECL(decl)->use.name)) {
+            return NULL;
+        }
+    }
+
+    if (!nim_compile_inline_scan_stmts (inlinable, body)) {
+        return NULL;
+    }
+
+    return inlinable;
+}
+
+/* the decl of the module-level function a call can be inlined to, or NULL */
+static NimRef *
+nim_compile_inline_target (NimCodeCompiler *c, NimRef *target, NimRef *args)
+{
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimRef *name;
+    NimRef *decl;
+
+    /* no inlining into an inlined body: it's how we avoid recursing */
+    if (c->inlinable == NULL || c->inline_vars != NULL ||
+            NIM_AST_EXPR_TYPE(target) != NIM_AST_EXPR_IDENT) {
+        return NULL;
+    }
+    name = NIM_AST_EXPR(target)->ident.id;
+    if (nim_code_find_var (code, name) >= 0 ||
+            nim_code_find_freevar (code, name) >= 0) {
+        return NULL;
+    }
+    if (nim_hash_get (c->inlinable, name, &decl) != 0 || decl == nim_nil) {
+        return NULL;
+    }
+    /* a call with the wrong number of args should still fail */
+    if (NIM_ARRAY_SIZE(NIM_AST_DECL(decl)->func.args) !=
+            NIM_ARRAY_SIZE(args)) {
+        return NULL;
+    }
+    return decl;
+}
+
+static nim_bool_t
+nim_compile_inline_item (NimCodeCompiler *c, NimRef *item)
+{
+    if (NIM_ANY_CLASS(item) == nim_ast_decl_class) {
+        return nim_compile_ast_decl (c, item);
+    }
+    return nim_compile_ast_stmt (c, item);
+}
+
+/* compiles a call as the callee's body, with the callee's args & locals */
+/* in new slots of the caller's frame, leaving its result on the stack */
+static nim_bool_t
+nim_compile_inline_call (NimCodeCompiler *c, NimRef *decl, NimRef *args)
+{
+    NimRef *code = NIM_COMPILER_CODE(c);
+    NimRef *params = NIM_AST_DECL(decl)->func.args;
+    NimRef *body = NIM_AST_DECL(decl)->func.body;
+    const size_t size = NIM_ARRAY_SIZE(body);
+    NimRef *symbols;
+    NimRef *vars;
+    NimRef *ste;
+    NimRef *last;
+    nim_bool_t ok = NIM_TRUE;
+    size_t i;
+
+    ste = nim_symtable_lookup (c->symtable, decl);
+    if (ste == NULL || ste == nim_nil) {
+        NIM_BUG ("symtable lookup failed for scope %p", decl);
+        return NIM_FALSE;
+    }
+
+    vars = nim_hash_new ();
+    if (vars == NULL) {
+        return NIM_FALSE;
+    }
+    c->inlined++;
+    symbols = NIM_SYMTABLE_ENTRY(ste)->symbols;
+    for (i = 0; i < NIM_HASH_SIZE(symbols); i++) {
+        NimRef *key = NIM_HASH(symbols)->keys[i];
+        NimRef *value = NIM_HASH(symbols)->values[i];
+        NimRef *renamed;
+
+        if (!(NIM_INT(value)->value & NIM_SYM_DECL)) {
+            continue;
+        }
+        /* not a valid identifier, so it can't clash with the caller's */
+        renamed = nim_str_new_format (
+            "%s@%zu", NIM_STR_DATA(key), c->inlined);
+        if (renamed == NULL) {
+            return NIM_FALSE;
+        }
+        renamed = nim_str_intern_ref (renamed);
+        if (renamed == NULL) {
+            return NIM_FALSE;
+        }
+        if (!nim_array_push (NIM_CODE(code)->vars, renamed)) {
+            return NIM_FALSE;
+        }
+        if (!nim_hash_put (vars, key, renamed)) {
+            return NIM_FALSE;
+        }
+    }
+
+    /* the args are evaluated in the caller's scope */
+    for (i = 0; i < NIM_ARRAY_SIZE(args); i++) {
+        if (!nim_compile_ast_expr (c, NIM_ARRAY_ITEM(args, i))) {
+            return NIM_FALSE;
+        }
+    }
 
-    if (NIM_ANY_CLASS(scope) == nim_module_class) {
-        return nim_module_add_local (scope, name, value == NULL ? nim_nil : value);
+    c->inline_vars = vars;
+
+    for (i = 0; ok && i < NIM_ARRAY_SIZE(params); i++) {
+        NimRef *param =
+            NIM_ARRAY_ITEM(params, NIM_ARRAY_SIZE(params) - i - 1);
+        ok = nim_compile_store_name (c, NIM_AST_DECL(param)->var.name);
     }
-    else {
-        /* TODO it's really about time we get ourselves a symbol table */
-        if (value != NULL) {
-            NimRef *code = NIM_COMPILER_CODE(c);
 
-            if (!nim_compile_ast_expr (c, value)) {
-                return NIM_FALSE;
-            }
+    for (i = 0; ok && i + 1 < size; i++) {
+        ok = nim_compile_inline_item (c, NIM_ARRAY_ITEM(body, i));
+    }
 
-            if (!nim_code_storename (code, name)) {
-                return NIM_FALSE;
-            }
+    /* the result is the value of a trailing ret or expression, or nil */
+    if (ok && size > 0) {
+        last = NIM_ARRAY_ITEM(body, size - 1);
+        if (NIM_ANY_CLASS(last) == nim_ast_stmt_class &&
+                NIM_AST_STMT_TYPE(last) == NIM_AST_STMT_EXPR) {
+            ok = nim_compile_ast_expr (c, NIM_AST_STMT(last)->expr.expr);
+        }
+        else if (NIM_ANY_CLASS(last) == nim_ast_stmt_class &&
+                NIM_AST_STMT_TYPE(last) == NIM_AST_STMT_RET &&
+                NIM_AST_STMT(last)->ret.expr != NULL) {
+            ok = nim_compile_ast_expr (c, NIM_AST_STMT(last)->ret.expr);
+        }
+        else if (NIM_ANY_CLASS(last) == nim_ast_stmt_class &&
+                NIM_AST_STMT_TYPE(last) == NIM_AST_STMT_RET) {
+            ok = nim_code_pushnil (code);
+        }
+        else {
+            ok = nim_compile_inline_item (c, last) && nim_code_pushnil (code);
         }
     }
-    return NIM_TRUE;
-}
-
-static nim_bool_t
-nim_compile_ast_decl (NimCodeCompiler *c, NimRef *decl)
-{
-    switch (NIM_AST_DECL_TYPE(decl)) {
-        case NIM_AST_DECL_FUNC:
-            return nim_compile_ast_decl_func (c, decl);
-        case NIM_AST_DECL_CLASS:
-            return nim_compile_ast_decl_class (c, decl);
-        case NIM_AST_DECL_USE:
-            return nim_compile_ast_decl_use (c, decl);
-        case NIM_AST_DECL_VAR:
-            return nim_compile_ast_decl_var (c, decl);
-        default:
-            NIM_BUG ("unknown AST stmt type: %d", NIM_AST_DECL_TYPE(decl));
-            return NIM_FALSE;
+    else if (ok) {
+        ok = nim_code_pushnil (code);
     }
-}
 
-static nim_bool_t
-nim_compile_ast_stmt (NimCodeCompiler *c, NimRef *stmt)
-{
-    switch (NIM_AST_STMT_TYPE(stmt)) {
-        case NIM_AST_STMT_EXPR:
-            if (!nim_compile_ast_expr (c, NIM_AST_STMT(stmt)->expr.expr)) {
-                return NIM_FALSE;
-            }
-            /* clean up the stack when we're not saving the result */
-            if (!nim_code_pop (NIM_COMPILER_CODE(c))) {
-                return NIM_FALSE;
-            }
-            return NIM_TRUE;
-        case NIM_AST_STMT_ASSIGN:
-            return nim_compile_ast_stmt_assign (c, stmt);
-        case NIM_AST_STMT_IF_:
-            return nim_compile_ast_stmt_if_ (c, stmt);
-        case NIM_AST_STMT_WHILE_:
-            return nim_compile_ast_stmt_while_ (c, stmt);
-        case NIM_AST_STMT_MATCH:
-            return nim_compile_ast_stmt_match (c, stmt);
-        case NIM_AST_STMT_RET:
-            return nim_compile_ast_stmt_ret (c, stmt);
-        case NIM_AST_STMT_BREAK_:
-            return nim_compile_ast_stmt_break_ (c, stmt);
-        default:
-            NIM_BUG ("unknown AST stmt type: %d", NIM_AST_STMT_TYPE(stmt));
-            return NIM_FALSE;
-    };
-}
+    c->inline_vars = NULL;
 
-static nim_bool_t
-nim_compile_ast_expr (NimCodeCompiler *c, NimRef *expr)
-{
-    switch (NIM_AST_EXPR_TYPE(expr)) {
-        case NIM_AST_EXPR_CALL:
-            return nim_compile_ast_expr_call (c, expr);
-        case NIM_AST_EXPR_GETATTR:
-            return nim_compile_ast_expr_getattr (c, expr);
-        case NIM_AST_EXPR_GETITEM:
-            return nim_compile_ast_expr_getitem (c, expr);
-        case NIM_AST_EXPR_ARRAY:
-            return nim_compile_ast_expr_array (c, expr);
-        case NIM_AST_EXPR_HASH:
-            return nim_compile_ast_expr_hash (c, expr);
-        case NIM_AST_EXPR_IDENT:
-            return nim_compile_ast_expr_ident (c, expr);
-        case NIM_AST_EXPR_STR:
-            return nim_compile_ast_expr_str (c, expr);
-        case NIM_AST_EXPR_BOOL:
-            return nim_compile_ast_expr_bool (c, expr);
-        case NIM_AST_EXPR_NIL:
-            return nim_code_pushnil (NIM_COMPILER_CODE(c));
-        case NIM_AST_EXPR_BINOP:
-            return nim_compile_ast_expr_binop (c, expr);
-        case NIM_AST_EXPR_INT_:
-            return nim_compile_ast_expr_int_ (c, expr);
-        case NIM_AST_EXPR_FLOAT_:
-            return nim_compile_ast_expr_float_ (c, expr);
-        case NIM_AST_EXPR_FN:
-            return nim_compile_ast_expr_fn (c, expr);
-        case NIM_AST_EXPR_SPAWN:
-            return nim_compile_ast_expr_spawn (c, expr);
-        case NIM_AST_EXPR_NOT:
-            return nim_compile_ast_expr_not (c, expr);
-        case NIM_AST_EXPR_WILDCARD:
-            {
-                NIM_BUG (
-                    "wildcard can't be used outside of a match statement");
-                return NIM_FALSE;
-            }
-        default:
-            NIM_BUG ("unknown AST expr type: %d", NIM_AST_EXPR_TYPE(expr));
-            return NIM_FALSE;
-    };
+    return ok;
 }
 
 static nim_bool_t
@@ -1494,22 +2807,42 @@ nim_compile_ast_expr_call (NimCodeCompiler *c, NimRef *expr)
 {
     NimRef *target;
     NimRef *args;
+    NimRef *decl;
     size_t i;
     NimRef *code = NIM_COMPILER_CODE(c);
 
     target = NIM_AST_EXPR(expr)->call.target;
-    if (!nim_compile_ast_expr (c, target)) {
+    args = NIM_AST_EXPR(expr)->call.args;
+
+    decl = nim_compile_inline_target (c, target, args);
+    if (decl != NULL) {
+        return nim_compile_inline_call (c, decl, args);
+    }
+
+    /* x.foo(...) looks up & calls foo in one step: no bound method */
+    if (NIM_AST_EXPR(target)->type == NIM_AST_EXPR_GETATTR) {
+        if (!nim_compile_ast_expr (c, NIM_AST_EXPR(target)->getattr.target)) {
+            return NIM_FALSE;
+        }
+    }
+    else if (!nim_compile_ast_expr (c, target)) {
         return NIM_FALSE;
     }
 
-    args = NIM_AST_EXPR(expr)->call.args;
     for (i = 0; i < NIM_ARRAY_SIZE(args); i++) {
         if (!nim_compile_ast_expr (c, NIM_ARRAY_ITEM(args, i))) {
             return NIM_FALSE;
         }
     }
 
-    if (!nim_code_call (code, NIM_ARRAY_SIZE(args))) {
+    if (NIM_AST_EXPR(target)->type == NIM_AST_EXPR_GETATTR) {
+        if (!nim_code_callmethod (
+                code, NIM_AST_EXPR(target)->getattr.attr,
+                NIM_ARRAY_SIZE(args))) {
+            return NIM_FALSE;
+        }
+    }
+    else if (!nim_code_call (code, NIM_ARRAY_SIZE(args))) {
         return NIM_FALSE;
     }
 
@@ -1586,19 +2919,111 @@ nim_compile_ast_expr_ident (NimCodeCompiler *c, NimRef *expr)
         }
     }
     else {
-        if (!nim_code_pushname (code, id)) {
+        if (!nim_compile_load_name (c, id)) {
+            return NIM_FALSE;
+        }
+    }
+    return NIM_TRUE;
+}
+
+/* literals whose value is known at compile time */
+static nim_bool_t
+nim_compile_is_const_expr (NimRef *expr)
+{
+    switch (NIM_AST_EXPR_TYPE(expr)) {
+        case NIM_AST_EXPR_STR:
+        case NIM_AST_EXPR_INT_:
+        case NIM_AST_EXPR_FLOAT_:
+        case NIM_AST_EXPR_BOOL:
+        case NIM_AST_EXPR_NIL:
+            return NIM_TRUE;
+        default:
+            return NIM_FALSE;
+    }
+}
+
+static NimRef *
+nim_compile_const_value (NimRef *expr)
+{
+    switch (NIM_AST_EXPR_TYPE(expr)) {
+        case NIM_AST_EXPR_STR:
+            return NIM_AST_EXPR(expr)->str.value;
+        case NIM_AST_EXPR_INT_:
+            return NIM_AST_EXPR(expr)->int_.value;
+        case NIM_AST_EXPR_FLOAT_:
+            return NIM_AST_EXPR(expr)->float_.value;
+        case NIM_AST_EXPR_BOOL:
+            return NIM_AST_EXPR(expr)->bool.value;
+        default:
+            return nim_nil;
+    }
+}
+
+static nim_bool_t
+nim_compile_is_const_exprs (NimRef *exprs)
+{
+    size_t i;
+    if (NIM_ARRAY_SIZE(exprs) == 0) {
+        return NIM_FALSE;
+    }
+    for (i = 0; i < NIM_ARRAY_SIZE(exprs); i++) {
+        if (!nim_compile_is_const_expr (NIM_ARRAY_ITEM(exprs, i))) {
             return NIM_FALSE;
         }
     }
     return NIM_TRUE;
 }
 
+/*
+ * An array literal made only of constants is built once, here, & every
+ * evaluation clones it with CLONECONST instead of pushing each item.
+ */
+static nim_bool_t
+nim_compile_const_array (NimCodeCompiler *c, NimRef *arr)
+{
+    size_t i;
+    NimRef *template = nim_array_new_with_capacity (NIM_ARRAY_SIZE(arr));
+    if (template == NULL) {
+        return NIM_FALSE;
+    }
+    for (i = 0; i < NIM_ARRAY_SIZE(arr); i++) {
+        NimRef *value = nim_compile_const_value (NIM_ARRAY_ITEM(arr, i));
+        if (!nim_array_push (template, value)) {
+            return NIM_FALSE;
+        }
+    }
+    return nim_code_cloneconst (NIM_COMPILER_CODE(c), template);
+}
+
+/* as above, but for hash literals with constant keys & values */
+static nim_bool_t
+nim_compile_const_hash (NimCodeCompiler *c, NimRef *arr)
+{
+    size_t i;
+    NimRef *template = nim_hash_new ();
+    if (template == NULL) {
+        return NIM_FALSE;
+    }
+    /* MAKEHASH pops pairs off the stack, so it inserts the last first */
+    for (i = NIM_ARRAY_SIZE(arr); i >= 2; i -= 2) {
+        NimRef *key = nim_compile_const_value (NIM_ARRAY_ITEM(arr, i - 2));
+        NimRef *value = nim_compile_const_value (NIM_ARRAY_ITEM(arr, i - 1));
+        if (!nim_hash_put (template, key, value)) {
+            return NIM_FALSE;
+        }
+    }
+    return nim_code_cloneconst (NIM_COMPILER_CODE(c), template);
+}
+
 static nim_bool_t
 nim_compile_ast_expr_array (NimCodeCompiler *c, NimRef *expr)
 {
     size_t i;
     NimRef *code = NIM_COMPILER_CODE(c);
     NimRef *arr = NIM_AST_EXPR(expr)->array.value;
+    if (nim_compile_is_const_exprs (arr)) {
+        return nim_compile_const_array (c, arr);
+    }
     for (i = 0; i < NIM_ARRAY_SIZE(arr); i++) {
         if (!nim_compile_ast_expr (c, NIM_ARRAY_ITEM(arr, i))) {
             return NIM_FALSE;
@@ -1617,6 +3042,18 @@ nim_compile_ast_expr_hash (NimCodeCompiler *c, NimRef *expr)
     NimRef *code = NIM_COMPILER_CODE(c);
     NimRef *arr = NIM_AST_EXPR(expr)->hash.value;
     /* TODO ensure array size is even (key/value pairs) */
+    if (NIM_ARRAY_SIZE(arr) % 2 == 0 && nim_compile_is_const_exprs (arr)) {
+        size_t n;
+        /* nil keys are an error MAKEHASH reports at runtime */
+        for (n = 0; n < NIM_ARRAY_SIZE(arr); n += 2) {
+            if (NIM_AST_EXPR_TYPE(NIM_ARRAY_ITEM(arr, n)) == NIM_AST_EXPR_NIL) {
+                break;
+            }
+        }
+        if (n == NIM_ARRAY_SIZE(arr)) {
+            return nim_compile_const_hash (c, arr);
+        }
+    }
     for (i = 0; i < NIM_ARRAY_SIZE(arr); i++) {
         if (!nim_compile_ast_expr (c, NIM_ARRAY_ITEM(arr, i))) {
             return NIM_FALSE;
@@ -1956,6 +3393,26 @@ nim_compile_ast_expr_not (NimCodeCompiler *c, NimRef *expr)
     return NIM_TRUE;
 }
 
+NimRef *
+nim_compile_uses (NimRef *ast)
+{
+    NimRef *uses = NIM_AST_MOD(ast)->root.uses;
+    NimRef *names;
+    size_t i;
+
+    names = nim_array_new_with_capacity (NIM_ARRAY_SIZE(uses));
+    if (names == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < NIM_ARRAY_SIZE(uses); i++) {
+        NimRef *decl = NIM_ARRAY_ITEM(uses, i);
+        if (!nim_array_push (names, NIM_AST_DECL(decl)->use.name)) {
+            return NULL;
+        }
+    }
+    return names;
+}
+
 NimRef *
 nim_compile_ast (NimRef *name, const char *filename, NimRef *ast)
 {
@@ -1964,9 +3421,39 @@ nim_compile_ast (NimRef *name, const char *filename, NimRef *ast)
     NimRef *filename_obj;
     memset (&c, 0, sizeof(c));
 
+    /* compile in the parser's arena (or a new one if the AST didn't come */
+    /* from the parser) so the AST, symtables & units all go at once */
+    c.arena = nim_gc_arena_find (NULL, ast);
+    if (c.arena == NULL) {
+        c.arena = nim_gc_arena_new (NULL);
+        if (c.arena == NULL) {
+            return NULL;
+        }
+    }
+    c.prev_arena = nim_gc_arena_enter (NULL, c.arena);
+
+    c.units = nim_array_new ();
+    if (c.units == NULL) {
+        goto error;
+    }
+
     filename_obj = nim_str_new (filename, strlen (filename));
     if (filename_obj == NULL) {
-        return NULL;
+        goto error;
+    }
+
+    /* get the module manager started on all of our imports at once, */
+    /* rather than one at a time as we reach each use decl */
+    if (NIM_ANY_CLASS(ast) == nim_ast_mod_class &&
+            NIM_ARRAY_SIZE(NIM_AST_MOD(ast)->root.uses) > 1) {
+        NimRef *uses = nim_compile_uses (ast);
+        if (uses == NULL || !nim_module_mgr_prefetch (uses)) {
+            goto error;
+        }
+    }
+
+    if (nim_opt_level () > 0 && !nim_ast_optimize (ast)) {
+        goto error;
     }
 
     c.symtable = nim_symtable_new_from_ast (filename_obj, ast);
@@ -1974,6 +3461,13 @@ nim_compile_ast (NimRef *name, const char *filename, NimRef *ast)
         goto error;
     }
 
+    if (nim_opt_level () > 0 && NIM_ANY_CLASS(ast) == nim_ast_mod_class) {
+        c.inlinable = nim_compile_find_inlinable (ast);
+        if (c.inlinable == NULL) {
+            goto error;
+        }
+    }
+
     module = nim_code_compiler_push_module_unit (&c, ast);
     if (module == NULL) {
         goto error;
@@ -1995,6 +3489,12 @@ nim_compile_ast (NimRef *name, const char *filename, NimRef *ast)
         goto error;
     }
 
+    if (getenv ("NIM_DEBUG_MODE")) {
+        fprintf (stderr,
+            "module %s: %zu instructions, %zu after optimization\n",
+            NIM_STR_DATA(name), c.emitted, c.optimized);
+    }
+
     nim_code_compiler_cleanup (&c);
 
     return module;
@@ -2029,7 +3529,31 @@ is_file (const char *filename, nim_bool_t *result)
 }
 
 NimRef *
-nim_compile_file (NimRef *name, const char *filename)
+nim_compile_module_name (const char *filename)
+{
+    ssize_t slash = -1;
+    ssize_t dot = -1;
+    size_t i;
+    size_t len = strlen (filename);
+
+    /* XXX this is just a shit O(n) basename() impl */
+    for (i = 0; i < len; i++) {
+        if (filename[i] == '/') {
+            slash = i + 1;
+            dot = -1;
+        }
+        else if (filename[i] == '.' && dot == -1) {
+            dot = i;
+        }
+    }
+    if (dot == -1) dot = len;
+    if (slash == -1) slash = 0;
+
+    return nim_str_new (filename + slash, dot - slash);
+}
+
+NimRef *
+nim_compile_parse_file (const char *filename)
 {
     int rc;
     NimRef *filename_obj;
@@ -2037,6 +3561,8 @@ nim_compile_file (NimRef *name, const char *filename)
     nim_bool_t isreg;
     void *scanner;
     FILE *input;
+    NimArena *arena;
+    NimArena *prev;
 
     if (!is_file (filename, &isreg)) {
         return NULL;
@@ -2056,6 +3582,12 @@ nim_compile_file (NimRef *name, const char *filename)
         fclose (input);
         return NULL;
     }
+    arena = nim_gc_arena_new (NULL);
+    if (arena == NULL) {
+        fclose (input);
+        return NULL;
+    }
+    prev = nim_gc_arena_enter (NULL, arena);
     yylex_init (&scanner);
     yyset_in (input, scanner);
 #ifdef NIM_PARSER_DEBUG
@@ -2065,36 +3597,32 @@ nim_compile_file (NimRef *name, const char *filename)
     rc = yyparse(scanner, filename_obj, &mod);
     fclose (input);
     yylex_destroy (scanner);
+    nim_gc_arena_enter (NULL, prev);
     if (rc == 0) {
-        /* keep a ptr to main_mod on the stack so it doesn't get collected */
-        if (name == NULL) {
-            ssize_t slash = -1;
-            ssize_t dot = -1;
-            size_t i;
-            size_t len = strlen (filename);
-
-            /* XXX this is just a shit O(n) basename() impl */
-            for (i = 0; i < len; i++) {
-                if (filename[i] == '/') {
-                    slash = i + 1;
-                    dot = -1;
-                }
-                else if (filename[i] == '.' && dot == -1) {
-                    dot = i;
-                }
-            }
-            if (dot == -1) dot = len;
-            if (slash == -1) slash = 0;
-
-            name = nim_str_new (filename + slash, dot - slash);
-            if (name == NULL) {
-                return NULL;
-            }
-        }
-        return nim_compile_ast (name, filename, mod);
+        return mod;
     }
     else {
+        nim_gc_arena_delete (NULL, arena);
+        return NULL;
+    }
+}
+
+NimRef *
+nim_compile_file (NimRef *name, const char *filename)
+{
+    NimRef *mod;
+
+    /* keep a ptr to main_mod on the stack so it doesn't get collected */
+    mod = nim_compile_parse_file (filename);
+    if (mod == NULL) {
         return NULL;
     }
+    if (name == NULL) {
+        name = nim_compile_module_name (filename);
+        if (name == NULL) {
+            return NULL;
+        }
+    }
+    return nim_compile_ast (name, filename, mod);
 }
 
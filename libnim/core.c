@@ -33,6 +33,9 @@
 #include "nim/method.h"
 #include "nim/task.h"
 #include "nim/hash.h"
+#include "nim/range.h"
+#include "nim/iter.h"
+#include "nim/generator.h"
 #include "nim/frame.h"
 #include "nim/ast.h"
 #include "nim/code.h"
@@ -41,6 +44,8 @@
 #include "nim/symtable.h"
 #include "nim/compile.h"
 #include "nim/module_mgr.h"
+#include "nim/optimize.h"
+#include "nim/jit.h"
 
 #define NIM_BOOTSTRAP_CLASS_L1(gc, c, n, sup) \
     do { \
@@ -83,6 +88,33 @@ NimRef *nim_false = NULL;
 NimRef *nim_builtins = NULL;
 NimRef *nim_module_path = NULL;
 
+/* builtins are only ever added during startup, so a builtin's position */
+/* in nim_builtins is stable and can be baked into bytecode. */
+int32_t
+nim_builtin_index (NimRef *name)
+{
+    size_t i;
+    for (i = 0; i < NIM_HASH_SIZE(nim_builtins); i++) {
+        NimCmpResult r = nim_object_cmp_eq (NIM_HASH(nim_builtins)->keys[i], name);
+        if (r == NIM_CMP_ERROR) {
+            return -1;
+        }
+        else if (r == NIM_CMP_EQ) {
+            return (int32_t) i;
+        }
+    }
+    return -1;
+}
+
+NimRef *
+nim_builtin_at (size_t index)
+{
+    if (index >= NIM_HASH_SIZE(nim_builtins)) {
+        return NULL;
+    }
+    return NIM_HASH(nim_builtins)->values[index];
+}
+
 static NimRef *
 _nim_module_make_path (const char *path);
 
@@ -191,21 +223,12 @@ static NimRef *
 _nim_object_getattr (NimRef *self, NimRef *name)
 {
     /* TODO check NIM_ANY(self)->attributes ? */
-    NimRef *class = NIM_ANY_CLASS(self);
-    while (class != NULL) {
-        NimLWHash *methods = NIM_CLASS(class)->methods;
-        NimRef *method;
-        if (nim_lwhash_get (methods, name, &method)) {
-            if (method == NULL) {
-                class = NIM_CLASS(class)->super;
-                continue;
-            }
-            /* XXX binding on every access is probably dumb/slow */
-            return nim_method_new_bound (method, self);
-        }
-        else break;
+    NimRef *method = nim_class_lookup_method (NIM_ANY_CLASS(self), name);
+    if (method == NULL) {
+        return NULL;
     }
-    return NULL;
+    /* XXX binding on every access is probably dumb/slow */
+    return nim_method_new_bound (method, self);
 }
 
 static NimRef *
@@ -258,52 +281,6 @@ _nim_task_self (NimRef *self, NimRef *args)
     return nim_task_get_self (NIM_CURRENT_TASK);
 }
 
-static NimRef *
-_nim_array_range(NimRef* a, NimRef *args)
-{
-    int64_t start = 0;
-    int64_t stop;
-    int64_t step = 1;
-    int64_t i;
-    NimRef *result;
-
-    switch (NIM_ARRAY(args)->size) {
-        case 0:
-            NIM_BUG("range(): not enough args");
-            return NULL;
-        case 1:
-            if (!nim_method_parse_args (args, "I", &stop)) {
-                return NULL;
-            }
-            break;
-        case 2:
-            if (!nim_method_parse_args (args, "II", &start, &stop)) {
-                return NULL;
-            }
-            break;
-        case 3:
-            if (!nim_method_parse_args (args, "III", &start, &stop, &step)) {
-                return NULL;
-            }
-            if (0 == step) {
-                NIM_BUG("range(): step argument can't be zero.");
-                return NULL;
-            }
-            break;
-        default:
-            NIM_BUG("range(): too many args.");
-            return NULL;
-    }
-
-    result = nim_array_new();
-    for (i = start; SIGN(step)*(stop - i) > 0; i += step) {
-        if (!nim_array_push(result, nim_int_new(i))) {
-            return NULL;
-        }
-    }
-    return result;
-}
-
 static NimTaskInternal *main_task = NULL;
 
 static NimRef *
@@ -350,10 +327,10 @@ nim_core_init_builtins (void)
     nim_hash_put_str (nim_builtins, "class",  nim_class_class);
     nim_hash_put_str (nim_builtins, "method", nim_method_class);
     nim_hash_put_str (nim_builtins, "error",  nim_error_class);
+    nim_hash_put_str (nim_builtins, "range",  nim_range_class);
 
     NIM_BUILTIN_METHOD(_nim_task_recv, "recv");
     NIM_BUILTIN_METHOD(_nim_task_self, "self");
-    NIM_BUILTIN_METHOD(_nim_array_range, "range");
     NIM_BUILTIN_METHOD(_nim_compile, "compile");
 
     return NIM_TRUE;
@@ -411,6 +388,14 @@ nim_bool_init (NimRef *self, NimRef *args)
 nim_bool_t
 nim_core_startup (const char *path, void *stack_start)
 {
+    if (!nim_opt_init ()) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_jit_init ()) {
+        return NIM_FALSE;
+    }
+
     main_task = nim_task_new_main (stack_start);
     if (main_task == NULL) {
         return NIM_FALSE;
@@ -450,6 +435,9 @@ nim_core_startup (const char *path, void *stack_start)
     if (!nim_float_class_bootstrap ()) goto error;
     if (!nim_array_class_bootstrap ()) goto error;
     if (!nim_hash_class_bootstrap ()) goto error;
+    if (!nim_range_class_bootstrap ()) goto error;
+    if (!nim_iter_class_bootstrap ()) goto error;
+    if (!nim_generator_class_bootstrap ()) goto error;
 
     nim_nil_class = nim_class_new (
         NIM_STR_NEW("nil"), nim_object_class, sizeof(NimAny));
@@ -517,6 +505,8 @@ nim_core_shutdown (void)
     if (main_task != NULL) {
         nim_module_mgr_shutdown ();
         nim_task_main_delete ();
+        nim_str_intern_cleanup ();
+        nim_int_cleanup ();
         main_task = NULL;
         nim_object_class = NULL;
         nim_class_class = NULL;
@@ -646,11 +636,13 @@ nim_num_add (NimRef *left, NimRef *right)
     }
     else {
 
-        int left_value, right_value;
+        int64_t left_value, right_value;
 
         left_value = NIM_INT(left)->value;
         right_value = NIM_INT(right)->value;
-        return nim_int_new (left_value + right_value);
+        /* wraps around on overflow, rather than being undefined */
+        return nim_int_new (
+            (int64_t)((uint64_t) left_value + (uint64_t) right_value));
     }
 }
 
@@ -671,11 +663,12 @@ nim_num_sub (NimRef *left, NimRef *right)
     }
     else {
 
-        int left_value, right_value;
+        int64_t left_value, right_value;
 
         left_value = NIM_INT(left)->value;
         right_value = NIM_INT(right)->value;
-        return nim_int_new (left_value - right_value);
+        return nim_int_new (
+            (int64_t)((uint64_t) left_value - (uint64_t) right_value));
     }
 }
 
@@ -696,11 +689,12 @@ nim_num_mul (NimRef *left, NimRef *right)
     }
     else {
 
-        int left_value, right_value;
+        int64_t left_value, right_value;
 
         left_value = NIM_INT(left)->value;
         right_value = NIM_INT(right)->value;
-        return nim_int_new (left_value * right_value);
+        return nim_int_new (
+            (int64_t)((uint64_t) left_value * (uint64_t) right_value));
     }
 }
 
@@ -721,10 +715,18 @@ nim_num_div (NimRef *left, NimRef *right)
     }
     else {
 
-        int left_value, right_value;
+        int64_t left_value, right_value;
 
         left_value = NIM_INT(left)->value;
         right_value = NIM_INT(right)->value;
+        if (right_value == 0) {
+            NIM_BUG ("integer division by zero");
+            return NULL;
+        }
+        /* the one quotient that doesn't fit: wrap it like the others */
+        if (left_value == INT64_MIN && right_value == -1) {
+            return nim_int_new (INT64_MIN);
+        }
         return nim_int_new (left_value / right_value);
     }
 }
@@ -33,12 +33,13 @@ _nim_frame_init (NimRef *self, NimRef *args)
         return NULL;
     }
 
-    locals = nim_hash_new ();
-    if (locals == NULL) {
-        return NULL;
-    }
     NIM_FRAME(self)->method = method;
-    NIM_FRAME(self)->locals = locals;
+    NIM_FRAME(self)->locals = NULL;
+    NIM_FRAME(self)->upvalues = NULL;
+    NIM_FRAME(self)->stack_base = 0;
+    NIM_FRAME(self)->pc = 0;
+    NIM_FRAME(self)->saved = NULL;
+    NIM_FRAME(self)->suspended = NIM_FALSE;
     if (NIM_METHOD_TYPE(method) == NIM_METHOD_TYPE_BYTECODE ||
             NIM_METHOD_TYPE(method) == NIM_METHOD_TYPE_CLOSURE) {
         NimRef *code;
@@ -51,25 +52,26 @@ _nim_frame_init (NimRef *self, NimRef *args)
             code = NIM_METHOD(method)->closure.code;
         }
 
-        /* allocate NimVar entries in `locals` for each non-free var */
+        /* allocate a NimVar cell for each non-free var */
+        locals = nim_array_new_with_capacity (
+                    NIM_ARRAY_SIZE(NIM_CODE(code)->vars));
+        if (locals == NULL) {
+            return NULL;
+        }
+        NIM_FRAME(self)->locals = locals;
         for (i = 0; i < NIM_ARRAY_SIZE(NIM_CODE(code)->vars); i++) {
-            NimRef *varname =
-                NIM_ARRAY_ITEM(NIM_CODE(code)->vars, i);
             NimRef *var = nim_var_new ();
-            if (!nim_hash_put (NIM_FRAME(self)->locals, varname, var)) {
-                return NIM_FALSE;
+            if (var == NULL) {
+                return NULL;
+            }
+            if (!nim_array_push (locals, var)) {
+                return NULL;
             }
         }
 
+        /* free vars share the cells captured by MAKECLOSURE */
         if (NIM_METHOD_TYPE(method) == NIM_METHOD_TYPE_CLOSURE) {
-            NimRef *bindings = NIM_CLOSURE_METHOD(method)->bindings;
-            for (i = 0; i < NIM_HASH_SIZE(bindings); i++) {
-                NimRef *varname = NIM_HASH(bindings)->keys[i];
-                NimRef *value = NIM_HASH(bindings)->values[i];
-                if (!nim_hash_put (NIM_FRAME(self)->locals, varname, value)) {
-                    return NIM_FALSE;
-                }
-            }
+            NIM_FRAME(self)->upvalues = NIM_CLOSURE_METHOD(method)->upvalues;
         }
     }
     return self;
@@ -82,6 +84,8 @@ _nim_frame_mark (NimGC *gc, NimRef *self)
 
     nim_gc_mark_ref (gc, NIM_FRAME(self)->method);
     nim_gc_mark_ref (gc, NIM_FRAME(self)->locals);
+    nim_gc_mark_ref (gc, NIM_FRAME(self)->upvalues);
+    nim_gc_mark_ref (gc, NIM_FRAME(self)->saved);
 }
 
 nim_bool_t
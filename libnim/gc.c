@@ -22,10 +22,13 @@
 #define VALGRIND_MAKE_MEM_DEFINED(p, s)
 #endif
 
+#include <stddef.h>
+
 #include "nim/gc.h"
 #include "nim/object.h"
 #include "nim/core.h"
 #include "nim/task.h"
+#include "nim/code.h"
 #include "nim/_parser.h"
 
 /* 64k default heap (NIM_VALUE_SIZE * DEFAULT_SLAB_SIZE) */
@@ -39,11 +42,33 @@ struct _NimRef {
 
 #define NIM_FAST_ANY(ref) ((NimAny *)(ref)->value)
 
+/* NIM_UNCHECKED_CAST depends on this */
+typedef char nim_gc_ref_header_size_check[
+    offsetof(struct _NimRef, value) == NIM_REF_HEADER_SIZE ? 1 : -1];
+
 typedef struct _NimSlab {
     NimRef *refs;
     void *head;
 } NimSlab;
 
+/* objects & plain memory are bumped out of 64k chunks */
+#define NIM_ARENA_CHUNK_SIZE (64 * 1024)
+#define NIM_ARENA_ALIGN(size) (((size) + 15) & ~((size_t) 15))
+
+typedef struct _NimArenaChunk {
+    struct _NimArenaChunk *next;
+    size_t size;
+    size_t used;
+    char  *data;
+} NimArenaChunk;
+
+struct _NimArena {
+    struct _NimArena *next;
+    NimArenaChunk    *chunks;
+    /* every object in the arena, linked through next */
+    NimRef           *objects;
+};
+
 typedef struct _NimHeap {
     NimSlab **slabs;
     size_t      slab_count;
@@ -62,11 +87,18 @@ struct _NimGC {
 
     void      *stack_start;
     uint64_t   collection_count;
+
+    /* every live arena, & the one nim_gc_new_temp_object uses */
+    NimArena  *arenas;
+    NimArena  *arena;
 };
 
 #define NIM_HEAP_CURRENT_SLAB(heap) \
     (heap)->slabs[(heap)->slab_count - 1]
 
+#define NIM_HEAP_CAPACITY(heap) \
+    ((heap)->slab_count * (heap)->slab_size)
+
 #define NIM_HEAP_ALLOCATED(heap) \
     ((heap)->slab_count * ((heap)->slab_size * sizeof(NimRef)))
 
@@ -206,14 +238,29 @@ void
 nim_gc_delete (NimGC *gc)
 {
     if (gc != NULL) {
-        NimRef *live = gc->live;
+        NimRef *live;
+
+        /* code first: its dtor waits for other tasks to stop running it */
+        /* natively, & until then they may still need its constants etc. */
+        for (live = gc->live; live != NULL; live = live->next) {
+            if (NIM_ANY_CLASS(live) == nim_code_class) {
+                nim_gc_value_dtor (gc, live);
+            }
+        }
+        live = gc->live;
         while (live != NULL) {
             NimRef *next = live->next;
-            nim_gc_value_dtor (gc, live);
+            if (NIM_ANY_CLASS(live) != nim_code_class) {
+                nim_gc_value_dtor (gc, live);
+            }
             live = next;
         }
         gc->live = NULL;
 
+        while (gc->arenas != NULL) {
+            nim_gc_arena_delete (gc, gc->arenas);
+        }
+
         nim_heap_destroy (&gc->heap);
         NIM_FREE (gc->roots);
         NIM_FREE (gc);
@@ -230,13 +277,18 @@ nim_gc_new_object (NimGC *gc)
     }
 
     if (gc->free == NULL) {
-        if (!nim_gc_collect (gc)) {
+        /* grow if the collection left the heap mostly full, too: */
+        /* otherwise a big live set means a collection every few allocs. */
+        if (!nim_gc_collect (gc) ||
+                nim_gc_num_free (gc) < NIM_HEAP_CAPACITY(&gc->heap) / 4) {
             NimSlab *slab;
             if (!nim_heap_grow (&gc->heap)) {
                 NIM_BUG ("out of memory");
                 return NULL;
             }
             slab = NIM_HEAP_CURRENT_SLAB(&gc->heap);
+            /* keep whatever the collection did free */
+            slab->refs[gc->heap.slab_size - 1].next = gc->free;
             gc->free = slab->head;
         }
     }
@@ -251,6 +303,175 @@ nim_gc_new_object (NimGC *gc)
     return ref;
 }
 
+NimArena *
+nim_gc_arena_new (NimGC *gc)
+{
+    NimArena *arena;
+
+    if (gc == NULL) {
+        gc = NIM_CURRENT_GC;
+    }
+
+    arena = NIM_MALLOC(NimArena, sizeof(*arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    memset (arena, 0, sizeof(*arena));
+    arena->next = gc->arenas;
+    gc->arenas = arena;
+    return arena;
+}
+
+static void
+_nim_gc_arena_free (NimArena *arena)
+{
+    NimArenaChunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        NimArenaChunk *next = chunk->next;
+        NIM_FREE (chunk);
+        chunk = next;
+    }
+    NIM_FREE (arena);
+}
+
+void
+nim_gc_arena_delete (NimGC *gc, NimArena *arena)
+{
+    NimArena **p;
+
+    if (gc == NULL) {
+        gc = NIM_CURRENT_GC;
+    }
+
+    for (p = &gc->arenas; *p != NULL; p = &(*p)->next) {
+        if (*p == arena) {
+            *p = arena->next;
+            break;
+        }
+    }
+    if (gc->arena == arena) {
+        gc->arena = NULL;
+    }
+
+    _nim_gc_arena_free (arena);
+}
+
+NimArena *
+nim_gc_static_arena_new (void)
+{
+    NimArena *arena = NIM_MALLOC(NimArena, sizeof(*arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    memset (arena, 0, sizeof(*arena));
+    return arena;
+}
+
+void
+nim_gc_static_arena_delete (NimArena *arena)
+{
+    if (arena != NULL) {
+        _nim_gc_arena_free (arena);
+    }
+}
+
+NimArena *
+nim_gc_arena_find (NimGC *gc, NimRef *ref)
+{
+    NimArena *arena;
+    NimArenaChunk *chunk;
+
+    if (gc == NULL) {
+        gc = NIM_CURRENT_GC;
+    }
+
+    for (arena = gc->arenas; arena != NULL; arena = arena->next) {
+        for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+            if ((char *) ref >= chunk->data &&
+                    (char *) ref < chunk->data + chunk->used) {
+                return arena;
+            }
+        }
+    }
+    return NULL;
+}
+
+NimArena *
+nim_gc_arena_enter (NimGC *gc, NimArena *arena)
+{
+    NimArena *prev;
+
+    if (gc == NULL) {
+        gc = NIM_CURRENT_GC;
+    }
+
+    prev = gc->arena;
+    gc->arena = arena;
+    return prev;
+}
+
+void *
+nim_gc_arena_alloc (NimArena *arena, size_t size)
+{
+    NimArenaChunk *chunk = arena->chunks;
+    void *ptr;
+
+    size = NIM_ARENA_ALIGN(size);
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > NIM_ARENA_CHUNK_SIZE
+            ? size : NIM_ARENA_CHUNK_SIZE;
+        chunk = NIM_MALLOC(NimArenaChunk,
+                    NIM_ARENA_ALIGN(sizeof(*chunk)) + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->data = ((char *) chunk) + NIM_ARENA_ALIGN(sizeof(*chunk));
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+NimRef *
+nim_gc_new_temp_object (NimGC *gc, size_t size)
+{
+    if (gc == NULL) {
+        gc = NIM_CURRENT_GC;
+    }
+
+    if (gc->arena == NULL) {
+        return nim_gc_new_object (gc);
+    }
+
+    return nim_gc_arena_new_object (gc->arena, size);
+}
+
+NimRef *
+nim_gc_arena_new_object (NimArena *arena, size_t size)
+{
+    NimRef *ref;
+
+    if (size > NIM_VALUE_SIZE) {
+        NIM_BUG ("object too big: %zu bytes", size);
+        return NULL;
+    }
+
+    ref = nim_gc_arena_alloc (arena, NIM_REF_HEADER_SIZE + size);
+    if (ref == NULL) {
+        NIM_BUG ("out of memory");
+        return NULL;
+    }
+    memset (ref, 0, NIM_REF_HEADER_SIZE + size);
+    ref->next = arena->objects;
+    arena->objects = ref;
+    return ref;
+}
+
 nim_bool_t
 nim_gc_make_root (NimGC *gc, NimRef *ref)
 {
@@ -395,6 +616,7 @@ nim_gc_collect (NimGC *gc)
 {
     size_t i;
     NimRef *ref;
+    NimArena *arena;
     NimRef *base;
     /* save registers to the stack */
 #if (defined NIM_ARCH_X86_64) && (defined __GNUC__)
@@ -463,6 +685,15 @@ nim_gc_collect (NimGC *gc)
 
     nim_task_mark (gc, NIM_CURRENT_TASK);
 
+    /* arena objects aren't in the heap, so they're only ever roots */
+    for (arena = gc->arenas; arena != NULL; arena = arena->next) {
+        for (ref = arena->objects; ref != NULL; ref = ref->next) {
+            NimRef *klass = NIM_FAST_ANY(ref)->klass;
+            nim_gc_mark_ref (gc, klass);
+            NIM_CLASS(klass)->mark (gc, ref);
+        }
+    }
+
     if (gc->stack_start != NULL) {
         void *ref_p;
         
@@ -0,0 +1,119 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "nim/generator.h"
+#include "nim/array.h"
+#include "nim/frame.h"
+#include "nim/str.h"
+#include "nim/class.h"
+#include "nim/object.h"
+#include "nim/vm.h"
+
+NimRef *nim_generator_class = NULL;
+
+static nim_bool_t
+_nim_generator_iter_next (NimRef *self, size_t *pos, NimRef **value)
+{
+    return nim_generator_next (self, value);
+}
+
+static void
+_nim_generator_mark (NimGC *gc, NimRef *self)
+{
+    NIM_SUPER (self)->mark (gc, self);
+
+    nim_gc_mark_ref (gc, NIM_GENERATOR(self)->frame);
+}
+
+nim_bool_t
+nim_generator_class_bootstrap (void)
+{
+    nim_generator_class = nim_class_new (
+        NIM_STR_NEW("generator"), NULL, sizeof(NimGenerator));
+    if (nim_generator_class == NULL) {
+        return NIM_FALSE;
+    }
+    NIM_CLASS(nim_generator_class)->mark = _nim_generator_mark;
+    NIM_CLASS(nim_generator_class)->iter_next = _nim_generator_iter_next;
+    nim_gc_make_root (NULL, nim_generator_class);
+    return NIM_TRUE;
+}
+
+NimRef *
+nim_generator_new (NimRef *method, NimRef *args)
+{
+    NimRef *frame;
+    NimRef *saved;
+    NimRef *self;
+    size_t i;
+
+    frame = nim_frame_new (method);
+    if (frame == NULL) {
+        return NULL;
+    }
+    /* the args are waiting on the stack when the function starts */
+    saved = nim_array_new_with_capacity (NIM_ARRAY_SIZE(args));
+    if (saved == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < NIM_ARRAY_SIZE(args); i++) {
+        if (!nim_array_push (saved, NIM_ARRAY_ITEM(args, i))) {
+            return NULL;
+        }
+    }
+    NIM_FRAME(frame)->saved = saved;
+    NIM_FRAME(frame)->suspended = NIM_TRUE;
+
+    self = nim_gc_new_object (NULL);
+    if (self == NULL) {
+        return NULL;
+    }
+    NIM_ANY(self)->klass = nim_generator_class;
+    NIM_GENERATOR(self)->frame = frame;
+    NIM_GENERATOR(self)->running = NIM_FALSE;
+    return self;
+}
+
+/* runs the generator to its next yield. *value is set to what it */
+/* yielded, or to NULL once the function has returned. */
+nim_bool_t
+nim_generator_next (NimRef *self, NimRef **value)
+{
+    NimRef *frame = NIM_GENERATOR(self)->frame;
+    nim_bool_t ok;
+
+    if (frame == NULL) {
+        *value = NULL;
+        return NIM_TRUE;
+    }
+    if (NIM_GENERATOR(self)->running) {
+        NIM_BUG ("generator is already running");
+        return NIM_FALSE;
+    }
+    NIM_GENERATOR(self)->running = NIM_TRUE;
+    ok = nim_vm_resume (NULL, frame, value);
+    NIM_GENERATOR(self)->running = NIM_FALSE;
+    if (!ok) {
+        return NIM_FALSE;
+    }
+    if (*value == NULL) {
+        NIM_GENERATOR(self)->frame = NULL;
+    }
+    return NIM_TRUE;
+}
+
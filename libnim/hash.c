@@ -101,16 +101,16 @@ nim_hash_str (NimRef *self)
 }
 
 static NimRef *
-_nim_hash_put (NimRef *self, NimRef *args)
+_nim_hash_put (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    return NIM_BOOL_REF(nim_hash_put (self, NIM_ARRAY_ITEM(args, 0), NIM_ARRAY_ITEM(args, 1)));
+    return NIM_BOOL_REF(nim_hash_put (self, args[0].o, args[1].o));
 }
 
 static NimRef *
-_nim_hash_get (NimRef *self, NimRef *args)
+_nim_hash_get (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     NimRef *value;
-    int rc = nim_hash_get (self, NIM_ARRAY_ITEM(args, 0), &value);
+    int rc = nim_hash_get (self, args[0].o, &value);
     if (rc > 0) {
         return nim_nil;
     }
@@ -123,7 +123,7 @@ _nim_hash_get (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_hash_size (NimRef *self, NimRef *args)
+_nim_hash_size (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     return nim_int_new (NIM_HASH_SIZE (self));
 }
@@ -161,7 +161,7 @@ _nim_hash_mark (NimGC *gc, NimRef *self)
 }
 
 static NimRef *
-_nim_hash_items (NimRef *self, NimRef *args)
+_nim_hash_items (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     size_t i;
     NimRef *items = nim_array_new ();
@@ -186,6 +186,19 @@ _nim_hash_nonzero (NimRef *self)
     return NIM_BOOL_REF(NIM_HASH_SIZE(self) > 0);
 }
 
+/* iterating over a hash gives its keys, in the order they're stored */
+static nim_bool_t
+_nim_hash_iter_next (NimRef *self, size_t *pos, NimRef **value)
+{
+    if (*pos < NIM_HASH_SIZE(self)) {
+        *value = NIM_HASH(self)->keys[(*pos)++];
+    }
+    else {
+        *value = NULL;
+    }
+    return NIM_TRUE;
+}
+
 nim_bool_t
 nim_hash_class_bootstrap (void)
 {
@@ -199,11 +212,16 @@ nim_hash_class_bootstrap (void)
     NIM_CLASS(nim_hash_class)->getitem = _nim_hash_getitem;
     NIM_CLASS(nim_hash_class)->mark = _nim_hash_mark;
     NIM_CLASS(nim_hash_class)->nonzero = _nim_hash_nonzero;
+    NIM_CLASS(nim_hash_class)->iter_next = _nim_hash_iter_next;
     nim_gc_make_root (NULL, nim_hash_class);
-    nim_class_add_native_method (nim_hash_class, "put", _nim_hash_put);
-    nim_class_add_native_method (nim_hash_class, "get", _nim_hash_get);
-    nim_class_add_native_method (nim_hash_class, "size", _nim_hash_size);
-    nim_class_add_native_method (nim_hash_class, "items", _nim_hash_items);
+    nim_class_add_native_method_typed (
+        nim_hash_class, "put", "oo", _nim_hash_put);
+    nim_class_add_native_method_typed (
+        nim_hash_class, "get", "o", _nim_hash_get);
+    nim_class_add_native_method_typed (
+        nim_hash_class, "size", "", _nim_hash_size);
+    nim_class_add_native_method_typed (
+        nim_hash_class, "items", "", _nim_hash_items);
     return NIM_TRUE;
 }
 
@@ -213,6 +231,30 @@ nim_hash_new (void)
     return nim_class_new_instance (nim_hash_class, NULL);
 }
 
+NimRef *
+nim_hash_copy (NimRef *self)
+{
+    const size_t size = NIM_HASH_SIZE(self);
+    NimRef *copy = nim_hash_new ();
+    if (copy == NULL || size == 0) {
+        return copy;
+    }
+    NIM_HASH(copy)->keys = NIM_MALLOC(NimRef *, size * sizeof(NimRef *));
+    if (NIM_HASH(copy)->keys == NULL) {
+        return NULL;
+    }
+    NIM_HASH(copy)->values = NIM_MALLOC(NimRef *, size * sizeof(NimRef *));
+    if (NIM_HASH(copy)->values == NULL) {
+        return NULL;
+    }
+    memcpy (NIM_HASH(copy)->keys, NIM_HASH(self)->keys,
+            size * sizeof(NimRef *));
+    memcpy (NIM_HASH(copy)->values, NIM_HASH(self)->values,
+            size * sizeof(NimRef *));
+    NIM_HASH(copy)->size = size;
+    return copy;
+}
+
 nim_bool_t
 nim_hash_put (NimRef *self, NimRef *key, NimRef *value)
 {
@@ -221,7 +263,7 @@ nim_hash_put (NimRef *self, NimRef *key, NimRef *value)
     size_t i;
 
     for (i = 0; i < NIM_HASH_SIZE(self); i++) {
-        NimCmpResult r = nim_object_cmp (NIM_HASH(self)->keys[i], key);
+        NimCmpResult r = nim_object_cmp_eq (NIM_HASH(self)->keys[i], key);
         if (r == NIM_CMP_ERROR) {
             return NIM_FALSE;
         }
@@ -253,7 +295,7 @@ nim_hash_put (NimRef *self, NimRef *key, NimRef *value)
 nim_bool_t
 nim_hash_put_str (NimRef *self, const char *key, NimRef *value)
 {
-    return nim_hash_put (self, nim_str_new (key, strlen(key)), value);
+    return nim_hash_put (self, nim_str_intern (key, strlen(key)), value);
 }
 
 int
@@ -261,7 +303,7 @@ nim_hash_get (NimRef *self, NimRef *key, NimRef **value)
 {
     size_t i;
     for (i = 0; i < NIM_HASH_SIZE(self); i++) {
-        NimCmpResult r = nim_object_cmp (NIM_HASH(self)->keys[i], key);
+        NimCmpResult r = nim_object_cmp_eq (NIM_HASH(self)->keys[i], key);
         if (r == NIM_CMP_ERROR) {
             if (value != NULL) {
                 *value = NULL;
@@ -25,8 +25,10 @@
 #include <nim/module.h>
 #include <nim/str.h>
 #include <nim/int.h>
+#include <nim/float.h>
 #include <nim/array.h>
 #include <nim/hash.h>
+#include <nim/range.h>
 #include <nim/class.h>
 #include <nim/task.h>
 #include <nim/method.h>
@@ -35,6 +37,8 @@
 #include <nim/ast.h>
 #include <nim/code.h>
 #include <nim/compile.h>
+#include <nim/cache.h>
+#include <nim/module_mgr.h>
 
 #endif
 
@@ -45,6 +45,13 @@ nim_array_new_with_capacity (size_t capacity);
 NimRef *
 nim_array_new_var (NimRef *a, ...);
 
+/* a shallow copy: the items are shared, the array isn't */
+NimRef *
+nim_array_copy (NimRef *self);
+
+nim_bool_t
+nim_array_ensure_capacity (NimRef *self, size_t capacity);
+
 nim_bool_t
 nim_array_insert (NimRef *self, int32_t pos, NimRef *value);
 
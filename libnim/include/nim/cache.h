@@ -0,0 +1,58 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+#ifndef _NIM_CACHE_H_INCLUDED_
+#define _NIM_CACHE_H_INCLUDED_
+
+#include <nim/gc.h>
+#include <nim/any.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* compiled modules are cached in .nimc files: next to the source by */
+/* default, or in NIM_CACHE_DIR if that's set. NIM_CACHE=0 turns the */
+/* cache off. a cache file is only used if the source's mtime, size, */
+/* path & contents all match what was recorded when it was written. */
+
+/* bump whenever the bytecode or the file format changes */
+#define NIM_CACHE_VERSION 3
+
+/* like nim_compile_file, but loads the module from its cache file */
+/* when there's a valid one, and writes one when there isn't. */
+NimRef *
+nim_cache_compile_file (NimRef *name, const char *filename);
+
+/* NULL if there's no valid cache file for the given source file */
+NimRef *
+nim_cache_load (NimRef *name, const char *filename);
+
+/* the names of the modules it uses, from a valid cache file: */
+/* NULL if there isn't one */
+NimRef *
+nim_cache_uses (NimRef *name, const char *filename);
+
+nim_bool_t
+nim_cache_store (NimRef *module, const char *filename);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
+
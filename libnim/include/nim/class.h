@@ -52,6 +52,9 @@ typedef struct _NimClass {
     NimRef *(*getattr)(NimRef *, NimRef *);
     NimRef *(*getitem)(NimRef *, NimRef *);
     NimRef *(*nonzero)(NimRef *);
+    /* for x in y: sets *value to the item at *pos & advances *pos, */
+    /* or sets *value to NULL if there are no items left. */
+    nim_bool_t (*iter_next)(NimRef *, size_t *, NimRef **);
     struct _NimLWHash *methods;
 } NimClass;
 
@@ -64,9 +67,17 @@ nim_class_new_instance (NimRef *klass, ...);
 nim_bool_t
 nim_class_add_method (NimRef *klass, NimRef *name, NimRef *method);
 
+NimRef *
+nim_class_lookup_method (NimRef *klass, NimRef *name);
+
 nim_bool_t
 nim_class_add_native_method (NimRef *klass, const char *name, NimNativeMethodFunc func);
 
+nim_bool_t
+nim_class_add_native_method_typed (
+    NimRef *klass, const char *name, const char *sig,
+    NimTypedNativeMethodFunc func);
+
 nim_bool_t
 _nim_bootstrap_L3 (void);
 
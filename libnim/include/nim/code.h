@@ -33,10 +33,17 @@ typedef enum _NimOpcode {
     NIM_OPCODE_PUSHCONST,
     NIM_OPCODE_STORENAME,
     NIM_OPCODE_PUSHNAME,
+    NIM_OPCODE_PUSHLOCAL,
+    NIM_OPCODE_STORELOCAL,
+    NIM_OPCODE_PUSHUPVAL,
+    NIM_OPCODE_STOREUPVAL,
+    NIM_OPCODE_LOADGLOBAL,
+    NIM_OPCODE_LOADBUILTIN,
     NIM_OPCODE_PUSHNIL,
     NIM_OPCODE_GETATTR,
     NIM_OPCODE_GETITEM,
     NIM_OPCODE_CALL,
+    NIM_OPCODE_CALLMETHOD,
     NIM_OPCODE_MAKEARRAY,
     NIM_OPCODE_MAKEHASH,
 
@@ -53,6 +60,8 @@ typedef enum _NimOpcode {
     NIM_OPCODE_POP,
 
     NIM_OPCODE_RET,
+    /* CALL that reuses the caller's frame if the target is bytecode */
+    NIM_OPCODE_TAILCALL,
     NIM_OPCODE_SPAWN,
 
     NIM_OPCODE_ADD,
@@ -63,7 +72,49 @@ typedef enum _NimOpcode {
     NIM_OPCODE_MAKECLOSURE,
 
     /* XXX temporary until we get a better way to do it */
-    NIM_OPCODE_GETCLASS
+    NIM_OPCODE_GETCLASS,
+
+    /* supplies the high 24 bits of ARG1 for the instruction that follows */
+    NIM_OPCODE_EXTENDED_ARG,
+
+    /* for loops: GETITER replaces the top of the stack with an iterator */
+    /* over it. FORITER pushes the iterator's next value, or jumps (with */
+    /* the iterator still on the stack) once there are none left. */
+    NIM_OPCODE_GETITER,
+    NIM_OPCODE_FORITER,
+
+    /* suspends the running generator, handing the top of the stack to */
+    /* whoever resumed it (see nim/generator.h) */
+    NIM_OPCODE_YIELD,
+
+    /* pushes a fresh shallow copy of the array or hash const ARG1: the */
+    /* compiler's form of a literal that only contains constants */
+    NIM_OPCODE_CLONECONST,
+
+    /* quickened forms of the generic opcodes above: never emitted by */
+    /* the compiler, the VM rewrites instructions in place at runtime. */
+    NIM_OPCODE_ADD_INT,
+    NIM_OPCODE_SUB_INT,
+    NIM_OPCODE_MUL_INT,
+    NIM_OPCODE_DIV_INT,
+    NIM_OPCODE_CMPEQ_INT,
+    NIM_OPCODE_CMPNEQ_INT,
+    NIM_OPCODE_CMPGT_INT,
+    NIM_OPCODE_CMPGTE_INT,
+    NIM_OPCODE_CMPLT_INT,
+    NIM_OPCODE_CMPLTE_INT,
+
+    /* superinstructions: only produced by nim_code_optimize */
+    NIM_OPCODE_JUMPIFNOTEQ,     /* CMPEQ  + JUMPIFFALSE */
+    NIM_OPCODE_JUMPIFNOTNEQ,    /* CMPNEQ + JUMPIFFALSE */
+    NIM_OPCODE_JUMPIFNOTGT,     /* CMPGT  + JUMPIFFALSE */
+    NIM_OPCODE_JUMPIFNOTGTE,    /* CMPGTE + JUMPIFFALSE */
+    NIM_OPCODE_JUMPIFNOTLT,     /* CMPLT  + JUMPIFFALSE */
+    NIM_OPCODE_JUMPIFNOTLTE,    /* CMPLTE + JUMPIFFALSE */
+    NIM_OPCODE_ADDNAMECONST,    /* PUSHNAME + PUSHCONST + ADD */
+    NIM_OPCODE_ADDLOCALCONST,   /* PUSHLOCAL + PUSHCONST + ADD */
+    /* not an opcode: how many there are */
+    NIM_OPCODE_COUNT
 } NimOpcode;
 
 typedef enum _NimBinopType {
@@ -81,6 +132,20 @@ typedef enum _NimBinopType {
     NIM_BINOP_DIV
 } NimBinopType;
 
+/* a monomorphic inline cache for a single GETATTR, LOADGLOBAL or
+ * CALLMETHOD site.
+ *
+ * code objects are shared across tasks, so entries are guarded by a
+ * sequence counter: writers make it odd while filling the entry, readers
+ * discard anything they saw while it was odd or changed underneath them.
+ */
+typedef struct _NimAttrCache {
+    volatile uint32_t  seq;
+    uint32_t           epoch;
+    NimRef            *key;
+    NimRef            *value;
+} NimAttrCache;
+
 typedef struct _NimCode {
     NimAny base;
     NimRef *constants;
@@ -90,8 +155,35 @@ typedef struct _NimCode {
     size_t    allocated;
     NimRef *vars;
     NimRef *freevars;
+    /* where MAKECLOSURE finds each freevar in the enclosing frame: */
+    /* >= 0 is a local slot, < 0 is upvalue (-slot - 1). */
+    int32_t *freevar_slots;
+    NimAttrCache *attr_caches;
+    size_t        attr_caches_used;
+    /* hash indexes over constants & names, only kept while emitting */
+    struct _NimCodePoolIndex *const_index;
+    struct _NimCodePoolIndex *name_index;
+    /* native code, see nim/jit.h. jit_state is one of NIM_CODE_JIT_* */
+    struct _NimJitCode *jit;
+    volatile int        jit_state;
+    uint32_t            jit_counter;
+    /* tasks compiling or running jit right now, see nim_jit_pin */
+    volatile int        jit_pins;
+    /* values on the stack when the code starts running (its args) */
+    size_t     nargs;
+    /* set by nim_code_verify */
+    nim_bool_t verified;
+    size_t     max_stack;
+    /* set once YIELD is emitted: calling the code makes a generator */
+    nim_bool_t generator;
 } NimCode;
 
+#define NIM_CODE_JIT_NONE      0
+#define NIM_CODE_JIT_COMPILING 1
+#define NIM_CODE_JIT_READY     2
+#define NIM_CODE_JIT_FAILED    3
+#define NIM_CODE_JIT_DEAD      4
+
 typedef struct _NimLabel {
     size_t      *patchlist;
     size_t       patchlist_size;
@@ -114,6 +206,24 @@ nim_code_pushname (NimRef *self, NimRef *id);
 nim_bool_t
 nim_code_pushnil (NimRef *self);
 
+nim_bool_t
+nim_code_pushlocal (NimRef *self, size_t slot);
+
+nim_bool_t
+nim_code_storelocal (NimRef *self, size_t slot);
+
+nim_bool_t
+nim_code_pushupval (NimRef *self, size_t slot);
+
+nim_bool_t
+nim_code_storeupval (NimRef *self, size_t slot);
+
+nim_bool_t
+nim_code_loadglobal (NimRef *self, NimRef *id);
+
+nim_bool_t
+nim_code_loadbuiltin (NimRef *self, size_t index);
+
 nim_bool_t
 nim_code_storename (NimRef *self, NimRef *id);
 
@@ -127,11 +237,20 @@ nim_bool_t
 nim_code_getitem (NimRef *self);
 
 nim_bool_t
-nim_code_call (NimRef *self, uint8_t nargs);
+nim_code_call (NimRef *self, size_t nargs);
+
+nim_bool_t
+nim_code_callmethod (NimRef *self, NimRef *id, size_t nargs);
 
 nim_bool_t
 nim_code_ret (NimRef *self);
 
+nim_bool_t
+nim_code_tailcall (NimRef *self);
+
+nim_bool_t
+nim_code_unpop (NimRef *self);
+
 nim_bool_t
 nim_code_not (NimRef *self);
 
@@ -142,14 +261,27 @@ nim_bool_t
 nim_code_spawn (NimRef *self);
 
 nim_bool_t
-nim_code_makearray (NimRef *self, uint8_t nargs);
+nim_code_makearray (NimRef *self, size_t nargs);
 
 nim_bool_t
-nim_code_makehash (NimRef *self, uint8_t nargs);
+nim_code_makehash (NimRef *self, size_t nargs);
+
+/* template must never be modified once it's been added to the code */
+nim_bool_t
+nim_code_cloneconst (NimRef *self, NimRef *template);
 
 nim_bool_t
 nim_code_makeclosure (NimRef *self);
 
+nim_bool_t
+nim_code_add_freevar (NimRef *self, NimRef *name, int32_t slot);
+
+int32_t
+nim_code_find_var (NimRef *self, NimRef *name);
+
+int32_t
+nim_code_find_freevar (NimRef *self, NimRef *name);
+
 nim_bool_t
 nim_code_jumpiftrue (NimRef *self, NimLabel *label);
 
@@ -159,6 +291,15 @@ nim_code_jumpiffalse (NimRef *self, NimLabel *label);
 nim_bool_t
 nim_code_jump (NimRef *self, NimLabel *label);
 
+nim_bool_t
+nim_code_getiter (NimRef *self);
+
+nim_bool_t
+nim_code_foriter (NimRef *self, NimLabel *label);
+
+nim_bool_t
+nim_code_yield (NimRef *self);
+
 nim_bool_t
 nim_code_eq (NimRef *self);
 
@@ -192,9 +333,35 @@ nim_code_div (NimRef *self);
 nim_bool_t
 nim_code_pop (NimRef *self);
 
+nim_bool_t
+nim_code_peephole (NimRef *self, nim_bool_t verbose);
+
+nim_bool_t
+nim_code_optimize (NimRef *self);
+
+nim_bool_t
+nim_code_verify (NimRef *self);
+
+/* frees what's only needed while emitting (the pool indexes) */
+void
+nim_code_finish (NimRef *self);
+
 NimRef *
 nim_code_dump (NimRef *self);
 
+const char *
+nim_code_opcode_str (NimOpcode op);
+
+NimRef *
+nim_code_attr_cache_get (NimRef *self, size_t slot, NimRef *key);
+
+void
+nim_code_attr_cache_put (
+    NimRef *self, size_t slot, NimRef *key, NimRef *value);
+
+void
+nim_code_attr_cache_invalidate (void);
+
 void
 nim_code_use_label (NimRef *self, NimLabel *label);
 
@@ -210,14 +377,47 @@ nim_label_free (NimLabel *self);
 #define NIM_INSTR_OP(ref, n) ((NimOpcode)((NIM_CODE_INSTR(ref, n) & 0xff000000) >> 24))
 #define NIM_INSTR_ADDR(ref, n) (NIM_CODE_INSTR(ref, n) & 0x00ffffff)
 
+#define NIM_OPCODE_IS_JUMP(op) \
+    ((op) == NIM_OPCODE_JUMP || \
+     (op) == NIM_OPCODE_JUMPIFTRUE || \
+     (op) == NIM_OPCODE_JUMPIFFALSE || \
+     (op) == NIM_OPCODE_FORITER || \
+     ((op) >= NIM_OPCODE_JUMPIFNOTEQ && (op) <= NIM_OPCODE_JUMPIFNOTLTE))
+
+#define NIM_INSTR_SET_OP(ref, n, op) \
+    (NIM_CODE_INSTR(ref, n) = \
+        (NIM_CODE_INSTR(ref, n) & 0x00ffffff) | (((op) & 0xff) << 24))
+
+/* set in ARG1 of a generic instruction once its quickened form deopts */
+#define NIM_INSTR_NOQUICKEN 0x01
+
 #define NIM_INSTR_ARG1(ref, n) ((NIM_CODE_INSTR(ref, n) & 0x00ff0000) >> 16)
 #define NIM_INSTR_ARG2(ref, n) ((NIM_CODE_INSTR(ref, n) & 0x0000ff00) >> 8)
 #define NIM_INSTR_ARG3(ref, n) ((NIM_CODE_INSTR(ref, n) & 0x000000ff))
 
+#define NIM_INSTR_EXTENDED(ref, n) \
+    ((n) > 0 && NIM_INSTR_OP(ref, (n) - 1) == NIM_OPCODE_EXTENDED_ARG)
+
+/* ARG1, widened by a preceding EXTENDED_ARG if there is one */
+#define NIM_INSTR_EXTARG1(ref, n) \
+    (NIM_INSTR_EXTENDED(ref, n) ? \
+        ((NIM_INSTR_ADDR(ref, (n) - 1) << 8) | NIM_INSTR_ARG1(ref, n)) : \
+        NIM_INSTR_ARG1(ref, n))
+
+/* the attr cache slot of GETATTR, LOADGLOBAL & CALLMETHOD. it lives in */
+/* ARG3, widened by a second EXTENDED_ARG ahead of the one for ARG1 */
+#define NIM_INSTR_EXTENDED2(ref, n) \
+    (NIM_INSTR_EXTENDED(ref, n) && NIM_INSTR_EXTENDED(ref, (n) - 1))
+
+#define NIM_INSTR_ATTRCACHE(ref, n) \
+    (NIM_INSTR_EXTENDED2(ref, n) ? \
+        ((NIM_INSTR_ADDR(ref, (n) - 2) << 8) | NIM_INSTR_ARG3(ref, n)) : \
+        NIM_INSTR_ARG3(ref, n))
+
 /* constants */
 
 #define NIM_INSTR_CONST1(ref, n) \
-    NIM_ARRAY_ITEM(NIM_CODE_CONSTANTS(ref), NIM_INSTR_ARG1(ref, n))
+    NIM_ARRAY_ITEM(NIM_CODE_CONSTANTS(ref), NIM_INSTR_EXTARG1(ref, n))
 
 #define NIM_INSTR_CONST2(ref, n) \
     NIM_ARRAY_ITEM(NIM_CODE_CONSTANTS(ref), NIM_INSTR_ARG2(ref, n))
@@ -228,7 +428,7 @@ nim_label_free (NimLabel *self);
 /* names */
 
 #define NIM_INSTR_NAME1(ref, n) \
-    NIM_ARRAY_ITEM(NIM_CODE_NAMES(ref), NIM_INSTR_ARG1(ref, n))
+    NIM_ARRAY_ITEM(NIM_CODE_NAMES(ref), NIM_INSTR_EXTARG1(ref, n))
 
 #define NIM_INSTR_NAME2(ref, n) \
     NIM_ARRAY_ITEM(NIM_CODE_NAMES(ref), NIM_INSTR_ARG2(ref, n))
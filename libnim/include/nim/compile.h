@@ -25,12 +25,26 @@
 extern "C" {
 #endif
 
+/* frees the AST along with the arena it was parsed into */
 NimRef *
 nim_compile_ast (NimRef *name, const char *filename, NimRef *ast);
 
 NimRef *
 nim_compile_file (NimRef *name, const char *filename);
 
+/* the AST for a source file, or NULL if it doesn't parse. it lives */
+/* in an arena of its own until it's passed to nim_compile_ast. */
+NimRef *
+nim_compile_parse_file (const char *filename);
+
+/* the names of the modules a module's AST uses */
+NimRef *
+nim_compile_uses (NimRef *ast);
+
+/* the module name for a source file: its basename, minus any extension */
+NimRef *
+nim_compile_module_name (const char *filename);
+
 #define NIM_COMPILE_MODULE_FROM_AST(name, ast) \
     nim_compile_ast (nim_str_new ((name), strlen(name)), (ast))
 
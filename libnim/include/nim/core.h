@@ -53,6 +53,12 @@ nim_bug (const char *filename, int lineno, const char *format, ...);
 nim_bool_t
 nim_is_builtin (struct _NimRef *name);
 
+int32_t
+nim_builtin_index (struct _NimRef *name);
+
+struct _NimRef *
+nim_builtin_at (size_t index);
+
 extern struct _NimRef *nim_module_path;
 
 NimRef *
@@ -29,7 +29,19 @@ extern "C" {
 typedef struct _NimFrame {
     NimAny   base;
     NimRef  *method;
+    /* NimVar cells, one per entry in code->vars */
     NimRef  *locals;
+    /* the closure's captured cells, or NULL */
+    NimRef  *upvalues;
+    /* where this frame's args started on the VM stack */
+    size_t   stack_base;
+    /* the CALL we're waiting on while a callee runs in the same loop, */
+    /* or where a suspended generator picks up again */
+    size_t   pc;
+    /* a suspended generator's values from stack_base up, or NULL */
+    NimRef  *saved;
+    /* set by YIELD, cleared when the frame is resumed */
+    nim_bool_t suspended;
 } NimFrame;
 
 nim_bool_t
@@ -69,6 +69,49 @@ nim_gc_new_object (NimGC *gc);
 nim_bool_t
 nim_gc_make_root (NimGC *gc, NimRef *ref);
 
+typedef struct _NimArena NimArena;
+
+/* arenas hold short-lived objects (the compiler's AST & symbol tables) */
+/* outside of the heap. they're never collected one by one: everything */
+/* in an arena is a root until the whole arena is deleted. */
+NimArena *
+nim_gc_arena_new (NimGC *gc);
+
+void
+nim_gc_arena_delete (NimGC *gc, NimArena *arena);
+
+/* an arena that belongs to no GC. its objects live outside of every */
+/* task's heap, so they're never marked or collected & must not point */
+/* into a heap themselves (interned strs live in one). */
+NimArena *
+nim_gc_static_arena_new (void);
+
+void
+nim_gc_static_arena_delete (NimArena *arena);
+
+/* the arena that ref was allocated from, or NULL */
+NimArena *
+nim_gc_arena_find (NimGC *gc, NimRef *ref);
+
+/* makes arena (or the heap, if it's NULL) the place that */
+/* nim_gc_new_temp_object allocates from. returns the old one. */
+NimArena *
+nim_gc_arena_enter (NimGC *gc, NimArena *arena);
+
+/* plain memory that's freed along with the arena. the GC never looks */
+/* inside it, so refs kept there need to be reachable some other way. */
+void *
+nim_gc_arena_alloc (NimArena *arena, size_t size);
+
+/* an object of the given value size allocated from arena */
+NimRef *
+nim_gc_arena_new_object (NimArena *arena, size_t size);
+
+/* like nim_gc_new_object, but from the current arena if there is one. */
+/* size is that of the object's value: it never gets a destructor. */
+NimRef *
+nim_gc_new_temp_object (NimGC *gc, size_t size);
+
 void *
 nim_gc_ref_check_cast (NimRef *ref, NimRef *klass);
 
@@ -92,6 +135,14 @@ nim_gc_num_free (NimGC *gc);
 
 #define NIM_VALUE_SIZE 256
 
+/* a ref's value follows its mark flag & next pointer (see gc.c) */
+#define NIM_REF_HEADER_SIZE (2 * sizeof(void *))
+
+/* NIM_CHECK_CAST without the NULL & class checks, for hot paths that */
+/* already know what they're looking at. */
+#define NIM_UNCHECKED_CAST(struc, ref) \
+    ((struc *)(((char *)(ref)) + NIM_REF_HEADER_SIZE))
+
 #define NIM_GC_MAKE_STACK_ROOT(p) \
     (*((NimRef **)alloca(sizeof(NimRef *)))) = (p)
 
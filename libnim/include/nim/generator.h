@@ -0,0 +1,58 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef _NIM_GENERATOR_H_INCLUDED_
+#define _NIM_GENERATOR_H_INCLUDED_
+
+#include <nim/gc.h>
+#include <nim/any.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* what calling a function containing yield returns: the function's */
+/* frame, suspended before its first instruction. each resume runs it */
+/* up to the next YIELD, in whichever task is iterating it. */
+typedef struct _NimGenerator {
+    NimAny     base;
+    /* NULL once the function has returned */
+    NimRef    *frame;
+    nim_bool_t running;
+} NimGenerator;
+
+nim_bool_t
+nim_generator_class_bootstrap (void);
+
+NimRef *
+nim_generator_new (NimRef *method, NimRef *args);
+
+nim_bool_t
+nim_generator_next (NimRef *self, NimRef **value);
+
+#define NIM_GENERATOR(ref) \
+    NIM_CHECK_CAST(NimGenerator, (ref), nim_generator_class)
+
+NIM_EXTERN_CLASS(generator);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
+
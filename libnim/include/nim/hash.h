@@ -40,6 +40,10 @@ nim_hash_class_bootstrap (void);
 NimRef *
 nim_hash_new (void);
 
+/* a shallow copy: the keys & values are shared, the hash isn't */
+NimRef *
+nim_hash_copy (NimRef *self);
+
 nim_bool_t
 nim_hash_put (NimRef *self, NimRef *key, NimRef *value);
 
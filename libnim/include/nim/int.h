@@ -34,6 +34,9 @@ typedef struct _NimInt {
 nim_bool_t
 nim_int_class_bootstrap (void);
 
+void
+nim_int_cleanup (void);
+
 NimRef *
 nim_int_new (int64_t value);
 
@@ -0,0 +1,55 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef _NIM_ITER_H_INCLUDED_
+#define _NIM_ITER_H_INCLUDED_
+
+#include <nim/gc.h>
+#include <nim/any.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the state of a for loop: the thing being iterated & a cursor that */
+/* only the target's iter_next understands. */
+typedef struct _NimIter {
+    NimAny  base;
+    NimRef *target;
+    size_t  pos;
+} NimIter;
+
+nim_bool_t
+nim_iter_class_bootstrap (void);
+
+NimRef *
+nim_iter_new (NimRef *target);
+
+nim_bool_t
+nim_iter_next (NimRef *self, NimRef **value);
+
+#define NIM_ITER(ref) NIM_CHECK_CAST(NimIter, (ref), nim_iter_class)
+
+NIM_EXTERN_CLASS(iter);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
+
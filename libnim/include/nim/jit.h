@@ -0,0 +1,95 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef _NIM_JIT_H_INCLUDED_
+#define _NIM_JIT_H_INCLUDED_
+
+#include <nim/gc.h>
+#include <nim/any.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A baseline template JIT: each instruction becomes a direct call to the
+ * same helper the interpreter uses, so it only saves us the dispatch.
+ * Jumps become native jumps. All state stays on the VM stack, which means
+ * we can enter compiled code at any instruction (e.g. on a loop back-edge)
+ * and that anything we can't compile simply stays in the interpreter.
+ */
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define NIM_JIT_SUPPORTED 1
+#endif
+
+typedef struct _NimJitCode NimJitCode;
+
+/* runs the instruction at pc. returns < 0 on error. for conditional */
+/* branches, > 0 means the branch is taken. for CALL, CALLMETHOD & */
+/* TAILCALL, > 0 means leave native code (e.g. so the VM can run the */
+/* callee without recursing). */
+typedef int (*NimJitHelper) (void *vm, void *state, size_t pc);
+
+/* reads NIM_JIT & NIM_JIT_THRESHOLD from the environment. called once */
+/* at startup, before there are any other threads to race with. */
+nim_bool_t
+nim_jit_init (void);
+
+/* enabled by NIM_JIT=1 in the environment */
+nim_bool_t
+nim_jit_enabled (void);
+
+/* calls + back-edges before a code object is compiled: NIM_JIT_THRESHOLD */
+uint32_t
+nim_jit_threshold (void);
+
+/* helpers is indexed by opcode. returns NULL if anything in the code */
+/* object has no helper (or we're on an unsupported platform). */
+NimJitCode *
+nim_jit_compile (NimRef *code, const NimJitHelper *helpers);
+
+/* a task other than the one owning code may be compiling or running it */
+/* (e.g. a spawned task). pinning keeps the code object, its bytecode & */
+/* its native code alive until the matching unpin. returns NIM_FALSE if */
+/* the code is already being destroyed. */
+nim_bool_t
+nim_jit_pin (NimRef *code);
+
+void
+nim_jit_unpin (NimRef *code);
+
+/* runs the native code of code starting at the instruction at pc until */
+/* RET or the end of the code (returns 0), a call helper asks us to leave */
+/* (returns > 0) or a helper fails (returns < 0). it holds a reference to */
+/* the native code rather than a pin, so the dtor never waits on a helper */
+/* that's blocked in e.g. recv. */
+int
+nim_jit_run (NimRef *code, void *vm, void *state, size_t pc);
+
+/* called by the code dtor: waits for any pins to go away, then drops the */
+/* code's reference to the native code. a nim_jit_run still in progress */
+/* frees it on the way out. the code can't be pinned again after this. */
+void
+nim_jit_free (NimRef *code);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
+
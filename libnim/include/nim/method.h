@@ -34,6 +34,27 @@ typedef enum _NimMethodType {
 
 typedef NimRef *(*NimNativeMethodFunc)(NimRef *, NimRef *);
 
+/* an arg to a typed native method, unboxed according to its signature */
+typedef union _NimNativeArg {
+    NimRef     *o;
+    const char *s;
+    int32_t     i;
+    int64_t     I;
+} NimNativeArg;
+
+/* args[n] for n >= nargs (optional args that weren't passed) are zeroed */
+typedef NimRef *(*NimTypedNativeMethodFunc)(
+    NimRef *self, const NimNativeArg *args, size_t nargs);
+
+#define NIM_NATIVE_SIG_MAX 8
+
+/* a nim_method_parse_args format string (e.g. "I|o"), parsed once */
+typedef struct _NimNativeSig {
+    uint8_t required;
+    uint8_t nargs;
+    char    types[NIM_NATIVE_SIG_MAX];
+} NimNativeSig;
+
 typedef struct _NimMethod {
     NimAny         base;
     NimRef        *self; /* NULL for unbound/function */
@@ -42,13 +63,17 @@ typedef struct _NimMethod {
     union {
         struct {
             NimNativeMethodFunc func;
+            /* if non-NULL, called instead of func with unboxed args */
+            NimTypedNativeMethodFunc typed;
+            NimNativeSig sig;
         } native;
         struct {
             NimRef *code;
         } bytecode;
         struct {
             NimRef *code;
-            NimRef *bindings;
+            /* captured NimVar cells, in the order of code->freevars */
+            NimRef *upvalues;
         } closure;
     };
 } NimMethod;
@@ -59,11 +84,15 @@ nim_method_class_bootstrap (void);
 NimRef *
 nim_method_new_native (NimRef *module, NimNativeMethodFunc func);
 
+NimRef *
+nim_method_new_native_typed (
+    NimRef *module, const char *sig, NimTypedNativeMethodFunc func);
+
 NimRef *
 nim_method_new_bytecode (NimRef *module, NimRef *code);
 
 NimRef *
-nim_method_new_closure (NimRef *method, NimRef *bindings);
+nim_method_new_closure (NimRef *method, NimRef *upvalues);
 
 NimRef *
 nim_method_new_bound (NimRef *unbound, NimRef *self);
@@ -74,11 +103,21 @@ nim_method_no_args (NimRef *args);
 nim_bool_t
 nim_method_parse_args (NimRef *args, const char *fmt, ...);
 
+nim_bool_t
+nim_method_parse_sig (NimNativeSig *sig, const char *fmt);
+
+NimRef *
+nim_method_call_typed (
+    NimRef *method, NimRef *self, NimRef **argv, size_t argc);
+
 #define NIM_METHOD(ref) NIM_CHECK_CAST(NimMethod, (ref), nim_method_class)
 #define NIM_METHOD_SELF(ref) (NIM_METHOD(ref)->self)
 #define NIM_METHOD_TYPE(ref) (NIM_METHOD(ref)->type)
 
 #define NIM_NATIVE_METHOD(ref) (&(NIM_METHOD(ref)->native))
+#define NIM_METHOD_IS_TYPED(ref) \
+    (NIM_METHOD_TYPE(ref) == NIM_METHOD_TYPE_NATIVE && \
+        NIM_NATIVE_METHOD(ref)->typed != NULL)
 #define NIM_BYTECODE_METHOD(ref) (&(NIM_METHOD(ref)->bytecode))
 #define NIM_CLOSURE_METHOD(ref) (&(NIM_METHOD(ref)->closure))
 
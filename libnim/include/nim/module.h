@@ -51,6 +51,14 @@ nim_module_add_method_str (
     NimNativeMethodFunc impl
 );
 
+nim_bool_t
+nim_module_add_method_str_typed (
+    NimRef *self,
+    const char *name,
+    const char *sig,
+    NimTypedNativeMethodFunc impl
+);
+
 nim_bool_t
 nim_module_add_local (
     NimRef *self,
@@ -19,6 +19,12 @@ nim_module_mgr_load (NimRef *name);
 NimRef *
 nim_module_mgr_compile (NimRef *name, NimRef *filename);
 
+/* starts loading each of the named modules without waiting for them: */
+/* independent modules are compiled in parallel. NIM_COMPILE_JOBS caps */
+/* the number of compiler tasks (the default is one per CPU). */
+nim_bool_t
+nim_module_mgr_prefetch (NimRef *names);
+
 #ifdef __cplusplus
 };
 #endif
@@ -37,7 +37,8 @@ typedef struct _NimMsgCell {
         NIM_MSG_CELL_ARRAY,
         NIM_MSG_CELL_MODULE,
         NIM_MSG_CELL_METHOD,
-        NIM_MSG_CELL_TASK
+        NIM_MSG_CELL_TASK,
+        NIM_MSG_CELL_RANGE
     } type;
     union {
         int64_t  int_;
@@ -49,6 +50,11 @@ typedef struct _NimMsgCell {
             struct _NimMsgCell *items;
             size_t                size;
         } array;
+        struct {
+            int64_t start;
+            int64_t stop;
+            int64_t step;
+        } range;
         NimRef          *method;
         NimRef          *module;
         NimTaskInternal *task;
@@ -48,6 +48,11 @@ typedef struct _NimObject {
 NimCmpResult
 nim_object_cmp (NimRef *a, NimRef *b);
 
+/* for lookups by key: only NIM_CMP_EQ & NIM_CMP_ERROR mean anything, */
+/* which lets interned strs be compared by pointer */
+NimCmpResult
+nim_object_cmp_eq (NimRef *a, NimRef *b);
+
 NimRef *
 nim_object_str (NimRef *self);
 
@@ -0,0 +1,49 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef _NIM_OPTIMIZE_H_INCLUDED_
+#define _NIM_OPTIMIZE_H_INCLUDED_
+
+#include <nim/gc.h>
+#include <nim/any.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* reads NIM_OPT_LEVEL from the environment. called once at startup, */
+/* before there are any other threads to race with. */
+nim_bool_t
+nim_opt_init (void);
+
+/* NIM_OPT_LEVEL in the environment: 0 turns off the AST optimizer. */
+/* defaults to 1. */
+int
+nim_opt_level (void);
+
+/* folds constant expressions & drops branches that can never run, */
+/* rewriting the module's AST in place before it's compiled. */
+nim_bool_t
+nim_ast_optimize (NimRef *mod);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
+
@@ -0,0 +1,64 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#ifndef _NIM_RANGE_H_INCLUDED_
+#define _NIM_RANGE_H_INCLUDED_
+
+#include <nim/gc.h>
+#include <nim/any.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* what range() returns: the ints from start up to (not including) stop */
+typedef struct _NimRange {
+    NimAny  base;
+    int64_t start;
+    int64_t stop;
+    int64_t step;
+} NimRange;
+
+nim_bool_t
+nim_range_class_bootstrap (void);
+
+NimRef *
+nim_range_new (int64_t start, int64_t stop, int64_t step);
+
+size_t
+nim_range_size (NimRef *self);
+
+nim_bool_t
+nim_range_contains (NimRef *self, int64_t value);
+
+NimRef *
+nim_range_to_array (NimRef *self);
+
+#define NIM_RANGE(ref) NIM_CHECK_CAST(NimRange, (ref), nim_range_class)
+
+#define NIM_RANGE_AT(ref, i) \
+    (NIM_RANGE(ref)->start + (int64_t)(i) * NIM_RANGE(ref)->step)
+
+NIM_EXTERN_CLASS(range);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
+
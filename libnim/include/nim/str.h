@@ -32,6 +32,9 @@ typedef struct _NimStr {
     NimAny  base;
     char     *data;
     size_t    size;
+    /* only valid for interned strs */
+    uint32_t  hash;
+    nim_bool_t interned;
 } NimStr;
 
 int
@@ -52,6 +55,22 @@ nim_str_new_formatv (const char *fmt, va_list args);
 NimRef *
 nim_str_new_concat (const char *a, ...);
 
+/* the canonical, immutable str with the given contents. interned strs */
+/* live outside of every heap & are shared by all tasks until shutdown, */
+/* so two of them are equal only if they're the same object. */
+NimRef *
+nim_str_intern (const char *data, size_t size);
+
+/* str itself if it's already interned */
+NimRef *
+nim_str_intern_ref (NimRef *str);
+
+void
+nim_str_intern_cleanup (void);
+
+uint32_t
+nim_str_hash (NimRef *str);
+
 /* XXX these mutate string state ... revisit me */
 
 nim_bool_t
@@ -76,6 +95,12 @@ nim_str_data (NimRef *str);
 
 #define NIM_STR_NEW(data) nim_str_new ((data), sizeof(data)-1)
 
+#define NIM_STR_INTERN(data) nim_str_intern ((data), sizeof(data)-1)
+
+#define NIM_STR_IS_INTERNED(ref) \
+    (NIM_ANY_CLASS(ref) == nim_str_class && \
+        NIM_UNCHECKED_CAST(NimStr, (ref))->interned)
+
 NIM_EXTERN_CLASS(str);
 
 #ifdef __cplusplus
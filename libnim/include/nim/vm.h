@@ -42,6 +42,11 @@ nim_vm_eval (NimVM *vm, NimRef *code, NimRef *locals);
 NimRef *
 nim_vm_invoke (NimVM *vm, NimRef *method, NimRef *args);
 
+/* runs a frame suspended by YIELD until it yields again, setting *value */
+/* to what it yielded. *value is NULL if the frame returned instead. */
+nim_bool_t
+nim_vm_resume (NimVM *vm, NimRef *frame, NimRef **value);
+
 void
 nim_vm_panic (NimVM *vm, NimRef *value);
 
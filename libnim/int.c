@@ -18,6 +18,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include "nim/array.h"
@@ -29,6 +30,14 @@
 
 NimRef *nim_int_class = NULL;
 
+/* ints are immutable, so small ones (loop counters, indexes, sizes) are */
+/* shared rather than allocated each time. they're rooted in the main */
+/* heap like nil & the bools. */
+#define NIM_INT_SMALL_MIN -16
+#define NIM_INT_SMALL_MAX 1023
+
+static NimRef *nim_int_small[NIM_INT_SMALL_MAX - NIM_INT_SMALL_MIN + 1];
+
 static NimRef *
 _nim_int_init (NimRef *self, NimRef *args)
 {
@@ -99,6 +108,8 @@ _nim_int_nonzero (NimRef *self)
 nim_bool_t
 nim_int_class_bootstrap (void)
 {
+    size_t i;
+
     nim_int_class =
         nim_class_new (NIM_STR_NEW ("int"), NULL, sizeof(NimInt));
     if (nim_int_class == NULL) {
@@ -113,13 +124,41 @@ nim_int_class_bootstrap (void)
     NIM_CLASS(nim_int_class)->div = nim_num_div;
     NIM_CLASS(nim_int_class)->cmp = nim_int_cmp;
     NIM_CLASS(nim_int_class)->nonzero = _nim_int_nonzero;
+
+    for (i = 0; i < NIM_INT_SMALL_MAX - NIM_INT_SMALL_MIN + 1; i++) {
+        NimRef *ref = nim_int_new ((int64_t) i + NIM_INT_SMALL_MIN);
+        if (ref == NULL || !nim_gc_make_root (NULL, ref)) {
+            return NIM_FALSE;
+        }
+        nim_int_small[i] = ref;
+    }
     return NIM_TRUE;
 }
 
+/* the shared ints live in the main heap, so they go away with it */
+void
+nim_int_cleanup (void)
+{
+    memset (nim_int_small, 0, sizeof(nim_int_small));
+}
+
 NimRef *
 nim_int_new (int64_t value)
 {
-    NimRef *ref = nim_class_new_instance (nim_int_class, NULL);
+    NimRef *ref;
+
+    if (value >= NIM_INT_SMALL_MIN && value <= NIM_INT_SMALL_MAX) {
+        ref = nim_int_small[value - NIM_INT_SMALL_MIN];
+        if (ref != NULL) {
+            return ref;
+        }
+    }
+    /* ints are created all the time by arithmetic: skip the constructor */
+    ref = nim_gc_new_object (NULL);
+    if (ref == NULL) {
+        return NULL;
+    }
+    NIM_ANY(ref)->klass = nim_int_class;
     NIM_INT(ref)->value = value;
     return ref;
 }
@@ -0,0 +1,75 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "nim/iter.h"
+#include "nim/str.h"
+#include "nim/class.h"
+#include "nim/object.h"
+
+NimRef *nim_iter_class = NULL;
+
+static void
+_nim_iter_mark (NimGC *gc, NimRef *self)
+{
+    NIM_SUPER (self)->mark (gc, self);
+
+    nim_gc_mark_ref (gc, NIM_ITER(self)->target);
+}
+
+nim_bool_t
+nim_iter_class_bootstrap (void)
+{
+    nim_iter_class =
+        nim_class_new (NIM_STR_NEW("iter"), NULL, sizeof(NimIter));
+    if (nim_iter_class == NULL) {
+        return NIM_FALSE;
+    }
+    NIM_CLASS(nim_iter_class)->mark = _nim_iter_mark;
+    nim_gc_make_root (NULL, nim_iter_class);
+    return NIM_TRUE;
+}
+
+NimRef *
+nim_iter_new (NimRef *target)
+{
+    NimRef *iter;
+
+    if (NIM_CLASS(NIM_ANY_CLASS(target))->iter_next == NULL) {
+        NIM_BUG ("%s is not iterable",
+            NIM_STR_DATA(NIM_CLASS_NAME(NIM_ANY_CLASS(target))));
+        return NULL;
+    }
+    iter = nim_class_new_instance (nim_iter_class, NULL);
+    if (iter == NULL) {
+        return NULL;
+    }
+    NIM_ITER(iter)->target = target;
+    NIM_ITER(iter)->pos = 0;
+    return iter;
+}
+
+/* sets *value to the next item, or to NULL once we're done */
+nim_bool_t
+nim_iter_next (NimRef *self, NimRef **value)
+{
+    NimRef *target = NIM_ITER(self)->target;
+
+    return NIM_CLASS(NIM_ANY_CLASS(target))->iter_next (
+                target, &NIM_ITER(self)->pos, value);
+}
+
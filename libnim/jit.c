@@ -0,0 +1,395 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "nim/core.h"
+#include "nim/jit.h"
+#include "nim/code.h"
+
+#include <sched.h>
+
+#ifdef NIM_JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static nim_bool_t nim_jit_enabled_flag = NIM_FALSE;
+static uint32_t nim_jit_threshold_value = 1000;
+
+nim_bool_t
+nim_jit_init (void)
+{
+    const char *value;
+
+    value = getenv ("NIM_JIT");
+    nim_jit_enabled_flag = (value != NULL && strcmp (value, "1") == 0);
+    value = getenv ("NIM_JIT_THRESHOLD");
+    if (value != NULL) {
+        const int threshold = atoi (value);
+        nim_jit_threshold_value = threshold > 0 ? (uint32_t) threshold : 0;
+    }
+    return NIM_TRUE;
+}
+
+nim_bool_t
+nim_jit_enabled (void)
+{
+    return nim_jit_enabled_flag;
+}
+
+uint32_t
+nim_jit_threshold (void)
+{
+    return nim_jit_threshold_value;
+}
+
+#ifdef NIM_JIT_SUPPORTED
+
+struct _NimJitCode {
+    uint8_t  *mem;
+    size_t    size;
+    /* native offset of each instruction in mem */
+    uint32_t *offsets;
+    /* the code object's reference, plus one per nim_jit_run in progress */
+    volatile int refs;
+};
+
+typedef int (*NimJitEntry) (void *vm, void *state, void *target);
+
+typedef struct _NimJitBuf {
+    uint8_t *p;
+    uint8_t *start;
+} NimJitBuf;
+
+/* SysV x86-64: vm lives in rbx & state in r12 for the life of the call */
+
+static void
+nim_jit_emit (NimJitBuf *buf, const uint8_t *bytes, size_t n)
+{
+    memcpy (buf->p, bytes, n);
+    buf->p += n;
+}
+
+static void
+nim_jit_emit_u32 (NimJitBuf *buf, uint32_t value)
+{
+    memcpy (buf->p, &value, sizeof(value));
+    buf->p += sizeof(value);
+}
+
+static void
+nim_jit_emit_u64 (NimJitBuf *buf, uint64_t value)
+{
+    memcpy (buf->p, &value, sizeof(value));
+    buf->p += sizeof(value);
+}
+
+/* helper (vm, state, pc) followed by a bail out if it returned < 0 */
+static void
+nim_jit_emit_call (NimJitBuf *buf, NimJitHelper helper, size_t pc, size_t *fail)
+{
+    static const uint8_t args[] = {
+        0x48, 0x89, 0xdf,       /* mov rdi, rbx */
+        0x4c, 0x89, 0xe6        /* mov rsi, r12 */
+    };
+    static const uint8_t call[] = {
+        0xff, 0xd0,             /* call rax */
+        0x85, 0xc0,             /* test eax, eax */
+        0x0f, 0x88              /* js rel32 */
+    };
+    nim_jit_emit (buf, args, sizeof(args));
+    *buf->p++ = 0xba;           /* mov edx, imm32 */
+    nim_jit_emit_u32 (buf, (uint32_t) pc);
+    *buf->p++ = 0x48;           /* mov rax, imm64 */
+    *buf->p++ = 0xb8;
+    nim_jit_emit_u64 (buf, (uint64_t)(uintptr_t) helper);
+    nim_jit_emit (buf, call, sizeof(call));
+    *fail = buf->p - buf->start;
+    nim_jit_emit_u32 (buf, 0);
+}
+
+static void
+nim_jit_patch (NimJitBuf *buf, size_t at, size_t target)
+{
+    const int32_t rel = (int32_t)(target - (at + 4));
+    memcpy (buf->start + at, &rel, sizeof(rel));
+}
+
+static void
+nim_jit_code_retain (NimJitCode *jit)
+{
+    __sync_add_and_fetch (&jit->refs, 1);
+}
+
+static void
+nim_jit_code_release (NimJitCode *jit)
+{
+    if (jit != NULL && __sync_sub_and_fetch (&jit->refs, 1) == 0) {
+        munmap (jit->mem, jit->size);
+        NIM_FREE (jit->offsets);
+        NIM_FREE (jit);
+    }
+}
+
+/* emitted bytes per instruction, worst case (a conditional branch) */
+#define NIM_JIT_MAX_INSTR_SIZE 40
+
+NimJitCode *
+nim_jit_compile (NimRef *code, const NimJitHelper *helpers)
+{
+    static const uint8_t prologue[] = {
+        0x53,                   /* push rbx */
+        0x41, 0x54,             /* push r12 */
+        0x41, 0x55,             /* push r13: keeps rsp 16-byte aligned */
+        0x48, 0x89, 0xfb,       /* mov rbx, rdi */
+        0x49, 0x89, 0xf4,       /* mov r12, rsi */
+        0xff, 0xe2              /* jmp rdx */
+    };
+    static const uint8_t ok[] = {
+        0x31, 0xc0,                     /* xor eax, eax */
+        0xeb, 0x0c                      /* jmp epilogue */
+    };
+    static const uint8_t leave[] = {
+        0xb8, 0x01, 0x00, 0x00, 0x00,   /* mov eax, 1 */
+        0xeb, 0x05                      /* jmp epilogue */
+    };
+    static const uint8_t fail[] = {
+        0xb8, 0xff, 0xff, 0xff, 0xff,   /* mov eax, -1 */
+        0x41, 0x5d,                     /* epilogue: pop r13 */
+        0x41, 0x5c,                     /* pop r12 */
+        0x5b,                           /* pop rbx */
+        0xc3                            /* ret */
+    };
+    const size_t used = NIM_CODE_SIZE(code);
+    NimJitCode *jit;
+    NimJitBuf buf;
+    size_t *jumps;
+    size_t *fails;
+    size_t *leaves;
+    size_t njumps = 0;
+    size_t nfails = 0;
+    size_t nleaves = 0;
+    size_t ret_at;
+    size_t leave_at;
+    size_t fail_at;
+    size_t pagesize;
+    size_t i;
+
+    /* everything we can't compile stays in the interpreter */
+    for (i = 0; i < used; i++) {
+        const NimOpcode op = NIM_INSTR_OP(code, i);
+        if (op != NIM_OPCODE_JUMP && op != NIM_OPCODE_RET &&
+                op != NIM_OPCODE_EXTENDED_ARG && helpers[op] == NULL) {
+            return NULL;
+        }
+    }
+
+    jit = NIM_MALLOC(NimJitCode, sizeof(*jit));
+    if (jit == NULL) {
+        return NULL;
+    }
+    jit->offsets = NIM_MALLOC(uint32_t, sizeof(uint32_t) * (used + 1));
+    jumps = NIM_MALLOC(size_t, sizeof(size_t) * 2 * (used + 1));
+    fails = NIM_MALLOC(size_t, sizeof(size_t) * (used + 1));
+    leaves = NIM_MALLOC(size_t, sizeof(size_t) * (used + 1));
+    pagesize = (size_t) sysconf (_SC_PAGESIZE);
+    jit->refs = 1;
+    jit->size = sizeof(prologue) + sizeof(ok) + sizeof(leave) +
+                    sizeof(fail) + used * NIM_JIT_MAX_INSTR_SIZE;
+    jit->size = (jit->size + pagesize - 1) & ~(pagesize - 1);
+    jit->mem = mmap (NULL, jit->size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (jit->offsets == NULL || jumps == NULL || fails == NULL ||
+            leaves == NULL || jit->mem == MAP_FAILED) {
+        if (jit->mem != MAP_FAILED) {
+            munmap (jit->mem, jit->size);
+        }
+        NIM_FREE (jit->offsets);
+        NIM_FREE (jumps);
+        NIM_FREE (fails);
+        NIM_FREE (leaves);
+        NIM_FREE (jit);
+        return NULL;
+    }
+
+    buf.start = buf.p = jit->mem;
+    nim_jit_emit (&buf, prologue, sizeof(prologue));
+
+    /* jumps[] holds (patch offset, target pc) pairs */
+    for (i = 0; i < used; i++) {
+        const NimOpcode op = NIM_INSTR_OP(code, i);
+        jit->offsets[i] = buf.p - buf.start;
+        if (op == NIM_OPCODE_EXTENDED_ARG) {
+            /* the next instruction's helper reads it from the bytecode */
+            continue;
+        }
+        else if (op == NIM_OPCODE_JUMP) {
+            *buf.p++ = 0xe9;    /* jmp rel32 */
+            jumps[2 * njumps] = buf.p - buf.start;
+            jumps[2 * njumps + 1] = NIM_INSTR_ADDR(code, i);
+            njumps++;
+            nim_jit_emit_u32 (&buf, 0);
+        }
+        else if (op == NIM_OPCODE_RET) {
+            *buf.p++ = 0xe9;
+            jumps[2 * njumps] = buf.p - buf.start;
+            jumps[2 * njumps + 1] = used;
+            njumps++;
+            nim_jit_emit_u32 (&buf, 0);
+        }
+        else {
+            nim_jit_emit_call (&buf, helpers[op], i, &fails[nfails++]);
+            if (NIM_OPCODE_IS_JUMP(op)) {
+                *buf.p++ = 0x0f;    /* jnz rel32 */
+                *buf.p++ = 0x85;
+                jumps[2 * njumps] = buf.p - buf.start;
+                jumps[2 * njumps + 1] = NIM_INSTR_ADDR(code, i);
+                njumps++;
+                nim_jit_emit_u32 (&buf, 0);
+            }
+            else if (op == NIM_OPCODE_CALL || op == NIM_OPCODE_CALLMETHOD ||
+                        op == NIM_OPCODE_TAILCALL) {
+                *buf.p++ = 0x0f;    /* jnz rel32 */
+                *buf.p++ = 0x85;
+                leaves[nleaves++] = buf.p - buf.start;
+                nim_jit_emit_u32 (&buf, 0);
+            }
+        }
+    }
+
+    /* falling off the end is the same as RET */
+    ret_at = buf.p - buf.start;
+    jit->offsets[used] = ret_at;
+    nim_jit_emit (&buf, ok, sizeof(ok));
+    leave_at = buf.p - buf.start;
+    nim_jit_emit (&buf, leave, sizeof(leave));
+    fail_at = buf.p - buf.start;
+    nim_jit_emit (&buf, fail, sizeof(fail));
+
+    for (i = 0; i < njumps; i++) {
+        nim_jit_patch (&buf, jumps[2 * i], jit->offsets[jumps[2 * i + 1]]);
+    }
+    for (i = 0; i < nfails; i++) {
+        nim_jit_patch (&buf, fails[i], fail_at);
+    }
+    for (i = 0; i < nleaves; i++) {
+        nim_jit_patch (&buf, leaves[i], leave_at);
+    }
+    NIM_FREE (jumps);
+    NIM_FREE (fails);
+    NIM_FREE (leaves);
+
+    if (mprotect (jit->mem, jit->size, PROT_READ | PROT_EXEC) != 0) {
+        nim_jit_code_release (jit);
+        return NULL;
+    }
+    return jit;
+}
+
+static int
+nim_jit_enter (NimJitCode *jit, void *vm, void *state, size_t pc)
+{
+    NimJitEntry entry = (NimJitEntry)(uintptr_t) jit->mem;
+    return entry (vm, state, jit->mem + jit->offsets[pc]);
+}
+
+#else
+
+NimJitCode *
+nim_jit_compile (NimRef *code, const NimJitHelper *helpers)
+{
+    return NULL;
+}
+
+static void
+nim_jit_code_retain (NimJitCode *jit)
+{
+}
+
+static void
+nim_jit_code_release (NimJitCode *jit)
+{
+}
+
+static int
+nim_jit_enter (NimJitCode *jit, void *vm, void *state, size_t pc)
+{
+    NIM_BUG ("JIT not supported on this platform");
+    return -1;
+}
+
+#endif
+
+/* pins & the dtor's NIM_CODE_JIT_DEAD are a handshake: each side does */
+/* its write, then a full barrier, then reads what the other one wrote. */
+/* so either the pin sees DEAD & backs off, or the dtor sees the pin & */
+/* waits for it to go away. nothing holds a pin across a helper (which */
+/* may block on another task), so the wait is always a short one. */
+
+nim_bool_t
+nim_jit_pin (NimRef *code)
+{
+    __sync_add_and_fetch (&NIM_CODE(code)->jit_pins, 1);
+    if (NIM_CODE(code)->jit_state == NIM_CODE_JIT_DEAD) {
+        nim_jit_unpin (code);
+        return NIM_FALSE;
+    }
+    return NIM_TRUE;
+}
+
+void
+nim_jit_unpin (NimRef *code)
+{
+    __sync_sub_and_fetch (&NIM_CODE(code)->jit_pins, 1);
+}
+
+int
+nim_jit_run (NimRef *code, void *vm, void *state, size_t pc)
+{
+    NimJitCode *jit;
+    int result;
+
+    if (!nim_jit_pin (code)) {
+        NIM_BUG ("running code that is being destroyed");
+        return -1;
+    }
+    /* only load the native code once we hold the pin */
+    if (NIM_CODE(code)->jit_state != NIM_CODE_JIT_READY) {
+        nim_jit_unpin (code);
+        NIM_BUG ("no native code to run");
+        return -1;
+    }
+    /* the native code outlives the pin: the last release frees it */
+    jit = NIM_CODE(code)->jit;
+    nim_jit_code_retain (jit);
+    nim_jit_unpin (code);
+    result = nim_jit_enter (jit, vm, state, pc);
+    nim_jit_code_release (jit);
+    return result;
+}
+
+void
+nim_jit_free (NimRef *code)
+{
+    NIM_CODE(code)->jit_state = NIM_CODE_JIT_DEAD;
+    __sync_synchronize ();
+    while (NIM_CODE(code)->jit_pins > 0) {
+        sched_yield ();
+    }
+    nim_jit_code_release (NIM_CODE(code)->jit);
+    NIM_CODE(code)->jit = NULL;
+}
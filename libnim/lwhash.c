@@ -58,7 +58,7 @@ nim_lwhash_find (NimLWHash *self, NimRef *key, NimLWHashItem **result)
     size_t i;
     for (i = 0; i < self->size; i++) {
         NimLWHashItem *item = self->items + i;
-        NimCmpResult r = nim_object_cmp (item->key, key);
+        NimCmpResult r = nim_object_cmp_eq (item->key, key);
         if (r == NIM_CMP_ERROR) {
             return NIM_FALSE;
         }
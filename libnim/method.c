@@ -31,7 +31,11 @@ NimRef *nim_method_class = NULL;
 static NimRef *
 nim_method_call (NimRef *self, NimRef *args)
 {
-    if (NIM_METHOD_TYPE(self) == NIM_METHOD_TYPE_NATIVE) {
+    if (NIM_METHOD_IS_TYPED(self)) {
+        return nim_method_call_typed (self, NIM_METHOD(self)->self,
+                    NIM_ARRAY_ITEMS(args), NIM_ARRAY_SIZE(args));
+    }
+    else if (NIM_METHOD_TYPE(self) == NIM_METHOD_TYPE_NATIVE) {
         return NIM_NATIVE_METHOD(self)->func (NIM_METHOD(self)->self, args);
     }
     else {
@@ -50,7 +54,7 @@ _nim_method_mark (NimGC *gc, NimRef *self)
     }
     else if (NIM_METHOD_TYPE(self) == NIM_METHOD_TYPE_CLOSURE) {
         nim_gc_mark_ref (gc, NIM_METHOD(self)->closure.code);
-        nim_gc_mark_ref (gc, NIM_METHOD(self)->closure.bindings);
+        nim_gc_mark_ref (gc, NIM_METHOD(self)->closure.upvalues);
     }
     nim_gc_mark_ref (gc, NIM_METHOD(self)->module);
 }
@@ -76,6 +80,22 @@ nim_method_new_native (NimRef *module, NimNativeMethodFunc func)
     NIM_METHOD(ref)->type = NIM_METHOD_TYPE_NATIVE;
     NIM_METHOD(ref)->module = module;
     NIM_NATIVE_METHOD(ref)->func = func;
+    NIM_NATIVE_METHOD(ref)->typed = NULL;
+    return ref;
+}
+
+NimRef *
+nim_method_new_native_typed (
+    NimRef *module, const char *sig, NimTypedNativeMethodFunc func)
+{
+    NimRef *ref = nim_method_new_native (module, NULL);
+    if (ref == NULL) {
+        return NULL;
+    }
+    if (!nim_method_parse_sig (&NIM_NATIVE_METHOD(ref)->sig, sig)) {
+        return NULL;
+    }
+    NIM_NATIVE_METHOD(ref)->typed = func;
     return ref;
 }
 
@@ -91,7 +111,7 @@ nim_method_new_bytecode (NimRef *module, NimRef *code)
 }
 
 NimRef *
-nim_method_new_closure (NimRef *method, NimRef *bindings)
+nim_method_new_closure (NimRef *method, NimRef *upvalues)
 {
     NimRef *ref;
     if (NIM_METHOD(method)->type != NIM_METHOD_TYPE_BYTECODE) {
@@ -102,8 +122,7 @@ nim_method_new_closure (NimRef *method, NimRef *bindings)
     NIM_METHOD(ref)->type = NIM_METHOD_TYPE_CLOSURE;
     NIM_METHOD(ref)->module = NIM_METHOD(method)->module;
     NIM_CLOSURE_METHOD(ref)->code = NIM_BYTECODE_METHOD(method)->code;
-    NIM_CLOSURE_METHOD(ref)->bindings = bindings;
-    /* TODO check for incomplete bindings hash? */
+    NIM_CLOSURE_METHOD(ref)->upvalues = upvalues;
     return ref;
 }
 
@@ -120,7 +139,7 @@ nim_method_new_bound (NimRef *unbound, NimRef *self)
     NIM_METHOD(ref)->self = self;
     NIM_METHOD(ref)->module = NIM_METHOD(unbound)->module;
     if (NIM_METHOD(ref)->type == NIM_METHOD_TYPE_NATIVE) {
-        NIM_NATIVE_METHOD(ref)->func = NIM_NATIVE_METHOD(unbound)->func;
+        *NIM_NATIVE_METHOD(ref) = *NIM_NATIVE_METHOD(unbound);
     }
     else {
         NIM_BYTECODE_METHOD(ref)->code =
@@ -212,3 +231,96 @@ error:
     return NIM_FALSE;
 }
 
+
+/* parses a format string for nim_method_new_native_typed. the format is */
+/* the same as nim_method_parse_args, but is checked here, once. */
+nim_bool_t
+nim_method_parse_sig (NimNativeSig *sig, const char *fmt)
+{
+    nim_bool_t optional = NIM_FALSE;
+    size_t i;
+
+    memset (sig, 0, sizeof(*sig));
+    for (i = 0; fmt[i] != '\0'; i++) {
+        switch (fmt[i]) {
+            case 'o':
+            case 's':
+            case 'i':
+            case 'I':
+                if (sig->nargs >= NIM_NATIVE_SIG_MAX) {
+                    NIM_BUG ("too many arguments in signature: %s", fmt);
+                    return NIM_FALSE;
+                }
+                sig->types[sig->nargs++] = fmt[i];
+                if (!optional) {
+                    sig->required++;
+                }
+                break;
+            case '|':
+                if (optional) {
+                    NIM_BUG ("more than one | in signature: %s", fmt);
+                    return NIM_FALSE;
+                }
+                optional = NIM_TRUE;
+                break;
+            default:
+                NIM_BUG ("unknown format character: %c", fmt[i]);
+                return NIM_FALSE;
+        };
+    }
+    return NIM_TRUE;
+}
+
+/*
+ * Unboxes argv according to the method's signature & calls it. argv
+ * needn't be an array: the VM passes a pointer into its stack, so a
+ * call from bytecode never allocates an args array.
+ */
+NimRef *
+nim_method_call_typed (
+    NimRef *method, NimRef *self, NimRef **argv, size_t argc)
+{
+    const NimNativeSig *sig = &NIM_NATIVE_METHOD(method)->sig;
+    NimNativeArg args[NIM_NATIVE_SIG_MAX];
+    size_t i;
+
+    if (argc < sig->required) {
+        NIM_BUG ("not enough arguments");
+        return NULL;
+    }
+    if (argc > sig->nargs) {
+        NIM_BUG ("too many arguments");
+        return NULL;
+    }
+    memset (args, 0, sizeof(args));
+    for (i = 0; i < argc; i++) {
+        NimRef *klass = NIM_ANY_CLASS(argv[i]);
+        switch (sig->types[i]) {
+            case 'o':
+                args[i].o = argv[i];
+                break;
+            case 's':
+                if (klass != nim_str_class) {
+                    NIM_BUG ("argument %zu must be a str", i + 1);
+                    return NULL;
+                }
+                args[i].s = NIM_STR_DATA(argv[i]);
+                break;
+            case 'i':
+                if (klass != nim_int_class) {
+                    NIM_BUG ("argument %zu must be an int", i + 1);
+                    return NULL;
+                }
+                args[i].i = (int32_t) NIM_INT(argv[i])->value;
+                break;
+            case 'I':
+                if (klass != nim_int_class) {
+                    NIM_BUG ("argument %zu must be an int", i + 1);
+                    return NULL;
+                }
+                args[i].I = NIM_INT(argv[i])->value;
+                break;
+        };
+    }
+    return NIM_NATIVE_METHOD(method)->typed (self, args, argc);
+}
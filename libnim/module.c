@@ -23,6 +23,7 @@
 #include "nim/object.h"
 #include "nim/str.h"
 #include "nim/compile.h"
+#include "nim/code.h"
 
 NimRef *nim_module_class = NULL;
 
@@ -118,6 +119,7 @@ nim_module_new_str (const char *name, NimRef *locals)
 nim_bool_t
 nim_module_add_local (NimRef *self, NimRef *name, NimRef *value)
 {
+    nim_code_attr_cache_invalidate ();
     return nim_hash_put (NIM_MODULE(self)->locals, name, value);
 }
 
@@ -131,7 +133,7 @@ nim_module_add_method_str (
     NimRef *nameref;
     NimRef *method;
     
-    nameref = nim_str_new (name, strlen(name));
+    nameref = nim_str_intern (name, strlen(name));
     if (nameref == NULL) {
         return NIM_FALSE;
     }
@@ -141,7 +143,31 @@ nim_module_add_method_str (
         return NIM_FALSE;
     }
 
-    return nim_hash_put (NIM_MODULE(self)->locals, nameref, method);
+    return nim_module_add_local (self, nameref, method);
+}
+
+nim_bool_t
+nim_module_add_method_str_typed (
+    NimRef *self,
+    const char *name,
+    const char *sig,
+    NimTypedNativeMethodFunc impl
+)
+{
+    NimRef *nameref;
+    NimRef *method;
+
+    nameref = nim_str_intern (name, strlen(name));
+    if (nameref == NULL) {
+        return NIM_FALSE;
+    }
+
+    method = nim_method_new_native_typed (self, sig, impl);
+    if (method == NULL) {
+        return NIM_FALSE;
+    }
+
+    return nim_module_add_local (self, nameref, method);
 }
 
 nim_bool_t
@@ -153,7 +179,7 @@ nim_module_add_local_str (
 {
     NimRef *nameref;
 
-    nameref = nim_str_new (name, strlen (name));
+    nameref = nim_str_intern (name, strlen (name));
     if (nameref == NULL) {
         return NIM_FALSE;
     }
@@ -1,18 +1,61 @@
+#include <stdlib.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include "nim/module_mgr.h"
 #include "nim/object.h"
 #include "nim/compile.h"
+#include "nim/cache.h"
 #include "nim/array.h"
+#include "nim/hash.h"
+#include "nim/int.h"
 #include "nim/str.h"
 #include "nim/task.h"
 #include "nim/modules.h"
 
 static NimRef *module_mgr_task = NULL;
 static NimRef *func = NULL;
+static NimRef *worker_func = NULL;
 static NimRef *cache = NULL;
 static NimRef *builtins = NULL;
 
+/*
+ * Modules are loaded in two steps, both run on a pool of worker tasks:
+ * a scan finds the modules a module uses (from its cache file, or by
+ * parsing it) & a build compiles it once everything it uses is loaded.
+ * A worker never has to wait on another module, so modules that don't
+ * depend on one another build in parallel.
+ *
+ * Each module that's still loading is tracked as an array of:
+ *
+ *   [name, filename, waiters, uses, worker, state]
+ *
+ * waiters are the tasks to send the module to once it's loaded & uses
+ * is nil until it's been scanned. The AST lives in the heap of the
+ * worker that scanned it, so that worker is the one to build it.
+ */
+#define NIM_JOB_NAME     0
+#define NIM_JOB_FILENAME 1
+#define NIM_JOB_WAITERS  2
+#define NIM_JOB_USES     3
+#define NIM_JOB_WORKER   4
+#define NIM_JOB_STATE    5
+
+#define NIM_JOB_QUEUED   0
+#define NIM_JOB_SCANNING 1
+#define NIM_JOB_WAITING  2
+#define NIM_JOB_BUILDING 3
+#define NIM_JOB_DONE     4
+
+#define NIM_JOB_GET(job, field) NIM_ARRAY_ITEM(job, NIM_JOB_ ## field)
+#define NIM_JOB_STATE_OF(job) NIM_INT_VALUE(NIM_JOB_GET(job, STATE))
+#define NIM_JOB_WORKER_OF(job) ((size_t) NIM_INT_VALUE(NIM_JOB_GET(job, WORKER)))
+
+static NimRef *jobs = NULL;
+static NimRef *workers = NULL;
+static nim_bool_t *workers_busy = NULL;
+static size_t max_workers = 0;
+
 #define IS_MODULE_MGR_TASK() \
     (nim_task_current() == NIM_TASK(module_mgr_task)->priv)
 
@@ -26,82 +69,612 @@ _nim_module_mgr_add_builtin (NimRef *module)
     return NIM_TRUE;
 }
 
+static size_t
+_nim_module_mgr_max_workers (void)
+{
+    const char *value = getenv ("NIM_COMPILE_JOBS");
+    long n;
+
+    if (value != NULL) {
+        n = atol (value);
+    }
+    else {
+        n = sysconf (_SC_NPROCESSORS_ONLN);
+    }
+    return n > 0 ? (size_t) n : 1;
+}
+
+static nim_bool_t
+_nim_module_mgr_name_eq (NimRef *a, NimRef *b)
+{
+    return NIM_STR_SIZE(a) == NIM_STR_SIZE(b) &&
+            memcmp (NIM_STR_DATA(a), NIM_STR_DATA(b), NIM_STR_SIZE(a)) == 0;
+}
+
+static nim_bool_t
+_nim_module_mgr_is_loaded (NimRef *name)
+{
+    return nim_hash_get (cache, name, NULL) == 0;
+}
+
 static NimRef *
-_nim_module_mgr_compile (
-    NimRef *name, NimRef *filename, nim_bool_t check)
+_nim_module_mgr_find_job (NimRef *name)
 {
-    NimRef *mod;
-    
-    if (check) {
-        if (nim_hash_get (cache, name, NULL) == 0) {
-            NIM_BUG ("attempt to bind the same module twice: %s",
-                    NIM_STR_DATA(name));
-            return NULL;
+    size_t i;
+
+    for (i = 0; i < NIM_ARRAY_SIZE(jobs); i++) {
+        NimRef *job = NIM_ARRAY_ITEM(jobs, i);
+        if (NIM_JOB_STATE_OF(job) != NIM_JOB_DONE &&
+                _nim_module_mgr_name_eq (NIM_JOB_GET(job, NAME), name)) {
+            return job;
         }
     }
+    return NULL;
+}
+
+static nim_bool_t
+_nim_module_mgr_set_job (NimRef *job, size_t field, NimRef *value)
+{
+    if (value == NULL) {
+        return NIM_FALSE;
+    }
+    NIM_ARRAY(job)->items[field] = value;
+    return NIM_TRUE;
+}
 
-    mod = nim_compile_file (name, NIM_STR_DATA(filename));
-    if (mod == NULL) {
+static NimRef *
+_nim_module_mgr_new_job (NimRef *name, NimRef *filename, NimRef *sender)
+{
+    NimRef *job;
+    NimRef *waiters = nim_array_new ();
+    if (waiters == NULL) {
         return NULL;
     }
-    if (!nim_hash_put (cache, name, mod)) {
+
+    if (sender != NULL && !nim_array_push (waiters, sender)) {
         return NULL;
     }
-    return mod;
+
+    job = nim_array_new_var (name, filename, waiters, nim_nil,
+            nim_nil, nim_nil, NULL);
+    if (job == NULL) {
+        return NULL;
+    }
+    if (!_nim_module_mgr_set_job (job, NIM_JOB_WORKER, nim_int_new (0))) {
+        return NULL;
+    }
+    if (!_nim_module_mgr_set_job (
+            job, NIM_JOB_STATE, nim_int_new (NIM_JOB_QUEUED))) {
+        return NULL;
+    }
+    if (!nim_array_push (jobs, job)) {
+        return NULL;
+    }
+    return job;
 }
 
 static NimRef *
-_nim_module_mgr_load (NimRef *name, NimRef *path)
+_nim_module_mgr_find_file (NimRef *name, NimRef *path)
 {
     size_t i;
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < NIM_ARRAY_SIZE(path); i++) {
+        NimRef *element = NIM_ARRAY_ITEM(path, i);
+        NimRef *filename = nim_str_new_format (
+            "%s/%s.nim", NIM_STR_DATA(element), NIM_STR_DATA(name));
+        struct stat st;
+
+        if (stat (NIM_STR_DATA(filename), &st) != 0) {
+            continue;
+        }
+
+        if (S_ISREG(st.st_mode)) {
+            return filename;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Sends the module named `name` to `sender` once it's loaded, starting
+ * a job to load it if need be. A NULL sender just starts the job.
+ */
+static nim_bool_t
+_nim_module_mgr_request (NimRef *name, NimRef *sender)
+{
     int rc;
     NimRef *mod;
-
-    /* TODO circular references ... ? */
+    NimRef *job;
+    NimRef *filename;
 
     rc = nim_hash_get (cache, name, &mod);
     if (rc < 0) {
         NIM_BUG ("error looking up module %s in cache",
                 NIM_STR_DATA(name));
-        return NULL;
+        return NIM_FALSE;
     }
     else if (rc == 0) {
-        return mod;
+        return sender == NULL || nim_task_send (sender, mod);
     }
 
-    if (path != NULL) {
-        for (i = 0; i < NIM_ARRAY_SIZE(path); i++) {
-            NimRef *element = NIM_ARRAY_ITEM(path, i);
-            NimRef *filename = nim_str_new_format (
-                "%s/%s.nim", NIM_STR_DATA(element), NIM_STR_DATA(name));
-            struct stat st;
-
-            if (stat (NIM_STR_DATA(filename), &st) != 0) {
-                continue;
-            }
+    job = _nim_module_mgr_find_job (name);
+    if (job != NULL) {
+        return sender == NULL ||
+                nim_array_push (NIM_JOB_GET(job, WAITERS), sender);
+    }
 
-            if (S_ISREG(st.st_mode)) {
-                return _nim_module_mgr_compile (name, filename, NIM_FALSE);
-            }
-        }
+    filename = _nim_module_mgr_find_file (name, nim_module_path);
+    if (filename != NULL) {
+        return _nim_module_mgr_new_job (name, filename, sender) != NULL;
     }
 
     rc = nim_hash_get (builtins, name, &mod);
 
     if (rc == 0) {
         if (!nim_hash_put (cache, name, mod)) {
-            return NULL;
+            return NIM_FALSE;
         }
-        return mod;
+        return sender == NULL || nim_task_send (sender, mod);
     }
     else if (rc == 1) {
         NIM_BUG ("module not found: %s", NIM_STR_DATA(name));
-        return NULL;
+        return NIM_FALSE;
     }
     else {
         NIM_BUG ("bad key in builtin_modules?");
+        return NIM_FALSE;
+    }
+}
+
+static nim_bool_t
+_nim_module_mgr_compile (NimRef *name, NimRef *filename, NimRef *sender)
+{
+    if (_nim_module_mgr_is_loaded (name) ||
+            _nim_module_mgr_find_job (name) != NULL) {
+        NIM_BUG ("attempt to bind the same module twice: %s",
+                NIM_STR_DATA(name));
+        return NIM_FALSE;
+    }
+    return _nim_module_mgr_new_job (name, filename, sender) != NULL;
+}
+
+static nim_bool_t
+_nim_module_mgr_job_uses (NimRef *job, NimRef *name)
+{
+    size_t i;
+    NimRef *uses = NIM_JOB_GET(job, USES);
+
+    if (uses == nim_nil) {
+        return NIM_FALSE;
+    }
+
+    for (i = 0; i < NIM_ARRAY_SIZE(uses); i++) {
+        if (_nim_module_mgr_name_eq (NIM_ARRAY_ITEM(uses, i), name)) {
+            return NIM_TRUE;
+        }
+    }
+    return NIM_FALSE;
+}
+
+/*
+ * Does the module named `name` use `target`, directly or otherwise?
+ * Only modules that are still loading can be part of a cycle.
+ */
+static nim_bool_t
+_nim_module_mgr_depends_on (NimRef *name, NimRef *target, NimRef *seen)
+{
+    size_t i;
+    NimRef *uses;
+    NimRef *job = _nim_module_mgr_find_job (name);
+
+    if (job == NULL || NIM_JOB_GET(job, USES) == nim_nil) {
+        return NIM_FALSE;
+    }
+
+    for (i = 0; i < NIM_ARRAY_SIZE(seen); i++) {
+        if (NIM_ARRAY_ITEM(seen, i) == job) {
+            return NIM_FALSE;
+        }
+    }
+    if (!nim_array_push (seen, job)) {
+        return NIM_FALSE;
+    }
+
+    uses = NIM_JOB_GET(job, USES);
+    for (i = 0; i < NIM_ARRAY_SIZE(uses); i++) {
+        NimRef *use = NIM_ARRAY_ITEM(uses, i);
+        if (_nim_module_mgr_name_eq (use, target) ||
+                _nim_module_mgr_depends_on (use, target, seen)) {
+            return NIM_TRUE;
+        }
+    }
+    return NIM_FALSE;
+}
+
+/*
+ * Hands the result of a job to everything waiting on it. A NULL module
+ * means the job failed: waiters get nil, as does anything that uses it.
+ */
+static nim_bool_t
+_nim_module_mgr_finish (NimRef *job, NimRef *module)
+{
+    size_t i;
+    NimRef *name = NIM_JOB_GET(job, NAME);
+    NimRef *waiters = NIM_JOB_GET(job, WAITERS);
+
+    if (!_nim_module_mgr_set_job (
+            job, NIM_JOB_STATE, nim_int_new (NIM_JOB_DONE))) {
+        return NIM_FALSE;
+    }
+
+    if (module != NULL && !nim_hash_put (cache, name, module)) {
+        return NIM_FALSE;
+    }
+
+    for (i = 0; i < NIM_ARRAY_SIZE(waiters); i++) {
+        if (!nim_task_send (NIM_ARRAY_ITEM(waiters, i),
+                module != NULL ? module : nim_nil)) {
+            return NIM_FALSE;
+        }
+    }
+
+    if (module == NULL) {
+        for (i = 0; i < NIM_ARRAY_SIZE(jobs); i++) {
+            NimRef *other = NIM_ARRAY_ITEM(jobs, i);
+            if (NIM_JOB_STATE_OF(other) == NIM_JOB_WAITING &&
+                    _nim_module_mgr_job_uses (other, name)) {
+                if (!_nim_module_mgr_finish (other, NULL)) {
+                    return NIM_FALSE;
+                }
+            }
+        }
+    }
+
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+_nim_module_mgr_scanned (NimRef *job, NimRef *uses)
+{
+    size_t i;
+    NimRef *seen;
+    NimRef *name = NIM_JOB_GET(job, NAME);
+
+    if (uses == nim_nil) {
+        return _nim_module_mgr_finish (job, NULL);
+    }
+
+    NIM_ARRAY(job)->items[NIM_JOB_USES] = uses;
+    if (!_nim_module_mgr_set_job (
+            job, NIM_JOB_STATE, nim_int_new (NIM_JOB_WAITING))) {
+        return NIM_FALSE;
+    }
+
+    for (i = 0; i < NIM_ARRAY_SIZE(uses); i++) {
+        if (!_nim_module_mgr_request (NIM_ARRAY_ITEM(uses, i), NULL)) {
+            return NIM_FALSE;
+        }
+    }
+
+    seen = nim_array_new ();
+    if (seen == NULL) {
+        return NIM_FALSE;
+    }
+    if (_nim_module_mgr_depends_on (name, name, seen)) {
+        fprintf (stderr, "error: circular use of module %s\n",
+                NIM_STR_DATA(name));
+        return _nim_module_mgr_finish (job, NULL);
+    }
+
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+_nim_module_mgr_is_ready (NimRef *job)
+{
+    size_t i;
+    NimRef *uses = NIM_JOB_GET(job, USES);
+
+    for (i = 0; i < NIM_ARRAY_SIZE(uses); i++) {
+        if (!_nim_module_mgr_is_loaded (NIM_ARRAY_ITEM(uses, i))) {
+            return NIM_FALSE;
+        }
+    }
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+_nim_module_mgr_spawn_worker (void)
+{
+    NimRef *self = nim_task_get_self (nim_task_current ());
+    NimRef *index = nim_int_new (NIM_ARRAY_SIZE(workers));
+    NimRef *worker;
+
+    if (index == NULL) {
+        return NIM_FALSE;
+    }
+
+    worker = nim_task_new (worker_func);
+    if (worker == NULL) {
+        return NIM_FALSE;
+    }
+    if (!nim_array_push (workers, worker)) {
+        return NIM_FALSE;
+    }
+    workers_busy[NIM_INT_VALUE(index)] = NIM_FALSE;
+
+    /* send args */
+    return nim_task_send (worker, nim_array_new_var (self, index, NULL));
+}
+
+static nim_bool_t
+_nim_module_mgr_dispatch (
+    NimRef *job, size_t worker, const char *action, int state)
+{
+    NimRef *msg = nim_array_new_var (
+        nim_str_new (action, strlen (action)),
+        NIM_JOB_GET(job, NAME), NIM_JOB_GET(job, FILENAME), NULL);
+    if (msg == NULL) {
+        return NIM_FALSE;
+    }
+
+    if (!_nim_module_mgr_set_job (
+            job, NIM_JOB_WORKER, nim_int_new ((int64_t) worker))) {
+        return NIM_FALSE;
+    }
+    if (!_nim_module_mgr_set_job (job, NIM_JOB_STATE, nim_int_new (state))) {
+        return NIM_FALSE;
+    }
+
+    workers_busy[worker] = NIM_TRUE;
+    return nim_task_send (NIM_ARRAY_ITEM(workers, worker), msg);
+}
+
+/*
+ * Keeps the workers busy: builds take priority over scans so finished
+ * modules get to their waiters sooner.
+ */
+static nim_bool_t
+_nim_module_mgr_pump (void)
+{
+    size_t i;
+    size_t worker = 0;
+
+    for (i = 0; i < NIM_ARRAY_SIZE(jobs); i++) {
+        NimRef *job = NIM_ARRAY_ITEM(jobs, i);
+        if (NIM_JOB_STATE_OF(job) == NIM_JOB_WAITING &&
+                !workers_busy[NIM_JOB_WORKER_OF(job)] &&
+                _nim_module_mgr_is_ready (job)) {
+            if (!_nim_module_mgr_dispatch (job, NIM_JOB_WORKER_OF(job),
+                    "build", NIM_JOB_BUILDING)) {
+                return NIM_FALSE;
+            }
+        }
+    }
+
+    for (i = 0; i < NIM_ARRAY_SIZE(jobs); i++) {
+        NimRef *job = NIM_ARRAY_ITEM(jobs, i);
+        if (NIM_JOB_STATE_OF(job) != NIM_JOB_QUEUED) {
+            continue;
+        }
+
+        while (worker < NIM_ARRAY_SIZE(workers) && workers_busy[worker]) {
+            worker++;
+        }
+        if (worker == NIM_ARRAY_SIZE(workers)) {
+            if (worker == max_workers) {
+                break;
+            }
+            if (!_nim_module_mgr_spawn_worker ()) {
+                return NIM_FALSE;
+            }
+        }
+
+        if (!_nim_module_mgr_dispatch (
+                job, worker, "scan", NIM_JOB_SCANNING)) {
+            return NIM_FALSE;
+        }
+    }
+
+    /* forget about jobs once nothing is left to do */
+    for (i = 0; i < NIM_ARRAY_SIZE(jobs); i++) {
+        if (NIM_JOB_STATE_OF(NIM_ARRAY_ITEM(jobs, i)) != NIM_JOB_DONE) {
+            return NIM_TRUE;
+        }
+    }
+    NIM_ARRAY(jobs)->size = 0;
+
+    return NIM_TRUE;
+}
+
+/*
+ * Returns the names of the modules used by the module in `filename`, or
+ * nil if it can't be parsed.
+ */
+static NimRef *
+_nim_module_mgr_scan (NimRef *parsed, NimRef *name, NimRef *filename)
+{
+    NimRef *ast;
+    NimRef *uses = nim_cache_uses (name, NIM_STR_DATA(filename));
+
+    if (uses != NULL) {
+        /* no AST: the build will load the cache file */
+        if (!nim_hash_put (parsed, name, nim_nil)) {
+            return NULL;
+        }
+        return uses;
+    }
+
+    ast = nim_compile_parse_file (NIM_STR_DATA(filename));
+    if (ast == NULL) {
+        return nim_nil;
+    }
+    if (!nim_hash_put (parsed, name, ast)) {
         return NULL;
     }
+    return nim_compile_uses (ast);
+}
+
+/*
+ * Returns the compiled module, or nil if it fails to compile.
+ */
+static NimRef *
+_nim_module_mgr_build (NimRef *parsed, NimRef *name, NimRef *filename)
+{
+    NimRef *mod;
+    NimRef *ast = nim_nil;
+
+    if (nim_hash_get (parsed, name, &ast) < 0) {
+        return NULL;
+    }
+    /* the AST is freed when it's compiled */
+    if (!nim_hash_put (parsed, name, nim_nil)) {
+        return NULL;
+    }
+
+    if (ast != nim_nil) {
+        mod = nim_compile_ast (name, NIM_STR_DATA(filename), ast);
+        if (mod != NULL) {
+            nim_cache_store (mod, NIM_STR_DATA(filename));
+        }
+    }
+    else {
+        mod = nim_cache_compile_file (name, NIM_STR_DATA(filename));
+    }
+
+    if (mod == NULL) {
+        return nim_nil;
+    }
+
+    /* the module lives in this task's heap, so keep it alive */
+    if (!nim_task_add_module (NULL, mod)) {
+        return NULL;
+    }
+    return mod;
+}
+
+static NimRef *
+_nim_module_mgr_worker (NimRef *self, NimRef *args)
+{
+    NimRef *mgr = NIM_ARRAY_ITEM(args, 0);
+    NimRef *index = NIM_ARRAY_ITEM(args, 1);
+    NimRef *parsed = nim_hash_new ();
+    if (parsed == NULL) {
+        return NULL;
+    }
+    nim_gc_make_root (NULL, parsed);
+
+    for (;;) {
+        NimRef *action;
+        NimRef *name;
+        NimRef *filename;
+        NimRef *result;
+        NimRef *reply;
+        NimRef *msg = nim_task_recv (NULL);
+        if (msg == NULL) {
+            return NULL;
+        }
+
+        action = NIM_ARRAY_ITEM(msg, 0);
+        if (strcmp (NIM_STR_DATA(action), "exit") == 0) {
+            break;
+        }
+
+        name = NIM_ARRAY_ITEM(msg, 1);
+        filename = NIM_ARRAY_ITEM(msg, 2);
+
+        if (strcmp (NIM_STR_DATA(action), "scan") == 0) {
+            result = _nim_module_mgr_scan (parsed, name, filename);
+            reply = NIM_STR_NEW ("scanned");
+        }
+        else if (strcmp (NIM_STR_DATA(action), "build") == 0) {
+            result = _nim_module_mgr_build (parsed, name, filename);
+            reply = NIM_STR_NEW ("built");
+        }
+        else {
+            NIM_BUG ("module worker received unknown command: %s",
+                NIM_STR_DATA(action));
+            return NULL;
+        }
+
+        if (result == NULL) {
+            return NULL;
+        }
+
+        if (!nim_task_send (
+                mgr, nim_array_new_var (reply, index, name, result, NULL))) {
+            return NULL;
+        }
+    }
+
+    return nim_nil;
+}
+
+static nim_bool_t
+_nim_module_mgr_worker_done (NimRef *msg)
+{
+    NimRef *action = NIM_ARRAY_ITEM(msg, 0);
+    NimRef *index = NIM_ARRAY_ITEM(msg, 1);
+    NimRef *name = NIM_ARRAY_ITEM(msg, 2);
+    NimRef *result = NIM_ARRAY_ITEM(msg, 3);
+    NimRef *job = _nim_module_mgr_find_job (name);
+
+    if (job == NULL) {
+        NIM_BUG ("module manager lost track of module %s",
+                NIM_STR_DATA(name));
+        return NIM_FALSE;
+    }
+
+    workers_busy[NIM_INT_VALUE(index)] = NIM_FALSE;
+
+    if (strcmp (NIM_STR_DATA(action), "scanned") == 0) {
+        return _nim_module_mgr_scanned (job, result);
+    }
+    else {
+        return _nim_module_mgr_finish (
+                job, result != nim_nil ? result : NULL);
+    }
+}
+
+static nim_bool_t
+_nim_module_mgr_stop_workers (void)
+{
+    size_t i;
+
+    /* let the workers finish what they're doing so none of them gets
+     * stuck trying to send us the result */
+    for (i = 0; i < NIM_ARRAY_SIZE(workers); i++) {
+        while (workers_busy[i]) {
+            NimRef *msg = nim_task_recv (NULL);
+            if (msg == NULL) {
+                return NIM_FALSE;
+            }
+            if (NIM_ANY_CLASS(msg) == nim_array_class &&
+                    NIM_ARRAY_SIZE(msg) == 4) {
+                NimRef *index = NIM_ARRAY_ITEM(msg, 1);
+                if (NIM_ANY_CLASS(index) == nim_int_class) {
+                    workers_busy[NIM_INT_VALUE(index)] = NIM_FALSE;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < NIM_ARRAY_SIZE(workers); i++) {
+        NimRef *worker = NIM_ARRAY_ITEM(workers, i);
+        if (!nim_task_send (
+                worker, nim_array_new_var (NIM_STR_NEW ("exit"), NULL))) {
+            return NIM_FALSE;
+        }
+        nim_task_join (NIM_TASK(worker)->priv);
+    }
+    NIM_FREE(workers_busy);
+    workers_busy = NULL;
+
+    return NIM_TRUE;
 }
 
 static NimRef *
@@ -117,6 +690,27 @@ _nim_module_mgr_func (NimRef *self, NimRef *args)
         return NULL;
     }
     nim_gc_make_root (NULL, builtins);
+    jobs = nim_array_new ();
+    if (jobs == NULL) {
+        return NULL;
+    }
+    nim_gc_make_root (NULL, jobs);
+    workers = nim_array_new ();
+    if (workers == NULL) {
+        return NULL;
+    }
+    nim_gc_make_root (NULL, workers);
+    worker_func = nim_method_new_native (NULL, _nim_module_mgr_worker);
+    if (worker_func == NULL) {
+        return NULL;
+    }
+    nim_gc_make_root (NULL, worker_func);
+
+    max_workers = _nim_module_mgr_max_workers ();
+    workers_busy = NIM_MALLOC(nim_bool_t, sizeof(nim_bool_t) * max_workers);
+    if (workers_busy == NULL) {
+        return NULL;
+    }
 
     if (!_nim_module_mgr_add_builtin (nim_init_io_module ())) {
         return NIM_FALSE;
@@ -169,25 +763,31 @@ _nim_module_mgr_func (NimRef *self, NimRef *args)
             if (strcmp (NIM_STR_DATA(action), "load") == 0) {
                 NimRef *sender = NIM_ARRAY_ITEM(msg, 1);
                 NimRef *name = NIM_ARRAY_ITEM(msg, 2);
-                NimRef *mod;
-                mod = _nim_module_mgr_load (name, nim_module_path);
-                if (mod == NULL) {
+                if (!_nim_module_mgr_request (name, sender)) {
                     return NULL;
                 }
-                if (!nim_task_send (sender, mod)) {
-                    return NULL;
+            }
+            else if (strcmp (NIM_STR_DATA(action), "prefetch") == 0) {
+                NimRef *names = NIM_ARRAY_ITEM(msg, 2);
+                size_t i;
+                for (i = 0; i < NIM_ARRAY_SIZE(names); i++) {
+                    if (!_nim_module_mgr_request (
+                            NIM_ARRAY_ITEM(names, i), NULL)) {
+                        return NULL;
+                    }
                 }
             }
             else if (strcmp (NIM_STR_DATA(action), "compile") == 0) {
                 NimRef *sender = NIM_ARRAY_ITEM(msg, 1);
                 NimRef *name = NIM_ARRAY_ITEM(msg, 2);
                 NimRef *filename = NIM_ARRAY_ITEM(msg, 3);
-                NimRef *mod =
-                    _nim_module_mgr_compile (name, filename, NIM_TRUE);
-                if (mod == NULL) {
+                if (!_nim_module_mgr_compile (name, filename, sender)) {
                     return NULL;
                 }
-                if (!nim_task_send (sender, mod)) {
+            }
+            else if (strcmp (NIM_STR_DATA(action), "scanned") == 0 ||
+                        strcmp (NIM_STR_DATA(action), "built") == 0) {
+                if (!_nim_module_mgr_worker_done (msg)) {
                     return NULL;
                 }
             }
@@ -199,6 +799,10 @@ _nim_module_mgr_func (NimRef *self, NimRef *args)
                     NIM_STR_DATA(nim_object_str (action)));
                 return NULL;
             }
+
+            if (!_nim_module_mgr_pump ()) {
+                return NULL;
+            }
         }
         else {
             NIM_BUG ("module manager received unexpected message: %s",
@@ -207,6 +811,10 @@ _nim_module_mgr_func (NimRef *self, NimRef *args)
         }
     }
 
+    if (!_nim_module_mgr_stop_workers ()) {
+        return NULL;
+    }
+
     return nim_nil;
 }
 
@@ -254,14 +862,14 @@ nim_module_mgr_shutdown (void)
 
 static NimRef *
 _nim_module_mgr_send_cmd (
-    const char *action, size_t actionlen, ...)
+    nim_bool_t wait, const char *action, size_t actionlen, ...)
 {
     va_list args;
     size_t num_args = 0;
     NimRef *cmd;
     NimRef *arg;
     NimRef *self = nim_task_get_self (nim_task_current ());
-    
+
     va_start (args, actionlen);
     while ((arg = va_arg (args, NimRef *)) != NULL) {
         num_args++;
@@ -293,29 +901,51 @@ _nim_module_mgr_send_cmd (
         return NULL;
     }
 
-    return nim_task_recv (NULL);
+    return wait ? nim_task_recv (NULL) : nim_nil;
 }
 
 NimRef *
 nim_module_mgr_load (NimRef *name)
 {
+    NimRef *mod;
+
     if (IS_MODULE_MGR_TASK ()) {
-        return _nim_module_mgr_load (name, nim_module_path);
-    }
-    else {
-        return _nim_module_mgr_send_cmd ("load", sizeof("load")-1, name, NULL);
+        NIM_BUG ("module manager cannot load %s itself",
+                NIM_STR_DATA(name));
+        return NULL;
     }
+
+    mod = _nim_module_mgr_send_cmd (
+            NIM_TRUE, "load", sizeof("load")-1, name, NULL);
+    /* nil means the module failed to compile */
+    return mod != nim_nil ? mod : NULL;
 }
 
 NimRef *
 nim_module_mgr_compile (NimRef *name, NimRef *filename)
 {
+    NimRef *mod;
+
     if (IS_MODULE_MGR_TASK ()) {
-        return _nim_module_mgr_compile (name, filename, NIM_TRUE);
+        NIM_BUG ("module manager cannot compile %s itself",
+                NIM_STR_DATA(name));
+        return NULL;
     }
-    else {
-        return _nim_module_mgr_send_cmd (
-                "compile", sizeof("compile")-1, name, filename, NULL);
+
+    mod = _nim_module_mgr_send_cmd (
+            NIM_TRUE, "compile", sizeof("compile")-1, name, filename, NULL);
+    return mod != nim_nil ? mod : NULL;
+}
+
+nim_bool_t
+nim_module_mgr_prefetch (NimRef *names)
+{
+    if (IS_MODULE_MGR_TASK ()) {
+        NIM_BUG ("module manager cannot prefetch modules itself");
+        return NIM_FALSE;
     }
+
+    return _nim_module_mgr_send_cmd (
+            NIM_FALSE, "prefetch", sizeof("prefetch")-1, names, NULL) != NULL;
 }
 
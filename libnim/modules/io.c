@@ -115,23 +115,21 @@ _nim_io_file_dtor (NimRef *self)
 }
 
 static NimRef *
-_nim_io_file_close (NimRef *self, NimRef *args)
+_nim_io_file_close (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     _nim_io_file_close_internal (self);
     return nim_nil;
 }
 
 static NimRef *
-_nim_io_file_read (NimRef *self, NimRef *args)
+_nim_io_file_read (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     int64_t size;
     int64_t rsize;
     char *buf;
 
-    if (NIM_ARRAY_SIZE(args) > 0) {
-        if (!nim_method_parse_args (args, "I", &size)) {
-            return NULL;
-        }
+    if (nargs > 0) {
+        size = args[0].I;
     }
     else {
         struct stat buf;
@@ -179,15 +177,11 @@ _nim_io_file_read (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_io_file_write (NimRef *self, NimRef *args)
+_nim_io_file_write (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    NimRef *s;
+    NimRef *s = args[0].o;
     FILE *stream;
 
-    if (!nim_method_parse_args (args, "o", &s)) {
-        return NULL;
-    }
-
     if (NIM_IO_FILE(self)->stream == NULL) {
         NIM_BUG ("attempt to write to closed stream");
         return NULL;
@@ -213,11 +207,14 @@ _nim_init_io_file_class (void)
     }
     NIM_CLASS(klass)->init = _nim_io_file_init;
     NIM_CLASS(klass)->dtor = _nim_io_file_dtor;
-    if (!nim_class_add_native_method (klass, "read", _nim_io_file_read))
+    if (!nim_class_add_native_method_typed (
+            klass, "read", "|I", _nim_io_file_read))
         return NULL;
-    if (!nim_class_add_native_method (klass, "write", _nim_io_file_write))
+    if (!nim_class_add_native_method_typed (
+            klass, "write", "o", _nim_io_file_write))
         return NULL;
-    if (!nim_class_add_native_method (klass, "close", _nim_io_file_close))
+    if (!nim_class_add_native_method_typed (
+            klass, "close", "", _nim_io_file_close))
         return NULL;
     return klass;
 }
@@ -90,15 +90,13 @@ _nim_socket_init (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_socket_bind (NimRef *self, NimRef *args)
+_nim_socket_bind (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     struct sockaddr_in addr;
     int64_t port;
     int fd;
 
-    if (!nim_method_parse_args (args, "I", &port)) {
-        return NULL;
-    }
+    port = args[0].I;
 
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
@@ -116,13 +114,13 @@ _nim_socket_bind (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_socket_listen (NimRef *self, NimRef *args)
+_nim_socket_listen (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     int64_t backlog = SOMAXCONN;
     int fd = NIM_NET_SOCKET(self)->fd;
 
-    if (!nim_method_parse_args (args, "|I", &backlog)) {
-        return NULL;
+    if (nargs > 0) {
+        backlog = args[0].I;
     }
 
     if (listen (fd, backlog) < 0) {
@@ -133,13 +131,13 @@ _nim_socket_listen (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_socket_setsockopt (NimRef *self, NimRef *args)
+_nim_socket_setsockopt (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     int32_t level, optname, optval;
 
-    if (!nim_method_parse_args (args, "iii", &level, &optname, &optval)) {
-        return NULL;
-    }
+    level = args[0].i;
+    optname = args[1].i;
+    optval = args[2].i;
 
     if (setsockopt (NIM_NET_SOCKET(self)->fd, level, optname, &optval, sizeof(optval)) != 0) {
         return nim_false;
@@ -149,7 +147,7 @@ _nim_socket_setsockopt (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_socket_accept (NimRef *self, NimRef *args)
+_nim_socket_accept (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     int fd = NIM_NET_SOCKET(self)->fd;
     struct sockaddr_in addr;
@@ -172,7 +170,7 @@ _nim_socket_accept (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_socket_close (NimRef *self, NimRef *args)
+_nim_socket_close (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     if (NIM_NET_SOCKET(self)->fd > 0) {
         close (NIM_NET_SOCKET(self)->fd);
@@ -182,13 +180,9 @@ _nim_socket_close (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_socket_shutdown (NimRef *self, NimRef *args)
+_nim_socket_shutdown (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    int32_t how = SHUT_RDWR;
-
-    if (!nim_method_parse_args (args, "i", &how)) {
-        return NULL;
-    }
+    int32_t how = args[0].i;
 
     if (shutdown (NIM_NET_SOCKET (self)->fd, how) != 0) {
         return nim_false;
@@ -197,14 +191,12 @@ _nim_socket_shutdown (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_socket_send (NimRef *self, NimRef *args)
+_nim_socket_send (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     NimRef *data;
     int rc;
 
-    if (!nim_method_parse_args (args, "o", &data)) {
-        return NULL;
-    }
+    data = args[0].o;
 
     rc = send (NIM_NET_SOCKET (self)->fd,
                 NIM_STR_DATA(data), NIM_STR_SIZE(data), 0);
@@ -213,15 +205,13 @@ _nim_socket_send (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_socket_recv (NimRef *self, NimRef *args)
+_nim_socket_recv (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     int32_t size;
     char *buf;
     int n;
 
-    if (!nim_method_parse_args (args, "i", &size)) {
-        return NULL;
-    }
+    size = args[0].i;
 
     buf = malloc (size + 1);
     if (buf == NULL) {
@@ -286,43 +276,43 @@ _nim_socket_class_bootstrap (void)
         NIM_CLASS(net_socket_class)->dtor = _nim_socket_dtor;
         NIM_CLASS(net_socket_class)->getattr = _nim_socket_getattr;
 
-        if (!nim_class_add_native_method (
-                net_socket_class, "close", _nim_socket_close)) {
+        if (!nim_class_add_native_method_typed (
+                net_socket_class, "close", "", _nim_socket_close)) {
             return NIM_FALSE;
         }
 
-        if (!nim_class_add_native_method (
-                net_socket_class, "bind", _nim_socket_bind)) {
+        if (!nim_class_add_native_method_typed (
+                net_socket_class, "bind", "I", _nim_socket_bind)) {
             return NIM_FALSE;
         }
 
-        if (!nim_class_add_native_method (
-                net_socket_class, "setsockopt", _nim_socket_setsockopt)) {
+        if (!nim_class_add_native_method_typed (
+                net_socket_class, "setsockopt", "iii", _nim_socket_setsockopt)) {
             return NIM_FALSE;
         }
 
-        if (!nim_class_add_native_method (
-                net_socket_class, "listen", _nim_socket_listen)) {
+        if (!nim_class_add_native_method_typed (
+                net_socket_class, "listen", "|I", _nim_socket_listen)) {
             return NIM_FALSE;
         }
 
-        if (!nim_class_add_native_method (
-                net_socket_class, "accept", _nim_socket_accept)) {
+        if (!nim_class_add_native_method_typed (
+                net_socket_class, "accept", "", _nim_socket_accept)) {
             return NIM_FALSE;
         }
 
-        if (!nim_class_add_native_method (
-                net_socket_class, "recv", _nim_socket_recv)) {
+        if (!nim_class_add_native_method_typed (
+                net_socket_class, "recv", "i", _nim_socket_recv)) {
             return NIM_FALSE;
         }
 
-        if (!nim_class_add_native_method (
-                net_socket_class, "send", _nim_socket_send)) {
+        if (!nim_class_add_native_method_typed (
+                net_socket_class, "send", "o", _nim_socket_send)) {
             return NIM_FALSE;
         }
 
-        if (!nim_class_add_native_method (
-                net_socket_class, "shutdown", _nim_socket_shutdown)) {
+        if (!nim_class_add_native_method_typed (
+                net_socket_class, "shutdown", "i", _nim_socket_shutdown)) {
             return NIM_FALSE;
         }
     }
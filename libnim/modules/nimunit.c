@@ -28,10 +28,14 @@ NimRef *nim_test_runner_class = NULL;
 typedef struct _NimTestRunner {
     NimAny base;
     NimRef *name;
-    int64_t  passed;
-    int64_t  failed;
 } NimTestRunner;
 
+/* the runner lives in the main task's GC, which may only get torn down */
+/* by a spawned task after the process has exited: keep the counts out */
+/* here so the summary can be printed at exit instead. */
+static int64_t nim_unit_passed = 0;
+static int64_t nim_unit_failed = 0;
+
 #define NIM_TEST(ref) NIM_CHECK_CAST(NimTestRunner, (ref), nim_test_runner_class)
 #define NIM_TEST_NAME(ref) (NIM_TEST(ref)->name)
 
@@ -39,22 +43,20 @@ static NimRef *
 _nim_test_runner_init (NimRef *self, NimRef *args)
 {
     NIM_TEST(self)->name = NIM_STR_NEW("");
-    NIM_TEST(self)->passed = 0;
-    NIM_TEST(self)->failed = 0;
     return self;
 }
 static void
-_nim_test_runner_output_stats (NimRef *self, FILE* dest)
+_nim_test_runner_output_stats (FILE* dest)
 {
     fprintf(dest, "\nPassed: %ju, Failed: %ju\n",
-        (intmax_t) NIM_TEST(self)->passed,
-        (intmax_t) NIM_TEST(self)->failed);
+        (intmax_t) nim_unit_passed,
+        (intmax_t) nim_unit_failed);
 }
 
 static void
-_nim_test_runner_dtor (NimRef *self)
+_nim_unit_atexit (void)
 {
-    _nim_test_runner_output_stats(self, stdout);
+    _nim_test_runner_output_stats(stdout);
 }
 
 static void
@@ -63,8 +65,8 @@ _nim_failed_test(NimRef *self)
     fprintf (stderr, "\nTest failed: %s",
         NIM_STR_DATA(NIM_TEST_NAME(self)));
 
-    NIM_TEST(self)->failed++;
-    _nim_test_runner_output_stats(self, stderr);
+    nim_unit_failed++;
+    _nim_test_runner_output_stats(stderr);
 }
 
 static NimRef *
@@ -153,7 +155,6 @@ nim_test_runner_class_bootstrap (void)
         return NIM_FALSE;
     }
     NIM_CLASS(nim_test_runner_class)->init = _nim_test_runner_init;
-    NIM_CLASS(nim_test_runner_class)->dtor = _nim_test_runner_dtor;
     nim_gc_make_root (NULL, nim_test_runner_class);
     nim_class_add_native_method (nim_test_runner_class, "equals",     _nim_test_runner_equals);
     nim_class_add_native_method (nim_test_runner_class, "not_equals", _nim_test_runner_not_equals);
@@ -185,6 +186,7 @@ _nim_unit_test(NimRef *self, NimRef *args)
         test_runner = nim_test_runner_new();
         /* XXX hack to avoid premature collection by the GC */
         nim_gc_make_root (NULL, test_runner);
+        atexit (_nim_unit_atexit);
     }
     NIM_TEST(test_runner)->name = name;
 
@@ -192,7 +194,7 @@ _nim_unit_test(NimRef *self, NimRef *args)
     nim_array_push(fn_args, test_runner);
 
     nim_object_call (fn, fn_args);
-    NIM_TEST(test_runner)->passed++;
+    nim_unit_passed++;
 
     return nim_nil;
 }
@@ -88,16 +88,14 @@ _nim_os_dirname (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_os_glob (NimRef *self, NimRef *args)
+_nim_os_glob (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     const char *pattern;
     glob_t res;
     NimRef *arr;
     size_t i;
 
-    if (!nim_method_parse_args (args, "s", &pattern)) {
-        return NULL;
-    }
+    pattern = args[0].s;
 
     if (glob (pattern, 0, NULL, &res) != 0) {
         NIM_BUG ("glob() failed");
@@ -110,14 +108,15 @@ _nim_os_glob (NimRef *self, NimRef *args)
         return NULL;
     }
 
+    /* push as we go: the GC only sees the first size items */
     for (i = 0; i < res.gl_pathc; i++) {
-        NIM_ARRAY(arr)->items[i] =
+        NimRef *path =
             nim_str_new (res.gl_pathv[i], strlen (res.gl_pathv[i]));
-        if (NIM_ARRAY(arr)->items[i] == NULL) {
+        if (path == NULL || !nim_array_push (arr, path)) {
+            globfree (&res);
             return NULL;
         }
     }
-    NIM_ARRAY(arr)->size = res.gl_pathc;
 
     globfree (&res);
 
@@ -125,13 +124,11 @@ _nim_os_glob (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_os_setuid (NimRef *self, NimRef *args)
+_nim_os_setuid (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     int64_t uid;
 
-    if (!nim_method_parse_args (args, "I", &uid)) {
-        return NULL;
-    }
+    uid = args[0].I;
 
     if (setuid ((uid_t) uid) != 0) {
         return nim_false;
@@ -142,13 +139,11 @@ _nim_os_setuid (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_os_setgid (NimRef *self, NimRef *args)
+_nim_os_setgid (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     int64_t gid;
 
-    if (!nim_method_parse_args (args, "I", &gid)) {
-        return NULL;
-    }
+    gid = args[0].I;
 
     if (setgid ((gid_t) gid) != 0) {
         return nim_false;
@@ -184,15 +179,18 @@ nim_init_os_module (void)
         return NULL;
     }
 
-    if (!nim_module_add_method_str (os, "glob", _nim_os_glob)) {
+    if (!nim_module_add_method_str_typed (
+            os, "glob", "s", _nim_os_glob)) {
         return NULL;
     }
 
-    if (!nim_module_add_method_str (os, "setuid", _nim_os_setuid)) {
+    if (!nim_module_add_method_str_typed (
+            os, "setuid", "I", _nim_os_setuid)) {
         return NULL;
     }
 
-    if (!nim_module_add_method_str (os, "setgid", _nim_os_setgid)) {
+    if (!nim_module_add_method_str_typed (
+            os, "setgid", "I", _nim_os_setgid)) {
         return NULL;
     }
 
@@ -22,12 +22,14 @@
 #include "nim/class.h"
 #include "nim/object.h"
 #include "nim/array.h"
+#include "nim/range.h"
 #include "nim/task.h"
 
 #define nim_msg_int_cell_size(ref) sizeof(NimMsgCell)
 #define nim_msg_nil_cell_size(ref) sizeof(NimMsgCell)
 #define nim_msg_method_cell_size(ref) sizeof(NimMsgCell)
 #define nim_msg_module_cell_size(ref) sizeof(NimMsgCell)
+#define nim_msg_range_cell_size(ref) sizeof(NimMsgCell)
 #define nim_msg_str_cell_size(ref) \
     (sizeof(NimMsgCell) + NIM_STR_SIZE(ref) + 1)
 
@@ -83,6 +85,9 @@ nim_msg_value_cell_size (NimRef *ref)
     else if (klass == nim_task_class) {
         return nim_msg_task_cell_size (ref);
     }
+    else if (klass == nim_range_class) {
+        return nim_msg_range_cell_size (ref);
+    }
     else {
         NIM_BUG ("unsupported message type in array encode: %s",
                 NIM_STR_DATA(NIM_CLASS_NAME(NIM_ANY_CLASS(ref))));
@@ -185,6 +190,21 @@ nim_msg_task_cell_encode (char **buf_ptr, NimRef *ref)
     return NIM_TRUE;
 }
 
+/* ranges travel as their bounds: the receiver gets a range, too */
+static nim_bool_t
+nim_msg_range_cell_encode (char **buf_ptr, NimRef *ref)
+{
+    char *buf = *buf_ptr;
+    NimMsgCell *cell = (NimMsgCell *)buf;
+    cell->type = NIM_MSG_CELL_RANGE;
+    cell->range.start = NIM_RANGE(ref)->start;
+    cell->range.stop = NIM_RANGE(ref)->stop;
+    cell->range.step = NIM_RANGE(ref)->step;
+    buf += nim_msg_range_cell_size (ref);
+    *buf_ptr = buf;
+    return NIM_TRUE;
+}
+
 static nim_bool_t
 nim_msg_value_cell_encode (char **buf_ptr, NimRef *ref)
 {
@@ -229,6 +249,11 @@ nim_msg_value_cell_encode (char **buf_ptr, NimRef *ref)
             return NIM_FALSE;
         }
     }
+    else if (klass == nim_range_class) {
+        if (!nim_msg_range_cell_encode (buf_ptr, ref)) {
+            return NIM_FALSE;
+        }
+    }
     else {
         NIM_BUG ("unsupported message type in encode: %s",
                 NIM_STR_DATA(NIM_CLASS_NAME(NIM_ANY_CLASS(ref))));
@@ -399,6 +424,17 @@ nim_msg_value_cell_decode (char **buf_ptr, NimRef **ref)
                 }
                 break;
             }
+        case NIM_MSG_CELL_RANGE:
+            {
+                *ref = nim_range_new (
+                    cell->range.start, cell->range.stop, cell->range.step);
+                if (*ref == NULL) {
+                    return NIM_FALSE;
+                }
+                buf += sizeof(NimMsgCell);
+                *buf_ptr = buf;
+                break;
+            }
         default:
             NIM_BUG ("unknown message cell type in decode: %d\n",
                         cell->type);
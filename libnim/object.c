@@ -44,6 +44,21 @@ nim_object_cmp (NimRef *a, NimRef *b)
     }
 }
 
+NimCmpResult
+nim_object_cmp_eq (NimRef *a, NimRef *b)
+{
+    if (a == b) {
+        return NIM_CMP_EQ;
+    }
+
+    /* distinct interned strs always differ */
+    if (NIM_STR_IS_INTERNED(a) && NIM_STR_IS_INTERNED(b)) {
+        return a < b ? NIM_CMP_LT : NIM_CMP_GT;
+    }
+
+    return nim_object_cmp (a, b);
+}
+
 NimRef *
 nim_object_str (NimRef *self)
 {
@@ -0,0 +1,615 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#include <stdlib.h>
+
+#include "nim/optimize.h"
+#include "nim/ast.h"
+#include "nim/array.h"
+#include "nim/str.h"
+#include "nim/int.h"
+#include "nim/float.h"
+#include "nim/object.h"
+
+static int nim_opt_level_value = 1;
+
+nim_bool_t
+nim_opt_init (void)
+{
+    const char *value = getenv ("NIM_OPT_LEVEL");
+    nim_opt_level_value = value != NULL ? atoi (value) : 1;
+    if (nim_opt_level_value < 0) {
+        nim_opt_level_value = 0;
+    }
+    return NIM_TRUE;
+}
+
+int
+nim_opt_level (void)
+{
+    return nim_opt_level_value;
+}
+
+static NimRef *
+nim_optimize_expr (NimRef *expr);
+
+static nim_bool_t
+nim_optimize_stmts (NimRef *stmts, nim_bool_t is_body);
+
+static nim_bool_t
+nim_optimize_decls (NimRef *decls);
+
+static nim_bool_t
+nim_optimize_is_const (NimRef *expr)
+{
+    switch (NIM_AST_EXPR_TYPE(expr)) {
+        case NIM_AST_EXPR_INT_:
+        case NIM_AST_EXPR_FLOAT_:
+        case NIM_AST_EXPR_STR:
+        case NIM_AST_EXPR_BOOL:
+        case NIM_AST_EXPR_NIL:
+            return NIM_TRUE;
+        default:
+            return NIM_FALSE;
+    }
+}
+
+/* only valid if nim_optimize_is_const (expr) */
+static NimRef *
+nim_optimize_const_value (NimRef *expr)
+{
+    switch (NIM_AST_EXPR_TYPE(expr)) {
+        case NIM_AST_EXPR_INT_:
+            return NIM_AST_EXPR(expr)->int_.value;
+        case NIM_AST_EXPR_FLOAT_:
+            return NIM_AST_EXPR(expr)->float_.value;
+        case NIM_AST_EXPR_STR:
+            return NIM_AST_EXPR(expr)->str.value;
+        case NIM_AST_EXPR_BOOL:
+            return NIM_AST_EXPR(expr)->bool.value;
+        default:
+            return nim_nil;
+    }
+}
+
+/* the same test JUMPIFFALSE & NOT make at runtime */
+static nim_bool_t
+nim_optimize_is_truthy (NimRef *expr)
+{
+    NimRef *value = nim_optimize_const_value (expr);
+    return value != nim_nil && value != nim_false;
+}
+
+static NimRef *
+nim_optimize_new_const (NimRef *value, const NimAstNodeLocation *location)
+{
+    NimRef *klass = NIM_ANY_CLASS(value);
+
+    if (klass == nim_int_class) {
+        return nim_ast_expr_new_int_ (value, location);
+    }
+    else if (klass == nim_float_class) {
+        return nim_ast_expr_new_float_ (value, location);
+    }
+    else if (klass == nim_str_class) {
+        return nim_ast_expr_new_str (value, location);
+    }
+    else if (klass == nim_bool_class) {
+        return nim_ast_expr_new_bool (value, location);
+    }
+    return nim_ast_expr_new_nil (location);
+}
+
+static nim_bool_t
+nim_optimize_is_num (NimRef *value)
+{
+    return NIM_ANY_CLASS(value) == nim_int_class ||
+            NIM_ANY_CLASS(value) == nim_float_class;
+}
+
+/* folds binop over two constants using the same methods the VM would */
+/* call, so the result can't differ from what we'd compute at runtime. */
+/* returns expr unchanged if it can't be folded. */
+static NimRef *
+nim_optimize_fold_binop (NimRef *expr, NimRef *left, NimRef *right)
+{
+    const NimAstNodeLocation *location = &NIM_AST_EXPR(expr)->location;
+    NimRef *a = nim_optimize_const_value (left);
+    NimRef *b = nim_optimize_const_value (right);
+    const nim_bool_t nums = nim_optimize_is_num (a) && nim_optimize_is_num (b);
+    const nim_bool_t strs = NIM_ANY_CLASS(a) == nim_str_class &&
+                                NIM_ANY_CLASS(b) == nim_str_class;
+    NimRef *result = NULL;
+    NimCmpResult r;
+
+    switch (NIM_AST_EXPR(expr)->binop.op) {
+        case NIM_BINOP_ADD:
+            if (nums || strs) {
+                result = nim_object_add (a, b);
+            }
+            break;
+        case NIM_BINOP_SUB:
+            if (nums) {
+                result = nim_object_sub (a, b);
+            }
+            break;
+        case NIM_BINOP_MUL:
+            if (nums) {
+                result = nim_object_mul (a, b);
+            }
+            break;
+        case NIM_BINOP_DIV:
+            /* int division by zero is left for the VM to report */
+            if (nums && !(NIM_ANY_CLASS(a) == nim_int_class &&
+                    NIM_ANY_CLASS(b) == nim_int_class &&
+                    NIM_INT(b)->value == 0)) {
+                result = nim_object_div (a, b);
+            }
+            break;
+        case NIM_BINOP_EQ:
+        case NIM_BINOP_NEQ:
+        case NIM_BINOP_GT:
+        case NIM_BINOP_GTE:
+        case NIM_BINOP_LT:
+        case NIM_BINOP_LTE:
+            if (!nums && !strs) {
+                break;
+            }
+            r = nim_object_cmp (a, b);
+            if (r == NIM_CMP_ERROR) {
+                return expr;
+            }
+            switch (NIM_AST_EXPR(expr)->binop.op) {
+                case NIM_BINOP_EQ:
+                    result = NIM_BOOL_REF(r == NIM_CMP_EQ);
+                    break;
+                case NIM_BINOP_NEQ:
+                    result = NIM_BOOL_REF(r != NIM_CMP_EQ);
+                    break;
+                case NIM_BINOP_GT:
+                    result = NIM_BOOL_REF(r == NIM_CMP_GT);
+                    break;
+                case NIM_BINOP_GTE:
+                    result = NIM_BOOL_REF(r == NIM_CMP_GT || r == NIM_CMP_EQ);
+                    break;
+                case NIM_BINOP_LT:
+                    result = NIM_BOOL_REF(r == NIM_CMP_LT);
+                    break;
+                default:
+                    result = NIM_BOOL_REF(r == NIM_CMP_LT || r == NIM_CMP_EQ);
+                    break;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (result == NULL) {
+        return expr;
+    }
+    return nim_optimize_new_const (result, location);
+}
+
+static NimRef *
+nim_optimize_binop (NimRef *expr)
+{
+    NimRef *left;
+    NimRef *right;
+
+    left = nim_optimize_expr (NIM_AST_EXPR(expr)->binop.left);
+    if (left == NULL) {
+        return NULL;
+    }
+    NIM_AST_EXPR(expr)->binop.left = left;
+    right = nim_optimize_expr (NIM_AST_EXPR(expr)->binop.right);
+    if (right == NULL) {
+        return NULL;
+    }
+    NIM_AST_EXPR(expr)->binop.right = right;
+
+    if (!nim_optimize_is_const (left)) {
+        return expr;
+    }
+
+    /* `and` & `or` short-circuit, so only the left side must be known */
+    switch (NIM_AST_EXPR(expr)->binop.op) {
+        case NIM_BINOP_AND:
+            return nim_optimize_is_truthy (left) ? right : left;
+        case NIM_BINOP_OR:
+            return nim_optimize_is_truthy (left) ? left : right;
+        default:
+            break;
+    }
+
+    if (!nim_optimize_is_const (right)) {
+        return expr;
+    }
+    return nim_optimize_fold_binop (expr, left, right);
+}
+
+static nim_bool_t
+nim_optimize_exprs (NimRef *exprs)
+{
+    size_t i;
+
+    for (i = 0; i < NIM_ARRAY_SIZE(exprs); i++) {
+        NimRef *expr = nim_optimize_expr (NIM_ARRAY_ITEM(exprs, i));
+        if (expr == NULL) {
+            return NIM_FALSE;
+        }
+        NIM_ARRAY_ITEMS(exprs)[i] = expr;
+    }
+    return NIM_TRUE;
+}
+
+/* returns the expr to use in place of expr, or NULL on error */
+static NimRef *
+nim_optimize_expr (NimRef *expr)
+{
+    NimRef *value;
+
+    switch (NIM_AST_EXPR_TYPE(expr)) {
+        case NIM_AST_EXPR_BINOP:
+            return nim_optimize_binop (expr);
+        case NIM_AST_EXPR_NOT:
+            value = nim_optimize_expr (NIM_AST_EXPR(expr)->not.value);
+            if (value == NULL) {
+                return NULL;
+            }
+            if (nim_optimize_is_const (value)) {
+                return nim_ast_expr_new_bool (
+                    NIM_BOOL_REF(!nim_optimize_is_truthy (value)),
+                    &NIM_AST_EXPR(expr)->location);
+            }
+            NIM_AST_EXPR(expr)->not.value = value;
+            return expr;
+        case NIM_AST_EXPR_CALL:
+            value = nim_optimize_expr (NIM_AST_EXPR(expr)->call.target);
+            if (value == NULL) {
+                return NULL;
+            }
+            NIM_AST_EXPR(expr)->call.target = value;
+            return nim_optimize_exprs (NIM_AST_EXPR(expr)->call.args) ?
+                    expr : NULL;
+        case NIM_AST_EXPR_SPAWN:
+            value = nim_optimize_expr (NIM_AST_EXPR(expr)->spawn.target);
+            if (value == NULL) {
+                return NULL;
+            }
+            NIM_AST_EXPR(expr)->spawn.target = value;
+            return nim_optimize_exprs (NIM_AST_EXPR(expr)->spawn.args) ?
+                    expr : NULL;
+        case NIM_AST_EXPR_GETATTR:
+            value = nim_optimize_expr (NIM_AST_EXPR(expr)->getattr.target);
+            if (value == NULL) {
+                return NULL;
+            }
+            NIM_AST_EXPR(expr)->getattr.target = value;
+            return expr;
+        case NIM_AST_EXPR_GETITEM:
+            value = nim_optimize_expr (NIM_AST_EXPR(expr)->getitem.target);
+            if (value == NULL) {
+                return NULL;
+            }
+            NIM_AST_EXPR(expr)->getitem.target = value;
+            value = nim_optimize_expr (NIM_AST_EXPR(expr)->getitem.key);
+            if (value == NULL) {
+                return NULL;
+            }
+            NIM_AST_EXPR(expr)->getitem.key = value;
+            return expr;
+        case NIM_AST_EXPR_ARRAY:
+            return nim_optimize_exprs (NIM_AST_EXPR(expr)->array.value) ?
+                    expr : NULL;
+        case NIM_AST_EXPR_HASH:
+            /* alternating keys & values */
+            return nim_optimize_exprs (NIM_AST_EXPR(expr)->hash.value) ?
+                    expr : NULL;
+        case NIM_AST_EXPR_FN:
+            return nim_optimize_stmts (NIM_AST_EXPR(expr)->fn.body, NIM_TRUE) ?
+                    expr : NULL;
+        default:
+            return expr;
+    }
+}
+
+/* a function with a yield anywhere in its body is a generator, even if */
+/* the yield can never run: we mustn't prune it away. */
+static nim_bool_t
+nim_optimize_contains_yield (NimRef *stmts)
+{
+    size_t i;
+
+    if (stmts == NULL) {
+        return NIM_FALSE;
+    }
+    for (i = 0; i < NIM_ARRAY_SIZE(stmts); i++) {
+        NimRef *stmt = NIM_ARRAY_ITEM(stmts, i);
+
+        if (NIM_ANY_CLASS(stmt) != nim_ast_stmt_class) {
+            continue;
+        }
+        switch (NIM_AST_STMT_TYPE(stmt)) {
+            case NIM_AST_STMT_YIELD:
+                return NIM_TRUE;
+            case NIM_AST_STMT_IF_:
+                if (nim_optimize_contains_yield (NIM_AST_STMT(stmt)->if_.body) ||
+                    nim_optimize_contains_yield (NIM_AST_STMT(stmt)->if_.orelse)) {
+                    return NIM_TRUE;
+                }
+                break;
+            case NIM_AST_STMT_WHILE_:
+                if (nim_optimize_contains_yield (
+                        NIM_AST_STMT(stmt)->while_.body)) {
+                    return NIM_TRUE;
+                }
+                break;
+            case NIM_AST_STMT_FOR_:
+                if (nim_optimize_contains_yield (
+                        NIM_AST_STMT(stmt)->for_.body)) {
+                    return NIM_TRUE;
+                }
+                break;
+            case NIM_AST_STMT_MATCH:
+                if (nim_optimize_contains_yield (
+                        NIM_AST_STMT(stmt)->match.body)) {
+                    return NIM_TRUE;
+                }
+                break;
+            case NIM_AST_STMT_PATTERN:
+                if (nim_optimize_contains_yield (
+                        NIM_AST_STMT(stmt)->pattern.body)) {
+                    return NIM_TRUE;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return NIM_FALSE;
+}
+
+static nim_bool_t
+nim_optimize_decl (NimRef *decl)
+{
+    NimRef *value;
+
+    switch (NIM_AST_DECL_TYPE(decl)) {
+        case NIM_AST_DECL_FUNC:
+            return nim_optimize_stmts (NIM_AST_DECL(decl)->func.body, NIM_TRUE);
+        case NIM_AST_DECL_CLASS:
+            return nim_optimize_decls (NIM_AST_DECL(decl)->class.body);
+        case NIM_AST_DECL_VAR:
+            if (NIM_AST_DECL(decl)->var.value != NULL) {
+                value = nim_optimize_expr (NIM_AST_DECL(decl)->var.value);
+                if (value == NULL) {
+                    return NIM_FALSE;
+                }
+                NIM_AST_DECL(decl)->var.value = value;
+            }
+            return NIM_TRUE;
+        default:
+            return NIM_TRUE;
+    }
+}
+
+static nim_bool_t
+nim_optimize_decls (NimRef *decls)
+{
+    size_t i;
+
+    for (i = 0; i < NIM_ARRAY_SIZE(decls); i++) {
+        if (!nim_optimize_decl (NIM_ARRAY_ITEM(decls, i))) {
+            return NIM_FALSE;
+        }
+    }
+    return NIM_TRUE;
+}
+
+/* optimizes stmt & pushes whatever should replace it onto result */
+static nim_bool_t
+nim_optimize_stmt (NimRef *stmt, NimRef *result)
+{
+    NimRef *value;
+    NimRef *branch;
+    size_t i;
+
+    switch (NIM_AST_STMT_TYPE(stmt)) {
+        case NIM_AST_STMT_EXPR:
+            value = nim_optimize_expr (NIM_AST_STMT(stmt)->expr.expr);
+            if (value == NULL) {
+                return NIM_FALSE;
+            }
+            NIM_AST_STMT(stmt)->expr.expr = value;
+            break;
+        case NIM_AST_STMT_IF_:
+            value = nim_optimize_expr (NIM_AST_STMT(stmt)->if_.expr);
+            if (value == NULL) {
+                return NIM_FALSE;
+            }
+            NIM_AST_STMT(stmt)->if_.expr = value;
+            if (!nim_optimize_stmts (NIM_AST_STMT(stmt)->if_.body, NIM_FALSE)) {
+                return NIM_FALSE;
+            }
+            if (NIM_AST_STMT(stmt)->if_.orelse != NULL &&
+                    !nim_optimize_stmts (
+                        NIM_AST_STMT(stmt)->if_.orelse, NIM_FALSE)) {
+                return NIM_FALSE;
+            }
+            if (!nim_optimize_is_const (value) || nim_optimize_contains_yield (
+                    nim_optimize_is_truthy (value) ?
+                        NIM_AST_STMT(stmt)->if_.orelse :
+                        NIM_AST_STMT(stmt)->if_.body)) {
+                break;
+            }
+            /* ifs don't open a scope, so the live branch can be inlined */
+            branch = nim_optimize_is_truthy (value) ?
+                        NIM_AST_STMT(stmt)->if_.body :
+                        NIM_AST_STMT(stmt)->if_.orelse;
+            if (branch != NULL) {
+                for (i = 0; i < NIM_ARRAY_SIZE(branch); i++) {
+                    if (!nim_array_push (result, NIM_ARRAY_ITEM(branch, i))) {
+                        return NIM_FALSE;
+                    }
+                }
+            }
+            return NIM_TRUE;
+        case NIM_AST_STMT_WHILE_:
+            value = nim_optimize_expr (NIM_AST_STMT(stmt)->while_.expr);
+            if (value == NULL) {
+                return NIM_FALSE;
+            }
+            NIM_AST_STMT(stmt)->while_.expr = value;
+            if (!nim_optimize_stmts (
+                    NIM_AST_STMT(stmt)->while_.body, NIM_FALSE)) {
+                return NIM_FALSE;
+            }
+            if (nim_optimize_is_const (value)) {
+                if (nim_optimize_is_truthy (value)) {
+                    /* no test at all: see nim_compile_ast_stmt_while_ */
+                    NIM_AST_STMT(stmt)->while_.expr = NULL;
+                }
+                else if (!nim_optimize_contains_yield (
+                            NIM_AST_STMT(stmt)->while_.body)) {
+                    return NIM_TRUE;
+                }
+            }
+            break;
+        case NIM_AST_STMT_FOR_:
+            value = nim_optimize_expr (NIM_AST_STMT(stmt)->for_.expr);
+            if (value == NULL) {
+                return NIM_FALSE;
+            }
+            NIM_AST_STMT(stmt)->for_.expr = value;
+            if (!nim_optimize_stmts (NIM_AST_STMT(stmt)->for_.body, NIM_FALSE)) {
+                return NIM_FALSE;
+            }
+            break;
+        case NIM_AST_STMT_MATCH:
+            value = nim_optimize_expr (NIM_AST_STMT(stmt)->match.expr);
+            if (value == NULL) {
+                return NIM_FALSE;
+            }
+            NIM_AST_STMT(stmt)->match.expr = value;
+            /* the patterns themselves are left alone */
+            for (i = 0; i < NIM_ARRAY_SIZE(NIM_AST_STMT(stmt)->match.body); i++) {
+                NimRef *pattern =
+                    NIM_ARRAY_ITEM(NIM_AST_STMT(stmt)->match.body, i);
+                if (!nim_optimize_stmts (
+                        NIM_AST_STMT(pattern)->pattern.body, NIM_FALSE)) {
+                    return NIM_FALSE;
+                }
+            }
+            break;
+        case NIM_AST_STMT_RET:
+            if (NIM_AST_STMT(stmt)->ret.expr != NULL) {
+                value = nim_optimize_expr (NIM_AST_STMT(stmt)->ret.expr);
+                if (value == NULL) {
+                    return NIM_FALSE;
+                }
+                NIM_AST_STMT(stmt)->ret.expr = value;
+            }
+            break;
+        case NIM_AST_STMT_YIELD:
+            value = nim_optimize_expr (NIM_AST_STMT(stmt)->yield.expr);
+            if (value == NULL) {
+                return NIM_FALSE;
+            }
+            NIM_AST_STMT(stmt)->yield.expr = value;
+            break;
+        case NIM_AST_STMT_ASSIGN:
+            value = nim_optimize_expr (NIM_AST_STMT(stmt)->assign.value);
+            if (value == NULL) {
+                return NIM_FALSE;
+            }
+            NIM_AST_STMT(stmt)->assign.value = value;
+            break;
+        default:
+            break;
+    }
+    return nim_array_push (result, stmt);
+}
+
+/* is_body is set for function bodies, where a trailing expression */
+/* statement is the return value. */
+static nim_bool_t
+nim_optimize_stmts (NimRef *stmts, nim_bool_t is_body)
+{
+    const size_t size = NIM_ARRAY_SIZE(stmts);
+    NimRef *result;
+    NimRef *last;
+    size_t i;
+
+    if (size == 0) {
+        return NIM_TRUE;
+    }
+
+    result = nim_array_new_with_capacity (size);
+    if (result == NULL) {
+        return NIM_FALSE;
+    }
+    for (i = 0; i < size; i++) {
+        NimRef *item = NIM_ARRAY_ITEM(stmts, i);
+        if (NIM_ANY_CLASS(item) == nim_ast_decl_class) {
+            if (!nim_optimize_decl (item) || !nim_array_push (result, item)) {
+                return NIM_FALSE;
+            }
+        }
+        else if (!nim_optimize_stmt (item, result)) {
+            return NIM_FALSE;
+        }
+    }
+
+    /* a pruned trailing if mustn't turn what's left into the return value */
+    last = NIM_ARRAY_ITEM(stmts, size - 1);
+    if (is_body && NIM_ARRAY_SIZE(result) > 0 &&
+            NIM_ARRAY_LAST(result) != last) {
+        NimRef *tail = NIM_ARRAY_LAST(result);
+        if (NIM_ANY_CLASS(tail) == nim_ast_stmt_class &&
+                NIM_AST_STMT_TYPE(tail) == NIM_AST_STMT_EXPR) {
+            const NimAstNodeLocation *location =
+                &NIM_AST_STMT(last)->location;
+            NimRef *nil = nim_ast_expr_new_nil (location);
+            if (nil == NULL) {
+                return NIM_FALSE;
+            }
+            nil = nim_ast_stmt_new_expr (nil, location);
+            if (nil == NULL || !nim_array_push (result, nil)) {
+                return NIM_FALSE;
+            }
+        }
+    }
+
+    NIM_ARRAY_SIZE(stmts) = 0;
+    for (i = 0; i < NIM_ARRAY_SIZE(result); i++) {
+        if (!nim_array_push (stmts, NIM_ARRAY_ITEM(result, i))) {
+            return NIM_FALSE;
+        }
+    }
+    return NIM_TRUE;
+}
+
+nim_bool_t
+nim_ast_optimize (NimRef *mod)
+{
+    if (NIM_ANY_CLASS(mod) != nim_ast_mod_class) {
+        return NIM_TRUE;
+    }
+    return nim_optimize_decls (NIM_AST_MOD(mod)->root.body);
+}
+
@@ -0,0 +1,453 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "nim/range.h"
+#include "nim/array.h"
+#include "nim/int.h"
+#include "nim/str.h"
+#include "nim/class.h"
+#include "nim/object.h"
+#include "nim/method.h"
+
+NimRef *nim_range_class = NULL;
+
+static size_t
+_nim_range_size (const NimRange *range)
+{
+    const int64_t start = range->start;
+    const int64_t stop = range->stop;
+    const int64_t step = range->step;
+
+    if (step > 0 && start < stop) {
+        return (size_t) (((uint64_t) stop - start - 1) / step + 1);
+    }
+    else if (step < 0 && start > stop) {
+        return (size_t) (((uint64_t) start - stop - 1) / -(uint64_t) step + 1);
+    }
+    return 0;
+}
+
+static nim_bool_t
+_nim_range_iter_next (NimRef *self, size_t *pos, NimRef **value)
+{
+    const NimRange *range = NIM_RANGE(self);
+
+    if (*pos >= _nim_range_size (range)) {
+        *value = NULL;
+        return NIM_TRUE;
+    }
+    *value = nim_int_new (range->start + (int64_t) *pos * range->step);
+    if (*value == NULL) {
+        return NIM_FALSE;
+    }
+    (*pos)++;
+    return NIM_TRUE;
+}
+
+static NimRef *
+_nim_range_each (NimRef *self, const NimNativeArg *args, size_t nargs)
+{
+    const size_t size = nim_range_size (self);
+    NimRef *fn = args[0].o;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        NimRef *fn_args;
+        NimRef *value;
+
+        value = nim_int_new (NIM_RANGE_AT(self, i));
+        if (value == NULL) {
+            return NULL;
+        }
+        fn_args = nim_array_new_var (value, NULL);
+        if (fn_args == NULL) {
+            return NULL;
+        }
+        if (nim_object_call (fn, fn_args) == NULL) {
+            return NULL;
+        }
+    }
+    return nim_nil;
+}
+
+static NimRef *
+_nim_range_map (NimRef *self, const NimNativeArg *args, size_t nargs)
+{
+    const size_t size = nim_range_size (self);
+    NimRef *fn = args[0].o;
+    NimRef *result = nim_array_new_with_capacity (size);
+    size_t i;
+
+    if (result == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < size; i++) {
+        NimRef *fn_args;
+        NimRef *mapped;
+        NimRef *value;
+
+        value = nim_int_new (NIM_RANGE_AT(self, i));
+        if (value == NULL) {
+            return NULL;
+        }
+        fn_args = nim_array_new_var (value, NULL);
+        if (fn_args == NULL) {
+            return NULL;
+        }
+        mapped = nim_object_call (fn, fn_args);
+        if (mapped == NULL) {
+            return NULL;
+        }
+        if (!nim_array_push (result, mapped)) {
+            return NULL;
+        }
+    }
+    return result;
+}
+
+static NimRef *
+_nim_range_filter (NimRef *self, const NimNativeArg *args, size_t nargs)
+{
+    const size_t size = nim_range_size (self);
+    NimRef *fn = args[0].o;
+    NimRef *result = nim_array_new ();
+    size_t i;
+
+    if (result == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < size; i++) {
+        NimRef *fn_args;
+        NimRef *r;
+        NimRef *value;
+
+        value = nim_int_new (NIM_RANGE_AT(self, i));
+        if (value == NULL) {
+            return NULL;
+        }
+        fn_args = nim_array_new_var (value, NULL);
+        if (fn_args == NULL) {
+            return NULL;
+        }
+        r = nim_object_call (fn, fn_args);
+        if (r == NULL) {
+            return NULL;
+        }
+        if (r == nim_true) {
+            if (!nim_array_push (result, value)) {
+                return NULL;
+            }
+        }
+    }
+    return result;
+}
+
+static NimRef *
+_nim_range_contains (NimRef *self, const NimNativeArg *args, size_t nargs)
+{
+    NimRef *value = args[0].o;
+
+    if (NIM_ANY_CLASS(value) != nim_int_class) {
+        return nim_false;
+    }
+    return NIM_BOOL_REF(nim_range_contains (self, NIM_INT(value)->value));
+}
+
+static NimRef *
+_nim_range_size_method (NimRef *self, const NimNativeArg *args, size_t nargs)
+{
+    return nim_int_new (nim_range_size (self));
+}
+
+static NimRef *
+_nim_range_to_array_method (
+    NimRef *self, const NimNativeArg *args, size_t nargs)
+{
+    return nim_range_to_array (self);
+}
+
+/* negative keys count back from the end, like nim_array_get */
+static NimRef *
+_nim_range_getitem (NimRef *self, NimRef *key)
+{
+    const size_t size = nim_range_size (self);
+    int64_t pos;
+
+    if (NIM_ANY_CLASS(key) != nim_int_class) {
+        NIM_BUG ("bad argument type for range.__getitem__");
+        return NULL;
+    }
+    pos = NIM_INT(key)->value;
+    if (pos < 0) {
+        pos += (int64_t) size;
+    }
+    if (pos < 0 || (uint64_t) pos >= size) {
+        return nim_nil;
+    }
+    return nim_int_new (NIM_RANGE_AT(self, pos));
+}
+
+/* compares against another range or an array without materializing */
+static NimCmpResult
+_nim_range_cmp (NimRef *left, NimRef *right)
+{
+    size_t size;
+    size_t i;
+
+    if (NIM_ANY_CLASS(left) != nim_range_class) {
+        return NIM_CMP_NOT_IMPL;
+    }
+    size = nim_range_size (left);
+
+    if (NIM_ANY_CLASS(right) == nim_range_class) {
+        if (size != nim_range_size (right)) {
+            return NIM_CMP_NOT_IMPL;
+        }
+        for (i = 0; i < size && i < 2; i++) {
+            if (NIM_RANGE_AT(left, i) != NIM_RANGE_AT(right, i)) {
+                return NIM_CMP_NOT_IMPL;
+            }
+        }
+        return NIM_CMP_EQ;
+    }
+    else if (NIM_ANY_CLASS(right) != nim_array_class) {
+        return NIM_CMP_NOT_IMPL;
+    }
+
+    if (size != NIM_ARRAY_SIZE(right)) {
+        return NIM_CMP_NOT_IMPL;
+    }
+    for (i = 0; i < size; i++) {
+        NimRef *item = NIM_ARRAY_ITEM(right, i);
+        int64_t value = NIM_RANGE_AT(left, i);
+
+        if (NIM_ANY_CLASS(item) != nim_int_class) {
+            return NIM_CMP_NOT_IMPL;
+        }
+        if (value < NIM_INT(item)->value) {
+            return NIM_CMP_LT;
+        }
+        else if (value > NIM_INT(item)->value) {
+            return NIM_CMP_GT;
+        }
+    }
+    return NIM_CMP_EQ;
+}
+
+static NimRef *
+_nim_range_init (NimRef *self, NimRef *args)
+{
+    int64_t start = 0;
+    int64_t stop;
+    int64_t step = 1;
+
+    switch (NIM_ARRAY(args)->size) {
+        case 0:
+            NIM_BUG("range(): not enough args");
+            return NULL;
+        case 1:
+            if (!nim_method_parse_args (args, "I", &stop)) {
+                return NULL;
+            }
+            break;
+        case 2:
+            if (!nim_method_parse_args (args, "II", &start, &stop)) {
+                return NULL;
+            }
+            break;
+        case 3:
+            if (!nim_method_parse_args (args, "III", &start, &stop, &step)) {
+                return NULL;
+            }
+            break;
+        default:
+            NIM_BUG("range(): too many args.");
+            return NULL;
+    }
+    if (step == 0) {
+        NIM_BUG ("range(): step argument can't be zero.");
+        return NULL;
+    }
+
+    NIM_RANGE(self)->start = start;
+    NIM_RANGE(self)->stop = stop;
+    NIM_RANGE(self)->step = step;
+    return self;
+}
+
+static NimRef *
+_nim_range_str (NimRef *self)
+{
+    NimRef *array = nim_range_to_array (self);
+    if (array == NULL) {
+        return NULL;
+    }
+    return nim_object_str (array);
+}
+
+/* read-only array methods we don't implement lazily. anything that */
+/* changes an array would only change a copy: use to_array() for that. */
+static const char *_nim_range_array_methods[] = { "any", "join", NULL };
+
+static NimRef *
+_nim_range_getattr (NimRef *self, NimRef *name)
+{
+    NimRef *method = nim_class_lookup_method (nim_range_class, name);
+    size_t i;
+
+    if (method != NULL) {
+        return nim_method_new_bound (method, self);
+    }
+    for (i = 0; _nim_range_array_methods[i] != NULL; i++) {
+        if (strcmp (NIM_STR_DATA(name), _nim_range_array_methods[i]) == 0) {
+            NimRef *array = nim_range_to_array (self);
+            if (array == NULL) {
+                return NULL;
+            }
+            return nim_object_getattr (array, name);
+        }
+    }
+    return NULL;
+}
+
+static NimRef *
+_nim_range_add (NimRef *self, NimRef *other)
+{
+    NimRef *array = nim_range_to_array (self);
+    if (array == NULL) {
+        return NULL;
+    }
+    return nim_object_add (array, other);
+}
+
+static NimRef *
+_nim_range_nonzero (NimRef *self)
+{
+    return NIM_BOOL_REF(nim_range_size (self) > 0);
+}
+
+nim_bool_t
+nim_range_class_bootstrap (void)
+{
+    nim_range_class =
+        nim_class_new (NIM_STR_NEW("range"), NULL, sizeof(NimRange));
+    if (nim_range_class == NULL) {
+        return NIM_FALSE;
+    }
+    nim_gc_make_root (NULL, nim_range_class);
+    NIM_CLASS(nim_range_class)->init = _nim_range_init;
+    NIM_CLASS(nim_range_class)->str = _nim_range_str;
+    NIM_CLASS(nim_range_class)->cmp = _nim_range_cmp;
+    NIM_CLASS(nim_range_class)->getattr = _nim_range_getattr;
+    NIM_CLASS(nim_range_class)->add = _nim_range_add;
+    NIM_CLASS(nim_range_class)->nonzero = _nim_range_nonzero;
+    NIM_CLASS(nim_range_class)->getitem = _nim_range_getitem;
+    NIM_CLASS(nim_range_class)->iter_next = _nim_range_iter_next;
+    if (!nim_class_add_native_method_typed (
+            nim_range_class, "each", "o", _nim_range_each)) {
+        return NIM_FALSE;
+    }
+    if (!nim_class_add_native_method_typed (
+            nim_range_class, "map", "o", _nim_range_map)) {
+        return NIM_FALSE;
+    }
+    if (!nim_class_add_native_method_typed (
+            nim_range_class, "filter", "o", _nim_range_filter)) {
+        return NIM_FALSE;
+    }
+    if (!nim_class_add_native_method_typed (
+            nim_range_class, "contains", "o", _nim_range_contains)) {
+        return NIM_FALSE;
+    }
+    if (!nim_class_add_native_method_typed (
+            nim_range_class, "size", "", _nim_range_size_method)) {
+        return NIM_FALSE;
+    }
+    if (!nim_class_add_native_method_typed (
+            nim_range_class, "to_array", "", _nim_range_to_array_method)) {
+        return NIM_FALSE;
+    }
+    return NIM_TRUE;
+}
+
+NimRef *
+nim_range_new (int64_t start, int64_t stop, int64_t step)
+{
+    NimRef *range;
+
+    if (step == 0) {
+        NIM_BUG ("range(): step argument can't be zero.");
+        return NULL;
+    }
+    range = nim_gc_new_object (NULL);
+    if (range == NULL) {
+        return NULL;
+    }
+    NIM_ANY(range)->klass = nim_range_class;
+    NIM_RANGE(range)->start = start;
+    NIM_RANGE(range)->stop = stop;
+    NIM_RANGE(range)->step = step;
+    return range;
+}
+
+size_t
+nim_range_size (NimRef *self)
+{
+    return _nim_range_size (NIM_RANGE(self));
+}
+
+nim_bool_t
+nim_range_contains (NimRef *self, int64_t value)
+{
+    const NimRange *range = NIM_RANGE(self);
+    uint64_t offset;
+
+    if (range->step > 0) {
+        if (value < range->start || value >= range->stop) {
+            return NIM_FALSE;
+        }
+        offset = (uint64_t) value - range->start;
+        return (offset % (uint64_t) range->step) == 0;
+    }
+    else {
+        if (value > range->start || value <= range->stop) {
+            return NIM_FALSE;
+        }
+        offset = (uint64_t) range->start - value;
+        return (offset % -(uint64_t) range->step) == 0;
+    }
+}
+
+NimRef *
+nim_range_to_array (NimRef *self)
+{
+    const size_t size = nim_range_size (self);
+    NimRef *array = nim_array_new_with_capacity (size);
+    size_t i;
+
+    if (array == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < size; i++) {
+        if (!nim_array_push (array, nim_int_new (NIM_RANGE_AT(self, i)))) {
+            return NULL;
+        }
+    }
+    return array;
+}
+
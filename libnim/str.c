@@ -16,9 +16,21 @@
  *                                                                           *
  *****************************************************************************/
 
+#include <pthread.h>
+
 #include "nim/object.h"
 #include "nim/str.h"
 
+/* the intern table is an open-addressed set of strs, shared by every */
+/* task. lookups only need the read lock; inserts take the write lock. */
+static pthread_rwlock_t nim_str_intern_lock = PTHREAD_RWLOCK_INITIALIZER;
+static NimArena *nim_str_intern_arena = NULL;
+static NimRef **nim_str_intern_table = NULL;
+static size_t nim_str_intern_capacity = 0;
+static size_t nim_str_intern_count = 0;
+
+#define NIM_STR_INTERN_INITIAL_CAPACITY 1024
+
 NimRef *
 nim_str_new (const char *data, size_t size)
 {
@@ -40,9 +52,175 @@ nim_str_new_take (char *data, size_t size)
     NIM_ANY(ref)->klass = nim_str_class;
     NIM_STR(ref)->data = data;
     NIM_STR(ref)->size = size;
+    NIM_STR(ref)->hash = 0;
+    NIM_STR(ref)->interned = NIM_FALSE;
+    return ref;
+}
+
+/* FNV-1a */
+static uint32_t
+_nim_str_hash_data (const char *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* the slot holding the given contents, or the empty one they'd go in */
+static NimRef **
+_nim_str_intern_slot (
+    NimRef **table, size_t capacity,
+    const char *data, size_t size, uint32_t hash)
+{
+    size_t i = hash & (capacity - 1);
+
+    while (table[i] != NULL) {
+        NimStr *str = NIM_UNCHECKED_CAST(NimStr, table[i]);
+        if (str->hash == hash && str->size == size &&
+                memcmp (str->data, data, size) == 0) {
+            break;
+        }
+        i = (i + 1) & (capacity - 1);
+    }
+    return table + i;
+}
+
+static nim_bool_t
+_nim_str_intern_grow (void)
+{
+    size_t capacity = nim_str_intern_capacity == 0
+        ? NIM_STR_INTERN_INITIAL_CAPACITY : nim_str_intern_capacity * 2;
+    NimRef **table = NIM_MALLOC(NimRef *, sizeof(*table) * capacity);
+    size_t i;
+
+    if (table == NULL) {
+        return NIM_FALSE;
+    }
+    memset (table, 0, sizeof(*table) * capacity);
+
+    for (i = 0; i < nim_str_intern_capacity; i++) {
+        NimRef *ref = nim_str_intern_table[i];
+        if (ref != NULL) {
+            NimStr *str = NIM_UNCHECKED_CAST(NimStr, ref);
+            *_nim_str_intern_slot (
+                table, capacity, str->data, str->size, str->hash) = ref;
+        }
+    }
+
+    NIM_FREE (nim_str_intern_table);
+    nim_str_intern_table = table;
+    nim_str_intern_capacity = capacity;
+    return NIM_TRUE;
+}
+
+static NimRef *
+_nim_str_intern_insert (const char *data, size_t size, uint32_t hash)
+{
+    NimRef **slot;
+    NimRef *ref;
+    char *copy;
+
+    if (nim_str_intern_arena == NULL) {
+        nim_str_intern_arena = nim_gc_static_arena_new ();
+        if (nim_str_intern_arena == NULL) {
+            return NULL;
+        }
+    }
+
+    /* keep the table at most half full */
+    if ((nim_str_intern_count + 1) * 2 > nim_str_intern_capacity) {
+        if (!_nim_str_intern_grow ()) {
+            return NULL;
+        }
+    }
+
+    slot = _nim_str_intern_slot (
+        nim_str_intern_table, nim_str_intern_capacity, data, size, hash);
+    if (*slot != NULL) {
+        /* another task got here first */
+        return *slot;
+    }
+
+    copy = nim_gc_arena_alloc (nim_str_intern_arena, size + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+    memcpy (copy, data, size);
+    copy[size] = '\0';
+
+    ref = nim_gc_arena_new_object (nim_str_intern_arena, sizeof(NimStr));
+    if (ref == NULL) {
+        return NULL;
+    }
+    NIM_ANY(ref)->klass = nim_str_class;
+    NIM_STR(ref)->data = copy;
+    NIM_STR(ref)->size = size;
+    NIM_STR(ref)->hash = hash;
+    NIM_STR(ref)->interned = NIM_TRUE;
+
+    *slot = ref;
+    nim_str_intern_count++;
+    return ref;
+}
+
+NimRef *
+nim_str_intern (const char *data, size_t size)
+{
+    uint32_t hash = _nim_str_hash_data (data, size);
+    NimRef *ref = NULL;
+
+    pthread_rwlock_rdlock (&nim_str_intern_lock);
+    if (nim_str_intern_table != NULL) {
+        ref = *_nim_str_intern_slot (nim_str_intern_table,
+                nim_str_intern_capacity, data, size, hash);
+    }
+    pthread_rwlock_unlock (&nim_str_intern_lock);
+
+    if (ref == NULL) {
+        pthread_rwlock_wrlock (&nim_str_intern_lock);
+        ref = _nim_str_intern_insert (data, size, hash);
+        pthread_rwlock_unlock (&nim_str_intern_lock);
+    }
     return ref;
 }
 
+NimRef *
+nim_str_intern_ref (NimRef *str)
+{
+    if (NIM_STR(str)->interned) {
+        return str;
+    }
+    return nim_str_intern (NIM_STR_DATA(str), NIM_STR_SIZE(str));
+}
+
+/* interned strs point at nim_str_class, so they can't outlive the core */
+void
+nim_str_intern_cleanup (void)
+{
+    pthread_rwlock_wrlock (&nim_str_intern_lock);
+    NIM_FREE (nim_str_intern_table);
+    nim_str_intern_table = NULL;
+    nim_str_intern_capacity = 0;
+    nim_str_intern_count = 0;
+    nim_gc_static_arena_delete (nim_str_intern_arena);
+    nim_str_intern_arena = NULL;
+    pthread_rwlock_unlock (&nim_str_intern_lock);
+}
+
+uint32_t
+nim_str_hash (NimRef *str)
+{
+    if (NIM_STR(str)->interned) {
+        return NIM_STR(str)->hash;
+    }
+    return _nim_str_hash_data (NIM_STR_DATA(str), NIM_STR_SIZE(str));
+}
+
 NimRef *
 nim_str_new_format (const char *fmt, ...)
 {
@@ -122,7 +300,12 @@ nim_str_new_concat (const char *a, ...)
 nim_bool_t
 nim_str_append (NimRef *self, NimRef *append_me)
 {
-    NimRef *append_str = nim_object_str (append_me);
+    NimRef *append_str;
+    if (NIM_STR(self)->interned) {
+        NIM_BUG ("cannot modify an interned str");
+        return NIM_FALSE;
+    }
+    append_str = nim_object_str (append_me);
     /* TODO error checking */
     char *data = NIM_REALLOC (char, NIM_STR(self)->data, NIM_STR_SIZE(self) + NIM_STR_SIZE(append_str) + 1);
     if (data == NULL) {
@@ -163,20 +346,15 @@ nim_str_data (NimRef *str)
 }
 
 static NimRef *
-_nim_str_size (NimRef *self, NimRef *args)
+_nim_str_size (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     return nim_int_new (NIM_STR_SIZE(self));
 }
 
 static NimRef *
-_nim_str_index (NimRef *self, NimRef *args)
+_nim_str_index (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    const char *needle;
-    const char *res;
-    if (!nim_method_parse_args (args, "s", &needle)) {
-        return NULL;
-    }
-    res = strstr (NIM_STR_DATA(self), needle);
+    const char *res = strstr (NIM_STR_DATA(self), args[0].s);
     if (res == NULL) {
         return nim_int_new (-1);
     }
@@ -186,7 +364,7 @@ _nim_str_index (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_str_trim (NimRef *self, NimRef *args)
+_nim_str_trim (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     size_t i, j;
 
@@ -211,24 +389,20 @@ _nim_str_trim (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_str_substr (NimRef *self, NimRef *args)
+_nim_str_substr (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    int64_t i, j;
-    NimRef *jobj = NULL;
-
-    if (!nim_method_parse_args (args, "I|o", &i, &jobj)) {
-        return NULL;
-    }
+    int64_t i = args[0].I;
+    int64_t j;
 
     if (i < 0) {
         i += NIM_STR_SIZE(self);
     }
 
-    if (jobj == NULL) {
+    if (nargs < 2) {
         j = NIM_STR_SIZE(self);
     }
     else {
-        j = NIM_INT(jobj)->value;
+        j = args[1].I;
         if (j < 0) {
             j += NIM_STR_SIZE(self);
         }
@@ -238,20 +412,16 @@ _nim_str_substr (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_str_split (NimRef *self, NimRef *args)
+_nim_str_split (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     const char *begin;
     const char *end;
-    const char *sep;
+    const char *sep = args[0].s;
     size_t seplen;
     NimRef *arr;
     const size_t len = NIM_STR_SIZE(self);
     size_t n = 0;
 
-    if (!nim_method_parse_args (args, "s", &sep)) {
-        return NULL;
-    }
-
     /* XXX could pull this directly from the str object */
     seplen = strlen (sep);
 
@@ -280,7 +450,7 @@ _nim_str_split (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_str_upper (NimRef *self, NimRef *args)
+_nim_str_upper (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     size_t i;
     char *data;
@@ -299,7 +469,7 @@ _nim_str_upper (NimRef *self, NimRef *args)
 }
 
 static NimRef *
-_nim_str_lower (NimRef *self, NimRef *args)
+_nim_str_lower (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
     size_t i;
     char *data;
@@ -317,34 +487,60 @@ _nim_str_lower (NimRef *self, NimRef *args)
     return str;
 }
 
+/* iterating over a str gives each (byte-sized) character as a str */
+static nim_bool_t
+_nim_str_iter_next (NimRef *self, size_t *pos, NimRef **value)
+{
+    if (*pos < NIM_STR_SIZE(self)) {
+        *value = nim_str_new (NIM_STR_DATA(self) + *pos, 1);
+        if (*value == NULL) {
+            return NIM_FALSE;
+        }
+        (*pos)++;
+    }
+    else {
+        *value = NULL;
+    }
+    return NIM_TRUE;
+}
+
 int
 nim_str_class_init_2 (void)
 {
-    if (!nim_class_add_native_method (nim_str_class, "size", _nim_str_size)) {
+    NIM_CLASS(nim_str_class)->iter_next = _nim_str_iter_next;
+
+    if (!nim_class_add_native_method_typed (
+            nim_str_class, "size", "", _nim_str_size)) {
         return NIM_FALSE;
     }
 
-    if (!nim_class_add_native_method (nim_str_class, "trim", _nim_str_trim)) {
+    if (!nim_class_add_native_method_typed (
+            nim_str_class, "trim", "", _nim_str_trim)) {
         return NIM_FALSE;
     }
 
-    if (!nim_class_add_native_method (nim_str_class, "index", _nim_str_index)) {
+    if (!nim_class_add_native_method_typed (
+            nim_str_class, "index", "s", _nim_str_index)) {
         return NIM_FALSE;
     }
 
-    if (!nim_class_add_native_method (nim_str_class, "substr", _nim_str_substr)) {
+    if (!nim_class_add_native_method_typed (
+            nim_str_class, "substr", "I|I", _nim_str_substr)) {
         return NIM_FALSE;
     }
 
-    if (!nim_class_add_native_method (nim_str_class, "split", _nim_str_split)) {
+    if (!nim_class_add_native_method_typed (
+            nim_str_class, "split", "s", _nim_str_split)) {
         return NIM_FALSE;
     }
 
-    if (!nim_class_add_native_method (nim_str_class, "upper", _nim_str_upper)) {
+    if (!nim_class_add_native_method_typed (
+            nim_str_class, "upper", "", _nim_str_upper)) {
         return NIM_FALSE;
     }
 
-    if (!nim_class_add_native_method (nim_str_class, "lower", _nim_str_lower)) {
+    if (!nim_class_add_native_method_typed (
+            nim_str_class, "lower", "", _nim_str_lower)) {
         return NIM_FALSE;
     }
 
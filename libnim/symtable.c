@@ -109,18 +109,9 @@ nim_symtable_class_bootstrap (void)
 }
 
 static NimRef *
-_nim_symtable_entry_init (NimRef *self, NimRef *args)
+_nim_symtable_entry_setup (NimRef *self,
+    NimRef *symtable, NimRef *parent, NimRef *scope, int64_t flags)
 {
-    int64_t flags;
-    NimRef *symtable;
-    NimRef *scope;
-    NimRef *parent;
-
-    if (!nim_method_parse_args (
-            args, "oooI", &symtable, &parent, &scope, &flags)) {
-        return NULL;
-    }
-
     NIM_SYMTABLE_ENTRY(self)->flags = flags;
     NIM_SYMTABLE_ENTRY(self)->symtable = symtable;
     NIM_SYMTABLE_ENTRY(self)->scope = scope;
@@ -138,6 +129,22 @@ _nim_symtable_entry_init (NimRef *self, NimRef *args)
     return self;
 }
 
+static NimRef *
+_nim_symtable_entry_init (NimRef *self, NimRef *args)
+{
+    int64_t flags;
+    NimRef *symtable;
+    NimRef *scope;
+    NimRef *parent;
+
+    if (!nim_method_parse_args (
+            args, "oooI", &symtable, &parent, &scope, &flags)) {
+        return NULL;
+    }
+
+    return _nim_symtable_entry_setup (self, symtable, parent, scope, flags);
+}
+
 static void
 _nim_symtable_entry_mark (NimGC *gc, NimRef *self)
 {
@@ -174,15 +181,17 @@ static NimRef *
 nim_symtable_entry_new (
     NimRef *symtable, NimRef *parent, NimRef *scope, int flags)
 {
-    NimRef *flags_obj = nim_int_new (flags);
-    if (flags_obj == NULL) {
+    /* entries go in the compiler's arena, along with the AST */
+    NimRef *self = nim_gc_new_temp_object (NULL, sizeof(NimSymtableEntry));
+    if (self == NULL) {
         return NULL;
     }
+    NIM_ANY(self)->klass = nim_symtable_entry_class;
+
     symtable = symtable ? symtable : nim_nil;
     parent = parent ? parent : nim_nil;
     scope = scope ? scope : nim_nil;
-    return nim_class_new_instance (
-        nim_symtable_entry_class, symtable, parent, scope, flags_obj, NULL);
+    return _nim_symtable_entry_setup (self, symtable, parent, scope, flags);
 }
 
 static nim_bool_t
@@ -218,6 +227,21 @@ nim_symtable_leave_scope (NimRef *self)
     return NIM_SYMTABLE_GET_CURRENT_ENTRY(self) != nim_nil;
 }
 
+static nim_bool_t
+nim_symtable_entry_add (NimRef *ste, NimRef *name, int64_t flags)
+{
+    NimRef *symbols = NIM_SYMTABLE_ENTRY(ste)->symbols;
+    NimRef *fl;
+    if (nim_hash_get (symbols, name, NULL) == 0) {
+        return NIM_TRUE;
+    }
+    fl = nim_int_new (flags);
+    if (fl == NULL) {
+        return NIM_FALSE;
+    }
+    return nim_hash_put (symbols, name, fl);
+}
+
 static nim_bool_t
 nim_symtable_add (NimRef *self, NimRef *name, int64_t flags)
 {
@@ -464,8 +488,17 @@ nim_symtable_visit_expr_ident (NimRef *self, NimRef *expr)
             int type = NIM_SYMTABLE_ENTRY(ste)->flags &
                         NIM_SYM_TYPE_MASK;
             if (ste != NIM_SYMTABLE_GET_CURRENT_ENTRY(self) &&
-                !NIM_SYMTABLE_ENTRY_IS_MODULE(ste)) {
-                return nim_symtable_add (self, name, NIM_SYM_FREE | type);
+                type == NIM_SYM_FUNC) {
+                /* every function between here & the one that declares */
+                /* the var needs it too so closures can pass it down. */
+                NimRef *inner = NIM_SYMTABLE_GET_CURRENT_ENTRY(self);
+                while (inner != ste) {
+                    if (!nim_symtable_entry_add (
+                            inner, name, NIM_SYM_FREE | type)) {
+                        return NIM_FALSE;
+                    }
+                    inner = NIM_SYMTABLE_ENTRY(inner)->parent;
+                }
             }
             return NIM_TRUE;
         }
@@ -638,10 +671,34 @@ nim_symtable_visit_stmt_while_ (NimRef *self, NimRef *stmt)
     NimRef *expr = NIM_AST_STMT(stmt)->while_.expr;
     NimRef *body = NIM_AST_STMT(stmt)->while_.body;
 
+    if (expr != NULL && !nim_symtable_visit_expr (self, expr)) {
+        return NIM_FALSE;
+    }
+
+    if (!nim_symtable_visit_stmts_or_decls (self, body)) {
+        return NIM_FALSE;
+    }
+
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_symtable_visit_stmt_for_ (NimRef *self, NimRef *stmt)
+{
+    NimRef *name = NIM_AST_STMT(stmt)->for_.name;
+    NimRef *expr = NIM_AST_STMT(stmt)->for_.expr;
+    NimRef *body = NIM_AST_STMT(stmt)->for_.body;
+    NimRef *ste = NIM_SYMTABLE_GET_CURRENT_ENTRY(self);
+    int type = NIM_SYMTABLE_ENTRY(ste)->flags & NIM_SYM_TYPE_MASK;
+
     if (!nim_symtable_visit_expr (self, expr)) {
         return NIM_FALSE;
     }
 
+    if (!nim_symtable_add (self, name, NIM_SYM_DECL | type)) {
+        return NIM_FALSE;
+    }
+
     if (!nim_symtable_visit_stmts_or_decls (self, body)) {
         return NIM_FALSE;
     }
@@ -753,6 +810,12 @@ nim_symtable_visit_stmt_ret (NimRef *self, NimRef *stmt)
     return NIM_TRUE;
 }
 
+static nim_bool_t
+nim_symtable_visit_stmt_yield (NimRef *self, NimRef *stmt)
+{
+    return nim_symtable_visit_expr (self, NIM_AST_STMT(stmt)->yield.expr);
+}
+
 static nim_bool_t
 nim_symtable_visit_stmt (NimRef *self, NimRef *stmt)
 {
@@ -765,10 +828,14 @@ nim_symtable_visit_stmt (NimRef *self, NimRef *stmt)
             return nim_symtable_visit_stmt_if_ (self, stmt);
         case NIM_AST_STMT_WHILE_:
             return nim_symtable_visit_stmt_while_ (self, stmt);
+        case NIM_AST_STMT_FOR_:
+            return nim_symtable_visit_stmt_for_ (self, stmt);
         case NIM_AST_STMT_MATCH:
             return nim_symtable_visit_stmt_match (self, stmt);
         case NIM_AST_STMT_RET:
             return nim_symtable_visit_stmt_ret (self, stmt);
+        case NIM_AST_STMT_YIELD:
+            return nim_symtable_visit_stmt_yield (self, stmt);
         case NIM_AST_STMT_BREAK_:
             return NIM_TRUE;
         default:
@@ -628,21 +628,14 @@ _nim_task_dtor (NimRef *self)
 }
 
 static NimRef *
-_nim_task_send (NimRef *self, NimRef *args)
+_nim_task_send (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    NimRef *arg;
-    if (!nim_method_parse_args (args, "o", &arg)) {
-        return NIM_FALSE;
-    }
-    return nim_task_send (self, NIM_ARRAY_ITEM(args, 0)) ? nim_true : nim_false;
+    return nim_task_send (self, args[0].o) ? nim_true : nim_false;
 }
 
 static NimRef *
-_nim_task_join (NimRef *self, NimRef *args)
+_nim_task_join (NimRef *self, const NimNativeArg *args, size_t nargs)
 {
-    if (!nim_method_no_args (args)) {
-        return NULL;
-    }
     nim_task_join (NIM_TASK(self)->priv);
     return nim_nil;
 }
@@ -686,8 +679,10 @@ nim_task_class_bootstrap (void)
     NIM_CLASS(nim_task_class)->cmp  = _nim_task_cmp;
     NIM_CLASS(nim_task_class)->mark = _nim_task_mark;
     nim_gc_make_root (NULL, nim_task_class);
-    nim_class_add_native_method (nim_task_class, "send", _nim_task_send);
-    nim_class_add_native_method (nim_task_class, "join", _nim_task_join);
+    nim_class_add_native_method_typed (
+        nim_task_class, "send", "o", _nim_task_send);
+    nim_class_add_native_method_typed (
+        nim_task_class, "join", "", _nim_task_join);
     return NIM_TRUE;
 }
 
@@ -16,20 +16,28 @@
  *                                                                           *
  *****************************************************************************/
 
+#include <inttypes.h>
+
 #include "nim/vm.h"
 #include "nim/array.h"
+#include "nim/hash.h"
 #include "nim/code.h"
 #include "nim/object.h"
 #include "nim/task.h"
+#include "nim/jit.h"
+#include "nim/iter.h"
+#include "nim/generator.h"
 
 struct _NimVM {
     NimRef  *stack;
     NimRef  *frames;
+#ifdef NIM_VM_STATS
+    uint64_t dispatched;
+#endif
 };
 
 static nim_bool_t
-nim_vm_resolvename (
-    NimVM *vm, NimRef *name, NimRef **value, nim_bool_t binding);
+nim_vm_resolvename (NimVM *vm, NimRef *name, NimRef **value);
 
 NimVM *
 nim_vm_new (void)
@@ -50,12 +58,19 @@ nim_vm_new (void)
     }
     nim_gc_make_root (NULL, vm->stack);
     nim_gc_make_root (NULL, vm->frames);
+#ifdef NIM_VM_STATS
+    vm->dispatched = 0;
+#endif
     return vm;
 }
 
 void
 nim_vm_delete (NimVM *vm)
 {
+#ifdef NIM_VM_STATS
+    fprintf (stderr, "[%p] %" PRIu64 " instructions dispatched\n",
+             vm, vm->dispatched);
+#endif
     NIM_FREE(vm);
 }
 
@@ -77,6 +92,18 @@ nim_vm_push (NimVM *vm, NimRef *value)
     return nim_array_push (vm->stack, value);
 }
 
+/* the value n slots below the top of the stack */
+static NimRef *
+nim_vm_peek (NimVM *vm, size_t n)
+{
+    const size_t size = NIM_ARRAY_SIZE(vm->stack);
+    if (n >= size) {
+        NIM_BUG ("stack underflow");
+        return NULL;
+    }
+    return NIM_ARRAY_ITEMS(vm->stack)[size - n - 1];
+}
+
 static nim_bool_t
 nim_vm_pushconst (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
 {
@@ -98,78 +125,104 @@ nim_vm_pushconst (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
 static nim_bool_t
 nim_vm_storename (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
 {
-    NimRef *value;
-    NimRef *var;
+    /* locals & free vars are stored by slot, so anything left is either */
+    /* a module-level name or a builtin: neither can be assigned to. */
     NimRef *target = NIM_INSTR_NAME1(code, pc);
     if (target == NULL) {
-        NIM_BUG ("unknown or missing name #%d at pc=%d", pc);
+        NIM_BUG ("unknown or missing name at pc=%zu", pc);
+        return NIM_FALSE;
+    }
+    NIM_BUG ("could not find local for %s", NIM_STR_DATA(target));
+    return NIM_FALSE;
+}
+
+static nim_bool_t
+nim_vm_pushlocal (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
+{
+    NimRef *var = NIM_ARRAY_ITEM(locals, NIM_INSTR_EXTARG1(code, pc));
+    if (NIM_VAR_VALUE(var) == NULL) {
+        NIM_BUG ("local %s used before assignment",
+            NIM_STR_DATA(NIM_ARRAY_ITEM(
+                NIM_CODE(code)->vars, NIM_INSTR_EXTARG1(code, pc))));
         return NIM_FALSE;
     }
-    value = nim_vm_pop (vm);
 #ifdef NIM_VM_DEBUG
-    printf ("[%p] STORENAME %s -> %s\n",
-            vm, NIM_STR_DATA(target), NIM_STR_DATA(nim_object_str (value)));
+    printf ("[%p] PUSHLOCAL %zu = %s\n",
+            vm, (size_t) NIM_INSTR_EXTARG1(code, pc),
+            NIM_STR_DATA(nim_object_str (NIM_VAR_VALUE(var))));
 #endif
+    return nim_vm_push (vm, NIM_VAR_VALUE(var));
+}
+
+static nim_bool_t
+nim_vm_storelocal (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
+{
+    NimRef *var = NIM_ARRAY_ITEM(locals, NIM_INSTR_EXTARG1(code, pc));
+    NimRef *value = nim_vm_pop (vm);
     if (value == NULL) {
-        NIM_BUG ("empty stack during assignment to %s", NIM_STR_DATA(target));
+        NIM_BUG ("empty stack during assignment to local #%zu",
+                    (size_t) NIM_INSTR_EXTARG1(code, pc));
+        return NIM_FALSE;
+    }
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] STORELOCAL %zu -> %s\n",
+            vm, (size_t) NIM_INSTR_EXTARG1(code, pc),
+            NIM_STR_DATA(nim_object_str (value)));
+#endif
+    NIM_VAR(var)->value = value;
+    return NIM_TRUE;
+}
+
+static nim_bool_t
+nim_vm_pushupval (NimVM *vm, NimRef *code, NimRef *upvalues, size_t pc)
+{
+    NimRef *var;
+    if (upvalues == NULL) {
+        NIM_BUG ("PUSHUPVAL outside of a closure at pc=%zu", pc);
         return NIM_FALSE;
     }
-    if (nim_hash_get (locals, target, &var) != 0) {
-        NIM_BUG ("could not find local for %s", NIM_STR_DATA(target));
+    var = NIM_ARRAY_ITEM(upvalues, NIM_INSTR_EXTARG1(code, pc));
+    if (NIM_VAR_VALUE(var) == NULL) {
+        NIM_BUG ("free var %s used before assignment",
+            NIM_STR_DATA(NIM_ARRAY_ITEM(
+                NIM_CODE(code)->freevars, NIM_INSTR_EXTARG1(code, pc))));
         return NIM_FALSE;
     }
-    NIM_VAR(var)->value = value;
+    return nim_vm_push (vm, NIM_VAR_VALUE(var));
+}
+
+static nim_bool_t
+nim_vm_storeupval (NimVM *vm, NimRef *code, NimRef *upvalues, size_t pc)
+{
+    NimRef *value;
+    if (upvalues == NULL) {
+        NIM_BUG ("STOREUPVAL outside of a closure at pc=%zu", pc);
+        return NIM_FALSE;
+    }
+    value = nim_vm_pop (vm);
+    if (value == NULL) {
+        return NIM_FALSE;
+    }
+    NIM_VAR(NIM_ARRAY_ITEM(upvalues, NIM_INSTR_EXTARG1(code, pc)))->value =
+        value;
     return NIM_TRUE;
 }
 
+/* locals & free vars are resolved to slots at compile time, so by the */
+/* time we get here it's either a module-level name or a builtin. */
 static nim_bool_t
-nim_vm_resolvename (
-    NimVM *vm, NimRef *name, NimRef **value, nim_bool_t binding)
+nim_vm_resolvename (NimVM *vm, NimRef *name, NimRef **value)
 {
     NimRef *frame;
     NimRef *module;
     int rc;
-    /* 1. check locals */
-    /* if we're binding a closure, we want to walk up the call stack */
-    /* XXX this is potentially expensive. how do we do it better? */
-    if (binding && NIM_ARRAY_SIZE(vm->frames) >= 1) {
-        size_t i = NIM_ARRAY_SIZE(vm->frames);
-        do {
-            i--;
-            frame = NIM_ARRAY_ITEM(vm->frames, i);
-            rc = nim_hash_get (NIM_FRAME(frame)->locals, name, value);
-            if (rc < 0) {
-                return NIM_FALSE;
-            }
-            else if (rc == 0) {
-                /* deref vars if we're not binding a closure */
-                if (!binding && NIM_ANY_CLASS(*value) == nim_var_class) {
-                    *value = NIM_VAR(*value)->value;
-                }
-                return NIM_TRUE;
-            }
-        } while (i > 0);
-        frame = NIM_ARRAY_LAST (vm->frames);
-    }
-    else {
-        frame = NIM_ARRAY_LAST (vm->frames);
-        if (frame == NULL) {
-            return NIM_FALSE;
-        }
-        rc = nim_hash_get (NIM_FRAME(frame)->locals, name, value);
-        if (rc < 0) {
-            return NIM_FALSE;
-        }
-        else if (rc == 0) {
-            /* deref vars if we're not binding a closure */
-            if (!binding && NIM_ANY_CLASS(*value) == nim_var_class) {
-                *value = NIM_VAR(*value)->value;
-            }
-            return NIM_TRUE;
-        }
+
+    frame = NIM_ARRAY_LAST (vm->frames);
+    if (frame == NULL) {
+        return NIM_FALSE;
     }
 
-    /* 2. check module */
+    /* 1. check module */
     module = NIM_METHOD(NIM_FRAME(frame)->method)->module;
     if (module != NULL) { /* builtins have no module */
         *value = nim_object_getattr (module, name);
@@ -179,7 +232,7 @@ nim_vm_resolvename (
         }
     }
 
-    /* 3. check builtins */
+    /* 2. check builtins */
     rc = nim_hash_get (nim_builtins, name, value);
     if (rc < 0) {
         return NIM_FALSE;
@@ -198,12 +251,12 @@ nim_vm_pushname (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
     NimRef *value;
     NimRef *name = NIM_INSTR_NAME1(code, pc);
     if (name == NULL) {
-        int n = NIM_INSTR_ARG1(code, pc);
-        NIM_BUG ("unknown or missing name #%d at pc=%d", n, pc);
+        size_t n = NIM_INSTR_EXTARG1(code, pc);
+        NIM_BUG ("unknown or missing name #%zu at pc=%zu", n, pc);
         return NIM_FALSE;
     }
 
-    if (!nim_vm_resolvename (vm, name, &value, NIM_FALSE)) {
+    if (!nim_vm_resolvename (vm, name, &value)) {
         return NIM_FALSE;
     }
 
@@ -214,12 +267,88 @@ nim_vm_pushname (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
     return nim_vm_push (vm, value);
 }
 
+/* resolves attr on target using the inline cache at the given slot.
+ *
+ * module attributes are cached on the identity of the module, methods of
+ * instances using the default getattr are cached on the instance's class.
+ * anything with a custom getattr takes the slow path.
+ *
+ * *unbound is set if the result is a method that still needs target as self.
+ */
+static NimRef *
+nim_vm_getattr_cached (
+    NimRef *code, size_t slot, NimRef *target, NimRef *attr,
+    nim_bool_t *unbound)
+{
+    NimRef *klass = NIM_ANY_CLASS(target);
+    NimRef *value;
+
+    *unbound = NIM_FALSE;
+
+    if (klass == nim_module_class) {
+        int rc;
+        value = nim_code_attr_cache_get (code, slot, target);
+        if (value != NULL) {
+            return value;
+        }
+        rc = nim_hash_get (NIM_MODULE_LOCALS(target), attr, &value);
+        if (rc < 0) {
+            return NULL;
+        }
+        else if (rc == 0) {
+            nim_code_attr_cache_put (code, slot, target, value);
+            return value;
+        }
+    }
+    else if (NIM_CLASS(klass)->getattr != NULL &&
+             NIM_CLASS(klass)->getattr == NIM_CLASS(nim_object_class)->getattr) {
+        value = nim_code_attr_cache_get (code, slot, klass);
+        if (value == NULL) {
+            value = nim_class_lookup_method (klass, attr);
+            if (value == NULL) {
+                return NULL;
+            }
+            nim_code_attr_cache_put (code, slot, klass, value);
+        }
+        *unbound = NIM_TRUE;
+        return value;
+    }
+
+    return nim_object_getattr (target, attr);
+}
+
+static nim_bool_t
+nim_vm_loadglobal (NimVM *vm, NimRef *code, NimRef *module, size_t pc)
+{
+    NimRef *name = NIM_INSTR_NAME1(code, pc);
+    size_t slot = NIM_INSTR_ATTRCACHE(code, pc);
+    NimRef *value = NULL;
+
+    if (module != NULL) {
+        value = nim_code_attr_cache_get (code, slot, module);
+    }
+    if (value == NULL) {
+        if (!nim_vm_resolvename (vm, name, &value)) {
+            return NIM_FALSE;
+        }
+        if (module != NULL) {
+            nim_code_attr_cache_put (code, slot, module, value);
+        }
+    }
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] LOADGLOBAL %s = %s\n",
+            vm, NIM_STR_DATA(name), NIM_STR_DATA(nim_object_str (value)));
+#endif
+    return nim_vm_push (vm, value);
+}
+
 static nim_bool_t
 nim_vm_getattr (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
 {
     NimRef *attr;
     NimRef *target;
     NimRef *result;
+    nim_bool_t unbound;
     
     attr = NIM_INSTR_NAME1 (code, pc);
     if (attr == NULL) {
@@ -229,10 +358,18 @@ nim_vm_getattr (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
     if (target == NULL) {
         return NIM_FALSE;
     }
-    result = nim_object_getattr (target, attr);
+    result = nim_vm_getattr_cached (
+        code, NIM_INSTR_ATTRCACHE (code, pc), target, attr, &unbound);
     if (result == NULL) {
         return NIM_FALSE;
     }
+    if (unbound) {
+        /* XXX binding on every access is probably dumb/slow */
+        result = nim_method_new_bound (result, target);
+        if (result == NULL) {
+            return NIM_FALSE;
+        }
+    }
 #ifdef NIM_VM_DEBUG
     printf ("[%p] GETATTR %s = %s\n",
             vm, NIM_STR_DATA(attr), NIM_STR_DATA (nim_object_str (result)));
@@ -243,16 +380,110 @@ nim_vm_getattr (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
     return NIM_TRUE;
 }
 
+#define NIM_VM_RAW_CODE(ref) NIM_UNCHECKED_CAST(NimCode, (ref))
+
+/* calling one of these makes a generator rather than running the code */
+#define NIM_IS_GENERATOR_METHOD(ref) \
+    (NIM_ANY_CLASS(ref) == nim_method_class && \
+        ( \
+            (NIM_METHOD(ref)->type == NIM_METHOD_TYPE_BYTECODE && \
+                NIM_VM_RAW_CODE(NIM_METHOD(ref)->bytecode.code)->generator) || \
+            (NIM_METHOD(ref)->type == NIM_METHOD_TYPE_CLOSURE && \
+                NIM_VM_RAW_CODE(NIM_METHOD(ref)->closure.code)->generator) \
+        ) \
+    )
+
+/* bytecode we can run in a frame of its own */
+#define NIM_IS_BYTECODE_METHOD(ref) \
+    (NIM_ANY_CLASS(ref) == nim_method_class && \
+        ( \
+            (NIM_METHOD(ref)->type == NIM_METHOD_TYPE_BYTECODE) || \
+            (NIM_METHOD(ref)->type == NIM_METHOD_TYPE_CLOSURE) \
+        ) && \
+        !NIM_IS_GENERATOR_METHOD(ref) \
+    )
+
+/* sets up a frame for a bytecode method being called with the nargs */
+/* values on top of the stack. the args move down over whatever is under */
+/* them (the call target), which is where the callee's stack starts. */
+static NimRef *
+nim_vm_push_frame (NimVM *vm, NimRef *method, size_t nargs)
+{
+    NimRef *frame;
+    NimRef **items;
+    size_t size;
+
+    /* method is still reachable from the stack while we allocate */
+    frame = nim_frame_new (method);
+    if (frame == NULL) {
+        return NULL;
+    }
+    size = NIM_ARRAY_SIZE(vm->stack);
+    items = NIM_ARRAY_ITEMS(vm->stack);
+    memmove (items + size - nargs - 1, items + size - nargs,
+                sizeof(NimRef *) * nargs);
+    NIM_ARRAY_SIZE(vm->stack)--;
+    NIM_FRAME(frame)->stack_base = size - nargs - 1;
+    if (!nim_array_push (vm->frames, frame)) {
+        return NULL;
+    }
+    return frame;
+}
+
+/* calls a typed native method with the args where they are on the stack */
+/* (see nim_method_call_typed), then replaces them & the target with */
+/* the result. */
+static nim_bool_t
+nim_vm_call_typed (NimVM *vm, NimRef *method, NimRef *self, size_t nargs)
+{
+    const size_t size = NIM_ARRAY_SIZE(vm->stack);
+    NimRef *result;
+
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] CALL %zu (typed native)\n", vm, nargs);
+#endif
+    /* the args stay on the stack during the call so the GC can see them */
+    result = nim_method_call_typed (
+                method, self, NIM_ARRAY_ITEMS(vm->stack) + size - nargs, nargs);
+    if (result == NULL) {
+        return NIM_FALSE;
+    }
+    NIM_ARRAY_SIZE(vm->stack) = size - nargs - 1;
+    return nim_vm_push (vm, result);
+}
+
+/* if next is non-NULL & the target is bytecode, *next is set to a new */
+/* frame for the eval loop to run instead of recursing into the VM. */
 static nim_bool_t
-nim_vm_call (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
+nim_vm_call (
+    NimVM *vm, NimRef *code, NimRef *locals, size_t pc, NimRef **next)
 {
     NimRef *args;
     NimRef *target;
     NimRef *result;
-    uint8_t nargs;
-    uint8_t i;
+    size_t nargs;
+    size_t i;
 
-    nargs = NIM_INSTR_ARG1 (code, pc);
+    nargs = NIM_INSTR_EXTARG1 (code, pc);
+    if (next != NULL) {
+        *next = NULL;
+    }
+    target = nim_vm_peek (vm, nargs);
+    if (target == NULL) {
+        return NIM_FALSE;
+    }
+    if (next != NULL && NIM_IS_BYTECODE_METHOD(target)) {
+#ifdef NIM_VM_DEBUG
+        printf ("[%p] CALL %zu (inline)\n", vm, nargs);
+#endif
+        *next = nim_vm_push_frame (vm, target, nargs);
+        return *next != NULL;
+    }
+    if (NIM_ANY_CLASS(target) == nim_method_class &&
+            NIM_METHOD_IS_TYPED(target)) {
+        return nim_vm_call_typed (
+                    vm, target, NIM_METHOD_SELF(target), nargs);
+    }
     args = nim_array_new_with_capacity (nargs);
     if (args == NULL) {
         return NIM_FALSE;
@@ -265,7 +496,7 @@ nim_vm_call (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
         return NIM_FALSE;
     }
 #ifdef NIM_VM_DEBUG
-    printf ("[%p] CALL %zu = ", vm, (intmax_t) nargs);
+    printf ("[%p] CALL %zu = ", vm, (size_t) nargs);
 #endif
     result = nim_object_call (target, args);
     if (result == NULL) {
@@ -282,12 +513,135 @@ nim_vm_call (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
     return NIM_TRUE;
 }
 
+/* TAILCALL: replaces the running frame with one for the bytecode method */
+/* under the args on the stack. the args move down to base (where the */
+/* caller's own args started) so a chain of tail calls uses constant */
+/* stack. anything else is called as usual & *next is set to NULL. */
+static nim_bool_t
+nim_vm_tailcall (
+    NimVM *vm, NimRef *code, NimRef *locals, size_t pc, size_t base,
+    NimRef **next)
+{
+    const size_t nargs = NIM_INSTR_EXTARG1(code, pc);
+    const size_t size = NIM_ARRAY_SIZE(vm->stack);
+    NimRef **items = NIM_ARRAY_ITEMS(vm->stack);
+    NimRef *target;
+    NimRef *frame;
+
+    if (size < base + nargs + 1) {
+        NIM_BUG ("stack underflow");
+        return NIM_FALSE;
+    }
+    target = items[size - nargs - 1];
+    if (!NIM_IS_BYTECODE_METHOD(target)) {
+        *next = NULL;
+        return nim_vm_call (vm, code, locals, pc, NULL);
+    }
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] TAILCALL %zu\n", vm, nargs);
+#endif
+    /* target stays on the stack until here so the GC can see it */
+    frame = nim_frame_new (target);
+    if (frame == NULL) {
+        return NIM_FALSE;
+    }
+    memmove (items + base, items + size - nargs, sizeof(NimRef *) * nargs);
+    NIM_ARRAY_SIZE(vm->stack) = base + nargs;
+    NIM_FRAME(frame)->stack_base = base;
+    NIM_ARRAY_ITEMS(vm->frames)[NIM_ARRAY_SIZE(vm->frames) - 1] = frame;
+    *next = frame;
+    return NIM_TRUE;
+}
+
+/* next works as it does for nim_vm_call */
+static nim_bool_t
+nim_vm_callmethod (
+    NimVM *vm, NimRef *code, NimRef *locals, size_t pc, NimRef **next)
+{
+    NimRef *attr;
+    NimRef *args;
+    NimRef *target;
+    NimRef *method;
+    NimRef *result;
+    nim_bool_t unbound;
+    uint8_t nargs;
+    uint8_t i;
+
+    attr = NIM_INSTR_NAME1 (code, pc);
+    if (attr == NULL) {
+        return NIM_FALSE;
+    }
+    nargs = NIM_INSTR_ARG2 (code, pc);
+    target = nim_vm_peek (vm, nargs);
+    if (target == NULL) {
+        return NIM_FALSE;
+    }
+    method = nim_vm_getattr_cached (
+        code, NIM_INSTR_ATTRCACHE (code, pc), target, attr, &unbound);
+    if (method == NULL) {
+        NIM_BUG ("%s has no attribute %s",
+            NIM_STR_DATA(nim_object_str (target)), NIM_STR_DATA(attr));
+        return NIM_FALSE;
+    }
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] CALLMETHOD %s %zu = ",
+            vm, NIM_STR_DATA(attr), (size_t) nargs);
+#endif
+    if (NIM_METHOD_IS_TYPED(method)) {
+        if (next != NULL) {
+            *next = NULL;
+        }
+        return nim_vm_call_typed (vm, method,
+                    unbound ? target : NIM_METHOD_SELF(method), nargs);
+    }
+    if (next != NULL) {
+        *next = NULL;
+        /* bytecode methods don't (yet) see self, so it's simply dropped */
+        if (NIM_IS_BYTECODE_METHOD(method)) {
+#ifdef NIM_VM_DEBUG
+            printf ("(inline)\n");
+#endif
+            *next = nim_vm_push_frame (vm, method, nargs);
+            return *next != NULL;
+        }
+    }
+    args = nim_array_new_with_capacity (nargs);
+    if (args == NULL) {
+        return NIM_FALSE;
+    }
+    for (i = 0; i < nargs; i++) {
+        nim_array_unshift (args, nim_vm_pop (vm));
+    }
+    /* the target is still at the top of the stack */
+    nim_vm_pop (vm);
+    /* native methods take self directly, so we can skip binding. */
+    /* bytecode methods don't (yet) see self at all. */
+    if (unbound && NIM_METHOD_TYPE(method) == NIM_METHOD_TYPE_NATIVE) {
+        result = NIM_NATIVE_METHOD(method)->func (target, args);
+    }
+    else {
+        result = nim_object_call (method, args);
+    }
+    if (result == NULL) {
+        NIM_BUG ("method %s of %s failed",
+            NIM_STR_DATA(attr), NIM_STR_DATA(nim_object_str (target)));
+        return NIM_FALSE;
+    }
+#ifdef NIM_VM_DEBUG
+    printf ("%s\n", NIM_STR_DATA(nim_object_str (result)));
+#endif
+    if (!nim_vm_push (vm, result)) {
+        return NIM_FALSE;
+    }
+    return NIM_TRUE;
+}
+
 static nim_bool_t
 nim_vm_makearray (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
 {
     NimRef *array;
-    int32_t nargs = NIM_INSTR_ARG1(code, pc);
-    int32_t i;
+    size_t nargs = NIM_INSTR_EXTARG1(code, pc);
+    size_t i;
 
     array = nim_array_new_with_capacity (nargs);
     if (array == NULL) {
@@ -312,8 +666,8 @@ static nim_bool_t
 nim_vm_makehash (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
 {
     NimRef *hash;
-    int32_t nargs = NIM_INSTR_ARG1(code, pc);
-    int32_t i;
+    size_t nargs = NIM_INSTR_EXTARG1(code, pc);
+    size_t i;
 
     hash = nim_hash_new ();
     if (hash == NULL) {
@@ -343,27 +697,64 @@ nim_vm_makehash (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
 }
 
 static nim_bool_t
-nim_vm_makeclosure (NimVM *vm, NimRef *code, size_t pc)
+nim_vm_cloneconst (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
+{
+    NimRef *template = NIM_INSTR_CONST1(code, pc);
+    NimRef *value;
+
+    if (NIM_ANY_CLASS(template) == nim_array_class) {
+        value = nim_array_copy (template);
+    }
+    else if (NIM_ANY_CLASS(template) == nim_hash_class) {
+        value = nim_hash_copy (template);
+    }
+    else {
+        NIM_BUG ("CLONECONST of a %s",
+                    NIM_STR_DATA(NIM_CLASS_NAME(NIM_ANY_CLASS(template))));
+        return NIM_FALSE;
+    }
+    if (value == NULL) {
+        return NIM_FALSE;
+    }
+    return nim_vm_push (vm, value);
+}
+
+static nim_bool_t
+nim_vm_makeclosure (NimVM *vm, NimRef *frame, size_t pc)
 {
-    NimRef *freevars;
+    NimRef *inner;
+    NimRef *upvalues;
+    size_t nfree;
     size_t i;
-    NimRef *bindings = nim_hash_new ();
     NimRef *method = nim_vm_pop (vm);
     if (method == NULL || method == nim_nil) {
         return NIM_FALSE;
     }
-    freevars = NIM_CODE(NIM_METHOD(method)->bytecode.code)->freevars;
-    for (i = 0; i < NIM_ARRAY_SIZE(freevars); i++) {
-        NimRef *varname = NIM_ARRAY_ITEM(freevars, i);
-        NimRef *value;
-        if (!nim_vm_resolvename (vm, varname, &value, NIM_TRUE)) {
+    inner = NIM_METHOD(method)->bytecode.code;
+    nfree = NIM_ARRAY_SIZE(NIM_CODE(inner)->freevars);
+    upvalues = nim_array_new_with_capacity (nfree);
+    if (upvalues == NULL) {
+        return NIM_FALSE;
+    }
+    /* capture the enclosing frame's cells, not their values */
+    for (i = 0; i < nfree; i++) {
+        const int32_t slot = NIM_CODE(inner)->freevar_slots[i];
+        NimRef *var;
+        if (slot >= 0) {
+            var = NIM_ARRAY_ITEM(NIM_FRAME(frame)->locals, slot);
+        }
+        else if (NIM_FRAME(frame)->upvalues != NULL) {
+            var = NIM_ARRAY_ITEM(NIM_FRAME(frame)->upvalues, -slot - 1);
+        }
+        else {
+            NIM_BUG ("MAKECLOSURE: no upvalues to capture at pc=%zu", pc);
             return NIM_FALSE;
         }
-        if (!nim_hash_put (bindings, varname, value)) {
+        if (!nim_array_push (upvalues, var)) {
             return NIM_FALSE;
         }
     }
-    method = nim_method_new_closure (method, bindings);
+    method = nim_method_new_closure (method, upvalues);
     if (method == NULL) {
         return NIM_FALSE;
     }
@@ -391,18 +782,272 @@ nim_vm_truthy (NimRef *value)
     return value != NULL && value != nim_nil && value != nim_false;
 }
 
-static NimCmpResult
-nim_vm_cmp (NimVM *vm)
+#define NIM_VM_IS_INT(ref) (NIM_ANY_CLASS(ref) == nim_int_class)
+
+/* int arithmetic for the quickened opcodes. returns NIM_FALSE if the */
+/* result overflows (or for a division by zero), leaving it to the */
+/* generic opcode. */
+static nim_bool_t
+nim_vm_int_arith (NimOpcode op, int64_t a, int64_t b, int64_t *result)
 {
-    NimRef *right = nim_vm_pop (vm);
-    NimRef *left = nim_vm_pop (vm);
-    NimCmpResult actual;
-    if (left == NULL || right == NULL) {
-        NIM_BUG ("NULL value on the stack");
-        return NIM_FALSE;
+    switch (op) {
+        case NIM_OPCODE_ADD_INT:
+            return !__builtin_add_overflow (a, b, result);
+        case NIM_OPCODE_SUB_INT:
+            return !__builtin_sub_overflow (a, b, result);
+        case NIM_OPCODE_MUL_INT:
+            return !__builtin_mul_overflow (a, b, result);
+        case NIM_OPCODE_DIV_INT:
+            if (b == 0 || (a == INT64_MIN && b == -1)) {
+                return NIM_FALSE;
+            }
+            *result = a / b;
+            return NIM_TRUE;
+        default:
+            NIM_BUG ("unknown int arithmetic opcode: %d", op);
+            return NIM_FALSE;
     }
+}
 
-#ifdef NIM_VM_DEBUG
+/* rewrites a generic arithmetic or comparison instruction in place to
+ * its int-specialized form once it has seen a pair of int operands.
+ *
+ * code objects are shared across tasks, but instructions are aligned
+ * words and both forms compute the same result, so a racing reader
+ * sees one or the other and either is fine.
+ */
+static void
+nim_vm_quicken (NimRef *code, size_t pc, NimRef *left, NimRef *right)
+{
+    NimOpcode op;
+
+    if (!NIM_VM_IS_INT(left) || !NIM_VM_IS_INT(right)) {
+        return;
+    }
+    if (NIM_INSTR_ARG1(code, pc) & NIM_INSTR_NOQUICKEN) {
+        return;
+    }
+    switch (NIM_INSTR_OP(code, pc)) {
+        case NIM_OPCODE_ADD: op = NIM_OPCODE_ADD_INT; break;
+        case NIM_OPCODE_SUB: op = NIM_OPCODE_SUB_INT; break;
+        case NIM_OPCODE_MUL: op = NIM_OPCODE_MUL_INT; break;
+        case NIM_OPCODE_DIV: op = NIM_OPCODE_DIV_INT; break;
+        case NIM_OPCODE_CMPEQ: op = NIM_OPCODE_CMPEQ_INT; break;
+        case NIM_OPCODE_CMPNEQ: op = NIM_OPCODE_CMPNEQ_INT; break;
+        case NIM_OPCODE_CMPGT: op = NIM_OPCODE_CMPGT_INT; break;
+        case NIM_OPCODE_CMPGTE: op = NIM_OPCODE_CMPGTE_INT; break;
+        case NIM_OPCODE_CMPLT: op = NIM_OPCODE_CMPLT_INT; break;
+        case NIM_OPCODE_CMPLTE: op = NIM_OPCODE_CMPLTE_INT; break;
+        default:
+            return;
+    };
+    NIM_INSTR_SET_OP(code, pc, op);
+}
+
+/* reverts a quickened instruction whose guard failed to the generic form */
+/* for good, so a site that sees mixed types doesn't flip-flop. */
+static void
+nim_vm_deopt (NimRef *code, size_t pc)
+{
+    NimOpcode op;
+
+    switch (NIM_INSTR_OP(code, pc)) {
+        case NIM_OPCODE_ADD_INT: op = NIM_OPCODE_ADD; break;
+        case NIM_OPCODE_SUB_INT: op = NIM_OPCODE_SUB; break;
+        case NIM_OPCODE_MUL_INT: op = NIM_OPCODE_MUL; break;
+        case NIM_OPCODE_DIV_INT: op = NIM_OPCODE_DIV; break;
+        case NIM_OPCODE_CMPEQ_INT: op = NIM_OPCODE_CMPEQ; break;
+        case NIM_OPCODE_CMPNEQ_INT: op = NIM_OPCODE_CMPNEQ; break;
+        case NIM_OPCODE_CMPGT_INT: op = NIM_OPCODE_CMPGT; break;
+        case NIM_OPCODE_CMPGTE_INT: op = NIM_OPCODE_CMPGTE; break;
+        case NIM_OPCODE_CMPLT_INT: op = NIM_OPCODE_CMPLT; break;
+        case NIM_OPCODE_CMPLTE_INT: op = NIM_OPCODE_CMPLTE; break;
+        default:
+            NIM_BUG ("cannot deopt instruction at pc=%zu", pc);
+            return;
+    };
+#ifdef NIM_VM_DEBUG
+    printf ("DEOPT %zu\n", pc);
+#endif
+    NIM_CODE_INSTR(code, pc) =
+        (((op) & 0xff) << 24) | (NIM_INSTR_NOQUICKEN << 16);
+}
+
+/* executes a quickened instruction.
+ *
+ * returns 1 on success, 0 if the operands aren't both ints or the result
+ * overflows (the stack is left untouched so the generic instruction can
+ * take over) and -1 on error.
+ */
+static int
+nim_vm_int_op (NimVM *vm, NimOpcode op)
+{
+    const size_t size = NIM_ARRAY_SIZE(vm->stack);
+    NimRef *left;
+    NimRef *right;
+    NimRef *result;
+    int64_t a;
+    int64_t b;
+    int64_t value;
+
+    if (size < 2) {
+        NIM_BUG ("stack underflow");
+        return -1;
+    }
+    left = NIM_ARRAY_ITEMS(vm->stack)[size - 2];
+    right = NIM_ARRAY_ITEMS(vm->stack)[size - 1];
+    if (!NIM_VM_IS_INT(left) || !NIM_VM_IS_INT(right)) {
+        return 0;
+    }
+    a = NIM_INT_VALUE(left);
+    b = NIM_INT_VALUE(right);
+    switch (op) {
+        case NIM_OPCODE_ADD_INT:
+        case NIM_OPCODE_SUB_INT:
+        case NIM_OPCODE_MUL_INT:
+        case NIM_OPCODE_DIV_INT:
+            if (!nim_vm_int_arith (op, a, b, &value)) {
+                return 0;
+            }
+            result = nim_int_new (value);
+            break;
+        case NIM_OPCODE_CMPEQ_INT: result = NIM_BOOL_REF(a == b); break;
+        case NIM_OPCODE_CMPNEQ_INT: result = NIM_BOOL_REF(a != b); break;
+        case NIM_OPCODE_CMPGT_INT: result = NIM_BOOL_REF(a > b); break;
+        case NIM_OPCODE_CMPGTE_INT: result = NIM_BOOL_REF(a >= b); break;
+        case NIM_OPCODE_CMPLT_INT: result = NIM_BOOL_REF(a < b); break;
+        case NIM_OPCODE_CMPLTE_INT: result = NIM_BOOL_REF(a <= b); break;
+        default:
+            NIM_BUG ("unknown int opcode: %d", op);
+            return -1;
+    };
+    if (result == NULL) {
+        return -1;
+    }
+    /* operands stay on the stack until here so the GC can see them */
+    NIM_ARRAY_SIZE(vm->stack)--;
+    NIM_ARRAY_ITEMS(vm->stack)[size - 2] = result;
+    return 1;
+}
+
+/* pops two operands & tests them against the comparison implied by a */
+/* fused JUMPIFNOTxx instruction. returns -1 on error. */
+static int
+nim_vm_cmp_test (NimVM *vm, NimOpcode op)
+{
+    NimRef *right = nim_vm_pop (vm);
+    NimRef *left = nim_vm_pop (vm);
+    NimCmpResult r;
+    if (left == NULL || right == NULL) {
+        NIM_BUG ("NULL value on the stack");
+        return -1;
+    }
+    if (NIM_VM_IS_INT(left) && NIM_VM_IS_INT(right)) {
+        const int64_t a = NIM_INT_VALUE(left);
+        const int64_t b = NIM_INT_VALUE(right);
+        r = (a < b ? NIM_CMP_LT : (a > b ? NIM_CMP_GT : NIM_CMP_EQ));
+    }
+    else {
+        r = nim_object_cmp (left, right);
+        if (r == NIM_CMP_ERROR) {
+            NIM_BUG ("TODO raise an exception");
+            return -1;
+        }
+    }
+    switch (op) {
+        case NIM_OPCODE_JUMPIFNOTEQ:
+            return r == NIM_CMP_EQ;
+        case NIM_OPCODE_JUMPIFNOTNEQ:
+            return r != NIM_CMP_EQ;
+        case NIM_OPCODE_JUMPIFNOTGT:
+            return r == NIM_CMP_GT;
+        case NIM_OPCODE_JUMPIFNOTGTE:
+            return r == NIM_CMP_GT || r == NIM_CMP_EQ;
+        case NIM_OPCODE_JUMPIFNOTLT:
+            return r == NIM_CMP_LT;
+        case NIM_OPCODE_JUMPIFNOTLTE:
+            return r == NIM_CMP_LT || r == NIM_CMP_EQ;
+        default:
+            NIM_BUG ("unknown compare & branch opcode: %d", op);
+            return -1;
+    };
+}
+
+static nim_bool_t
+nim_vm_addnameconst (NimVM *vm, NimRef *code, size_t pc)
+{
+    NimRef *left;
+    NimRef *right;
+    NimRef *result;
+    int64_t value;
+    NimRef *name = NIM_INSTR_NAME1(code, pc);
+
+    if (!nim_vm_resolvename (vm, name, &left)) {
+        return NIM_FALSE;
+    }
+    right = NIM_INSTR_CONST2(code, pc);
+    if (NIM_VM_IS_INT(left) && NIM_VM_IS_INT(right) &&
+            nim_vm_int_arith (NIM_OPCODE_ADD_INT,
+                NIM_INT_VALUE(left), NIM_INT_VALUE(right), &value)) {
+        result = nim_int_new (value);
+    }
+    else {
+        result = nim_object_add (left, right);
+    }
+    if (result == NULL) {
+        return NIM_FALSE;
+    }
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] ADDNAMECONST %s = %s\n",
+            vm, NIM_STR_DATA(name), NIM_STR_DATA (nim_object_str (result)));
+#endif
+    return nim_vm_push (vm, result);
+}
+
+static nim_bool_t
+nim_vm_addlocalconst (NimVM *vm, NimRef *code, NimRef *locals, size_t pc)
+{
+    NimRef *left;
+    NimRef *right;
+    NimRef *result;
+    int64_t value;
+
+    left = NIM_VAR_VALUE(NIM_ARRAY_ITEM(locals, NIM_INSTR_EXTARG1(code, pc)));
+    if (left == NULL) {
+        NIM_BUG ("local %s used before assignment",
+            NIM_STR_DATA(NIM_ARRAY_ITEM(
+                NIM_CODE(code)->vars, NIM_INSTR_EXTARG1(code, pc))));
+        return NIM_FALSE;
+    }
+    right = NIM_INSTR_CONST2(code, pc);
+    if (NIM_VM_IS_INT(left) && NIM_VM_IS_INT(right) &&
+            nim_vm_int_arith (NIM_OPCODE_ADD_INT,
+                NIM_INT_VALUE(left), NIM_INT_VALUE(right), &value)) {
+        result = nim_int_new (value);
+    }
+    else {
+        result = nim_object_add (left, right);
+    }
+    if (result == NULL) {
+        return NIM_FALSE;
+    }
+    return nim_vm_push (vm, result);
+}
+
+static NimCmpResult
+nim_vm_cmp (NimVM *vm, NimRef *code, size_t pc)
+{
+    NimRef *right = nim_vm_pop (vm);
+    NimRef *left = nim_vm_pop (vm);
+    NimCmpResult actual;
+    if (left == NULL || right == NULL) {
+        NIM_BUG ("NULL value on the stack");
+        return NIM_FALSE;
+    }
+
+    nim_vm_quicken (code, pc, left, right);
+
+#ifdef NIM_VM_DEBUG
     printf ("[%p] CMP %s, %s\n",
             vm,
             NIM_STR_DATA(NIM_CLASS_NAME(NIM_ANY_CLASS(left))),
@@ -416,18 +1061,874 @@ nim_vm_cmp (NimVM *vm)
     return actual;
 }
 
+static nim_bool_t
+nim_vm_loadbuiltin (NimVM *vm, NimRef *code, size_t pc)
+{
+    NimRef *value = nim_builtin_at (NIM_INSTR_EXTARG1(code, pc));
+    if (value == NULL) {
+        return NIM_FALSE;
+    }
+    return nim_vm_push (vm, value);
+}
+
+static nim_bool_t
+nim_vm_getclass (NimVM *vm)
+{
+    NimRef *value = nim_vm_pop (vm);
+    if (value == NULL) {
+        return NIM_FALSE;
+    }
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] GETCLASS = %s\n",
+            vm, NIM_STR_DATA(NIM_CLASS_NAME(NIM_ANY_CLASS(value))));
+#endif
+    return nim_vm_push (vm, NIM_ANY_CLASS(value));
+}
+
+static nim_bool_t
+nim_vm_getitem (NimVM *vm)
+{
+    NimRef *result;
+    NimRef *key;
+    NimRef *target;
+
+    key = nim_vm_pop (vm);
+    if (key == NULL) {
+        return NIM_FALSE;
+    }
+    target = nim_vm_pop (vm);
+    if (target == NULL) {
+        return NIM_FALSE;
+    }
+    result = nim_object_getitem (target, key);
+    if (result == NULL) {
+        return NIM_FALSE;
+    }
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] GETITEM = %s\n",
+            vm, NIM_STR_DATA(nim_object_str (result)));
+#endif
+    return nim_vm_push (vm, result);
+}
+
+static nim_bool_t
+nim_vm_spawn (NimVM *vm)
+{
+    NimRef *task;
+    NimRef *target;
+
+    target = nim_vm_pop (vm);
+    if (target == NULL) {
+        return NIM_FALSE;
+    }
+    if (NIM_METHOD_TYPE(target) == NIM_METHOD_TYPE_CLOSURE) {
+        NIM_BUG ("cannot use the spawn keyword with a closure");
+        return NIM_FALSE;
+    }
+    task = nim_task_new (target);
+    if (task == NULL) {
+        return NIM_FALSE;
+    }
+    return nim_vm_push (vm, task);
+}
+
+static nim_bool_t
+nim_vm_dup (NimVM *vm)
+{
+    NimRef *top = nim_vm_top (vm);
+    if (top == NULL) {
+        return NIM_FALSE;
+    }
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] DUP = %s\n", vm, NIM_STR_DATA (nim_object_str (top)));
+#endif
+    return nim_vm_push (vm, top);
+}
+
+static nim_bool_t
+nim_vm_not (NimVM *vm)
+{
+    NimRef *value = nim_vm_pop (vm);
+    if (value == NULL) {
+        return NIM_FALSE;
+    }
+    return nim_vm_push (vm, nim_vm_truthy (value) ? nim_false : nim_true);
+}
+
+static nim_bool_t
+nim_vm_getiter (NimVM *vm)
+{
+    NimRef *iter;
+    /* the target stays on the stack while the iterator is allocated */
+    NimRef *target = nim_vm_peek (vm, 0);
+    if (target == NULL) {
+        return NIM_FALSE;
+    }
+    iter = nim_iter_new (target);
+    if (iter == NULL) {
+        return NIM_FALSE;
+    }
+    NIM_ARRAY_ITEMS(vm->stack)[NIM_ARRAY_SIZE(vm->stack) - 1] = iter;
+    return NIM_TRUE;
+}
+
+/* > 0 if the iterator is exhausted & the jump should be taken */
+static int
+nim_vm_foriter (NimVM *vm)
+{
+    NimRef *value;
+    NimRef *iter = nim_vm_peek (vm, 0);
+    if (iter == NULL) {
+        return -1;
+    }
+    if (!nim_iter_next (iter, &value)) {
+        return -1;
+    }
+    if (value == NULL) {
+        return 1;
+    }
+    return nim_vm_push (vm, value) ? 0 : -1;
+}
+
+/* op is passed in rather than read from the code: nim_vm_cmp may */
+/* have quickened the instruction by the time we look at the result. */
+static nim_bool_t
+nim_vm_compare (NimVM *vm, NimRef *code, size_t pc, NimOpcode op)
+{
+    nim_bool_t result;
+    NimCmpResult r = nim_vm_cmp (vm, code, pc);
+    switch (op) {
+        case NIM_OPCODE_CMPEQ:
+            result = r == NIM_CMP_EQ;
+            break;
+        case NIM_OPCODE_CMPNEQ:
+            result = r != NIM_CMP_EQ;
+            break;
+        case NIM_OPCODE_CMPGT:
+            result = r == NIM_CMP_GT;
+            break;
+        case NIM_OPCODE_CMPGTE:
+            result = r == NIM_CMP_GT || r == NIM_CMP_EQ;
+            break;
+        case NIM_OPCODE_CMPLT:
+            result = r == NIM_CMP_LT;
+            break;
+        case NIM_OPCODE_CMPLTE:
+            result = r == NIM_CMP_LT || r == NIM_CMP_EQ;
+            break;
+        default:
+            NIM_BUG ("unknown compare opcode: %d", op);
+            return NIM_FALSE;
+    };
+    if (r == NIM_CMP_ERROR) {
+        return NIM_FALSE;
+    }
+    return result ? nim_vm_pushtrue (vm) : nim_vm_pushfalse (vm);
+}
+
+static nim_bool_t
+nim_vm_binop (NimVM *vm, NimRef *code, size_t pc, NimOpcode op)
+{
+    NimRef *left;
+    NimRef *right;
+    NimRef *result;
+
+    right = nim_vm_pop (vm);
+    if (right == NULL) {
+        return NIM_FALSE;
+    }
+    left = nim_vm_pop (vm);
+    if (left == NULL) {
+        return NIM_FALSE;
+    }
+    nim_vm_quicken (code, pc, left, right);
+    switch (op) {
+        case NIM_OPCODE_ADD:
+            result = nim_object_add (left, right);
+            break;
+        case NIM_OPCODE_SUB:
+            result = nim_object_sub (left, right);
+            break;
+        case NIM_OPCODE_MUL:
+            result = nim_object_mul (left, right);
+            break;
+        case NIM_OPCODE_DIV:
+            result = nim_object_div (left, right);
+            break;
+        default:
+            NIM_BUG ("unknown binary opcode: %d", op);
+            return NIM_FALSE;
+    };
+#ifdef NIM_VM_DEBUG
+    printf ("[%p] %s = %s\n",
+            vm, nim_code_opcode_str (op),
+            NIM_STR_DATA (nim_object_str (result)));
+#endif
+    return nim_vm_push (vm, result);
+}
+
+/* everything a JIT helper needs from the frame being evaluated */
+typedef struct _NimVMFrameState {
+    NimRef *frame;
+    NimRef *code;
+    NimRef *locals;
+    NimRef *upvalues;
+    NimRef *module;
+    /* set by a call helper that wants the VM to run a new frame */
+    NimRef *next;
+} NimVMFrameState;
+
+/* adapts an interpreter helper to the NimJitHelper calling convention */
+#define NIM_VM_JIT_HELPER(name, expr) \
+    static int \
+    nim_vm_jit_##name (void *v, void *s, size_t pc) \
+    { \
+        NimVM *vm = (NimVM *) v; \
+        NimVMFrameState *st = (NimVMFrameState *) s; \
+        (void) vm; (void) st; (void) pc; \
+        return (expr) ? 0 : -1; \
+    }
+
+NIM_VM_JIT_HELPER(pushconst, nim_vm_pushconst (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(storename, nim_vm_storename (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(pushname, nim_vm_pushname (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(pushlocal, nim_vm_pushlocal (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(storelocal, nim_vm_storelocal (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(pushupval, nim_vm_pushupval (vm, st->code, st->upvalues, pc))
+NIM_VM_JIT_HELPER(storeupval,
+    nim_vm_storeupval (vm, st->code, st->upvalues, pc))
+NIM_VM_JIT_HELPER(loadglobal, nim_vm_loadglobal (vm, st->code, st->module, pc))
+NIM_VM_JIT_HELPER(loadbuiltin, nim_vm_loadbuiltin (vm, st->code, pc))
+NIM_VM_JIT_HELPER(pushnil, nim_vm_push (vm, nim_nil))
+NIM_VM_JIT_HELPER(getclass, nim_vm_getclass (vm))
+NIM_VM_JIT_HELPER(getattr, nim_vm_getattr (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(getitem, nim_vm_getitem (vm))
+NIM_VM_JIT_HELPER(spawn, nim_vm_spawn (vm))
+NIM_VM_JIT_HELPER(dup, nim_vm_dup (vm))
+NIM_VM_JIT_HELPER(not, nim_vm_not (vm))
+NIM_VM_JIT_HELPER(pop, nim_vm_pop (vm) != NULL)
+NIM_VM_JIT_HELPER(getiter, nim_vm_getiter (vm))
+NIM_VM_JIT_HELPER(makearray, nim_vm_makearray (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(makehash, nim_vm_makehash (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(cloneconst,
+    nim_vm_cloneconst (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(makeclosure, nim_vm_makeclosure (vm, st->frame, pc))
+NIM_VM_JIT_HELPER(addnameconst, nim_vm_addnameconst (vm, st->code, pc))
+NIM_VM_JIT_HELPER(addlocalconst,
+    nim_vm_addlocalconst (vm, st->code, st->locals, pc))
+NIM_VM_JIT_HELPER(cmpeq, nim_vm_compare (vm, st->code, pc, NIM_OPCODE_CMPEQ))
+NIM_VM_JIT_HELPER(cmpneq, nim_vm_compare (vm, st->code, pc, NIM_OPCODE_CMPNEQ))
+NIM_VM_JIT_HELPER(cmpgt, nim_vm_compare (vm, st->code, pc, NIM_OPCODE_CMPGT))
+NIM_VM_JIT_HELPER(cmpgte, nim_vm_compare (vm, st->code, pc, NIM_OPCODE_CMPGTE))
+NIM_VM_JIT_HELPER(cmplt, nim_vm_compare (vm, st->code, pc, NIM_OPCODE_CMPLT))
+NIM_VM_JIT_HELPER(cmplte, nim_vm_compare (vm, st->code, pc, NIM_OPCODE_CMPLTE))
+NIM_VM_JIT_HELPER(add, nim_vm_binop (vm, st->code, pc, NIM_OPCODE_ADD))
+NIM_VM_JIT_HELPER(sub, nim_vm_binop (vm, st->code, pc, NIM_OPCODE_SUB))
+NIM_VM_JIT_HELPER(mul, nim_vm_binop (vm, st->code, pc, NIM_OPCODE_MUL))
+NIM_VM_JIT_HELPER(div, nim_vm_binop (vm, st->code, pc, NIM_OPCODE_DIV))
+
+/* native code is compiled against the opcode seen at compile time, so a */
+/* quickened helper keeps being called after the bytecode deopts. */
+#define NIM_VM_JIT_INT_HELPER(name, quick, generic) \
+    static int \
+    nim_vm_jit_##name (void *v, void *s, size_t pc) \
+    { \
+        NimVMFrameState *st = (NimVMFrameState *) s; \
+        int rc = nim_vm_int_op ((NimVM *) v, (quick)); \
+        if (rc != 0) { \
+            return rc < 0 ? -1 : 0; \
+        } \
+        if (NIM_INSTR_OP(st->code, pc) == (quick)) { \
+            nim_vm_deopt (st->code, pc); \
+        } \
+        return nim_vm_jit_##generic (v, s, pc); \
+    }
+
+NIM_VM_JIT_INT_HELPER(add_int, NIM_OPCODE_ADD_INT, add)
+NIM_VM_JIT_INT_HELPER(sub_int, NIM_OPCODE_SUB_INT, sub)
+NIM_VM_JIT_INT_HELPER(mul_int, NIM_OPCODE_MUL_INT, mul)
+NIM_VM_JIT_INT_HELPER(div_int, NIM_OPCODE_DIV_INT, div)
+NIM_VM_JIT_INT_HELPER(cmpeq_int, NIM_OPCODE_CMPEQ_INT, cmpeq)
+NIM_VM_JIT_INT_HELPER(cmpneq_int, NIM_OPCODE_CMPNEQ_INT, cmpneq)
+NIM_VM_JIT_INT_HELPER(cmpgt_int, NIM_OPCODE_CMPGT_INT, cmpgt)
+NIM_VM_JIT_INT_HELPER(cmpgte_int, NIM_OPCODE_CMPGTE_INT, cmpgte)
+NIM_VM_JIT_INT_HELPER(cmplt_int, NIM_OPCODE_CMPLT_INT, cmplt)
+NIM_VM_JIT_INT_HELPER(cmplte_int, NIM_OPCODE_CMPLTE_INT, cmplte)
+
+/* calls into bytecode leave native code (returning > 0) with the new */
+/* frame in st->next, so nim_vm_eval_frame can run it without recursing. */
+
+static int
+nim_vm_jit_call (void *v, void *s, size_t pc)
+{
+    NimVMFrameState *st = (NimVMFrameState *) s;
+    if (!nim_vm_call ((NimVM *) v, st->code, st->locals, pc, &st->next)) {
+        return -1;
+    }
+    if (st->next == NULL) {
+        return 0;
+    }
+    NIM_FRAME(st->frame)->pc = pc;
+    return 1;
+}
+
+static int
+nim_vm_jit_callmethod (void *v, void *s, size_t pc)
+{
+    NimVMFrameState *st = (NimVMFrameState *) s;
+    if (!nim_vm_callmethod (
+            (NimVM *) v, st->code, st->locals, pc, &st->next)) {
+        return -1;
+    }
+    if (st->next == NULL) {
+        return 0;
+    }
+    NIM_FRAME(st->frame)->pc = pc;
+    return 1;
+}
+
+static int
+nim_vm_jit_tailcall (void *v, void *s, size_t pc)
+{
+    NimVMFrameState *st = (NimVMFrameState *) s;
+    if (!nim_vm_tailcall ((NimVM *) v, st->code, st->locals, pc,
+            NIM_FRAME(st->frame)->stack_base, &st->next)) {
+        return -1;
+    }
+    return st->next != NULL ? 1 : 0;
+}
+
+/* conditional branches: > 0 means the branch is taken */
+
+static int
+nim_vm_jit_jumpiftrue (void *v, void *s, size_t pc)
+{
+    NimRef *value = nim_vm_pop ((NimVM *) v);
+    if (value == NULL) {
+        NIM_BUG ("NULL value on the stack");
+        return -1;
+    }
+    return nim_vm_truthy (value) ? 1 : 0;
+}
+
+static int
+nim_vm_jit_jumpiffalse (void *v, void *s, size_t pc)
+{
+    NimRef *value = nim_vm_pop ((NimVM *) v);
+    if (value == NULL) {
+        NIM_BUG ("NULL value on the stack");
+        return -1;
+    }
+    return (value == nim_false || value == nim_nil) ? 1 : 0;
+}
+
+static int
+nim_vm_jit_foriter (void *v, void *s, size_t pc)
+{
+    return nim_vm_foriter ((NimVM *) v);
+}
+
+static int
+nim_vm_jit_jumpifnot (void *v, void *s, size_t pc)
+{
+    NimVMFrameState *st = (NimVMFrameState *) s;
+    int rc = nim_vm_cmp_test ((NimVM *) v, NIM_INSTR_OP(st->code, pc));
+    if (rc < 0) {
+        return -1;
+    }
+    return rc == 0 ? 1 : 0;
+}
+
+/* indexed by opcode. JUMP, RET & EXTENDED_ARG are handled by the JIT */
+/* itself; anything else that's missing keeps a method interpreted. */
+static const NimJitHelper nim_vm_jit_helpers[256] = {
+    [NIM_OPCODE_JUMPIFFALSE] = nim_vm_jit_jumpiffalse,
+    [NIM_OPCODE_JUMPIFTRUE] = nim_vm_jit_jumpiftrue,
+    [NIM_OPCODE_PUSHCONST] = nim_vm_jit_pushconst,
+    [NIM_OPCODE_STORENAME] = nim_vm_jit_storename,
+    [NIM_OPCODE_PUSHNAME] = nim_vm_jit_pushname,
+    [NIM_OPCODE_PUSHLOCAL] = nim_vm_jit_pushlocal,
+    [NIM_OPCODE_STORELOCAL] = nim_vm_jit_storelocal,
+    [NIM_OPCODE_PUSHUPVAL] = nim_vm_jit_pushupval,
+    [NIM_OPCODE_STOREUPVAL] = nim_vm_jit_storeupval,
+    [NIM_OPCODE_LOADGLOBAL] = nim_vm_jit_loadglobal,
+    [NIM_OPCODE_LOADBUILTIN] = nim_vm_jit_loadbuiltin,
+    [NIM_OPCODE_PUSHNIL] = nim_vm_jit_pushnil,
+    [NIM_OPCODE_GETATTR] = nim_vm_jit_getattr,
+    [NIM_OPCODE_GETITEM] = nim_vm_jit_getitem,
+    [NIM_OPCODE_CALL] = nim_vm_jit_call,
+    [NIM_OPCODE_CALLMETHOD] = nim_vm_jit_callmethod,
+    [NIM_OPCODE_TAILCALL] = nim_vm_jit_tailcall,
+    [NIM_OPCODE_MAKEARRAY] = nim_vm_jit_makearray,
+    [NIM_OPCODE_MAKEHASH] = nim_vm_jit_makehash,
+    [NIM_OPCODE_CLONECONST] = nim_vm_jit_cloneconst,
+    [NIM_OPCODE_CMPEQ] = nim_vm_jit_cmpeq,
+    [NIM_OPCODE_CMPNEQ] = nim_vm_jit_cmpneq,
+    [NIM_OPCODE_CMPGT] = nim_vm_jit_cmpgt,
+    [NIM_OPCODE_CMPGTE] = nim_vm_jit_cmpgte,
+    [NIM_OPCODE_CMPLT] = nim_vm_jit_cmplt,
+    [NIM_OPCODE_CMPLTE] = nim_vm_jit_cmplte,
+    [NIM_OPCODE_NOT] = nim_vm_jit_not,
+    [NIM_OPCODE_DUP] = nim_vm_jit_dup,
+    [NIM_OPCODE_POP] = nim_vm_jit_pop,
+    [NIM_OPCODE_SPAWN] = nim_vm_jit_spawn,
+    [NIM_OPCODE_ADD] = nim_vm_jit_add,
+    [NIM_OPCODE_SUB] = nim_vm_jit_sub,
+    [NIM_OPCODE_MUL] = nim_vm_jit_mul,
+    [NIM_OPCODE_DIV] = nim_vm_jit_div,
+    [NIM_OPCODE_MAKECLOSURE] = nim_vm_jit_makeclosure,
+    [NIM_OPCODE_GETCLASS] = nim_vm_jit_getclass,
+    [NIM_OPCODE_GETITER] = nim_vm_jit_getiter,
+    [NIM_OPCODE_FORITER] = nim_vm_jit_foriter,
+    [NIM_OPCODE_ADD_INT] = nim_vm_jit_add_int,
+    [NIM_OPCODE_SUB_INT] = nim_vm_jit_sub_int,
+    [NIM_OPCODE_MUL_INT] = nim_vm_jit_mul_int,
+    [NIM_OPCODE_DIV_INT] = nim_vm_jit_div_int,
+    [NIM_OPCODE_CMPEQ_INT] = nim_vm_jit_cmpeq_int,
+    [NIM_OPCODE_CMPNEQ_INT] = nim_vm_jit_cmpneq_int,
+    [NIM_OPCODE_CMPGT_INT] = nim_vm_jit_cmpgt_int,
+    [NIM_OPCODE_CMPGTE_INT] = nim_vm_jit_cmpgte_int,
+    [NIM_OPCODE_CMPLT_INT] = nim_vm_jit_cmplt_int,
+    [NIM_OPCODE_CMPLTE_INT] = nim_vm_jit_cmplte_int,
+    [NIM_OPCODE_JUMPIFNOTEQ] = nim_vm_jit_jumpifnot,
+    [NIM_OPCODE_JUMPIFNOTNEQ] = nim_vm_jit_jumpifnot,
+    [NIM_OPCODE_JUMPIFNOTGT] = nim_vm_jit_jumpifnot,
+    [NIM_OPCODE_JUMPIFNOTGTE] = nim_vm_jit_jumpifnot,
+    [NIM_OPCODE_JUMPIFNOTLT] = nim_vm_jit_jumpifnot,
+    [NIM_OPCODE_JUMPIFNOTLTE] = nim_vm_jit_jumpifnot,
+    [NIM_OPCODE_ADDNAMECONST] = nim_vm_jit_addnameconst,
+    [NIM_OPCODE_ADDLOCALCONST] = nim_vm_jit_addlocalconst
+};
+
+/* counts a call or loop back-edge & returns NIM_TRUE once the code object */
+/* is hot & has native code, or NIM_FALSE if it should stay interpreted. */
+static nim_bool_t
+nim_vm_jit_get (NimRef *code)
+{
+    NimCode *c = NIM_CODE(code);
+    NimJitCode *jit;
+
+    if (c->jit_state == NIM_CODE_JIT_READY) {
+        return NIM_TRUE;
+    }
+    if (c->jit_state != NIM_CODE_JIT_NONE) {
+        return NIM_FALSE;
+    }
+    /* XXX racy across tasks, but a lost update only delays compilation */
+    if (c->jit_counter++ < nim_jit_threshold ()) {
+        return NIM_FALSE;
+    }
+    if (!__sync_bool_compare_and_swap (
+            &c->jit_state, NIM_CODE_JIT_NONE, NIM_CODE_JIT_COMPILING)) {
+        return NIM_FALSE;
+    }
+    /* the compiler reads the bytecode, so hold off the dtor meanwhile */
+    if (!nim_jit_pin (code)) {
+        return NIM_FALSE;
+    }
+    jit = nim_jit_compile (code, nim_vm_jit_helpers);
+    c->jit = jit;
+    /* if the dtor got in meanwhile, it frees c->jit once we unpin */
+    __sync_bool_compare_and_swap (&c->jit_state, NIM_CODE_JIT_COMPILING,
+        jit != NULL ? NIM_CODE_JIT_READY : NIM_CODE_JIT_FAILED);
+    nim_jit_unpin (code);
+    return c->jit_state == NIM_CODE_JIT_READY;
+}
+
+static void
+nim_vm_load_frame (NimRef *frame, NimVMFrameState *state)
+{
+    state->frame = frame;
+    state->code = NIM_FRAME_CODE(frame);
+    state->locals = NIM_FRAME(frame)->locals;
+    state->upvalues = NIM_FRAME(frame)->upvalues;
+    state->module = NIM_METHOD(NIM_FRAME(frame)->method)->module;
+}
+
+#define NIM_VM_RAW_ITEMS(ref) (NIM_UNCHECKED_CAST(NimArray, (ref))->items)
+#define NIM_VM_RAW_VAR(ref) NIM_UNCHECKED_CAST(NimVar, (ref))
+#define NIM_VM_RAW_INT(ref) NIM_UNCHECKED_CAST(NimInt, (ref))
+#define NIM_VM_RAW_IS_INT(ref) \
+    (NIM_UNCHECKED_CAST(NimAny, (ref))->klass == nim_int_class)
+
+/* NIM_INSTR_EXTARG1 for the raw bytecode in nim_vm_eval_verified */
+#define NIM_VM_RAW_ARG1(bytecode, pc) \
+    (((pc) > 0 && ((bytecode)[(pc) - 1] >> 24) == NIM_OPCODE_EXTENDED_ARG) ? \
+        ((((bytecode)[(pc) - 1] & 0x00ffffff) << 8) | \
+            (((bytecode)[pc] & 0x00ff0000) >> 16)) : \
+        (((bytecode)[pc] & 0x00ff0000) >> 16))
+
+/*
+ * The fast path for code that passed nim_code_verify. The verifier has
+ * already proven that operands are in range & the stack can't underflow,
+ * so this skips the bounds checks & checked casts the main loop makes on
+ * every instruction. It only knows the common opcodes: it stops at the pc
+ * of anything else (or of an int op whose operands aren't ints, or of a
+ * local read before assignment) for the main loop to run instead.
+ * Returns NIM_FALSE if an instruction failed.
+ *
+ * The caller must have reserved max_stack slots on top of the stack.
+ */
+static nim_bool_t
+nim_vm_eval_verified (
+    NimVM *vm, NimRef *code, NimRef *locals, NimRef *upvalues, size_t *pcp,
+    nim_bool_t jit_enabled)
+{
+    NimArray *stack = NIM_UNCHECKED_CAST(NimArray, vm->stack);
+    NimCode *c = NIM_UNCHECKED_CAST(NimCode, code);
+    const uint32_t *bytecode = c->bytecode;
+    const size_t used = c->used;
+    NimRef **consts = NIM_VM_RAW_ITEMS(c->constants);
+    NimRef **vars = NIM_VM_RAW_ITEMS(locals);
+    NimRef **items = stack->items;
+    size_t sp = stack->size;
+    size_t pc = *pcp;
+
+    while (pc < used) {
+        const uint32_t instr = bytecode[pc];
+#ifdef NIM_VM_STATS
+        vm->dispatched++;
+#endif
+        switch ((NimOpcode)(instr >> 24)) {
+            case NIM_OPCODE_PUSHCONST:
+            {
+                items[sp++] = consts[NIM_VM_RAW_ARG1(bytecode, pc)];
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_PUSHNIL:
+            {
+                items[sp++] = nim_nil;
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_PUSHLOCAL:
+            {
+                NimRef *value =
+                    NIM_VM_RAW_VAR(vars[NIM_VM_RAW_ARG1(bytecode, pc)])->value;
+                if (value == NULL) {
+                    goto out;
+                }
+                items[sp++] = value;
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_STORELOCAL:
+            {
+                NIM_VM_RAW_VAR(vars[NIM_VM_RAW_ARG1(bytecode, pc)])->value =
+                    items[--sp];
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_PUSHUPVAL:
+            {
+                NimRef *value;
+                if (upvalues == NULL) {
+                    goto out;
+                }
+                value = NIM_VM_RAW_VAR(NIM_VM_RAW_ITEMS(upvalues)[
+                            NIM_VM_RAW_ARG1(bytecode, pc)])->value;
+                if (value == NULL) {
+                    goto out;
+                }
+                items[sp++] = value;
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_STOREUPVAL:
+            {
+                if (upvalues == NULL) {
+                    goto out;
+                }
+                NIM_VM_RAW_VAR(NIM_VM_RAW_ITEMS(upvalues)[
+                    NIM_VM_RAW_ARG1(bytecode, pc)])->value = items[--sp];
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_POP:
+            {
+                sp--;
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_DUP:
+            {
+                items[sp] = items[sp - 1];
+                sp++;
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_EXTENDED_ARG:
+            {
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_JUMP:
+            {
+                const size_t target = instr & 0x00ffffff;
+                if (target <= pc && jit_enabled) {
+                    /* let the main loop decide whether to go native */
+                    goto out;
+                }
+                pc = target;
+                break;
+            }
+            case NIM_OPCODE_JUMPIFTRUE:
+            {
+                NimRef *value = items[--sp];
+                pc = nim_vm_truthy (value) ? (instr & 0x00ffffff) : pc + 1;
+                break;
+            }
+            case NIM_OPCODE_JUMPIFFALSE:
+            {
+                NimRef *value = items[--sp];
+                pc = (value == nim_false || value == nim_nil) ?
+                        (instr & 0x00ffffff) : pc + 1;
+                break;
+            }
+            case NIM_OPCODE_FORITER:
+            {
+                NimRef *value;
+                /* the iterator stays visible to the GC while we allocate */
+                stack->size = sp;
+                if (!nim_iter_next (items[sp - 1], &value)) {
+                    NIM_BUG ("FORITER instruction failed");
+                    return NIM_FALSE;
+                }
+                /* a generator runs on this stack, which may have moved */
+                items = stack->items;
+                sp = stack->size;
+                if (value == NULL) {
+                    pc = instr & 0x00ffffff;
+                }
+                else {
+                    items[sp++] = value;
+                    pc++;
+                }
+                break;
+            }
+            case NIM_OPCODE_JUMPIFNOTEQ:
+            case NIM_OPCODE_JUMPIFNOTNEQ:
+            case NIM_OPCODE_JUMPIFNOTGT:
+            case NIM_OPCODE_JUMPIFNOTGTE:
+            case NIM_OPCODE_JUMPIFNOTLT:
+            case NIM_OPCODE_JUMPIFNOTLTE:
+            {
+                NimRef *left = items[sp - 2];
+                NimRef *right = items[sp - 1];
+                int64_t a;
+                int64_t b;
+                nim_bool_t holds;
+                if (!NIM_VM_RAW_IS_INT(left) || !NIM_VM_RAW_IS_INT(right)) {
+                    goto out;
+                }
+                a = NIM_VM_RAW_INT(left)->value;
+                b = NIM_VM_RAW_INT(right)->value;
+                switch ((NimOpcode)(instr >> 24)) {
+                    case NIM_OPCODE_JUMPIFNOTEQ: holds = a == b; break;
+                    case NIM_OPCODE_JUMPIFNOTNEQ: holds = a != b; break;
+                    case NIM_OPCODE_JUMPIFNOTGT: holds = a > b; break;
+                    case NIM_OPCODE_JUMPIFNOTGTE: holds = a >= b; break;
+                    case NIM_OPCODE_JUMPIFNOTLT: holds = a < b; break;
+                    default: holds = a <= b; break;
+                };
+                sp -= 2;
+                pc = holds ? pc + 1 : (instr & 0x00ffffff);
+                break;
+            }
+            case NIM_OPCODE_ADD_INT:
+            case NIM_OPCODE_SUB_INT:
+            case NIM_OPCODE_MUL_INT:
+            case NIM_OPCODE_DIV_INT:
+            {
+                NimRef *left = items[sp - 2];
+                NimRef *right = items[sp - 1];
+                NimRef *result;
+                int64_t value;
+                if (!NIM_VM_RAW_IS_INT(left) || !NIM_VM_RAW_IS_INT(right) ||
+                        !nim_vm_int_arith ((NimOpcode)(instr >> 24),
+                            NIM_VM_RAW_INT(left)->value,
+                            NIM_VM_RAW_INT(right)->value, &value)) {
+                    goto out;
+                }
+                /* operands stay visible to the GC while we allocate */
+                stack->size = sp;
+                result = nim_int_new (value);
+                if (result == NULL) {
+                    goto out;
+                }
+                items[sp - 2] = result;
+                sp--;
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_CMPEQ_INT:
+            case NIM_OPCODE_CMPNEQ_INT:
+            case NIM_OPCODE_CMPGT_INT:
+            case NIM_OPCODE_CMPGTE_INT:
+            case NIM_OPCODE_CMPLT_INT:
+            case NIM_OPCODE_CMPLTE_INT:
+            {
+                NimRef *left = items[sp - 2];
+                NimRef *right = items[sp - 1];
+                int64_t a;
+                int64_t b;
+                nim_bool_t result;
+                if (!NIM_VM_RAW_IS_INT(left) || !NIM_VM_RAW_IS_INT(right)) {
+                    goto out;
+                }
+                a = NIM_VM_RAW_INT(left)->value;
+                b = NIM_VM_RAW_INT(right)->value;
+                switch ((NimOpcode)(instr >> 24)) {
+                    case NIM_OPCODE_CMPEQ_INT: result = a == b; break;
+                    case NIM_OPCODE_CMPNEQ_INT: result = a != b; break;
+                    case NIM_OPCODE_CMPGT_INT: result = a > b; break;
+                    case NIM_OPCODE_CMPGTE_INT: result = a >= b; break;
+                    case NIM_OPCODE_CMPLT_INT: result = a < b; break;
+                    default: result = a <= b; break;
+                };
+                items[sp - 2] = NIM_BOOL_REF(result);
+                sp--;
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_ADDLOCALCONST:
+            {
+                NimRef *left =
+                    NIM_VM_RAW_VAR(vars[NIM_VM_RAW_ARG1(bytecode, pc)])->value;
+                NimRef *right = consts[(instr & 0x0000ff00) >> 8];
+                NimRef *result;
+                int64_t value;
+                if (left == NULL ||
+                        !NIM_VM_RAW_IS_INT(left) || !NIM_VM_RAW_IS_INT(right) ||
+                        !nim_vm_int_arith (NIM_OPCODE_ADD_INT,
+                            NIM_VM_RAW_INT(left)->value,
+                            NIM_VM_RAW_INT(right)->value, &value)) {
+                    goto out;
+                }
+                stack->size = sp;
+                result = nim_int_new (value);
+                if (result == NULL) {
+                    goto out;
+                }
+                items[sp++] = result;
+                pc++;
+                break;
+            }
+            default:
+            {
+                goto out;
+            }
+        };
+    }
+
+out:
+    stack->size = sp;
+    *pcp = pc;
+    return NIM_TRUE;
+}
+
+/* YIELD: moves whatever the frame has on the stack into frame->saved so */
+/* nim_vm_resume can put it back, wherever the stack is by then. */
+static nim_bool_t
+nim_vm_suspend (NimVM *vm, NimRef *frame, size_t pc)
+{
+    const size_t base = NIM_FRAME(frame)->stack_base;
+    const size_t size = NIM_ARRAY_SIZE(vm->stack);
+    NimRef *saved = NULL;
+    size_t i;
+
+    if (size > base) {
+        saved = nim_array_new_with_capacity (size - base);
+        if (saved == NULL) {
+            return NIM_FALSE;
+        }
+        for (i = base; i < size; i++) {
+            if (!nim_array_push (saved, NIM_ARRAY_ITEMS(vm->stack)[i])) {
+                return NIM_FALSE;
+            }
+        }
+    }
+    NIM_ARRAY_SIZE(vm->stack) = base;
+    NIM_FRAME(frame)->saved = saved;
+    NIM_FRAME(frame)->pc = pc;
+    NIM_FRAME(frame)->suspended = NIM_TRUE;
+    return NIM_TRUE;
+}
+
+/*
+ * Calls between bytecode methods don't recurse: the callee's frame is
+ * pushed onto vm->frames & run by this same loop, and RET picks the
+ * caller back up where it left off. We only return once the frame we
+ * were called with is done; native methods (& native code from the
+ * JIT) are the only things that re-enter us.
+ */
 static NimRef *
-nim_vm_eval_frame (NimVM *vm, NimRef *frame)
+nim_vm_eval_frame (NimVM *vm, NimRef *frame, size_t base, size_t start)
 {
-    NimRef *code = NIM_FRAME_CODE(frame);
-    NimRef *locals = NIM_FRAME(frame)->locals;
+    NimRef *code;
+    NimRef *locals;
+    NimRef *upvalues;
+    NimRef *module;
+    NimRef *next;
+    NimRef *value;
+    NimVMFrameState state;
+    const nim_bool_t jit_enabled = nim_jit_enabled ();
+    nim_bool_t verified;
+    size_t depth;
+    size_t pc;
+    int rc;
 
+    NIM_FRAME(frame)->stack_base = base;
     if (!nim_array_push (vm->frames, frame)) {
         return NIM_FALSE;
     }
+    depth = NIM_ARRAY_SIZE(vm->frames);
+    pc = start;
+    goto load;
+
+enter:
+    pc = 0;
+load:
+    nim_vm_load_frame (frame, &state);
+    code = state.code;
+    locals = state.locals;
+    upvalues = state.upvalues;
+    module = state.module;
+
+    verified = NIM_CODE(code)->verified;
+    if (verified) {
+        /* the verifier assumed nargs values on entry: missing args are nil */
+        while (pc == 0 && NIM_ARRAY_SIZE(vm->stack) <
+                NIM_FRAME(frame)->stack_base + NIM_CODE(code)->nargs) {
+            if (!nim_vm_push (vm, nim_nil)) {
+                return NULL;
+            }
+        }
+        if (!nim_array_ensure_capacity (vm->stack,
+                NIM_ARRAY_SIZE(vm->stack) + NIM_CODE(code)->max_stack)) {
+            return NULL;
+        }
+    }
+
+    if (jit_enabled && nim_vm_jit_get (code)) {
+        goto native;
+    }
 
-    size_t pc = 0;
+resume:
     while (pc < NIM_CODE_SIZE(code)) {
+        if (verified) {
+            if (!nim_vm_eval_verified (
+                    vm, code, locals, upvalues, &pc, jit_enabled)) {
+                return NULL;
+            }
+            if (pc >= NIM_CODE_SIZE(code)) {
+                break;
+            }
+        }
+#ifdef NIM_VM_STATS
+        vm->dispatched++;
+#endif
         switch (NIM_INSTR_OP(code, pc)) {
             case NIM_OPCODE_PUSHCONST:
             {
@@ -456,6 +1957,60 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
                 pc++;
                 break;
             }
+            case NIM_OPCODE_PUSHLOCAL:
+            {
+                if (!nim_vm_pushlocal (vm, code, locals, pc)) {
+                    NIM_BUG ("PUSHLOCAL instruction failed");
+                    return NULL;
+                }
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_STORELOCAL:
+            {
+                if (!nim_vm_storelocal (vm, code, locals, pc)) {
+                    NIM_BUG ("STORELOCAL instruction failed");
+                    return NULL;
+                }
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_PUSHUPVAL:
+            {
+                if (!nim_vm_pushupval (vm, code, upvalues, pc)) {
+                    NIM_BUG ("PUSHUPVAL instruction failed");
+                    return NULL;
+                }
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_STOREUPVAL:
+            {
+                if (!nim_vm_storeupval (vm, code, upvalues, pc)) {
+                    NIM_BUG ("STOREUPVAL instruction failed");
+                    return NULL;
+                }
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_LOADGLOBAL:
+            {
+                if (!nim_vm_loadglobal (vm, code, module, pc)) {
+                    NIM_BUG ("LOADGLOBAL instruction failed");
+                    return NULL;
+                }
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_LOADBUILTIN:
+            {
+                if (!nim_vm_loadbuiltin (vm, code, pc)) {
+                    NIM_BUG ("LOADBUILTIN instruction failed");
+                    return NULL;
+                }
+                pc++;
+                break;
+            }
             case NIM_OPCODE_PUSHNIL:
             {
                 if (!nim_vm_push (vm, nim_nil)) {
@@ -465,20 +2020,18 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
                 pc++;
                 break;
             }
+            case NIM_OPCODE_EXTENDED_ARG:
+            {
+                /* consumed by the instruction that follows */
+                pc++;
+                break;
+            }
             case NIM_OPCODE_GETCLASS:
             {
-                NimRef *value = nim_vm_pop (vm);
-#ifdef NIM_VM_DEBUG
-                printf ("[%p] GETCLASS = %s\n",
-                        vm, NIM_STR_DATA(NIM_CLASS_NAME(NIM_ANY_CLASS(value))));
-#endif
-                if (value == NULL) {
+                if (!nim_vm_getclass (vm)) {
                     NIM_BUG ("GETCLASS instruction failed");
                     return NULL;
                 }
-                if (!nim_vm_push (vm, NIM_ANY_CLASS(value))) {
-                    return NULL;
-                }
                 pc++;
                 break;
             }
@@ -493,48 +2046,38 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
             }
             case NIM_OPCODE_GETITEM:
             {
-                NimRef *result;
-                NimRef *key;
-                NimRef *target;
-                
-                key = nim_vm_pop (vm);
-                if (key == NULL) {
-                    NIM_BUG ("GETITEM instruction failed 1");
+                if (!nim_vm_getitem (vm)) {
+                    NIM_BUG ("GETITEM instruction failed");
                     return NULL;
                 }
-
-                target = nim_vm_pop (vm);
-                if (target == NULL) {
-                    NIM_BUG ("GETITEM instruction failed 2");
-                    return NULL;
-                }
-
-                result = nim_object_getitem (target, key);
-                if (result == NULL) {
-                    NIM_BUG ("GETITEM instruction failed 3");
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_CALL:
+            {
+                if (!nim_vm_call (vm, code, locals, pc, &next)) {
+                    NIM_BUG ("CALL instruction failed");
                     return NULL;
                 }
-
-#ifdef NIM_VM_DEBUG
-                printf ("[%p] GETITEM = %s\n",
-                        vm,
-                        NIM_STR_DATA(nim_object_str (result)));
-#endif
-
-                if (!nim_vm_push (vm, result)) {
-                    NIM_BUG ("GETITEM instruction failed 4");
-                    return NULL;
+                if (next != NULL) {
+                    NIM_FRAME(frame)->pc = pc;
+                    frame = next;
+                    goto enter;
                 }
-
                 pc++;
                 break;
             }
-            case NIM_OPCODE_CALL:
+            case NIM_OPCODE_CALLMETHOD:
             {
-                if (!nim_vm_call (vm, code, locals, pc)) {
-                    NIM_BUG ("CALL instruction failed");
+                if (!nim_vm_callmethod (vm, code, locals, pc, &next)) {
+                    NIM_BUG ("CALLMETHOD instruction failed");
                     return NULL;
                 }
+                if (next != NULL) {
+                    NIM_FRAME(frame)->pc = pc;
+                    frame = next;
+                    goto enter;
+                }
                 pc++;
                 break;
             }
@@ -542,67 +2085,64 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
             {
                 goto done;
             }
-            case NIM_OPCODE_SPAWN:
+            case NIM_OPCODE_YIELD:
             {
-                NimRef *task;
-                NimRef *target;
-
-                target = nim_vm_pop (vm);
-                if (target == NULL) {
-                    return NIM_FALSE;
+                /* generators are never run inline (see nim_vm_call), so */
+                /* the yielding frame is always the one we were given */
+                if (NIM_ARRAY_SIZE(vm->frames) != depth) {
+                    NIM_BUG ("YIELD outside of a generator");
+                    return NULL;
                 }
-                if (NIM_METHOD_TYPE(target) == NIM_METHOD_TYPE_CLOSURE) {
-                    NIM_BUG ("cannot use the spawn keyword with a closure");
-                    return NIM_FALSE;
+                value = nim_vm_pop (vm);
+                if (value == NULL) {
+                    NIM_BUG ("YIELD instruction failed");
+                    return NULL;
                 }
-                task = nim_task_new (target);
-                if (task == NULL) {
-                    return NIM_FALSE;
+                if (!nim_vm_suspend (vm, frame, pc + 1)) {
+                    NIM_BUG ("YIELD instruction failed");
+                    return NULL;
                 }
-
-                if (!nim_vm_push (vm, task)) {
-                    return NIM_FALSE;
+                nim_array_pop (vm->frames);
+                return value;
+            }
+            case NIM_OPCODE_TAILCALL:
+            {
+                if (!nim_vm_tailcall (
+                        vm, code, locals, pc, NIM_FRAME(frame)->stack_base, &next)) {
+                    NIM_BUG ("TAILCALL instruction failed");
+                    return NULL;
                 }
-
+                if (next != NULL) {
+                    frame = next;
+                    goto enter;
+                }
+                /* the RET that follows returns the result */
                 pc++;
                 break;
             }
-            case NIM_OPCODE_DUP:
+            case NIM_OPCODE_SPAWN:
             {
-                NimRef *top = nim_vm_top (vm);
-
-                if (top == NULL) {
-                    return NIM_FALSE;
+                if (!nim_vm_spawn (vm)) {
+                    NIM_BUG ("SPAWN instruction failed");
+                    return NULL;
                 }
-
-#ifdef NIM_VM_DEBUG
-                printf ("[%p] DUP = %s\n",
-                        vm,
-                        NIM_STR_DATA (nim_object_str (top)));
-#endif
-
-                if (!nim_vm_push (vm, top)) {
-                    return NIM_FALSE;
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_DUP:
+            {
+                if (!nim_vm_dup (vm)) {
+                    NIM_BUG ("DUP instruction failed");
+                    return NULL;
                 }
-
                 pc++;
                 break;
             }
             case NIM_OPCODE_NOT:
             {
-                NimRef *value = nim_vm_pop (vm);
-                if (value == NULL) {
-                    return NIM_FALSE;
-                }
-                if (nim_vm_truthy (value)) {
-                    if (!nim_vm_push (vm, nim_false)) {
-                        return NIM_FALSE;
-                    }
-                }
-                else {
-                    if (!nim_vm_push (vm, nim_true)) {
-                        return NIM_FALSE;
-                    }
+                if (!nim_vm_not (vm)) {
+                    NIM_BUG ("NOT instruction failed");
+                    return NULL;
                 }
                 pc++;
                 break;
@@ -625,15 +2165,43 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
                 pc++;
                 break;
             }
+            case NIM_OPCODE_CLONECONST:
+            {
+                if (!nim_vm_cloneconst (vm, code, locals, pc)) {
+                    NIM_BUG ("CLONECONST instruction failed");
+                    return NULL;
+                }
+                pc++;
+                break;
+            }
             case NIM_OPCODE_MAKECLOSURE:
             {
-                if (!nim_vm_makeclosure (vm, code, pc)) {
+                if (!nim_vm_makeclosure (vm, frame, pc)) {
                     NIM_BUG ("MAKECLOSURE instruction failed");
                     return NULL;
                 }
                 pc++;
                 break;
             }
+            case NIM_OPCODE_GETITER:
+            {
+                if (!nim_vm_getiter (vm)) {
+                    NIM_BUG ("GETITER instruction failed");
+                    return NULL;
+                }
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_FORITER:
+            {
+                rc = nim_vm_foriter (vm);
+                if (rc < 0) {
+                    NIM_BUG ("FORITER instruction failed");
+                    return NULL;
+                }
+                pc = rc > 0 ? NIM_INSTR_ADDR(code, pc) : pc + 1;
+                break;
+            }
             case NIM_OPCODE_JUMPIFTRUE:
             {
                 NimRef *value = nim_vm_pop (vm);
@@ -643,7 +2211,7 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
                 }
                 if (nim_vm_truthy (value)) {
 #ifdef NIM_VM_DEBUG
-                    printf ("[%p] JUMPIFTRUE %zu\n", vm, (intmax_t) pc);
+                    printf ("[%p] JUMPIFTRUE %zu\n", vm, pc);
 #endif
                     pc = NIM_INSTR_ADDR(code, pc);
                 }
@@ -662,7 +2230,7 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
                 /* TODO test for non-truthiness */
                 if (value == nim_false || value == nim_nil) {
 #ifdef NIM_VM_DEBUG
-                    printf ("[%p] JUMPIFFALSE %zu\n", vm, (intmax_t) pc);
+                    printf ("[%p] JUMPIFFALSE %zu\n", vm, pc);
 #endif
                     pc = NIM_INSTR_ADDR(code, pc);
                 }
@@ -673,120 +2241,103 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
             }
             case NIM_OPCODE_JUMP:
             {
-                pc = NIM_INSTR_ADDR(code, pc);
+                const size_t target = NIM_INSTR_ADDR(code, pc);
+                if (target <= pc && jit_enabled && nim_vm_jit_get (code)) {
+                    /* hot loop: run the rest of this frame natively */
+                    pc = target;
+                    goto native;
+                }
+                pc = target;
                 break;
             }
-            case NIM_OPCODE_CMPEQ:
+            case NIM_OPCODE_JUMPIFNOTEQ:
+            case NIM_OPCODE_JUMPIFNOTNEQ:
+            case NIM_OPCODE_JUMPIFNOTGT:
+            case NIM_OPCODE_JUMPIFNOTGTE:
+            case NIM_OPCODE_JUMPIFNOTLT:
+            case NIM_OPCODE_JUMPIFNOTLTE:
             {
-                NimCmpResult r = nim_vm_cmp (vm);
-                if (r == NIM_CMP_ERROR) {
+                int rc = nim_vm_cmp_test (vm, NIM_INSTR_OP(code, pc));
+                if (rc < 0) {
                     return NULL;
                 }
-                else if (r == NIM_CMP_EQ) {
-                    if (!nim_vm_pushtrue (vm)) {
-                        return NULL;
-                    }
+                else if (rc == 0) {
+                    pc = NIM_INSTR_ADDR(code, pc);
                 }
                 else {
-                    if (!nim_vm_pushfalse (vm)) {
-                        return NULL;
-                    }
+                    pc++;
+                }
+                break;
+            }
+            case NIM_OPCODE_ADDNAMECONST:
+            {
+                if (!nim_vm_addnameconst (vm, code, pc)) {
+                    NIM_BUG ("ADDNAMECONST instruction failed");
+                    return NULL;
                 }
                 pc++;
                 break;
             }
-            case NIM_OPCODE_CMPNEQ:
+            case NIM_OPCODE_ADDLOCALCONST:
             {
-                NimCmpResult r = nim_vm_cmp (vm);
-                if (r == NIM_CMP_ERROR) {
+                if (!nim_vm_addlocalconst (vm, code, locals, pc)) {
+                    NIM_BUG ("ADDLOCALCONST instruction failed");
                     return NULL;
                 }
-                else if (r == NIM_CMP_EQ) {
-                    if (!nim_vm_pushfalse (vm)) {
-                        return NULL;
-                    }
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_CMPEQ:
+            {
+                if (!nim_vm_compare (vm, code, pc, NIM_OPCODE_CMPEQ)) {
+                    NIM_BUG ("CMPEQ instruction failed");
+                    return NULL;
                 }
-                else {
-                    if (!nim_vm_pushtrue (vm)) {
-                        return NULL;
-                    }
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_CMPNEQ:
+            {
+                if (!nim_vm_compare (vm, code, pc, NIM_OPCODE_CMPNEQ)) {
+                    NIM_BUG ("CMPNEQ instruction failed");
+                    return NULL;
                 }
                 pc++;
                 break;
             }
             case NIM_OPCODE_CMPGT:
             {
-                NimCmpResult r = nim_vm_cmp (vm);
-                if (r == NIM_CMP_ERROR) {
+                if (!nim_vm_compare (vm, code, pc, NIM_OPCODE_CMPGT)) {
+                    NIM_BUG ("CMPGT instruction failed");
                     return NULL;
                 }
-                else if (r == NIM_CMP_GT) {
-                    if (!nim_vm_pushtrue (vm)) {
-                        return NULL;
-                    }
-                }
-                else {
-                    if (!nim_vm_pushfalse (vm)) {
-                        return NULL;
-                    }
-                }
                 pc++;
                 break;
             }
             case NIM_OPCODE_CMPGTE:
             {
-                NimCmpResult r = nim_vm_cmp (vm);
-                if (r == NIM_CMP_ERROR) {
+                if (!nim_vm_compare (vm, code, pc, NIM_OPCODE_CMPGTE)) {
+                    NIM_BUG ("CMPGTE instruction failed");
                     return NULL;
                 }
-                else if (r == NIM_CMP_GT || r == NIM_CMP_EQ) {
-                    if (!nim_vm_pushtrue (vm)) {
-                        return NULL;
-                    }
-                }
-                else {
-                    if (!nim_vm_pushfalse (vm)) {
-                        return NULL;
-                    }
-                }
                 pc++;
                 break;
             }
             case NIM_OPCODE_CMPLT:
             {
-                NimCmpResult r = nim_vm_cmp (vm);
-                if (r == NIM_CMP_ERROR) {
+                if (!nim_vm_compare (vm, code, pc, NIM_OPCODE_CMPLT)) {
+                    NIM_BUG ("CMPLT instruction failed");
                     return NULL;
                 }
-                else if (r == NIM_CMP_LT) {
-                    if (!nim_vm_pushtrue (vm)) {
-                        return NULL;
-                    }
-                }
-                else {
-                    if (!nim_vm_pushfalse (vm)) {
-                        return NULL;
-                    }
-                }
                 pc++;
                 break;
             }
             case NIM_OPCODE_CMPLTE:
             {
-                NimCmpResult r = nim_vm_cmp (vm);
-                if (r == NIM_CMP_ERROR) {
+                if (!nim_vm_compare (vm, code, pc, NIM_OPCODE_CMPLTE)) {
+                    NIM_BUG ("CMPLTE instruction failed");
                     return NULL;
                 }
-                else if (r == NIM_CMP_LT || r == NIM_CMP_EQ) {
-                    if (!nim_vm_pushtrue (vm)) {
-                        return NULL;
-                    }
-                }
-                else {
-                    if (!nim_vm_pushfalse (vm)) {
-                        return NULL;
-                    }
-                }
                 pc++;
                 break;
             }
@@ -804,25 +2355,8 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
             }
             case NIM_OPCODE_ADD:
             {
-                NimRef *left;
-                NimRef *right;
-                NimRef *result;
-
-                right = nim_vm_pop (vm);
-                if (right == NULL) {
-                    return NULL;
-                }
-
-                left = nim_vm_pop (vm);
-                if (left == NULL) {
-                    return NULL;
-                }
-
-                result = nim_object_add (left, right);
-#ifdef NIM_VM_DEBUG
-                printf ("[%p] ADD = %s\n", vm, NIM_STR_DATA (nim_object_str (result)));
-#endif
-                if (!nim_vm_push (vm, result)) {
+                if (!nim_vm_binop (vm, code, pc, NIM_OPCODE_ADD)) {
+                    NIM_BUG ("ADD instruction failed");
                     return NULL;
                 }
                 pc++;
@@ -830,79 +2364,51 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
             }
             case NIM_OPCODE_SUB:
             {
-                NimRef *left;
-                NimRef *right;
-                NimRef *result;
-
-                right = nim_vm_pop (vm);
-                if (right == NULL) {
-                    return NULL;
-                }
-
-                left = nim_vm_pop (vm);
-                if (left == NULL) {
+                if (!nim_vm_binop (vm, code, pc, NIM_OPCODE_SUB)) {
+                    NIM_BUG ("SUB instruction failed");
                     return NULL;
                 }
-
-                result = nim_object_sub (left, right);
-                if (!nim_vm_push (vm, result)) {
-                    return NULL;
-                }
-#ifdef NIM_VM_DEBUG
-                printf ("[%p] SUB = %s\n", vm, NIM_STR_DATA (nim_object_str (result)));
-#endif
                 pc++;
                 break;
             }
             case NIM_OPCODE_MUL:
             {
-                NimRef *left;
-                NimRef *right;
-                NimRef *result;
-
-                right = nim_vm_pop (vm);
-                if (right == NULL) {
-                    return NULL;
-                }
-
-                left = nim_vm_pop (vm);
-                if (left == NULL) {
-                    return NULL;
-                }
-
-                result = nim_object_mul (left, right);
-                if (!nim_vm_push (vm, result)) {
+                if (!nim_vm_binop (vm, code, pc, NIM_OPCODE_MUL)) {
+                    NIM_BUG ("MUL instruction failed");
                     return NULL;
                 }
-#ifdef NIM_VM_DEBUG
-                printf ("[%p] MUL = %s\n", vm, NIM_STR_DATA (nim_object_str (result)));
-#endif
                 pc++;
                 break;
             }
             case NIM_OPCODE_DIV:
             {
-                NimRef *left;
-                NimRef *right;
-                NimRef *result;
-
-                right = nim_vm_pop (vm);
-                if (right == NULL) {
+                if (!nim_vm_binop (vm, code, pc, NIM_OPCODE_DIV)) {
+                    NIM_BUG ("DIV instruction failed");
                     return NULL;
                 }
-
-                left = nim_vm_pop (vm);
-                if (left == NULL) {
+                pc++;
+                break;
+            }
+            case NIM_OPCODE_ADD_INT:
+            case NIM_OPCODE_SUB_INT:
+            case NIM_OPCODE_MUL_INT:
+            case NIM_OPCODE_DIV_INT:
+            case NIM_OPCODE_CMPEQ_INT:
+            case NIM_OPCODE_CMPNEQ_INT:
+            case NIM_OPCODE_CMPGT_INT:
+            case NIM_OPCODE_CMPGTE_INT:
+            case NIM_OPCODE_CMPLT_INT:
+            case NIM_OPCODE_CMPLTE_INT:
+            {
+                int rc = nim_vm_int_op (vm, NIM_INSTR_OP(code, pc));
+                if (rc < 0) {
                     return NULL;
                 }
-
-                result = nim_object_div (left, right);
-                if (!nim_vm_push (vm, result)) {
-                    return NULL;
+                else if (rc == 0) {
+                    /* guard failed: rerun this pc as the generic opcode */
+                    nim_vm_deopt (code, pc);
+                    break;
                 }
-#ifdef NIM_VM_DEBUG
-                printf ("[%p] DIV = %s\n", vm, NIM_STR_DATA (nim_object_str (result)));
-#endif
                 pc++;
                 break;
             }
@@ -914,9 +2420,54 @@ nim_vm_eval_frame (NimVM *vm, NimRef *frame)
         };
     }
 
+    goto done;
+
+native:
+    rc = nim_jit_run (code, vm, &state, pc);
+    if (rc < 0) {
+        NIM_BUG ("native code failed");
+        return NULL;
+    }
+    else if (rc > 0) {
+        /* a call helper pushed (or swapped in) a frame for us to run */
+        frame = state.next;
+        goto enter;
+    }
+
 done:
+    /* code that falls off the end with nothing on the stack returns nil */
+    if (NIM_ARRAY_SIZE(vm->stack) > NIM_FRAME(frame)->stack_base) {
+        value = nim_vm_pop (vm);
+        if (value == NULL) {
+            NIM_BUG ("no return value on the stack");
+            return NULL;
+        }
+    }
+    else {
+        value = nim_nil;
+    }
+    if (NIM_ARRAY_SIZE(vm->frames) > depth) {
+        /* return to a caller running in this loop */
+        NIM_ARRAY_SIZE(vm->stack) = NIM_FRAME(frame)->stack_base;
+        nim_array_pop (vm->frames);
+        frame = NIM_ARRAY_LAST (vm->frames);
+        nim_vm_load_frame (frame, &state);
+        code = state.code;
+        locals = state.locals;
+        upvalues = state.upvalues;
+        module = state.module;
+        verified = NIM_CODE(code)->verified;
+        if (!nim_vm_push (vm, value)) {
+            return NULL;
+        }
+        pc = NIM_FRAME(frame)->pc + 1;
+        if (jit_enabled && NIM_CODE(code)->jit_state == NIM_CODE_JIT_READY) {
+            goto native;
+        }
+        goto resume;
+    }
     nim_array_pop (vm->frames);
-    return nim_vm_pop(vm);
+    return value;
 }
 
 /*
@@ -935,18 +2486,10 @@ nim_vm_eval (NimVM *vm, NimRef *code, NimRef *locals)
     if (frame == NULL) {
         return NULL;
     }
-    return nim_vm_eval_frame (vm, frame);
+    return nim_vm_eval_frame (vm, frame, NIM_ARRAY_SIZE(vm->stack), 0);
 }
 */
 
-#define NIM_IS_BYTECODE_METHOD(ref) \
-    (NIM_ANY_CLASS(ref) == nim_method_class && \
-        ( \
-            (NIM_METHOD(ref)->type == NIM_METHOD_TYPE_BYTECODE) || \
-            (NIM_METHOD(ref)->type == NIM_METHOD_TYPE_CLOSURE) \
-        ) \
-    )
-
 NimRef *
 nim_vm_invoke (NimVM *vm, NimRef *method, NimRef *args)
 {
@@ -955,6 +2498,10 @@ nim_vm_invoke (NimVM *vm, NimRef *method, NimRef *args)
     NimRef *frame;
     NimRef *ret;
 
+    if (NIM_IS_GENERATOR_METHOD(method)) {
+        return nim_generator_new (method, args);
+    }
+
     if (!NIM_IS_BYTECODE_METHOD(method)) {
         return nim_object_call (method, args);
     }
@@ -980,7 +2527,7 @@ nim_vm_invoke (NimVM *vm, NimRef *method, NimRef *args)
         }
     }
 
-    ret = nim_vm_eval_frame (vm, frame);
+    ret = nim_vm_eval_frame (vm, frame, stack_size, 0);
 
     /* restore the stack */
     NIM_ARRAY(vm->stack)->size = stack_size;
@@ -988,3 +2535,47 @@ nim_vm_invoke (NimVM *vm, NimRef *method, NimRef *args)
     return ret;
 }
 
+nim_bool_t
+nim_vm_resume (NimVM *vm, NimRef *frame, NimRef **value)
+{
+    NimRef *saved;
+    size_t stack_size;
+    size_t i;
+
+    if (vm == NULL) {
+        vm = NIM_CURRENT_VM;
+    }
+
+    if (!NIM_FRAME(frame)->suspended) {
+        NIM_BUG ("frame is not suspended");
+        return NIM_FALSE;
+    }
+
+    /* put back whatever the frame had on the stack when it yielded */
+    stack_size = NIM_ARRAY_SIZE(vm->stack);
+    saved = NIM_FRAME(frame)->saved;
+    if (saved != NULL) {
+        for (i = 0; i < NIM_ARRAY_SIZE(saved); i++) {
+            if (!nim_vm_push (vm, NIM_ARRAY_ITEM(saved, i))) {
+                return NIM_FALSE;
+            }
+        }
+    }
+    NIM_FRAME(frame)->saved = NULL;
+    NIM_FRAME(frame)->suspended = NIM_FALSE;
+
+    *value = nim_vm_eval_frame (
+                vm, frame, stack_size, NIM_FRAME(frame)->pc);
+
+    NIM_ARRAY(vm->stack)->size = stack_size;
+
+    if (*value == NULL) {
+        return NIM_FALSE;
+    }
+    /* anything but a YIELD means the generator is done */
+    if (!NIM_FRAME(frame)->suspended) {
+        *value = NULL;
+    }
+    return NIM_TRUE;
+}
+
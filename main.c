@@ -77,7 +77,7 @@ real_main (int argc, char **argv)
         return 1;
     }
 
-    module = NIM_COMPILE_MODULE_FROM_FILE (NULL, argv[1]);
+    module = nim_cache_compile_file (NULL, argv[1]);
     if (module == NULL) {
         fprintf (stderr, "error: failed to compile %s\n", argv[1]);
         return 1;
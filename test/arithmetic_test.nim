@@ -1,6 +1,24 @@
 use nimunit
 use io
 
+sums pairs {
+  ret pairs.map(fn { |pair|
+    ret pair[0] + pair[1]
+  })
+}
+
+lesses pairs {
+  ret pairs.map(fn { |pair|
+    ret pair[0] < pair[1]
+  })
+}
+
+quotients pairs {
+  ret pairs.map(fn { |pair|
+    ret pair[0] / pair[1]
+  })
+}
+
 main argv {
 
   # Addition tests
@@ -90,4 +108,30 @@ main argv {
     t.equals(4 / 2.0, 2.0)
     t.equals(4 / 2.0 / 2, 1.0)
   })
+
+  nimunit.test("Test 64-bit Int arithmetic", fn { |t|
+    t.equals(3000000000 + 3000000000, 6000000000)
+    t.equals(100000 * 100000, 10000000000)
+    t.equals(-3000000000 - 3000000000, -6000000000)
+  })
+
+  nimunit.test("Test Int overflow wraps around", fn { |t|
+    var max = 9223372036854775807
+    var min = -9223372036854775807 - 1
+    t.equals([1, 2, max].map(fn { |x| ret x + 1 }), [2, 3, min])
+    t.equals([1, 2, max].map(fn { |x| ret x * 2 }), [2, 4, -2])
+    t.equals(min - 1, max)
+    t.equals(min / -1, min)
+  })
+
+  nimunit.test("Test division at one site", fn { |t|
+    t.equals(quotients([[7, 2], [-7, 2], [9, 3]]), [3, -3, 3])
+    var min = -9223372036854775807 - 1
+    t.equals(quotients([[7, 2], [7.0, 2], [min, -1], [9, 3]]), [3, 3.5, min, 3])
+  })
+
+  nimunit.test("Test mixed types at one site", fn { |t|
+    t.equals(sums([[1, 2], [1, 2], [1.5, 2], ["a", "b"], [1, 2]]), [3, 3, 3.5, "ab", 3])
+    t.equals(lesses([[1, 2], [2, 1], [1.5, 2.5], [2, 1]]), [true, false, true, false])
+  })
 }
@@ -101,4 +101,14 @@ main argv {
     t.equals(true, ["Hello", "World", "!"].any(bool))
     t.equals(false, ["", "", ""].any(bool))
   })
+
+  nimunit.test("constant literals are fresh every time", fn { |t|
+    var make = fn {
+      [1, "two", 3.0]
+    }
+    var a = make()
+    a.push(4)
+    t.equals(make(), [1, "two", 3.0])
+    t.equals(a, [1, "two", 3.0, 4])
+  })
 }
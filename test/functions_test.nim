@@ -3,11 +3,75 @@ use nimunit
 incr n {
   n + 1
 }
+
+twice x {
+  ret x * 2
+}
+
+nothing x {
+  var y = x
+}
+
+sum_to n {
+  var total = 0
+  var i = 1
+  while i <= n {
+    total = total + i
+    i = i + 1
+  }
+  total
+}
+
+count_down n {
+  if n == 0 {
+    ret "done"
+  }
+  count_down(n - 1)
+}
+
+unmatched x {
+  match x {
+    1 { ret "one" }
+  }
+}
+
+compile x {
+  ret "shadowed"
+}
+
+count n, acc {
+  if n == 0 {
+    ret acc
+  }
+  ret count(n - 1, acc + 1)
+}
+
+depth n {
+  if n == 0 {
+    ret 0
+  }
+  ret 1 + depth(n - 1)
+}
+
 main argv {
   nimunit.test("basic function call", fn { |t|
     t.equals(1, incr(0))
   })
 
+  nimunit.test("function without a result returns nil", fn { |t|
+    t.equals(nil, nothing(1))
+  })
+
+  nimunit.test("trailing expression is the result", fn { |t|
+    t.equals(10, sum_to(4))
+    t.equals("done", count_down(100000))
+  })
+
+  nimunit.test("match with no arm taken returns nil", fn { |t|
+    t.equals("one", unmatched(1))
+    t.equals(nil, unmatched(2))
+  })
+
   nimunit.test("function as variable", fn { |t|
     var double = fn { |n| n * 2 }
     t.equals(2, double(1))
@@ -18,4 +82,68 @@ main argv {
     fn { i = i + 1 }()
     t.equals(1, i)
   })
+
+  nimunit.test("closure outlives its frame", fn { |t|
+    var counter = fn { |start|
+      var n = start
+      ret fn {
+        n = n + 1
+        ret n
+      }
+    }
+    var next = counter(10)
+    next()
+    t.equals(12, next())
+  })
+
+  nimunit.test("nested closures share captured vars", fn { |t|
+    var total = 0
+    var outer = fn {
+      ret fn { |x| total = total + x }
+    }
+    [1, 2, 3].each(outer())
+    t.equals(6, total)
+  })
+
+  nimunit.test("module-level functions from a closure", fn { |t|
+    var f = fn { |x| ret twice(x) }
+    t.equals(8, f(4))
+    t.equals(10, f(5))
+  })
+
+  nimunit.test("module-level names shadow builtins", fn { |t|
+    t.equals("shadowed", compile(1))
+    t.equals([0, 1, 2], range(3))
+  })
+
+  nimunit.test("deep tail recursion", fn { |t|
+    t.equals(200000, count(200000, 0))
+  })
+
+  nimunit.test("deep recursion", fn { |t|
+    t.equals(5000, depth(5000))
+  })
+
+  nimunit.test("tail call to a closure and a builtin", fn { |t|
+    var sum = fn { |n, acc|
+      if n == 0 {
+        ret str(acc)
+      }
+      ret sum(n - 1, acc + n)
+    }
+    t.equals("5050", sum(100, 0))
+  })
+
+  nimunit.test("method call", fn { |t|
+    var a = [1, 2]
+    a.push(3)
+    t.equals(3, a.size())
+  })
+
+  nimunit.test("method as variable", fn { |t|
+    var a = [1, 2]
+    var push = a.push
+    push(3)
+    t.equals([1, 2, 3], a)
+  })
 }
@@ -0,0 +1,109 @@
+use nimunit
+
+count n {
+  var i = 0
+  while i < n {
+    yield i
+    i = i + 1
+  }
+}
+
+squares g {
+  for x in g {
+    yield x * x
+  }
+}
+
+pairs xs {
+  for x in xs {
+    for y in xs {
+      yield [x, y]
+    }
+  }
+}
+
+first_two xs {
+  var n = 0
+  for x in xs {
+    if n == 2 {
+      ret nil
+    }
+    yield x
+    n = n + 1
+  }
+}
+
+depth n {
+  if n == 0 {
+    ret 0
+  }
+  ret 1 + depth(n - 1)
+}
+
+deep n {
+  var i = 0
+  while i < n {
+    yield depth(i * 500)
+    i = i + 1
+  }
+}
+
+collect g {
+  var result = []
+  for x in g {
+    result.push(x)
+  }
+  ret result
+}
+
+main argv {
+  nimunit.test("yield from a loop", fn { |t|
+    t.equals(collect(count(4)), [0, 1, 2, 3])
+  })
+
+  nimunit.test("generators are lazy", fn { |t|
+    var g = count(1000000000)
+    var n = 0
+    for x in g {
+      if x == 3 {
+        break
+      }
+      n = n + 1
+    }
+    t.equals(n, 3)
+  })
+
+  nimunit.test("chained generators", fn { |t|
+    t.equals(collect(squares(count(5))), [0, 1, 4, 9, 16])
+  })
+
+  nimunit.test("yield inside nested for loops", fn { |t|
+    t.equals(collect(pairs([1, 2])), [[1, 1], [1, 2], [2, 1], [2, 2]])
+  })
+
+  nimunit.test("ret ends a generator", fn { |t|
+    t.equals(collect(first_two(range(10))), [0, 1])
+  })
+
+  nimunit.test("exhausted generators stay exhausted", fn { |t|
+    var g = count(2)
+    t.equals(collect(g), [0, 1])
+    t.equals(collect(g), [])
+  })
+
+  nimunit.test("generators can grow the stack under a for loop", fn { |t|
+    t.equals(collect(deep(3)), [0, 500, 1000])
+  })
+
+  nimunit.test("closures can yield", fn { |t|
+    var step = 3
+    var g = fn { |n|
+      var i = 0
+      while i < n {
+        yield i * step
+        i = i + 1
+      }
+    }
+    t.equals(collect(g(3)), [0, 3, 6])
+  })
+}
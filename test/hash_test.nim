@@ -15,5 +15,16 @@ main argv {
     # XXX relying on ordering here is dumb.
     t.equals(h.items(), [["bar", "baz"], ["foo", "bar"]])
   })
+
+  nimunit.test("constant literals are fresh every time", fn { |t|
+    var make = fn {
+      {"foo": 1, "bar": 2}
+    }
+    var h = make()
+    h.put("baz", 3)
+    t.equals(make().size(), 2)
+    t.equals(h.size(), 3)
+    t.equals(make().items(), [["bar", 2], ["foo", 1]])
+  })
 }
 
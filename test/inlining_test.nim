@@ -0,0 +1,98 @@
+use nimunit
+
+square x {
+  x * x
+}
+
+first pair {
+  ret pair[0]
+}
+
+sum3 a, b, c {
+  var total = a + b
+  total + c
+}
+
+swap pair {
+  var a = pair[0]
+  var b = pair[1]
+  a = [b, a]
+  a
+}
+
+fresh x {
+  var seen
+  seen = x
+  ret seen
+}
+
+log_to out, x {
+  out.push(x)
+}
+
+quad x {
+  square(square(x))
+}
+
+fib n {
+  if n < 2 {
+    ret n
+  }
+  ret fib(n - 1) + fib(n - 2)
+}
+
+main argv {
+  nimunit.test("inlined calls return the callee's result", fn { |t|
+    t.equals(16, square(4))
+    t.equals("a", first(["a", "b"]))
+    t.equals(6, sum3(1, 2, 3))
+    t.equals(256, quad(4))
+  })
+
+  nimunit.test("inlined locals don't clash with the caller's", fn { |t|
+    var total = 100
+    var x = 5
+    t.equals(6, sum3(1, 2, 3))
+    t.equals(25, square(x))
+    t.equals(100, total)
+    t.equals(5, x)
+  })
+
+  nimunit.test("inlined calls in a loop", fn { |t|
+    var results = []
+    var i = 0
+    while i < 3 {
+      results.push(fresh(i))
+      results.push(swap([i, "x"]))
+      i = i + 1
+    }
+    t.equals([0, ["x", 0], 1, ["x", 1], 2, ["x", 2]], results)
+  })
+
+  nimunit.test("args are evaluated once, in order", fn { |t|
+    var calls = []
+    var arg = fn { |x|
+      calls.push(x)
+      ret x
+    }
+    t.equals(6, sum3(arg(1), arg(2), arg(3)))
+    t.equals([1, 2, 3], calls)
+    t.equals(9, square(arg(3)))
+    t.equals([1, 2, 3, 3], calls)
+  })
+
+  nimunit.test("calls from closures are inlined", fn { |t|
+    var out = []
+    [1, 2].each(fn { |x| log_to(out, square(x)) })
+    t.equals([1, 4], out)
+  })
+
+  nimunit.test("locals shadow module-level functions", fn { |t|
+    var square = fn { |x| x + 1 }
+    t.equals(3, square(2))
+  })
+
+  nimunit.test("recursive functions are still called", fn { |t|
+    t.equals(55, fib(10))
+  })
+}
@@ -0,0 +1,322 @@
+use nimunit
+
+main argv {
+  nimunit.test("array literal with more than 255 elements", fn { |t|
+    var a = [1000, 1001, 1002, 1003, 1004, 1005, 1006, 1007, 1008, 1009, 1010, 1011, 1012, 1013, 1014, 1015, 1016, 1017, 1018, 1019, 1020, 1021, 1022, 1023, 1024, 1025, 1026, 1027, 1028, 1029, 1030, 1031, 1032, 1033, 1034, 1035, 1036, 1037, 1038, 1039, 1040, 1041, 1042, 1043, 1044, 1045, 1046, 1047, 1048, 1049, 1050, 1051, 1052, 1053, 1054, 1055, 1056, 1057, 1058, 1059, 1060, 1061, 1062, 1063, 1064, 1065, 1066, 1067, 1068, 1069, 1070, 1071, 1072, 1073, 1074, 1075, 1076, 1077, 1078, 1079, 1080, 1081, 1082, 1083, 1084, 1085, 1086, 1087, 1088, 1089, 1090, 1091, 1092, 1093, 1094, 1095, 1096, 1097, 1098, 1099, 1100, 1101, 1102, 1103, 1104, 1105, 1106, 1107, 1108, 1109, 1110, 1111, 1112, 1113, 1114, 1115, 1116, 1117, 1118, 1119, 1120, 1121, 1122, 1123, 1124, 1125, 1126, 1127, 1128, 1129, 1130, 1131, 1132, 1133, 1134, 1135, 1136, 1137, 1138, 1139, 1140, 1141, 1142, 1143, 1144, 1145, 1146, 1147, 1148, 1149, 1150, 1151, 1152, 1153, 1154, 1155, 1156, 1157, 1158, 1159, 1160, 1161, 1162, 1163, 1164, 1165, 1166, 1167, 1168, 1169, 1170, 1171, 1172, 1173, 1174, 1175, 1176, 1177, 1178, 1179, 1180, 1181, 1182, 1183, 1184, 1185, 1186, 1187, 1188, 1189, 1190, 1191, 1192, 1193, 1194, 1195, 1196, 1197, 1198, 1199, 1200, 1201, 1202, 1203, 1204, 1205, 1206, 1207, 1208, 1209, 1210, 1211, 1212, 1213, 1214, 1215, 1216, 1217, 1218, 1219, 1220, 1221, 1222, 1223, 1224, 1225, 1226, 1227, 1228, 1229, 1230, 1231, 1232, 1233, 1234, 1235, 1236, 1237, 1238, 1239, 1240, 1241, 1242, 1243, 1244, 1245, 1246, 1247, 1248, 1249, 1250, 1251, 1252, 1253, 1254, 1255, 1256, 1257, 1258, 1259, 1260, 1261, 1262, 1263, 1264, 1265, 1266, 1267, 1268, 1269, 1270, 1271, 1272, 1273, 1274, 1275, 1276, 1277, 1278, 1279, 1280, 1281, 1282, 1283, 1284, 1285, 1286, 1287, 1288, 1289, 1290, 1291, 1292, 1293, 1294, 1295, 1296, 1297, 1298, 1299]
+    t.equals(300, a.size())
+    t.equals(1000, a[0])
+    t.equals(1299, a[299])
+  })
+
+  nimunit.test("hash literal with more than 255 entries", fn { |t|
+    var h = {"k0": 2000, "k1": 2001, "k2": 2002, "k3": 2003, "k4": 2004, "k5": 2005, "k6": 2006, "k7": 2007, "k8": 2008, "k9": 2009, "k10": 2010, "k11": 2011, "k12": 2012, "k13": 2013, "k14": 2014, "k15": 2015, "k16": 2016, "k17": 2017, "k18": 2018, "k19": 2019, "k20": 2020, "k21": 2021, "k22": 2022, "k23": 2023, "k24": 2024, "k25": 2025, "k26": 2026, "k27": 2027, "k28": 2028, "k29": 2029, "k30": 2030, "k31": 2031, "k32": 2032, "k33": 2033, "k34": 2034, "k35": 2035, "k36": 2036, "k37": 2037, "k38": 2038, "k39": 2039, "k40": 2040, "k41": 2041, "k42": 2042, "k43": 2043, "k44": 2044, "k45": 2045, "k46": 2046, "k47": 2047, "k48": 2048, "k49": 2049, "k50": 2050, "k51": 2051, "k52": 2052, "k53": 2053, "k54": 2054, "k55": 2055, "k56": 2056, "k57": 2057, "k58": 2058, "k59": 2059, "k60": 2060, "k61": 2061, "k62": 2062, "k63": 2063, "k64": 2064, "k65": 2065, "k66": 2066, "k67": 2067, "k68": 2068, "k69": 2069, "k70": 2070, "k71": 2071, "k72": 2072, "k73": 2073, "k74": 2074, "k75": 2075, "k76": 2076, "k77": 2077, "k78": 2078, "k79": 2079, "k80": 2080, "k81": 2081, "k82": 2082, "k83": 2083, "k84": 2084, "k85": 2085, "k86": 2086, "k87": 2087, "k88": 2088, "k89": 2089, "k90": 2090, "k91": 2091, "k92": 2092, "k93": 2093, "k94": 2094, "k95": 2095, "k96": 2096, "k97": 2097, "k98": 2098, "k99": 2099, "k100": 2100, "k101": 2101, "k102": 2102, "k103": 2103, "k104": 2104, "k105": 2105, "k106": 2106, "k107": 2107, "k108": 2108, "k109": 2109, "k110": 2110, "k111": 2111, "k112": 2112, "k113": 2113, "k114": 2114, "k115": 2115, "k116": 2116, "k117": 2117, "k118": 2118, "k119": 2119, "k120": 2120, "k121": 2121, "k122": 2122, "k123": 2123, "k124": 2124, "k125": 2125, "k126": 2126, "k127": 2127, "k128": 2128, "k129": 2129, "k130": 2130, "k131": 2131, "k132": 2132, "k133": 2133, "k134": 2134, "k135": 2135, "k136": 2136, "k137": 2137, "k138": 2138, "k139": 2139, "k140": 2140, "k141": 2141, "k142": 2142, "k143": 2143, "k144": 2144, "k145": 2145, "k146": 2146, "k147": 2147, "k148": 2148, "k149": 2149, "k150": 2150, "k151": 2151, "k152": 2152, "k153": 2153, "k154": 2154, "k155": 2155, "k156": 2156, "k157": 2157, "k158": 2158, "k159": 2159, "k160": 2160, "k161": 2161, "k162": 2162, "k163": 2163, "k164": 2164, "k165": 2165, "k166": 2166, "k167": 2167, "k168": 2168, "k169": 2169, "k170": 2170, "k171": 2171, "k172": 2172, "k173": 2173, "k174": 2174, "k175": 2175, "k176": 2176, "k177": 2177, "k178": 2178, "k179": 2179, "k180": 2180, "k181": 2181, "k182": 2182, "k183": 2183, "k184": 2184, "k185": 2185, "k186": 2186, "k187": 2187, "k188": 2188, "k189": 2189, "k190": 2190, "k191": 2191, "k192": 2192, "k193": 2193, "k194": 2194, "k195": 2195, "k196": 2196, "k197": 2197, "k198": 2198, "k199": 2199, "k200": 2200, "k201": 2201, "k202": 2202, "k203": 2203, "k204": 2204, "k205": 2205, "k206": 2206, "k207": 2207, "k208": 2208, "k209": 2209, "k210": 2210, "k211": 2211, "k212": 2212, "k213": 2213, "k214": 2214, "k215": 2215, "k216": 2216, "k217": 2217, "k218": 2218, "k219": 2219, "k220": 2220, "k221": 2221, "k222": 2222, "k223": 2223, "k224": 2224, "k225": 2225, "k226": 2226, "k227": 2227, "k228": 2228, "k229": 2229, "k230": 2230, "k231": 2231, "k232": 2232, "k233": 2233, "k234": 2234, "k235": 2235, "k236": 2236, "k237": 2237, "k238": 2238, "k239": 2239, "k240": 2240, "k241": 2241, "k242": 2242, "k243": 2243, "k244": 2244, "k245": 2245, "k246": 2246, "k247": 2247, "k248": 2248, "k249": 2249, "k250": 2250, "k251": 2251, "k252": 2252, "k253": 2253, "k254": 2254, "k255": 2255, "k256": 2256, "k257": 2257, "k258": 2258, "k259": 2259, "k260": 2260, "k261": 2261, "k262": 2262, "k263": 2263, "k264": 2264, "k265": 2265, "k266": 2266, "k267": 2267, "k268": 2268, "k269": 2269, "k270": 2270, "k271": 2271, "k272": 2272, "k273": 2273, "k274": 2274, "k275": 2275, "k276": 2276, "k277": 2277, "k278": 2278, "k279": 2279, "k280": 2280, "k281": 2281, "k282": 2282, "k283": 2283, "k284": 2284, "k285": 2285, "k286": 2286, "k287": 2287, "k288": 2288, "k289": 2289, "k290": 2290, "k291": 2291, "k292": 2292, "k293": 2293, "k294": 2294, "k295": 2295, "k296": 2296, "k297": 2297, "k298": 2298, "k299": 2299}
+    t.equals(2000, h["k0"])
+    t.equals(2299, h["k299"])
+  })
+
+  nimunit.test("more than 255 names in one function", fn { |t|
+    var v0 = 0
+    var v1 = 1
+    var v2 = 2
+    var v3 = 3
+    var v4 = 4
+    var v5 = 5
+    var v6 = 6
+    var v7 = 7
+    var v8 = 8
+    var v9 = 9
+    var v10 = 10
+    var v11 = 11
+    var v12 = 12
+    var v13 = 13
+    var v14 = 14
+    var v15 = 15
+    var v16 = 16
+    var v17 = 17
+    var v18 = 18
+    var v19 = 19
+    var v20 = 20
+    var v21 = 21
+    var v22 = 22
+    var v23 = 23
+    var v24 = 24
+    var v25 = 25
+    var v26 = 26
+    var v27 = 27
+    var v28 = 28
+    var v29 = 29
+    var v30 = 30
+    var v31 = 31
+    var v32 = 32
+    var v33 = 33
+    var v34 = 34
+    var v35 = 35
+    var v36 = 36
+    var v37 = 37
+    var v38 = 38
+    var v39 = 39
+    var v40 = 40
+    var v41 = 41
+    var v42 = 42
+    var v43 = 43
+    var v44 = 44
+    var v45 = 45
+    var v46 = 46
+    var v47 = 47
+    var v48 = 48
+    var v49 = 49
+    var v50 = 50
+    var v51 = 51
+    var v52 = 52
+    var v53 = 53
+    var v54 = 54
+    var v55 = 55
+    var v56 = 56
+    var v57 = 57
+    var v58 = 58
+    var v59 = 59
+    var v60 = 60
+    var v61 = 61
+    var v62 = 62
+    var v63 = 63
+    var v64 = 64
+    var v65 = 65
+    var v66 = 66
+    var v67 = 67
+    var v68 = 68
+    var v69 = 69
+    var v70 = 70
+    var v71 = 71
+    var v72 = 72
+    var v73 = 73
+    var v74 = 74
+    var v75 = 75
+    var v76 = 76
+    var v77 = 77
+    var v78 = 78
+    var v79 = 79
+    var v80 = 80
+    var v81 = 81
+    var v82 = 82
+    var v83 = 83
+    var v84 = 84
+    var v85 = 85
+    var v86 = 86
+    var v87 = 87
+    var v88 = 88
+    var v89 = 89
+    var v90 = 90
+    var v91 = 91
+    var v92 = 92
+    var v93 = 93
+    var v94 = 94
+    var v95 = 95
+    var v96 = 96
+    var v97 = 97
+    var v98 = 98
+    var v99 = 99
+    var v100 = 100
+    var v101 = 101
+    var v102 = 102
+    var v103 = 103
+    var v104 = 104
+    var v105 = 105
+    var v106 = 106
+    var v107 = 107
+    var v108 = 108
+    var v109 = 109
+    var v110 = 110
+    var v111 = 111
+    var v112 = 112
+    var v113 = 113
+    var v114 = 114
+    var v115 = 115
+    var v116 = 116
+    var v117 = 117
+    var v118 = 118
+    var v119 = 119
+    var v120 = 120
+    var v121 = 121
+    var v122 = 122
+    var v123 = 123
+    var v124 = 124
+    var v125 = 125
+    var v126 = 126
+    var v127 = 127
+    var v128 = 128
+    var v129 = 129
+    var v130 = 130
+    var v131 = 131
+    var v132 = 132
+    var v133 = 133
+    var v134 = 134
+    var v135 = 135
+    var v136 = 136
+    var v137 = 137
+    var v138 = 138
+    var v139 = 139
+    var v140 = 140
+    var v141 = 141
+    var v142 = 142
+    var v143 = 143
+    var v144 = 144
+    var v145 = 145
+    var v146 = 146
+    var v147 = 147
+    var v148 = 148
+    var v149 = 149
+    var v150 = 150
+    var v151 = 151
+    var v152 = 152
+    var v153 = 153
+    var v154 = 154
+    var v155 = 155
+    var v156 = 156
+    var v157 = 157
+    var v158 = 158
+    var v159 = 159
+    var v160 = 160
+    var v161 = 161
+    var v162 = 162
+    var v163 = 163
+    var v164 = 164
+    var v165 = 165
+    var v166 = 166
+    var v167 = 167
+    var v168 = 168
+    var v169 = 169
+    var v170 = 170
+    var v171 = 171
+    var v172 = 172
+    var v173 = 173
+    var v174 = 174
+    var v175 = 175
+    var v176 = 176
+    var v177 = 177
+    var v178 = 178
+    var v179 = 179
+    var v180 = 180
+    var v181 = 181
+    var v182 = 182
+    var v183 = 183
+    var v184 = 184
+    var v185 = 185
+    var v186 = 186
+    var v187 = 187
+    var v188 = 188
+    var v189 = 189
+    var v190 = 190
+    var v191 = 191
+    var v192 = 192
+    var v193 = 193
+    var v194 = 194
+    var v195 = 195
+    var v196 = 196
+    var v197 = 197
+    var v198 = 198
+    var v199 = 199
+    var v200 = 200
+    var v201 = 201
+    var v202 = 202
+    var v203 = 203
+    var v204 = 204
+    var v205 = 205
+    var v206 = 206
+    var v207 = 207
+    var v208 = 208
+    var v209 = 209
+    var v210 = 210
+    var v211 = 211
+    var v212 = 212
+    var v213 = 213
+    var v214 = 214
+    var v215 = 215
+    var v216 = 216
+    var v217 = 217
+    var v218 = 218
+    var v219 = 219
+    var v220 = 220
+    var v221 = 221
+    var v222 = 222
+    var v223 = 223
+    var v224 = 224
+    var v225 = 225
+    var v226 = 226
+    var v227 = 227
+    var v228 = 228
+    var v229 = 229
+    var v230 = 230
+    var v231 = 231
+    var v232 = 232
+    var v233 = 233
+    var v234 = 234
+    var v235 = 235
+    var v236 = 236
+    var v237 = 237
+    var v238 = 238
+    var v239 = 239
+    var v240 = 240
+    var v241 = 241
+    var v242 = 242
+    var v243 = 243
+    var v244 = 244
+    var v245 = 245
+    var v246 = 246
+    var v247 = 247
+    var v248 = 248
+    var v249 = 249
+    var v250 = 250
+    var v251 = 251
+    var v252 = 252
+    var v253 = 253
+    var v254 = 254
+    var v255 = 255
+    var v256 = 256
+    var v257 = 257
+    var v258 = 258
+    var v259 = 259
+    var v260 = 260
+    var v261 = 261
+    var v262 = 262
+    var v263 = 263
+    var v264 = 264
+    var v265 = 265
+    var v266 = 266
+    var v267 = 267
+    var v268 = 268
+    var v269 = 269
+    var v270 = 270
+    var v271 = 271
+    var v272 = 272
+    var v273 = 273
+    var v274 = 274
+    var v275 = 275
+    var v276 = 276
+    var v277 = 277
+    var v278 = 278
+    var v279 = 279
+    var v280 = 280
+    var v281 = 281
+    var v282 = 282
+    var v283 = 283
+    var v284 = 284
+    var v285 = 285
+    var v286 = 286
+    var v287 = 287
+    var v288 = 288
+    var v289 = 289
+    var v290 = 290
+    var v291 = 291
+    var v292 = 292
+    var v293 = 293
+    var v294 = 294
+    var v295 = 295
+    var v296 = 296
+    var v297 = 297
+    var v298 = 298
+    var v299 = 299
+    t.equals(0, v0)
+    t.equals(299, v299)
+    t.equals(598, v299 + v299)
+  })
+}
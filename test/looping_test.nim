@@ -19,4 +19,66 @@ main argv {
     }
     t.equals(10, i)
   })
+
+  nimunit.test("while with a float counter", fn { |t|
+    var f = 0.0
+    while f < 2.5 {
+      f = f + 1.0
+    }
+    t.equals(3.0, f)
+  })
+
+  nimunit.test("while with a string accumulator", fn { |t|
+    var s = ""
+    while s != "aaa" {
+      s = s + "a"
+    }
+    t.equals("aaa", s)
+  })
+
+  nimunit.test("for over an array", fn { |t|
+    var total = 0
+    for x in [1, 2, 3] {
+      total = total + x
+    }
+    t.equals(6, total)
+  })
+
+  nimunit.test("for over a range", fn { |t|
+    var seen = []
+    for i in range(10, 0, -3) {
+      seen.push(i)
+    }
+    t.equals([10, 7, 4, 1], seen)
+  })
+
+  nimunit.test("for over a hash gives its keys", fn { |t|
+    var h = {"a": 1}
+    var keys = []
+    for k in h {
+      keys.push(k)
+    }
+    t.equals(["a"], keys)
+  })
+
+  nimunit.test("for over a str", fn { |t|
+    var s = ""
+    for c in "abc" {
+      s = c + s
+    }
+    t.equals("cba", s)
+  })
+
+  nimunit.test("break out of nested fors", fn { |t|
+    var n = 0
+    for i in range(3) {
+      for j in range(10) {
+        if j > i {
+          break
+        }
+        n = n + 1
+      }
+    }
+    t.equals(6, n)
+  })
 }
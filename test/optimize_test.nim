@@ -0,0 +1,86 @@
+use nimunit
+
+trailing_dead_branch {
+  5
+  if false {
+    1
+  }
+}
+
+trailing_live_branch {
+  if true {
+    7
+  }
+}
+
+dead_yield {
+  if false {
+    yield 1
+  }
+}
+
+collect g {
+  var result = []
+  for x in g {
+    result.push(x)
+  }
+  ret result
+}
+
+main argv {
+  nimunit.test("constant arithmetic", fn { |t|
+    t.equals(60 * 60 * 24, 86400)
+    t.equals(7 / 2, 3)
+    t.equals(1.5 * 2, 3.0)
+    t.equals(10 - 2 - 3, 5)
+  })
+
+  nimunit.test("constant string concatenation", fn { |t|
+    t.equals("foo" + "bar" + "baz", "foobarbaz")
+  })
+
+  nimunit.test("constant comparisons", fn { |t|
+    t.equals(1 < 2, true)
+    t.equals(2 <= 1, false)
+    t.equals("a" == "a", true)
+    t.equals("a" != "a", false)
+  })
+
+  nimunit.test("constant boolean logic", fn { |t|
+    var x = 3
+    t.equals(true and x, 3)
+    t.equals(false and x, false)
+    t.equals(nil or x, 3)
+    t.equals(0 or x, 0)
+    t.equals(not nil, true)
+    t.equals(not 0, false)
+  })
+
+  nimunit.test("while true runs until break", fn { |t|
+    var n = 0
+    while true {
+      n = n + 1
+      if n == 5 {
+        break
+      }
+    }
+    t.equals(n, 5)
+  })
+
+  nimunit.test("while false never runs", fn { |t|
+    var n = 0
+    while false {
+      n = n + 1
+    }
+    t.equals(n, 0)
+  })
+
+  nimunit.test("pruned branches don't change return values", fn { |t|
+    t.equals(trailing_dead_branch(), nil)
+    t.equals(trailing_live_branch(), nil)
+  })
+
+  nimunit.test("a yield in a dead branch is still a generator", fn { |t|
+    t.equals(collect(dead_yield()), [])
+  })
+}
@@ -140,5 +140,63 @@ main argv {
     }
     t.equals(y, 2)
   })
+
+  nimunit.test("match dispatches on message tags", fn { |t|
+    var dispatch = fn { |msg|
+      var result = nil
+      match msg {
+        ["put", k, v] { result = ["put", k, v] }
+        ["get", k] { result = ["get", k] }
+        ["del", "all"] { result = "del all" }
+        ["del", k] { result = ["del", k] }
+        ["ping"] { result = "pong" }
+        other { result = "unknown" }
+      }
+      result
+    }
+    t.equals(dispatch(["get", 1]), ["get", 1])
+    t.equals(dispatch(["put", 1, 2]), ["put", 1, 2])
+    t.equals(dispatch(["del", "all"]), "del all")
+    t.equals(dispatch(["del", 3]), ["del", 3])
+    t.equals(dispatch(["ping"]), "pong")
+    t.equals(dispatch(["get"]), "unknown")
+    t.equals(dispatch(["nope", 1]), "unknown")
+    t.equals(dispatch([1, 2]), "unknown")
+    t.equals(dispatch("get"), "unknown")
+    t.equals(dispatch([]), "unknown")
+  })
+
+  nimunit.test("match dispatches on literals", fn { |t|
+    var dispatch = fn { |x|
+      var result = 0
+      match x {
+        "c" { result = 3 }
+        "a" { result = 1 }
+        "b" { result = 2 }
+        "a" { result = 4 }
+        5 { result = 5 }
+        6 { result = 6 }
+        _ { result = -1 }
+      }
+      result
+    }
+    t.equals(dispatch("a"), 1)
+    t.equals(dispatch("b"), 2)
+    t.equals(dispatch("c"), 3)
+    t.equals(dispatch(5), 5)
+    t.equals(dispatch(6), 6)
+    t.equals(dispatch("d"), -1)
+    t.equals(dispatch(5.0), -1)
+    t.equals(dispatch(nil), -1)
+  })
+
+  nimunit.test("match dispatches ranges on int tags", fn { |t|
+    var result = 0
+    match range(1, 3) {
+      [0, x] { result = 1 }
+      [1, x] { result = x }
+    }
+    t.equals(result, 2)
+  })
 }
 
@@ -1,5 +1,10 @@
 use nimunit
 
+echo_task {
+  var origin = recv()
+  origin.send(recv())
+}
+
 main argv {
   nimunit.test("range single arg", fn { |t|
     t.equals(range(5), [0, 1, 2, 3, 4])
@@ -30,4 +35,69 @@ main argv {
     t.equals(range(5, 0, -1), [5, 4, 3, 2, 1])
     t.equals(range(4, -4, -2), [4, 2, 0, -2])
   })
+
+  nimunit.test("range size", fn { |t|
+    t.equals(range(10000000).size(), 10000000)
+    t.equals(range(0, 10, 3).size(), 4)
+    t.equals(range(5, 0).size(), 0)
+  })
+
+  nimunit.test("range contains", fn { |t|
+    t.equals(range(0, 10, 3).contains(9), true)
+    t.equals(range(0, 10, 3).contains(10), false)
+    t.equals(range(0, 10, 3).contains(4), false)
+    t.equals(range(4, -4, -2).contains(-2), true)
+    t.equals(range(4, -4, -2).contains(-4), false)
+    t.equals(range(5).contains("1"), false)
+  })
+
+  nimunit.test("range getitem", fn { |t|
+    var r = range(10, 20, 2)
+    t.equals(r[0], 10)
+    t.equals(r[4], 18)
+    t.equals(r[-1], 18)
+    t.equals(r[5], nil)
+  })
+
+  nimunit.test("range map and filter", fn { |t|
+    t.equals(range(4).map(fn { |x| ret x * x }), [0, 1, 4, 9])
+    t.equals(range(10).filter(fn { |x| ret x > 6 }), [7, 8, 9])
+  })
+
+  nimunit.test("range to_array", fn { |t|
+    var r = range(3)
+    var a = r.to_array()
+    a.push(3)
+    t.equals(a, [0, 1, 2, 3])
+    t.equals(r, [0, 1, 2])
+  })
+
+  nimunit.test("range read-only array methods", fn { |t|
+    t.equals(range(3).join(","), "0,1,2")
+    t.equals(range(3).any(fn { |x| ret x == 2 }), true)
+  })
+
+  nimunit.test("range added to arrays", fn { |t|
+    t.equals([9] + range(2), [9, 0, 1])
+    t.equals(range(2) + [9], [0, 1, 9])
+    t.equals(range(2) + range(1), [0, 1, 0])
+  })
+
+  nimunit.test("range matches array patterns", fn { |t|
+    var matched = nil
+    match range(1, 4) {
+      [a, b] { matched = "two" }
+      [1, b, c] { matched = b + c }
+    }
+    t.equals(matched, 5)
+  })
+
+  nimunit.test("range messages", fn { |t|
+    var task = spawn echo_task()
+    task.send(self())
+    task.send(range(0, 6, 2))
+    var r = recv()
+    t.equals(r.size(), 3)
+    t.equals(r, [0, 2, 4])
+  })
 }
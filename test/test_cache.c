@@ -0,0 +1,113 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#define TEST_CACHE_SOURCE "/tmp/nim_test_cache.nim"
+#define TEST_CACHE_FILE   "/tmp/nim_test_cache.nimc"
+
+void
+test_cache_setup (void)
+{
+    fail_unless (nim_core_startup (NULL, stack_base), "core_startup failed");
+}
+
+void
+test_cache_teardown (void)
+{
+    remove (TEST_CACHE_SOURCE);
+    remove (TEST_CACHE_FILE);
+    nim_core_shutdown ();
+}
+
+static void
+test_cache_write_source (const char *source)
+{
+    FILE *output = fopen (TEST_CACHE_SOURCE, "w");
+    fail_unless (output != NULL, "could not write " TEST_CACHE_SOURCE);
+    fputs (source, output);
+    fclose (output);
+}
+
+START_TEST(cache_round_trips_a_module)
+{
+    NimRef *name = NIM_STR_NEW ("nim_test_cache");
+    NimRef *module;
+    NimRef *result;
+
+    test_cache_write_source (
+        "answer x {\n"
+        "  ret [x, 2.5, {\"k\": nil}]\n"
+        "}\n");
+
+    fail_unless (nim_cache_load (name, TEST_CACHE_SOURCE) == NULL,
+                    "expected no cache file yet");
+    fail_unless (nim_cache_compile_file (name, TEST_CACHE_SOURCE) != NULL,
+                    "compile failed");
+
+    module = nim_cache_load (name, TEST_CACHE_SOURCE);
+    fail_unless (module != NULL, "expected the module to be cached");
+    fail_unless (NIM_MODULE_NAME(module) == name, "expected the module name");
+
+    result = nim_object_call (
+        nim_object_getattr_str (module, "answer"),
+        nim_array_new_var (nim_int_new (40), NULL));
+    fail_unless (result != NULL, "call failed");
+    fail_unless (NIM_ARRAY_SIZE(result) == 3, "expected 3 items");
+    fail_unless (NIM_INT_VALUE(NIM_ARRAY_ITEM(result, 0)) == 40,
+                    "expected the argument back");
+    fail_unless (NIM_FLOAT_VALUE(NIM_ARRAY_ITEM(result, 1)) == 2.5,
+                    "expected the float constant");
+    fail_unless (NIM_HASH_SIZE(NIM_ARRAY_ITEM(result, 2)) == 1,
+                    "expected the hash constant");
+}
+END_TEST
+
+START_TEST(cache_rejects_a_changed_source)
+{
+    NimRef *name = NIM_STR_NEW ("nim_test_cache");
+
+    test_cache_write_source ("main argv {\n  ret 1\n}\n");
+    fail_unless (nim_cache_compile_file (name, TEST_CACHE_SOURCE) != NULL,
+                    "compile failed");
+    fail_unless (nim_cache_load (name, TEST_CACHE_SOURCE) != NULL,
+                    "expected the module to be cached");
+
+    /* same size, so only the hash gives it away within the same second */
+    test_cache_write_source ("main argv {\n  ret 2\n}\n");
+    fail_unless (nim_cache_load (name, TEST_CACHE_SOURCE) == NULL,
+                    "expected the cache file to be stale");
+}
+END_TEST
+
+
+START_TEST(cache_rejects_changed_builtins)
+{
+    NimRef *name = NIM_STR_NEW ("nim_test_cache");
+
+    test_cache_write_source ("main argv {\n  ret str\n}\n");
+    fail_unless (nim_cache_compile_file (name, TEST_CACHE_SOURCE) != NULL,
+                    "compile failed");
+    fail_unless (nim_cache_load (name, TEST_CACHE_SOURCE) != NULL,
+                    "expected the module to be cached");
+
+    /* the cached bytecode refers to builtins by index */
+    fail_unless (nim_hash_put (nim_builtins, NIM_STR_NEW ("extra"), nim_nil),
+                    "could not add a builtin");
+    fail_unless (nim_cache_load (name, TEST_CACHE_SOURCE) == NULL,
+                    "expected the cache file to be stale");
+}
+END_TEST
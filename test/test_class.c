@@ -93,3 +93,39 @@ START_TEST(nil_value_should_have_nil_class)
 }
 END_TEST
 
+
+START_TEST(lookup_method_should_walk_the_super_class_chain)
+{
+    NimRef *name = NIM_STR_NEW ("testing");
+    NimRef *method = nim_method_new_native (NULL, NULL);
+    NimRef *base = nim_class_new (NIM_STR_NEW ("base"), NULL, 128);
+    NimRef *klass = nim_class_new (NIM_STR_NEW ("derived"), base, 128);
+
+    fail_unless (nim_class_lookup_method (klass, name) == NULL,
+                "expected lookup of a missing method to fail");
+    fail_unless (nim_class_add_method (base, name, method),
+                "failed to add method to base class");
+    fail_unless (nim_class_lookup_method (klass, name) == method,
+                "expected lookup to find the method on the super class");
+}
+END_TEST
+
+START_TEST(adding_a_method_should_invalidate_attr_caches)
+{
+    NimRef *name = NIM_STR_NEW ("testing");
+    NimRef *method = nim_method_new_native (NULL, NULL);
+    NimRef *klass = nim_class_new (NIM_STR_NEW ("cached"), NULL, 128);
+    NimRef *code = nim_code_new ();
+
+    fail_unless (nim_code_getattr (code, name), "failed to emit GETATTR");
+    nim_code_attr_cache_put (code, 0, klass, method);
+    fail_unless (nim_code_attr_cache_get (code, 0, klass) == method,
+                "expected inline cache hit");
+    fail_unless (nim_code_attr_cache_get (code, 0, nim_object_class) == NULL,
+                "expected inline cache miss for a different class");
+    fail_unless (nim_class_add_method (klass, name, method),
+                "failed to add method");
+    fail_unless (nim_code_attr_cache_get (code, 0, klass) == NULL,
+                "expected inline cache to be invalidated");
+}
+END_TEST
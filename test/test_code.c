@@ -0,0 +1,246 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+void
+test_code_setup (void)
+{
+    fail_unless (nim_core_startup (NULL, stack_base), "core_startup failed");
+}
+
+void
+test_code_teardown (void)
+{
+    nim_core_shutdown ();
+}
+
+START_TEST(code_verify_accepts_balanced_code)
+{
+    NimRef *code = nim_code_new ();
+    NimLabel end = NIM_LABEL_INIT;
+
+    /* if true { 1 + 2 }; ret nil, popping the sum inside the branch */
+    nim_code_pushconst (code, nim_true);
+    nim_code_jumpiffalse (code, &end);
+    nim_code_pushconst (code, nim_int_new (1));
+    nim_code_pushconst (code, nim_int_new (2));
+    nim_code_add (code);
+    nim_code_pop (code);
+    nim_code_use_label (code, &end);
+    nim_code_pushnil (code);
+    nim_code_ret (code);
+    nim_label_free (&end);
+
+    fail_unless (nim_code_verify (code), "expected code to verify");
+    fail_unless (NIM_CODE(code)->max_stack == 2, "expected max_stack of 2");
+}
+END_TEST
+
+START_TEST(code_verify_counts_args_on_entry)
+{
+    NimRef *code = nim_code_new ();
+
+    nim_code_pop (code);
+    fail_if (nim_code_verify (code), "expected stack underflow");
+
+    NIM_CODE(code)->nargs = 1;
+    fail_unless (nim_code_verify (code), "expected the arg to be popped");
+}
+END_TEST
+
+START_TEST(code_verify_rejects_unbalanced_branches)
+{
+    NimRef *code = nim_code_new ();
+    NimLabel end = NIM_LABEL_INIT;
+
+    nim_code_pushconst (code, nim_true);
+    nim_code_jumpiffalse (code, &end);
+    nim_code_pushnil (code);
+    nim_code_use_label (code, &end);
+    nim_code_ret (code);
+    nim_label_free (&end);
+
+    fail_if (nim_code_verify (code), "expected mismatched stack depths");
+}
+END_TEST
+
+START_TEST(code_verify_rejects_bad_operands)
+{
+    NimRef *code = nim_code_new ();
+
+    nim_code_pushlocal (code, 0);
+    fail_if (nim_code_verify (code), "expected an unknown local");
+
+    nim_array_push (NIM_CODE(code)->vars, NIM_STR_NEW ("x"));
+    fail_unless (nim_code_verify (code), "expected a known local");
+}
+END_TEST
+
+START_TEST(code_verify_accepts_for_loops)
+{
+    NimRef *code = nim_code_new ();
+    NimLabel start = NIM_LABEL_INIT;
+    NimLabel end = NIM_LABEL_INIT;
+
+    /* for x in [] { x } */
+    nim_code_makearray (code, 0);
+    nim_code_getiter (code);
+    nim_code_use_label (code, &start);
+    nim_code_foriter (code, &end);
+    nim_code_pop (code);
+    nim_code_jump (code, &start);
+    nim_code_use_label (code, &end);
+    nim_code_pop (code);
+    nim_code_pushnil (code);
+    nim_code_ret (code);
+    nim_label_free (&start);
+    nim_label_free (&end);
+
+    fail_unless (nim_code_verify (code), "expected code to verify");
+    fail_unless (NIM_CODE(code)->max_stack == 2, "expected max_stack of 2");
+}
+END_TEST
+
+START_TEST(code_yield_makes_a_generator)
+{
+    NimRef *code = nim_code_new ();
+
+    fail_if (NIM_CODE(code)->generator, "expected a plain function");
+
+    /* yield 1 */
+    nim_code_pushconst (code, nim_int_new (1));
+    nim_code_yield (code);
+    nim_code_pushnil (code);
+    nim_code_ret (code);
+
+    fail_unless (NIM_CODE(code)->generator, "expected a generator");
+    fail_unless (nim_code_verify (code), "expected code to verify");
+    fail_unless (NIM_CODE(code)->max_stack == 1, "expected max_stack of 1");
+}
+END_TEST
+
+START_TEST(code_cloneconst_pushes_one_value)
+{
+    NimRef *code = nim_code_new ();
+    NimRef *template =
+        nim_array_new_var (nim_int_new (1), nim_int_new (2), NULL);
+
+    nim_code_cloneconst (code, template);
+    nim_code_ret (code);
+
+    fail_unless (nim_code_verify (code), "expected code to verify");
+    fail_unless (NIM_CODE(code)->max_stack == 1, "expected max_stack of 1");
+    fail_unless (NIM_ARRAY_SIZE(NIM_CODE(code)->constants) == 1,
+                    "expected the template in the constant pool");
+}
+END_TEST
+
+START_TEST(code_pushconst_dedupes_large_pools)
+{
+    NimRef *code = nim_code_new ();
+    size_t i;
+
+    /* enough to outgrow a linear search */
+    for (i = 0; i < 200; i++) {
+        nim_code_pushconst (code, nim_int_new (i % 100));
+        nim_code_pushconst (code, nim_float_new (i % 100));
+        nim_code_pushname (code, nim_str_new ("x", 1));
+        nim_code_pushname (code, NIM_STR_INTERN("y"));
+    }
+    nim_code_pushconst (code, nim_float_new (-0.0));
+
+    fail_unless (NIM_ARRAY_SIZE(NIM_CODE(code)->constants) == 200,
+                    "expected each constant once");
+    fail_unless (NIM_ARRAY_SIZE(NIM_CODE(code)->names) == 2,
+                    "expected each name once");
+
+    nim_code_finish (code);
+    nim_code_pushconst (code, nim_int_new (42));
+    fail_unless (NIM_ARRAY_SIZE(NIM_CODE(code)->constants) == 200,
+                    "expected a rebuilt index to find 42");
+}
+END_TEST
+
+START_TEST(code_peephole_simplifies_branches)
+{
+    NimRef *code = nim_code_new ();
+    NimLabel end = NIM_LABEL_INIT;
+    NimLabel next = NIM_LABEL_INIT;
+
+    /* if not true { dup; pop }, with a jump to a jump & dead code */
+    nim_code_pushconst (code, nim_true);
+    nim_code_not (code);
+    nim_code_jumpiffalse (code, &next);
+    nim_code_dup (code);
+    nim_code_pop (code);
+    nim_code_use_label (code, &next);
+    nim_code_jump (code, &end);
+    nim_code_pushnil (code);
+    nim_code_pop (code);
+    nim_code_use_label (code, &end);
+    nim_code_pushnil (code);
+    nim_code_ret (code);
+    nim_label_free (&next);
+    nim_label_free (&end);
+
+    fail_unless (nim_code_peephole (code, NIM_FALSE), "peephole failed");
+    fail_unless (NIM_CODE_SIZE(code) == 4, "expected 4 instructions");
+    fail_unless (NIM_INSTR_OP(code, 1) == NIM_OPCODE_JUMPIFTRUE,
+                    "expected NOT; JUMPIFFALSE to become JUMPIFTRUE");
+    fail_unless (NIM_INSTR_ADDR(code, 1) == 2,
+                    "expected the jump to go straight to the end");
+    fail_unless (nim_code_verify (code), "expected code to verify");
+}
+END_TEST
+
+
+START_TEST(code_getattr_caches_every_site)
+{
+    NimRef *code = nim_code_new ();
+    NimRef *target = NIM_STR_INTERN("target");
+    size_t i;
+    size_t pc;
+    size_t sites = 0;
+    char name[32];
+
+    /* more sites & names than fit in 8 bits */
+    nim_code_pushnil (code);
+    for (i = 0; i < 300; i++) {
+        snprintf (name, sizeof(name), "attr%zu", i);
+        nim_code_getattr (code, nim_str_new (name, strlen (name)));
+    }
+    nim_code_ret (code);
+
+    fail_unless (NIM_CODE(code)->attr_caches_used == 300,
+                    "expected a cache per site");
+    for (pc = 0; pc < NIM_CODE_SIZE(code); pc++) {
+        if (NIM_INSTR_OP(code, pc) == NIM_OPCODE_GETATTR) {
+            fail_unless (NIM_INSTR_ATTRCACHE(code, pc) == sites,
+                            "expected site %zu to have its own cache", sites);
+            fail_unless (NIM_INSTR_EXTARG1(code, pc) == sites,
+                            "expected site %zu to keep its name", sites);
+            sites++;
+        }
+    }
+    fail_unless (sites == 300, "expected 300 sites");
+    fail_unless (nim_code_verify (code), "expected code to verify");
+
+    nim_code_attr_cache_put (code, 299, target, nim_true);
+    fail_unless (nim_code_attr_cache_get (code, 299, target) == nim_true,
+                    "expected the last site to be cached");
+}
+END_TEST
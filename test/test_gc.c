@@ -0,0 +1,82 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+void
+test_gc_setup (void)
+{
+    fail_unless (nim_core_startup (NULL, stack_base), "core_startup failed");
+}
+
+void
+test_gc_teardown (void)
+{
+    nim_core_shutdown ();
+}
+
+START_TEST(gc_arena_objects_are_roots)
+{
+    NimAstNodeLocation location;
+    NimArena *arena = nim_gc_arena_new (NULL);
+    NimArena *prev;
+    NimRef *expr;
+
+    memset (&location, 0, sizeof(location));
+
+    prev = nim_gc_arena_enter (NULL, arena);
+    expr = nim_ast_expr_new_str (NIM_STR_NEW ("kept"), &location);
+    nim_gc_arena_enter (NULL, prev);
+
+    fail_unless (nim_gc_arena_find (NULL, expr) == arena,
+                    "expected the node in the arena");
+    fail_unless (nim_gc_arena_find (NULL, NIM_AST_EXPR(expr)->str.value) == NULL,
+                    "expected the str in the heap");
+
+    nim_gc_collect (NULL);
+    fail_unless (strcmp (NIM_STR_DATA(NIM_AST_EXPR(expr)->str.value), "kept") == 0,
+                    "expected the arena to keep the str alive");
+
+    nim_gc_arena_delete (NULL, arena);
+    fail_unless (nim_gc_arena_find (NULL, expr) == NULL,
+                    "expected the arena to be gone");
+}
+END_TEST
+
+
+START_TEST(gc_range_iteration_shares_small_ints)
+{
+    NimRef *range = nim_range_new (0, 1000, 1);
+    NimRef *value;
+    size_t pos = 0;
+    uint64_t live = nim_gc_num_live (NULL);
+
+    for (;;) {
+        fail_unless (NIM_CLASS(nim_range_class)->iter_next (range, &pos, &value),
+                        "iter_next failed");
+        if (value == NULL) {
+            break;
+        }
+        fail_unless (NIM_INT(value)->value == (int64_t) pos - 1,
+                        "expected item %zu", pos - 1);
+    }
+    fail_unless (pos == 1000, "expected 1000 items");
+    fail_unless (nim_gc_num_live (NULL) == live,
+                    "expected no allocations per item");
+    fail_unless (nim_int_new (1000) == nim_int_new (1000),
+                    "expected small ints to be shared");
+}
+END_TEST
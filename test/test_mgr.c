@@ -0,0 +1,104 @@
+/*****************************************************************************
+ *                                                                           *
+ * Copyright 2012 Thomas Lee                                                 *
+ *                                                                           *
+ * Licensed under the Apache License, Version 2.0 (the "License");           *
+ * you may not use this file except in compliance with the License.          *
+ * You may obtain a copy of the License at                                   *
+ *                                                                           *
+ *     http://www.apache.org/licenses/LICENSE-2.0                            *
+ *                                                                           *
+ * Unless required by applicable law or agreed to in writing, software       *
+ * distributed under the License is distributed on an "AS IS" BASIS,         *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  *
+ * See the License for the specific language governing permissions and       *
+ * limitations under the License.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+static const char *test_mgr_files[] = {
+    "/tmp/nim_test_mgr_base",
+    "/tmp/nim_test_mgr_left",
+    "/tmp/nim_test_mgr_right",
+    "/tmp/nim_test_mgr_main",
+    NULL
+};
+
+void
+test_mgr_setup (void)
+{
+    fail_unless (nim_core_startup ("/tmp", stack_base), "core_startup failed");
+}
+
+void
+test_mgr_teardown (void)
+{
+    char path[FILENAME_MAX];
+    size_t i;
+
+    for (i = 0; test_mgr_files[i] != NULL; i++) {
+        snprintf (path, sizeof(path), "%s.nim", test_mgr_files[i]);
+        remove (path);
+        snprintf (path, sizeof(path), "%s.nimc", test_mgr_files[i]);
+        remove (path);
+    }
+    nim_core_shutdown ();
+}
+
+static void
+test_mgr_write_source (const char *name, const char *source)
+{
+    char path[FILENAME_MAX];
+    FILE *output;
+
+    snprintf (path, sizeof(path), "/tmp/%s.nim", name);
+    output = fopen (path, "w");
+    fail_unless (output != NULL, "could not write %s", path);
+    fputs (source, output);
+    fclose (output);
+}
+
+START_TEST(mgr_compiles_a_dependency_graph)
+{
+    NimRef *module;
+    NimRef *result;
+
+    /* main uses left & right, both of which use base */
+    test_mgr_write_source ("nim_test_mgr_base", "base {\n  ret 10\n}\n");
+    test_mgr_write_source ("nim_test_mgr_left",
+        "use nim_test_mgr_base\n"
+        "left {\n  ret nim_test_mgr_base.base() + 1\n}\n");
+    test_mgr_write_source ("nim_test_mgr_right",
+        "use nim_test_mgr_base\n"
+        "right {\n  ret nim_test_mgr_base.base() + 2\n}\n");
+    test_mgr_write_source ("nim_test_mgr_main",
+        "use nim_test_mgr_left\n"
+        "use nim_test_mgr_right\n"
+        "answer {\n"
+        "  ret nim_test_mgr_left.left() + nim_test_mgr_right.right()\n"
+        "}\n");
+
+    module = nim_module_mgr_compile (
+        NIM_STR_NEW ("nim_test_mgr_main"),
+        NIM_STR_NEW ("/tmp/nim_test_mgr_main.nim"));
+    fail_unless (module != NULL, "compile failed");
+
+    result = nim_object_call (
+        nim_object_getattr_str (module, "answer"), nim_array_new ());
+    fail_unless (result != NULL, "call failed");
+    fail_unless (NIM_INT_VALUE(result) == 23, "expected 23");
+}
+END_TEST
+
+START_TEST(mgr_rejects_circular_uses)
+{
+    test_mgr_write_source ("nim_test_mgr_left",
+        "use nim_test_mgr_right\nleft {\n}\n");
+    test_mgr_write_source ("nim_test_mgr_right",
+        "use nim_test_mgr_left\nright {\n}\n");
+
+    fail_unless (nim_module_mgr_load (NIM_STR_NEW ("nim_test_mgr_left")) == NULL,
+                    "expected a circular use to fail");
+}
+END_TEST
+
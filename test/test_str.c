@@ -52,3 +52,46 @@ START_TEST(str_constructor_with_int_arg_returns_int_value)
 }
 END_TEST
 
+START_TEST(str_typed_method_zeroes_omitted_optional_args)
+{
+    NimRef *s = NIM_STR_NEW ("bert banana");
+    NimRef *substr = nim_object_getattr_str (s, "substr");
+    NimRef *result;
+
+    fail_unless (NIM_METHOD_IS_TYPED(substr), "expected a typed method");
+
+    result = nim_object_call (substr, nim_array_new_var (nim_int_new (5), NULL));
+    fail_unless (strcmp ("banana", NIM_STR_DATA(result)) == 0,
+                "expected the rest of the string");
+
+    result = nim_object_call (substr,
+                nim_array_new_var (nim_int_new (0), nim_int_new (4), NULL));
+    fail_unless (strcmp ("bert", NIM_STR_DATA(result)) == 0,
+                "expected the first word");
+}
+END_TEST
+
+START_TEST(str_intern_returns_one_object_per_value)
+{
+    NimRef *a = NIM_STR_INTERN ("banana");
+    NimRef *b = nim_str_intern_ref (NIM_STR_NEW ("banana"));
+    NimRef *c = NIM_STR_INTERN ("bananas");
+
+    fail_unless (a == b, "expected the same interned str");
+    fail_unless (a != c, "expected a different interned str");
+    fail_unless (NIM_STR_IS_INTERNED(a), "expected an interned str");
+    fail_if (NIM_STR_IS_INTERNED(NIM_STR_NEW ("banana")),
+                "expected a plain str");
+    fail_unless (nim_str_hash (a) == nim_str_hash (NIM_STR_NEW ("banana")),
+                "expected plain & interned strs to hash alike");
+    fail_unless (nim_object_cmp_eq (a, c) != NIM_CMP_EQ,
+                "expected distinct interned strs to differ");
+    fail_unless (nim_object_cmp_eq (a, NIM_STR_NEW ("banana")) == NIM_CMP_EQ,
+                "expected an interned str to equal a plain one");
+
+    nim_gc_collect (NULL);
+    fail_unless (strcmp (NIM_STR_DATA(a), "banana") == 0,
+                "expected interned strs to outlive a collection");
+}
+END_TEST
+
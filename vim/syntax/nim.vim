@@ -8,7 +8,7 @@ if exists("b:current_syntax")
     finish
 endif
 
-syn keyword nimKeyword nil use ret var and or fn spawn while not _
+syn keyword nimKeyword nil use ret var and or fn spawn while for in yield not _
 syn keyword nimKeyword match class this break
 syn keyword nimBoolean true false
 syn keyword nimConditional if else